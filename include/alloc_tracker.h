@@ -0,0 +1,320 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Counts every C++ heap allocation by replacing the global operator new / delete.
+// Exactly one translation unit has to define the replacements:
+//
+//   #define ALLOC_TRACKER_IMPLEMENTATION
+//   #include "alloc_tracker.h"
+//
+// The frame loop should not allocate once it has warmed up. FrameAllocations measures a frame, on every thread that
+// works on frames (record workers, the simulation, the export writer), and ForbidAllocations aborts right at the
+// offending allocation, so a debugger shows who made it. Threads that serve requests at their own pace rather than
+// frames call outsideFrames(). Allocations made by C libraries (the GL driver, GLFW) go through malloc and are not
+// seen here.
+namespace Learus_Alloc
+{
+    struct Counters
+    {
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+
+        // Only the threads that work on frames
+        std::atomic<uint64_t> frameAllocations;
+        std::atomic<uint64_t> frameBytes;
+    };
+
+    // Every thread together. Zero initialized before any constructor runs, so safe to use from operator new.
+    inline Counters & global()
+    {
+        static Counters counters;
+        return counters;
+    }
+
+    // The calling thread only
+    struct ThreadCounters
+    {
+        uint64_t allocations;
+        uint64_t bytes;
+        bool forbidden;
+        bool outsideFrames;
+    };
+
+    inline ThreadCounters & thread()
+    {
+        static thread_local ThreadCounters counters = { 0, 0, false, false };
+        return counters;
+    }
+
+    // The calling thread's allocations are left out of FrameAllocations from now on
+    inline void outsideFrames()
+    {
+        thread().outsideFrames = true;
+    }
+
+    inline void recordAllocation(size_t size)
+    {
+        Counters & counters = global();
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+
+        ThreadCounters & local = thread();
+        local.allocations++;
+        local.bytes += size;
+
+        if (!local.outsideFrames)
+        {
+            counters.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+            counters.frameBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        if (local.forbidden)
+        {
+            // No iostreams here, they could allocate again
+            std::fprintf(stderr, "ERROR: Heap allocation of %lu bytes inside a no-allocation scope\n", (unsigned long)size);
+            std::abort();
+        }
+    }
+
+    inline void recordFree()
+    {
+        global().frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Allocations made between begin() and end() by any thread that works on frames
+    class FrameAllocations
+    {
+        public:
+            uint64_t allocations;
+            uint64_t bytes;
+
+            FrameAllocations() : allocations(0), bytes(0), startAllocations(0), startBytes(0) {}
+
+            void begin()
+            {
+                startAllocations = global().frameAllocations.load(std::memory_order_relaxed);
+                startBytes = global().frameBytes.load(std::memory_order_relaxed);
+            }
+
+            // Returns the number of allocations since begin()
+            uint64_t end()
+            {
+                allocations = global().frameAllocations.load(std::memory_order_relaxed) - startAllocations;
+                bytes = global().frameBytes.load(std::memory_order_relaxed) - startBytes;
+                return allocations;
+            }
+
+        private:
+            uint64_t startAllocations;
+            uint64_t startBytes;
+    };
+
+    // Per frame allocation counts over a whole run. Frames before the loop is expected to be steady are not checked.
+    class SteadyStateCheck
+    {
+        public:
+            unsigned long frames;
+            unsigned long allocatingFrames;
+            uint64_t allocations;
+            uint64_t bytes;
+            long firstAllocatingFrame;
+
+            SteadyStateCheck() : frames(0), allocatingFrames(0), allocations(0), bytes(0), firstAllocatingFrame(-1) {}
+
+            void beginFrame()
+            {
+                current.begin();
+            }
+
+            void endFrame(bool steady)
+            {
+                current.end();
+                if (!steady)
+                    return;
+
+                if (current.allocations > 0)
+                {
+                    if (firstAllocatingFrame < 0)
+                        firstAllocatingFrame = frames;
+
+                    allocatingFrames++;
+                    allocations += current.allocations;
+                    bytes += current.bytes;
+                }
+
+                frames++;
+            }
+
+            bool clean() const
+            {
+                return allocatingFrames == 0;
+            }
+
+            void print() const
+            {
+                if (frames == 0)
+                    return;
+
+                if (clean())
+                {
+                    std::cout << "Heap: no allocations in " << frames << " steady state frames" << std::endl;
+                    return;
+                }
+
+                std::cout << "Heap: " << allocatingFrames << " of " << frames << " steady state frames allocated, "
+                          << allocations << " allocations (" << bytes << " bytes), first at steady frame " << firstAllocatingFrame << std::endl;
+            }
+
+        private:
+            FrameAllocations current;
+    };
+
+    // Any allocation on this thread while one of these is alive aborts the program
+    class ForbidAllocations
+    {
+        public:
+            ForbidAllocations() : previous(thread().forbidden)
+            {
+                thread().forbidden = true;
+            }
+
+            ~ForbidAllocations()
+            {
+                thread().forbidden = previous;
+            }
+
+        private:
+            bool previous;
+
+            ForbidAllocations(const ForbidAllocations &);
+            ForbidAllocations & operator=(const ForbidAllocations &);
+    };
+}
+
+#endif
+
+// Outside the include guard, so that the one translation unit can define the replacements even when a header it
+// included earlier brought this file in already
+#if defined(ALLOC_TRACKER_IMPLEMENTATION) && !defined(ALLOC_TRACKER_IMPLEMENTED)
+#define ALLOC_TRACKER_IMPLEMENTED
+
+void * operator new(size_t size)
+{
+    Learus_Alloc::recordAllocation(size);
+
+    void * memory = std::malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void * operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    Learus_Alloc::recordAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    Learus_Alloc::recordAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void * memory) noexcept
+{
+    if (!memory)
+        return;
+
+    Learus_Alloc::recordFree();
+    std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void * memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+// Types aligned past what malloc guarantees, C++17 and later
+#ifdef __cpp_aligned_new
+
+void * operator new(size_t size, std::align_val_t alignment)
+{
+    Learus_Alloc::recordAllocation(size);
+
+    void * memory = NULL;
+    size_t align = (size_t)alignment < sizeof(void *) ? sizeof(void *) : (size_t)alignment;
+    if (posix_memalign(&memory, align, size ? size : 1) != 0)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void * operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return operator new(size, alignment);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return NULL;
+    }
+}
+
+void * operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void * memory, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void * memory, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void * memory, size_t, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void * memory, size_t, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "../lib/glad/glad.h"
+
+#include "gpu_profiler.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Learus_Benchmark
+{
+    // Frame times in fixed 10 microsecond buckets up to 250 ms. Percentiles come out of the buckets,
+    // so memory does not grow with the length of the run and two runs are binned identically.
+    class Histogram
+    {
+        public:
+            static const unsigned int BUCKETS = 25000;
+            static constexpr double BUCKET_MS = 0.01;
+
+            Histogram() : buckets(BUCKETS, 0), count(0), total(0.0), maximum(0.0) {}
+
+            void add(double ms)
+            {
+                unsigned int bucket = ms <= 0.0 ? 0 : (unsigned int)(ms / BUCKET_MS);
+                buckets[std::min(bucket, BUCKETS - 1)]++;
+
+                count++;
+                total += ms;
+                maximum = std::max(maximum, ms);
+            }
+
+            // Upper edge of the bucket holding the p-th percentile (0 - 100)
+            double percentile(double p) const
+            {
+                if (count == 0)
+                    return 0.0;
+
+                uint64_t rank = (uint64_t)(p / 100.0 * count + 0.5);
+                rank = std::max<uint64_t>(rank, 1);
+
+                uint64_t seen = 0;
+                for (unsigned int i = 0; i < BUCKETS; i++)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank)
+                        return std::min((i + 1) * BUCKET_MS, maximum);
+                }
+
+                return maximum;
+            }
+
+            double mean() const { return count ? total / count : 0.0; }
+            double max() const { return maximum; }
+            uint64_t samples() const { return count; }
+
+            void writeJSON(std::ostream & out) const
+            {
+                out << "{ \"mean\": " << mean()
+                    << ", \"p50\": " << percentile(50.0)
+                    << ", \"p95\": " << percentile(95.0)
+                    << ", \"p99\": " << percentile(99.0)
+                    << ", \"max\": " << max()
+                    << ", \"samples\": " << samples() << " }";
+            }
+
+        private:
+            std::vector<uint64_t> buckets;
+            uint64_t count;
+            double total;
+            double maximum;
+    };
+
+    // Per frame CPU, GPU and wall clock times for one benchmark run, plus whatever per frame counts the caller adds up.
+    // The GPU times are the profiler's "Frame" scope in the frames it counted.
+    class Recorder : public Learus_Profiler::FrameListener
+    {
+        public:
+            Histogram cpu;      // Time to build and submit the frame
+            Histogram gpu;      // GPU time of the frame's commands
+            Histogram frame;    // Start of one frame to the start of the next, including present
+
+            unsigned long frames;
+            unsigned long drawCalls;
+            unsigned long meshes;
+            unsigned long triangles;
+            unsigned long stateChanges;
+
+            // A quality level change, with the frame times it reacted to
+            struct LevelChange
+            {
+                unsigned long frame;
+                const char * level;
+                double frameMs;         // The frame before the change, start to start
+                double costMs;          // What the governor based the change on
+            };
+
+            std::vector<LevelChange> levelChanges;
+
+            explicit Recorder(Learus_Profiler::GpuProfiler & _profiler)
+            : frames(0), drawCalls(0), meshes(0), triangles(0), stateChanges(0), profiler(_profiler), lastFrameMs(0.0), started(false)
+            {
+                // Kept from allocating during the run, later changes are only counted
+                levelChanges.reserve(MAX_LEVEL_CHANGES);
+
+                profiler.enable();
+                profiler.listen(this);
+            }
+
+            ~Recorder()
+            {
+                profiler.unlisten(this);
+            }
+
+            void levelChanged(const char * level, double costMs)
+            {
+                if (levelChanges.size() == MAX_LEVEL_CHANGES)
+                    return;
+
+                LevelChange change = { frames, level, lastFrameMs, costMs };
+                levelChanges.push_back(change);
+            }
+
+            void beginFrame()
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (started)
+                {
+                    lastFrameMs = milliseconds(frameStart, now);
+                    frame.add(lastFrameMs);
+                }
+
+                frameStart = now;
+                started = true;
+            }
+
+            // Call right after the frame's commands are submitted, before presenting
+            void endSubmit()
+            {
+                cpu.add(milliseconds(frameStart, std::chrono::steady_clock::now()));
+                frames++;
+            }
+
+            void gpuFrame(const Learus_Profiler::GpuProfiler & source)
+            {
+                double ms;
+                if (source.lastCounted && source.lastTime("Frame", ms))
+                    gpu.add(ms);
+            }
+
+            bool writeJSON(const std::string & path, const std::string & pathName, const std::string & renderer, int width, int height, float step,
+                           const std::vector<Learus_Profiler::PassTime> & passes) const
+            {
+                std::ofstream out(path.c_str());
+                if (!out)
+                {
+                    std::cerr << "ERROR: Could not write benchmark results: " << path << std::endl;
+                    return false;
+                }
+
+                double perFrame = frames ? 1.0 / frames : 0.0;
+
+                out << std::fixed << std::setprecision(4);
+                out << "{\n"
+                    << "  \"path\": \"" << escape(pathName) << "\",\n"
+                    << "  \"renderer\": \"" << escape(renderer) << "\",\n"
+                    << "  \"width\": " << width << ",\n"
+                    << "  \"height\": " << height << ",\n"
+                    << "  \"step\": " << step << ",\n"
+                    << "  \"frames\": " << frames << ",\n"
+                    << "  \"cpu_ms\": "; cpu.writeJSON(out); out << ",\n";
+                out << "  \"gpu_ms\": "; gpu.writeJSON(out); out << ",\n";
+                out << "  \"frame_ms\": "; frame.writeJSON(out); out << ",\n";
+                out << "  \"draw_calls_per_frame\": " << drawCalls * perFrame << ",\n"
+                    << "  \"meshes_per_frame\": " << meshes * perFrame << ",\n"
+                    << "  \"triangles_per_frame\": " << triangles * perFrame << ",\n"
+                    << "  \"state_changes_per_frame\": " << stateChanges * perFrame << ",\n"
+                    << "  \"gpu_pass_ms\": {";
+
+                for (unsigned int i = 0; i < passes.size(); i++)
+                    out << (i ? ", " : " ") << "\"" << escape(passes[i].name) << "\": " << passes[i].meanMs();
+
+                out << " },\n"
+                    << "  \"quality_changes\": [";
+
+                for (unsigned int i = 0; i < levelChanges.size(); i++)
+                    out << (i ? ", " : " ") << "{ \"frame\": " << levelChanges[i].frame << ", \"level\": \"" << levelChanges[i].level
+                        << "\", \"frame_ms\": " << levelChanges[i].frameMs << ", \"cost_ms\": " << levelChanges[i].costMs << " }";
+
+                out << (levelChanges.empty() ? "]\n" : " ]\n")
+                    << "}\n";
+
+                return true;
+            }
+
+            void print() const
+            {
+                std::cout << std::fixed << std::setprecision(3)
+                          << "Benchmark: " << frames << " frames" << std::endl
+                          << "  cpu   p50 " << cpu.percentile(50) << " ms, p95 " << cpu.percentile(95) << " ms, p99 " << cpu.percentile(99) << " ms, max " << cpu.max() << " ms" << std::endl
+                          << "  gpu   p50 " << gpu.percentile(50) << " ms, p95 " << gpu.percentile(95) << " ms, p99 " << gpu.percentile(99) << " ms, max " << gpu.max() << " ms" << std::endl
+                          << "  frame p50 " << frame.percentile(50) << " ms, p95 " << frame.percentile(95) << " ms, p99 " << frame.percentile(99) << " ms, max " << frame.max() << " ms" << std::endl;
+
+                for (unsigned int i = 0; i < levelChanges.size(); i++)
+                    std::cout << "  quality " << levelChanges[i].level << " at frame " << levelChanges[i].frame << ", after a " << levelChanges[i].frameMs
+                              << " ms frame (" << levelChanges[i].costMs << " ms smoothed cost)" << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
+            }
+
+        private:
+            static const unsigned int MAX_LEVEL_CHANGES = 256;
+
+            Learus_Profiler::GpuProfiler & profiler;
+            double lastFrameMs;
+            std::chrono::steady_clock::time_point frameStart;
+            bool started;
+
+            static double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+            {
+                return std::chrono::duration<double, std::milli>(to - from).count();
+            }
+
+            static std::string escape(const std::string & text)
+            {
+                std::string result;
+                for (unsigned int i = 0; i < text.size(); i++)
+                {
+                    if (text[i] == '"' || text[i] == '\\')
+                        result += '\\';
+                    if ((unsigned char)text[i] >= 0x20)
+                        result += text[i];
+                }
+                return result;
+            }
+
+            Recorder(const Recorder &);
+            Recorder & operator=(const Recorder &);
+    };
+}
+
+#endif
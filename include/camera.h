@@ -169,6 +169,18 @@ class Camera
             Position -= Front * radius;
         }
 
+        // Places the camera at position, facing target. Used for scripted camera paths.
+        void LookAt(glm::vec3 position, glm::vec3 target)
+        {
+            Position = position;
+
+            glm::vec3 direction = glm::normalize(target - position);
+            Pitch = glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+            Yaw = glm::degrees(atan2(direction.z, direction.x));
+
+            updateCameraVectors();
+        }
+
         // Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
         void Zoom(float yoffset)
         {
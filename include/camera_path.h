@@ -0,0 +1,174 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include "../lib/glm/glm.hpp"
+
+#include "camera.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A scripted camera flight plus simulation timeline, for benchmarks that have to replay exactly the same frames.
+//
+// Path files are plain text, one keyframe per line, '#' starts a comment:
+//   time  posX posY posZ  targetX targetY targetZ  zoom  simTime
+// Keyframes are interpolated with a Catmull-Rom spline. Optional settings:
+//   step 0.0166667     fixed time step per frame (seconds)
+//   warmup 30          frames rendered before recording starts
+namespace Learus_Benchmark
+{
+    struct Keyframe
+    {
+        float time;
+        glm::vec3 position;
+        glm::vec3 target;
+        float zoom;
+        float simTime;
+    };
+
+    template <typename T>
+    inline T catmullRom(const T & p0, const T & p1, const T & p2, const T & p3, float t)
+    {
+        float t2 = t * t;
+        float t3 = t2 * t;
+
+        return 0.5f * ((2.0f * p1) +
+                       (p2 - p0) * t +
+                       (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                       (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    class CameraPath
+    {
+        public:
+            std::string name;
+            float step;
+            unsigned int warmup;
+
+            CameraPath() : step(1.0f / 60.0f), warmup(30) {}
+
+            bool load(const std::string & path)
+            {
+                std::ifstream file(path.c_str());
+                if (!file)
+                {
+                    std::cerr << "ERROR: Could not open camera path: " << path << std::endl;
+                    return false;
+                }
+
+                name = path;
+                keys.clear();
+
+                std::string line;
+                unsigned int number = 0;
+                while (std::getline(file, line))
+                {
+                    number++;
+
+                    size_t comment = line.find('#');
+                    if (comment != std::string::npos)
+                        line.erase(comment);
+
+                    std::istringstream in(line);
+                    std::string first;
+                    if (!(in >> first))
+                        continue;
+
+                    if (first == "step")
+                    {
+                        in >> step;
+                    }
+                    else if (first == "warmup")
+                    {
+                        in >> warmup;
+                    }
+                    else
+                    {
+                        Keyframe key;
+                        std::istringstream time(first);
+                        time >> key.time;
+
+                        in >> key.position.x >> key.position.y >> key.position.z
+                           >> key.target.x >> key.target.y >> key.target.z
+                           >> key.zoom >> key.simTime;
+
+                        if (time.fail() || in.fail())
+                        {
+                            std::cerr << "ERROR: Malformed keyframe in " << path << ":" << number << std::endl;
+                            return false;
+                        }
+
+                        if (!keys.empty() && key.time <= keys.back().time)
+                        {
+                            std::cerr << "ERROR: Keyframe times must increase in " << path << ":" << number << std::endl;
+                            return false;
+                        }
+
+                        keys.push_back(key);
+                    }
+                }
+
+                if (keys.size() < 2 || step <= 0.0f)
+                {
+                    std::cerr << "ERROR: A camera path needs at least two keyframes and a positive step: " << path << std::endl;
+                    return false;
+                }
+
+                return true;
+            }
+
+            float duration() const
+            {
+                return keys.empty() ? 0.0f : keys.back().time - keys.front().time;
+            }
+
+            // Frames recorded when the path is played at its fixed step
+            unsigned int frameCount() const
+            {
+                return (unsigned int)(duration() / step) + 1;
+            }
+
+            // Puts the camera where the path is at time t and returns the simulation time for it
+            float apply(float t, Camera & camera) const
+            {
+                Keyframe key = sample(t);
+
+                camera.LookAt(key.position, key.target);
+                camera.zoom = key.zoom;
+
+                return key.simTime;
+            }
+
+            Keyframe sample(float t) const
+            {
+                t += keys.front().time;
+
+                unsigned int i = 0;
+                while (i + 2 < keys.size() && keys[i + 1].time <= t)
+                    i++;
+
+                const Keyframe & k1 = keys[i];
+                const Keyframe & k2 = keys[i + 1];
+                const Keyframe & k0 = keys[i > 0 ? i - 1 : i];
+                const Keyframe & k3 = keys[i + 2 < keys.size() ? i + 2 : i + 1];
+
+                float u = glm::clamp((t - k1.time) / (k2.time - k1.time), 0.0f, 1.0f);
+
+                Keyframe key;
+                key.time = t;
+                key.position = catmullRom(k0.position, k1.position, k2.position, k3.position, u);
+                key.target = catmullRom(k0.target, k1.target, k2.target, k3.target, u);
+                key.zoom = catmullRom(k0.zoom, k1.zoom, k2.zoom, k3.zoom, u);
+                key.simTime = catmullRom(k0.simTime, k1.simTime, k2.simTime, k3.simTime, u);
+                return key;
+            }
+
+        private:
+            std::vector<Keyframe> keys;
+    };
+}
+
+#endif
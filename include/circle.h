@@ -1,11 +1,18 @@
+#ifndef CIRCLE_H
+#define CIRCLE_H
+
 #include "../lib/glad/glad.h"
 #include "../lib/glm/glm.hpp"
 #include "../lib/glm/gtc/matrix_transform.hpp"
 #include <math.h>
+#include <algorithm>
 #include <vector>
 #include <string>
 
 #include "shader.h"
+#include "shader_manager.h"
+#include "render_queue.h"
+#include "resource_registry.h"
 
 #ifndef M_PI
     #define M_PI 3.14159
@@ -14,13 +21,19 @@
 
 namespace Learus_Circle
 {
+    // Tessellations kept per circle, each with half the vertices of the one before
+    const unsigned int DETAIL_LEVELS = 4;
+
     const char * vertex_shader =    "#version 330 core\n"
                                     "layout (location = 0) in vec3 aPos;\n"
                                     "layout (location = 1) in vec3 aColor;\n"
                                     "out vec3 Color;\n"
+                                    "layout (std140) uniform Camera {\n"
+                                    "    mat4 projection;\n"
+                                    "    mat4 view;\n"
+                                    "    vec3 viewPos;\n"
+                                    "};\n"
                                     "uniform mat4 model;\n"
-                                    "uniform mat4 view;\n"
-                                    "uniform mat4 projection;\n"
                                     "void main()\n"
                                     "{\n"
                                     "    Color = aColor;\n"
@@ -35,7 +48,7 @@ namespace Learus_Circle
                                     "    FragColor = vec4(Color, 1.0);\n"
                                     "}\0";
 
-    class Circle
+    class Circle : public Learus_Render::Renderable
     {
         public:
 
@@ -45,36 +58,55 @@ namespace Learus_Circle
                 glm::vec3 Color;
             };
 
+            // Only kept until the upload. vertexCount is the full tessellation, which starts the buffer.
             std::vector<Circle::Vertex> vertices;
+            unsigned int vertexCount;
 
             glm::vec3 Center;
             float Radius;
 
             glm::vec3 Color;
 
-            Shader shader;
+            // Shared by every circle
+            Shader * shader;
             unsigned int VAO;
             
 
-            Circle(glm::vec3 _center, float _radius, glm::vec3 _color, unsigned int _num_vertices)
-            : Center(_center), Radius(_radius), Color(_color), shader(vertex_shader, fragment_shader, true)
+            Circle(glm::vec3 _center, float _radius, glm::vec3 _color, unsigned int _num_vertices, Learus_Shaders::ShaderManager & shaders)
+            : Center(_center), Radius(_radius), Color(_color), shader(shaders.fromSource(vertex_shader, fragment_shader)), modelProgram(0),
+              drawFirst(0), drawCount(0)
             {
+
                 glGenVertexArrays(1, &VAO);
                 glGenBuffers(1, &VBO);
 
-                glBindVertexArray(VAO);
+                Learus_GLState::current().bindVertexArray(VAO);
                 glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-                // Create vertices of a 2d circle line
-                for (float angle = 0.0f; angle <= 2.0f * M_PI; angle += 2.0f * M_PI / _num_vertices)
+                // Create vertices of a 2d circle line, the coarser versions after the full one
+                for (unsigned int level = 0; level < DETAIL_LEVELS; level++)
                 {
-                    Vertex v;
-                    v.Position = glm::vec3(Radius * cos(angle) + Center.x, Radius * sin(angle) + Center.y, 0);
-                    v.Color = Color;
-                    vertices.push_back(v);
+                    unsigned int count = std::max(_num_vertices >> level, 8u);
+                    firsts[level] = vertices.size();
+
+                    for (float angle = 0.0f; angle <= 2.0f * M_PI; angle += 2.0f * M_PI / count)
+                    {
+                        Vertex v;
+                        v.Position = glm::vec3(Radius * cos(angle) + Center.x, Radius * sin(angle) + Center.y, 0);
+                        v.Color = Color;
+                        vertices.push_back(v);
+                    }
+
+                    counts[level] = vertices.size() - firsts[level];
                 }
 
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                size_t cpuBytes = vertices.capacity() * sizeof(Vertex);
+                resources.trackCpu(Learus_Resources::SUB_ORBITS, cpuBytes);
+
                 glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+                vertexCount = counts[0];
+                drawCount = counts[0];
 
                 // Position
                 glEnableVertexAttribArray(0);
@@ -84,19 +116,37 @@ namespace Learus_Circle
                 glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(offsetof(Vertex, Color)));
                 glEnableVertexAttribArray(1);
 
-                glBindVertexArray(0);
+                Learus_GLState::current().bindVertexArray(0);
+
+                resources.track(Learus_Resources::KIND_VERTEX_ARRAY, VAO, Learus_Resources::SUB_ORBITS, 0, "orbit");
+                resources.track(Learus_Resources::KIND_BUFFER, VBO, Learus_Resources::SUB_ORBITS, vertices.size() * sizeof(Vertex), "orbit vertices");
+
+                resources.releaseCpu(Learus_Resources::SUB_ORBITS, cpuBytes);
+                std::vector<Circle::Vertex>().swap(vertices);
+            }
+
+            ~Circle()
+            {
+                Learus_Resources::registry().release(Learus_Resources::KIND_VERTEX_ARRAY, VAO);
+                Learus_Resources::registry().release(Learus_Resources::KIND_BUFFER, VBO);
+
+                Learus_GLState::current().forgetVertexArray(VAO);
+                glDeleteVertexArrays(1, &VAO);
+                glDeleteBuffers(1, &VBO);
             }
 
-            void Draw()
+            void Record(const Learus_Render::DrawItem & item, Learus_Commands::CommandList & commands)
             {
-                shader.use();
-                shader.setMat4("projection", projection);
-                shader.setMat4("view", view);
-                shader.setMat4("model", model);
-
-                glBindVertexArray(VAO);
-                glDrawArrays(GL_LINE_LOOP, 0, vertices.size());
-                glBindVertexArray(0);
+                if (modelProgram != shader->ID)
+                {
+                    modelLocation = shader->location("model");
+                    modelProgram = shader->ID;
+                }
+
+                commands.useProgram(shader);
+                commands.uniform(modelLocation, model);
+                commands.bindVertexArray(VAO);
+                commands.drawArrays(GL_LINE_LOOP, drawFirst, drawCount);
             }
 
             void translate(glm::vec3 newPos)
@@ -114,18 +164,48 @@ namespace Learus_Circle
                 model = glm::scale(model, newScale);
             }
 
-            void setUniforms(glm::mat4 _projection = glm::mat4(1.0f), glm::mat4 _view = glm::mat4(1.0f), glm::mat4 _model = glm::mat4(1.0f))
+            const glm::mat4 & modelMatrix() const
+            {
+                return model;
+            }
+
+            // Holds vertexCount Circle::Vertex
+            unsigned int vertexBuffer() const
+            {
+                return VBO;
+            }
+
+            // Draws the coarsest tessellation that still has at least count vertices
+            void setVertexCount(unsigned int count)
+            {
+                unsigned int level = 0;
+                while (level + 1 < DETAIL_LEVELS && counts[level + 1] >= count)
+                    level++;
+
+                drawFirst = firsts[level];
+                drawCount = counts[level];
+            }
+
+            // Projection and view come from the shared Camera block, only the model matrix is per circle
+            void setUniforms(glm::mat4 _model = glm::mat4(1.0f))
             {
-                projection = _projection;
-                view = _view;
                 model = _model;
             }
 
         private:
             unsigned int VBO;
+            GLint modelLocation;
+            unsigned int modelProgram;
 
-            glm::mat4 projection;
-            glm::mat4 view;
             glm::mat4 model;
+
+            unsigned int firsts[DETAIL_LEVELS];
+            unsigned int counts[DETAIL_LEVELS];
+            unsigned int drawFirst, drawCount;
+
+            Circle(const Circle &);
+            Circle & operator=(const Circle &);
     };
 }
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+
+#include "shader.h"
+#include "geometry_arena.h"
+#include "gl_state.h"
+
+#include <cstring>
+#include <vector>
+
+// Draws recorded as plain data, so that preparing them (picking programs, looking up uniforms, computing matrices)
+// can happen on any thread. Recording never calls GL. Only replay() does, on the context thread, through the state
+// cache so redundant binds are still skipped.
+namespace Learus_Commands
+{
+    enum Type
+    {
+        CMD_USE_PROGRAM,
+        CMD_UNIFORM_MAT4,
+        CMD_UNIFORM_MAT3,
+        CMD_UNIFORM_FLOAT,
+        CMD_UNIFORM_INT,
+        CMD_BIND_TEXTURE,
+        CMD_BIND_VERTEX_ARRAY,
+        CMD_BIND_GEOMETRY,
+        CMD_DEPTH_MASK,
+        CMD_DRAW_ARRAYS,
+        CMD_DRAW_MESH,      // Batched into the arena's next multi-draw
+        CMD_SUBMIT_DRAWS    // Issues the batch
+    };
+
+    struct Command
+    {
+        Type type;
+        GLint location;         // Uniform location, or texture unit
+        GLenum target;          // Texture target, or primitive mode
+        GLuint object;          // Texture / vertex array name, first vertex, or depth mask on / off
+        GLuint count;
+        void * pointer;         // Shader or GeometryArena
+        Learus_Geometry::Allocation allocation;
+        float values[16];
+    };
+
+    // One thread's commands for a frame. Keeps its storage between frames, so steady state recording does not allocate.
+    class CommandList
+    {
+        public:
+            void clear()
+            {
+                commands.clear();
+            }
+
+            unsigned int size() const
+            {
+                return commands.size();
+            }
+
+            void reserve(unsigned int count)
+            {
+                commands.reserve(count);
+            }
+
+            const Command * data() const
+            {
+                return commands.empty() ? NULL : &commands[0];
+            }
+
+            void useProgram(Shader * shader)
+            {
+                Command & command = add(CMD_USE_PROGRAM);
+                command.pointer = shader;
+            }
+
+            void uniform(GLint location, const glm::mat4 & value)
+            {
+                Command & command = add(CMD_UNIFORM_MAT4);
+                command.location = location;
+                std::memcpy(command.values, &value[0][0], 16 * sizeof(float));
+            }
+
+            void uniform(GLint location, const glm::mat3 & value)
+            {
+                Command & command = add(CMD_UNIFORM_MAT3);
+                command.location = location;
+                std::memcpy(command.values, &value[0][0], 9 * sizeof(float));
+            }
+
+            void uniform(GLint location, float value)
+            {
+                Command & command = add(CMD_UNIFORM_FLOAT);
+                command.location = location;
+                command.values[0] = value;
+            }
+
+            void uniform(GLint location, int value)
+            {
+                Command & command = add(CMD_UNIFORM_INT);
+                command.location = location;
+                command.object = value;
+            }
+
+            void bindTexture(unsigned int unit, GLenum target, GLuint texture)
+            {
+                Command & command = add(CMD_BIND_TEXTURE);
+                command.location = unit;
+                command.target = target;
+                command.object = texture;
+            }
+
+            void bindVertexArray(GLuint vertexArray)
+            {
+                Command & command = add(CMD_BIND_VERTEX_ARRAY);
+                command.object = vertexArray;
+            }
+
+            void bindGeometry(Learus_Geometry::GeometryArena * arena)
+            {
+                Command & command = add(CMD_BIND_GEOMETRY);
+                command.pointer = arena;
+            }
+
+            void depthMask(bool enabled)
+            {
+                Command & command = add(CMD_DEPTH_MASK);
+                command.object = enabled;
+            }
+
+            void drawArrays(GLenum mode, GLuint first, GLuint count)
+            {
+                Command & command = add(CMD_DRAW_ARRAYS);
+                command.target = mode;
+                command.object = first;
+                command.count = count;
+            }
+
+            void drawMesh(Learus_Geometry::GeometryArena * arena, const Learus_Geometry::Allocation & allocation)
+            {
+                Command & command = add(CMD_DRAW_MESH);
+                command.pointer = arena;
+                command.allocation = allocation;
+            }
+
+            void submitDraws(Learus_Geometry::GeometryArena * arena)
+            {
+                Command & command = add(CMD_SUBMIT_DRAWS);
+                command.pointer = arena;
+            }
+
+        private:
+            std::vector<Command> commands;
+
+            Command & add(Type type)
+            {
+                commands.resize(commands.size() + 1);
+
+                Command & command = commands.back();
+                command.type = type;
+                return command;
+            }
+    };
+
+    // The GL backend. Runs count commands on the current context.
+    inline void replay(const Command * commands, unsigned int count)
+    {
+        Learus_GLState::StateCache & state = Learus_GLState::current();
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const Command & command = commands[i];
+
+            switch (command.type)
+            {
+                case CMD_USE_PROGRAM:
+                    ((Shader *)command.pointer)->use();
+                    break;
+
+                case CMD_UNIFORM_MAT4:
+                    glUniformMatrix4fv(command.location, 1, GL_FALSE, command.values);
+                    break;
+
+                case CMD_UNIFORM_MAT3:
+                    glUniformMatrix3fv(command.location, 1, GL_FALSE, command.values);
+                    break;
+
+                case CMD_UNIFORM_FLOAT:
+                    glUniform1f(command.location, command.values[0]);
+                    break;
+
+                case CMD_UNIFORM_INT:
+                    glUniform1i(command.location, (GLint)command.object);
+                    break;
+
+                case CMD_BIND_TEXTURE:
+                    state.bindTexture(command.location, command.target, command.object);
+                    break;
+
+                case CMD_BIND_VERTEX_ARRAY:
+                    state.bindVertexArray(command.object);
+                    break;
+
+                case CMD_BIND_GEOMETRY:
+                    ((Learus_Geometry::GeometryArena *)command.pointer)->bind();
+                    break;
+
+                case CMD_DEPTH_MASK:
+                    state.setDepthMask(command.object != 0);
+                    break;
+
+                case CMD_DRAW_ARRAYS:
+                    glDrawArrays(command.target, command.object, command.count);
+                    break;
+
+                case CMD_DRAW_MESH:
+                    ((Learus_Geometry::GeometryArena *)command.pointer)->draws.add(command.allocation);
+                    break;
+
+                case CMD_SUBMIT_DRAWS:
+                    ((Learus_Geometry::GeometryArena *)command.pointer)->draws.submit();
+                    break;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,836 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "../lib/glm/glm.hpp"
+
+#include "alloc_tracker.h"
+#include "camera_path.h"
+#include "image_writer.h"
+#include "profiler.h"
+#include "simulation.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A command channel on a Unix domain socket, so that scripts can drive a running window instead of someone at the
+// keyboard. One JSON object per line goes in, one per line comes back:
+//
+//   {"id":1,"cmd":"time","value":12.5}                           simulation time, in seconds
+//   {"id":2,"cmd":"warp","value":4}                              simulation seconds per real second
+//   {"id":3,"cmd":"camera","position":[0,10,30],"target":[0,0,0],"zoom":30}
+//   {"id":4,"cmd":"animate"}                                     toggles, "on":true / false sets it
+//   {"id":5,"cmd":"load","path":"benchmarks/flyby.path"}         plays a camera path, answered when it ends
+//   {"id":6,"cmd":"capture","path":"shot.png"}                   writes the next frame, answered once it is on disk
+//   {"id":7,"cmd":"stats"}
+//   {"id":8,"cmd":"quit"}
+//
+// A server thread reads and parses the lines and queues the commands; the render loop takes them at the start of a
+// frame, so none of them lands in the middle of one. Answers go back through a second queue and can come frames
+// later, each with the id its command was sent with: {"id":5,"ok":true,...} or {"id":5,"ok":false,"error":"..."}.
+namespace Learus_Control
+{
+    enum CommandType
+    {
+        COMMAND_TIME,
+        COMMAND_WARP,
+        COMMAND_CAMERA,
+        COMMAND_ANIMATE,
+        COMMAND_LOAD,
+        COMMAND_CAPTURE,
+        COMMAND_STATS,
+        COMMAND_QUIT
+    };
+
+    const unsigned int MAX_ID = 64;         // The id as it was sent, a JSON number or string
+    const unsigned int MAX_PATH = 256;
+    const unsigned int MAX_REPLY = 1024;
+    const unsigned int MAX_LINE = 4096;
+    const unsigned int MAX_CLIENTS = 8;
+
+    struct Command
+    {
+        CommandType type;
+        unsigned long client;       // The connection it came from
+        char id[MAX_ID];            // null when it had none
+        float value;
+        glm::vec3 position;
+        glm::vec3 target;
+        float zoom;                 // 0 keeps the current one
+        int on;                     // -1 toggles
+        char path[MAX_PATH];
+        Learus_Benchmark::CameraPath * cameraPath;      // For load, read by the server thread. Whoever takes the command owns it.
+    };
+
+    struct Reply
+    {
+        unsigned long client;
+        char text[MAX_REPLY];       // Without the newline
+
+        // For a capture the server thread writes the pixels (rows bottom up, as glReadPixels gives them) to path first
+        std::vector<unsigned char> * pixels;
+        int width, height;
+        char id[MAX_ID];
+        char path[MAX_PATH];
+    };
+
+    // Just enough JSON for one flat object per line: strings, numbers, booleans and arrays of three numbers
+    class Parser
+    {
+        public:
+            explicit Parser(const char * text) : error(NULL), p(text) {}
+
+            const char * error;
+
+            // False with error set if the line is not a command it knows
+            bool parse(Command & command)
+            {
+                char name[16] = "";
+                bool hasValue = false, hasPosition = false;
+
+                command.value = 0.0f;
+                command.position = command.target = glm::vec3(0.0f);
+                command.zoom = 0.0f;
+                command.on = -1;
+                command.path[0] = '\0';
+                command.cameraPath = NULL;
+                std::strcpy(command.id, "null");
+
+                space();
+                if (*p++ != '{')
+                    return fail("expected a JSON object");
+                space();
+
+                while (*p != '}')
+                {
+                    char key[16];
+                    if (!string(key, sizeof(key)))
+                        return fail("expected a field name");
+                    space();
+                    if (*p++ != ':')
+                        return fail("expected ':' after a field name");
+                    space();
+
+                    if (std::strcmp(key, "cmd") == 0)
+                    {
+                        if (!string(name, sizeof(name)))
+                            return fail("cmd must be a string");
+                    }
+                    else if (std::strcmp(key, "id") == 0)
+                    {
+                        if (!raw(command.id, sizeof(command.id)))
+                            return fail("id must be a number or a short string");
+                    }
+                    else if (std::strcmp(key, "value") == 0)
+                    {
+                        if (!number(command.value))
+                            return fail("value must be a number");
+                        hasValue = true;
+                    }
+                    else if (std::strcmp(key, "position") == 0)
+                    {
+                        if (!vector(command.position))
+                            return fail("position must be an array of three numbers");
+                        hasPosition = true;
+                    }
+                    else if (std::strcmp(key, "target") == 0)
+                    {
+                        if (!vector(command.target))
+                            return fail("target must be an array of three numbers");
+                    }
+                    else if (std::strcmp(key, "zoom") == 0)
+                    {
+                        if (!number(command.zoom) || command.zoom < 1.0f || command.zoom > 45.0f)
+                            return fail("zoom must be a field of view between 1 and 45 degrees");
+                    }
+                    else if (std::strcmp(key, "on") == 0)
+                    {
+                        if (!boolean(command.on))
+                            return fail("on must be true or false");
+                    }
+                    else if (std::strcmp(key, "path") == 0)
+                    {
+                        if (!string(command.path, sizeof(command.path)) || command.path[0] == '\0')
+                            return fail("path must be a string of at most 255 characters");
+                    }
+                    else
+                    {
+                        return fail("unknown field");
+                    }
+
+                    space();
+                    if (*p == ',')
+                    {
+                        p++;
+                        space();
+                    }
+                    else if (*p != '}')
+                    {
+                        return fail("expected ',' or '}'");
+                    }
+                }
+
+                p++;
+                space();
+                if (*p != '\0')
+                    return fail("one object per line");
+
+                if (std::strcmp(name, "time") == 0 || std::strcmp(name, "warp") == 0)
+                {
+                    command.type = name[0] == 't' ? COMMAND_TIME : COMMAND_WARP;
+                    if (!hasValue)
+                        return fail("needs a value");
+                }
+                else if (std::strcmp(name, "camera") == 0)
+                {
+                    command.type = COMMAND_CAMERA;
+                    if (!hasPosition)
+                        return fail("needs a position");
+                    if (command.position == command.target)
+                        return fail("position and target are the same point");
+                }
+                else if (std::strcmp(name, "animate") == 0)
+                {
+                    command.type = COMMAND_ANIMATE;
+                }
+                else if (std::strcmp(name, "load") == 0 || std::strcmp(name, "capture") == 0)
+                {
+                    command.type = name[0] == 'l' ? COMMAND_LOAD : COMMAND_CAPTURE;
+                    if (command.path[0] == '\0')
+                        return fail("needs a path");
+                }
+                else if (std::strcmp(name, "stats") == 0)
+                {
+                    command.type = COMMAND_STATS;
+                }
+                else if (std::strcmp(name, "quit") == 0)
+                {
+                    command.type = COMMAND_QUIT;
+                }
+                else
+                {
+                    return fail(name[0] ? "unknown cmd" : "needs a cmd");
+                }
+
+                return true;
+            }
+
+        private:
+            const char * p;
+
+            bool fail(const char * message)
+            {
+                error = message;
+                return false;
+            }
+
+            void space()
+            {
+                while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+                    p++;
+            }
+
+            // Into out, which holds size - 1 characters. \u escapes are not needed for anything here.
+            bool string(char * out, size_t size)
+            {
+                if (*p != '"')
+                    return false;
+                p++;
+
+                size_t length = 0;
+                while (*p != '"')
+                {
+                    char c = *p++;
+                    if (c == '\0' || (unsigned char)c < 0x20)
+                        return false;
+
+                    if (c == '\\')
+                    {
+                        c = *p++;
+                        if (c == 'n')
+                            c = '\n';
+                        else if (c == 't')
+                            c = '\t';
+                        else if (c != '"' && c != '\\' && c != '/')
+                            return false;
+                    }
+
+                    if (length + 1 >= size)
+                        return false;
+                    out[length++] = c;
+                }
+
+                p++;
+                out[length] = '\0';
+                return true;
+            }
+
+            bool number(float & out)
+            {
+                if (*p != '-' && (*p < '0' || *p > '9'))
+                    return false;
+
+                char * end;
+                double value = std::strtod(p, &end);
+                if (end == p || !std::isfinite(value))
+                    return false;
+
+                p = end;
+                out = (float)value;
+                return true;
+            }
+
+            bool boolean(int & out)
+            {
+                if (std::strncmp(p, "true", 4) == 0)
+                {
+                    p += 4;
+                    out = 1;
+                    return true;
+                }
+                if (std::strncmp(p, "false", 5) == 0)
+                {
+                    p += 5;
+                    out = 0;
+                    return true;
+                }
+                return false;
+            }
+
+            bool vector(glm::vec3 & out)
+            {
+                if (*p++ != '[')
+                    return false;
+
+                for (int i = 0; i < 3; i++)
+                {
+                    space();
+                    if (!number(out[i]))
+                        return false;
+                    space();
+                    if (*p++ != (i < 2 ? ',' : ']'))
+                        return false;
+                }
+
+                return true;
+            }
+
+            // A number or string copied as it was written, so that it can be sent back unchanged
+            bool raw(char * out, size_t size)
+            {
+                const char * start = p;
+                if (*p == '"')
+                {
+                    char scratch[MAX_ID];
+                    if (!string(scratch, sizeof(scratch)))
+                        return false;
+                }
+                else
+                {
+                    float ignored;
+                    if (!number(ignored))
+                        return false;
+                }
+
+                size_t length = p - start;
+                if (length >= size)
+                    return false;
+
+                std::memcpy(out, start, length);
+                out[length] = '\0';
+                return true;
+            }
+    };
+
+    // Adds s to out as a JSON string, quotes included, as far as it fits
+    inline void appendString(char * out, size_t size, const char * s)
+    {
+        size_t length = std::strlen(out);
+        if (length + 3 > size)
+            return;
+
+        out[length++] = '"';
+        for (; *s && length + 3 < size; s++)
+        {
+            char c = *s;
+            if (c == '"' || c == '\\')
+            {
+                if (length + 4 >= size)
+                    break;
+                out[length++] = '\\';
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                c = ' ';
+            }
+            out[length++] = c;
+        }
+        out[length++] = '"';
+        out[length] = '\0';
+    }
+
+    struct Stats
+    {
+        unsigned long connections = 0;
+        unsigned long commands = 0;         // Queued for the render loop
+        unsigned long rejected = 0;         // Lines that were not a command, or came while the queue was full
+        unsigned long captures = 0;
+        unsigned long droppedReplies = 0;   // The reply queue was full, the server thread fell behind
+    };
+
+    class Server
+    {
+        public:
+            // wake is called from the server thread once a command is queued, to get a render loop that waits for
+            // events going again
+            Server(const std::string & _path, void (* _wake)())
+            : path(_path), wake(_wake), listener(-1), stopping(false), clientCount(0), nextClient(1)
+            {
+                wakePipe[0] = wakePipe[1] = -1;
+            }
+
+            ~Server()
+            {
+                stop();
+            }
+
+            // Replaces a socket left behind by an earlier run, but no other kind of file
+            bool start()
+            {
+                sockaddr_un address;
+                std::memset(&address, 0, sizeof(address));
+                address.sun_family = AF_UNIX;
+                if (path.size() >= sizeof(address.sun_path))
+                {
+                    std::cerr << "ERROR: Control socket path is too long: " << path << std::endl;
+                    return false;
+                }
+                std::strcpy(address.sun_path, path.c_str());
+
+                struct stat existing;
+                if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+                    unlink(path.c_str());
+
+                listener = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 4) != 0)
+                {
+                    std::cerr << "ERROR: Could not listen for commands on " << path << ": " << std::strerror(errno) << std::endl;
+                    if (listener >= 0)
+                        close(listener);
+                    listener = -1;
+                    return false;
+                }
+
+                // The render thread only ever pokes it, a full pipe means a wake up is pending anyway
+                if (pipe(wakePipe) != 0)
+                {
+                    std::cerr << "ERROR: Could not create the control wake up pipe" << std::endl;
+                    stop();
+                    return false;
+                }
+                fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+                fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+                std::cout << "Control: listening on " << path << std::endl;
+
+                stopping.store(false);
+                thread = std::thread(&Server::run, this);
+                return true;
+            }
+
+            // Sends whatever answers are still queued, then closes every connection and removes the socket
+            void stop()
+            {
+                if (thread.joinable())
+                {
+                    stopping.store(true);
+                    notify();
+                    thread.join();
+                    sendReplies();
+                }
+
+                Command command;
+                while (commands.pop(command))
+                    delete command.cameraPath;
+
+                for (unsigned int i = 0; i < clientCount; i++)
+                    close(clients[i].fd);
+                clientCount = 0;
+
+                if (listener >= 0)
+                {
+                    close(listener);
+                    unlink(path.c_str());
+                    listener = -1;
+                }
+
+                for (int i = 0; i < 2; i++)
+                {
+                    if (wakePipe[i] >= 0)
+                        close(wakePipe[i]);
+                    wakePipe[i] = -1;
+                }
+            }
+
+            // Render thread, at the start of a frame: the next command that came in
+            bool next(Command & command)
+            {
+                return commands.pop(command);
+            }
+
+            // Render thread. fields are added to the answer after "ok":true, e.g. "\"frames\":12", or NULL for none.
+            void reply(const Command & command, const char * fields)
+            {
+                Reply answer;
+                answer.client = command.client;
+                answer.pixels = NULL;
+                std::snprintf(answer.text, sizeof(answer.text), "{\"id\":%s,\"ok\":true%s%s}", command.id, fields ? "," : "", fields ? fields : "");
+                queue(answer);
+            }
+
+            void fail(const Command & command, const char * error)
+            {
+                Reply answer;
+                answer.client = command.client;
+                answer.pixels = NULL;
+                format(answer.text, command.id, error);
+                queue(answer);
+            }
+
+            // Render thread: takes the frame's pixels, the server thread writes them to the command's path and answers
+            void capture(const Command & command, std::vector<unsigned char> * pixels, int width, int height)
+            {
+                Reply answer;
+                answer.client = command.client;
+                answer.pixels = pixels;
+                answer.width = width;
+                answer.height = height;
+                std::strcpy(answer.id, command.id);
+                std::strcpy(answer.path, command.path);
+                queue(answer);
+            }
+
+            // Once stopped
+            void printStats() const
+            {
+                std::cout << "Control: " << stats.commands << " commands from " << stats.connections << " connections, " << stats.captures << " captures";
+                if (stats.rejected)
+                    std::cout << ", " << stats.rejected << " rejected";
+                if (stats.droppedReplies)
+                    std::cout << ", " << stats.droppedReplies << " answers dropped";
+                std::cout << std::endl;
+            }
+
+        private:
+            static const int POLL_MS = 200;                 // How often the server checks whether it should stop, if nothing wakes it
+            static const int CLIENT_TIMEOUT_SECONDS = 2;    // For a client that stops reading its answers
+
+            struct Client
+            {
+                int fd;
+                unsigned long id;
+                char line[MAX_LINE];
+                size_t length;
+                bool overlong;      // Skipping the rest of a line that did not fit
+            };
+
+            std::string path;
+            void (* wake)();
+
+            int listener;
+            int wakePipe[2];
+            std::atomic<bool> stopping;
+            std::thread thread;
+
+            Learus_Simulation::SpscQueue<Command, 64> commands;     // Server thread to render thread
+            Learus_Simulation::SpscQueue<Reply, 64> replies;        // Render thread to server thread
+
+            // Server thread, and whoever calls stop() once it is gone
+            Client clients[MAX_CLIENTS];
+            unsigned int clientCount;
+            unsigned long nextClient;
+
+            Stats stats;
+
+            static void format(char * out, const char * id, const char * error)
+            {
+                std::snprintf(out, MAX_REPLY, "{\"id\":%s,\"ok\":false,\"error\":", id);
+                appendString(out, MAX_REPLY, error);
+                std::strncat(out, "}", MAX_REPLY - std::strlen(out) - 1);
+            }
+
+            void queue(const Reply & answer)
+            {
+                if (!replies.push(answer))
+                {
+                    stats.droppedReplies++;
+                    delete answer.pixels;
+                    return;
+                }
+                notify();
+            }
+
+            void notify()
+            {
+                if (wakePipe[1] >= 0)
+                {
+                    char byte = 1;
+                    ssize_t ignored = write(wakePipe[1], &byte, 1);
+                    (void)ignored;
+                }
+            }
+
+            void run()
+            {
+                PROFILE_THREAD_NAME("Control");
+
+                // Answering a client allocates, at the client's pace rather than a frame's
+                Learus_Alloc::outsideFrames();
+
+                while (!stopping.load())
+                {
+                    pollfd fds[2 + MAX_CLIENTS];
+                    unsigned int watched = clientCount;
+                    fds[0].fd = listener;
+                    fds[1].fd = wakePipe[0];
+                    for (unsigned int i = 0; i < watched; i++)
+                        fds[2 + i].fd = clients[i].fd;
+                    for (unsigned int i = 0; i < 2 + watched; i++)
+                    {
+                        fds[i].events = POLLIN;
+                        fds[i].revents = 0;
+                    }
+
+                    if (poll(fds, 2 + watched, POLL_MS) < 0 && errno != EINTR)
+                        break;
+
+                    if (fds[1].revents)
+                    {
+                        char drain[64];
+                        while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+                            ;
+                    }
+                    sendReplies();
+
+                    // Backwards, so that closing one does not move those not read yet
+                    for (unsigned int i = watched; i-- > 0; )
+                    {
+                        if (fds[2 + i].revents && !receive(clients[i]))
+                            drop(i);
+                    }
+
+                    if (fds[0].revents & POLLIN)
+                        acceptClient();
+                }
+            }
+
+            void acceptClient()
+            {
+                int fd = ::accept(listener, NULL, NULL);
+                if (fd < 0)
+                    return;
+
+                if (clientCount == MAX_CLIENTS)
+                {
+                    char text[MAX_REPLY];
+                    format(text, "null", "too many connections");
+                    sendLine(fd, text);
+                    close(fd);
+                    return;
+                }
+
+                timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+                Client & client = clients[clientCount++];
+                client.fd = fd;
+                client.id = nextClient++;
+                client.length = 0;
+                client.overlong = false;
+                stats.connections++;
+            }
+
+            void drop(unsigned int index)
+            {
+                close(clients[index].fd);
+                clientCount--;
+                if (index != clientCount)
+                    clients[index] = clients[clientCount];
+            }
+
+            // False once the client hung up
+            bool receive(Client & client)
+            {
+                ssize_t got = recv(client.fd, client.line + client.length, MAX_LINE - 1 - client.length, 0);
+                if (got <= 0)
+                    return got < 0 && (errno == EINTR || errno == EAGAIN);
+                client.length += got;
+
+                size_t start = 0;
+                for (size_t i = client.length - got; i < client.length; i++)
+                {
+                    if (client.line[i] != '\n')
+                        continue;
+
+                    client.line[i] = '\0';
+                    if (!client.overlong)
+                        handle(client, client.line + start);
+                    client.overlong = false;
+                    start = i + 1;
+                }
+
+                client.length -= start;
+                std::memmove(client.line, client.line + start, client.length);
+
+                if (client.length == MAX_LINE - 1)
+                {
+                    if (!client.overlong)
+                    {
+                        char text[MAX_REPLY];
+                        format(text, "null", "line too long");
+                        sendLine(client.fd, text);
+                        stats.rejected++;
+                    }
+                    client.overlong = true;
+                    client.length = 0;
+                }
+
+                return true;
+            }
+
+            void handle(Client & client, const char * line)
+            {
+                while (*line == ' ' || *line == '\t' || *line == '\r')
+                    line++;
+                if (*line == '\0')
+                    return;
+
+                Command command;
+                command.client = client.id;
+
+                Parser parser(line);
+                const char * error = NULL;
+                if (!parser.parse(command))
+                {
+                    error = parser.error;
+                }
+                else if (command.type == COMMAND_LOAD)
+                {
+                    // Read here, a file read has no place in a frame
+                    command.cameraPath = new Learus_Benchmark::CameraPath();
+                    if (!command.cameraPath->load(command.path))
+                        error = "could not load the camera path";
+                }
+
+                if (!error && !commands.push(command))
+                    error = "busy, too many commands waiting for a frame";
+
+                if (error)
+                {
+                    delete command.cameraPath;
+
+                    char text[MAX_REPLY];
+                    format(text, command.id, error);
+                    sendLine(client.fd, text);
+                    stats.rejected++;
+                    return;
+                }
+
+                stats.commands++;
+                if (wake)
+                    wake();
+            }
+
+            void sendReplies()
+            {
+                Reply answer;
+                while (replies.pop(answer))
+                {
+                    if (answer.pixels)
+                        writeCapture(answer);
+
+                    for (unsigned int i = 0; i < clientCount; i++)
+                    {
+                        if (clients[i].id == answer.client)
+                            sendLine(clients[i].fd, answer.text);
+                    }
+                }
+            }
+
+            void writeCapture(Reply & answer)
+            {
+                std::vector<unsigned char> & rgb = *answer.pixels;
+                if (rgb.empty())
+                {
+                    format(answer.text, answer.id, "window has no pixels");
+                    delete answer.pixels;
+                    answer.pixels = NULL;
+                    return;
+                }
+
+                size_t row = (size_t)answer.width * 3;
+                std::vector<unsigned char> swap(row);
+                for (int y = 0; y < answer.height / 2; y++)
+                {
+                    unsigned char * top = &rgb[y * row];
+                    unsigned char * bottom = &rgb[(answer.height - 1 - y) * row];
+                    std::copy(top, top + row, swap.begin());
+                    std::copy(bottom, bottom + row, top);
+                    std::copy(swap.begin(), swap.end(), bottom);
+                }
+
+                if (Learus_Image::write(answer.path, answer.width, answer.height, &rgb[0]))
+                {
+                    char written[MAX_REPLY / 2] = "";
+                    appendString(written, sizeof(written), answer.path);
+                    std::snprintf(answer.text, sizeof(answer.text), "{\"id\":%s,\"ok\":true,\"path\":%s,\"width\":%d,\"height\":%d}",
+                                  answer.id, written, answer.width, answer.height);
+                    stats.captures++;
+                }
+                else
+                {
+                    format(answer.text, answer.id, "could not write the image");
+                }
+
+                delete answer.pixels;
+                answer.pixels = NULL;
+            }
+
+            // The line and its newline, as far as the client takes it
+            static void sendLine(int fd, const char * text)
+            {
+                char line[MAX_REPLY + 1];
+                size_t length = std::strlen(text);
+                std::memcpy(line, text, length);
+                line[length++] = '\n';
+
+                for (size_t sent = 0; sent < length; )
+                {
+                    ssize_t wrote = send(fd, line + sent, length - sent, MSG_NOSIGNAL);
+                    if (wrote <= 0)
+                        break;
+                    sent += wrote;
+                }
+            }
+
+            Server(const Server &);
+            Server & operator=(const Server &);
+    };
+}
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include "../lib/glad/glad.h"
+
+#include "shader.h"
+#include "shader_manager.h"
+#include "gl_state.h"
+#include "resource_registry.h"
+#include "gpu_profiler.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Renders the scene into an offscreen target at a fraction of the output size, picked every frame to keep the scene's
+// GPU time on a target, then scales the result up into the real framebuffer. Fragment work (lighting, the skybox)
+// shrinks with the square of the scale, so on a slow GPU it buys back a steady frame rate for some sharpness.
+namespace Learus_DynamicRes
+{
+    // Bilinear upscale with a light unsharp mask, clamped to the neighbourhood so edges do not ring. Samples stay
+    // inside the rendered part of the target, which is smaller than the texture.
+    const char * sharpen_vertex_shader =    "#version 330 core\n"
+                                            "out vec2 uv;\n"
+                                            "void main() {\n"
+                                            "    // One triangle covering the screen, no vertex data\n"
+                                            "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+                                            "    uv = corner;\n"
+                                            "    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+                                            "}\0";
+
+    const char * sharpen_fragment_shader =  "#version 330 core\n"
+                                            "in vec2 uv;\n"
+                                            "out vec4 FragColor;\n"
+                                            "uniform sampler2D image;\n"
+                                            "uniform vec2 extent;\n"      // Rendered part of the texture, in texture coordinates
+                                            "uniform vec2 texel;\n"
+                                            "uniform float sharpness;\n"
+                                            "vec3 fetch(vec2 p) {\n"
+                                            "    return texture(image, clamp(p, texel * 0.5, extent - texel * 0.5)).rgb;\n"
+                                            "}\n"
+                                            "void main() {\n"
+                                            "    vec2 p = uv * extent;\n"
+                                            "    vec3 c = fetch(p);\n"
+                                            "    vec3 n = fetch(p + vec2(0.0, texel.y));\n"
+                                            "    vec3 s = fetch(p - vec2(0.0, texel.y));\n"
+                                            "    vec3 e = fetch(p + vec2(texel.x, 0.0));\n"
+                                            "    vec3 w = fetch(p - vec2(texel.x, 0.0));\n"
+                                            "    vec3 sharpened = c + sharpness * (4.0 * c - n - s - e - w);\n"
+                                            "    vec3 lo = min(c, min(min(n, s), min(e, w)));\n"
+                                            "    vec3 hi = max(c, max(max(n, s), max(e, w)));\n"
+                                            "    FragColor = vec4(clamp(sharpened, lo, hi), 1.0);\n"
+                                            "}\0";
+
+    enum Filter
+    {
+        FILTER_BILINEAR,
+        FILTER_SHARPEN
+    };
+
+    // PI controller on the render scale, in velocity form: each measurement moves the scale by
+    // Kp * (change in error) + Ki * error, so clamping the scale to its limits cannot wind anything up.
+    // The error is the headroom relative to the target, errors within the dead band are treated as on target.
+    class Controller
+    {
+        public:
+            float minScale, maxScale;
+
+            Controller(double _targetMs, float _minScale, float _maxScale)
+            : minScale(_minScale), maxScale(_maxScale), targetMs(_targetMs), scale(_maxScale), lastError(0.0)
+            {
+            }
+
+            float update(double gpuMs)
+            {
+                double error = (targetMs - gpuMs) / targetMs;
+                if (std::fabs(error) < DEAD_BAND)
+                    error = 0.0;
+
+                // Time goes with the area, so the scale needs about half the relative change
+                double change = KP * (error - lastError) + KI * 0.5 * error;
+                lastError = error;
+
+                scale = std::min(maxScale, std::max(minScale, (float)(scale * (1.0 + change))));
+                return scale;
+            }
+
+            float current() const
+            {
+                return scale;
+            }
+
+            double target() const
+            {
+                return targetMs;
+            }
+
+        private:
+            static constexpr double KP = 0.3;
+            static constexpr double KI = 0.2;
+            static constexpr double DEAD_BAND = 0.05;
+
+            double targetMs;
+            float scale;
+            double lastError;
+    };
+
+    // Follows the GPU time of the profiler's "Frame" scope, which holds the scaled scene and its upscale
+    class DynamicResolution : public Learus_Profiler::FrameListener
+    {
+        public:
+            DynamicResolution(Learus_Shaders::ShaderManager & _shaders, Learus_Profiler::GpuProfiler & _profiler, double targetMs, float minScale, float maxScale,
+                              Filter _filter)
+            : controller(targetMs, minScale, maxScale), filter(_filter), shaders(_shaders), profiler(_profiler), sharpen(NULL),
+              framebuffer(0), color(0), depth(0), emptyVertexArray(0), width(0), height(0), scaledWidth(0), scaledHeight(0),
+              outputFramebuffer(0), frames(0), measured(0), gpuTotal(0.0), overTarget(0), scaleTotal(0.0), lowest(maxScale), resizes(0)
+            {
+                profiler.enable();
+                profiler.listen(this);
+
+                if (filter == FILTER_SHARPEN)
+                    sharpen = shaders.fromSource(sharpen_vertex_shader, sharpen_fragment_shader);
+
+                glGenFramebuffers(1, &framebuffer);
+                glGenTextures(1, &color);
+                glGenRenderbuffers(1, &depth);
+                glGenVertexArrays(1, &emptyVertexArray);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_FRAMEBUFFER, framebuffer, Learus_Resources::SUB_RENDER_TARGETS, 0, "scaled target");
+                resources.track(Learus_Resources::KIND_TEXTURE, color, Learus_Resources::SUB_RENDER_TARGETS, 0, "scaled color");
+                resources.track(Learus_Resources::KIND_RENDERBUFFER, depth, Learus_Resources::SUB_RENDER_TARGETS, 0, "scaled depth");
+                resources.track(Learus_Resources::KIND_VERTEX_ARRAY, emptyVertexArray, Learus_Resources::SUB_RENDER_TARGETS, 0, "upscale pass");
+            }
+
+            ~DynamicResolution()
+            {
+                profiler.unlisten(this);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_FRAMEBUFFER, framebuffer);
+                resources.release(Learus_Resources::KIND_TEXTURE, color);
+                resources.release(Learus_Resources::KIND_RENDERBUFFER, depth);
+                resources.release(Learus_Resources::KIND_VERTEX_ARRAY, emptyVertexArray);
+
+                Learus_GLState::StateCache & state = Learus_GLState::current();
+                state.forgetTexture(color);
+                state.forgetVertexArray(emptyVertexArray);
+
+                glDeleteFramebuffers(1, &framebuffer);
+                glDeleteTextures(1, &color);
+                glDeleteRenderbuffers(1, &depth);
+                glDeleteVertexArrays(1, &emptyVertexArray);
+            }
+
+            // Instead of the output framebuffer, which is the one bound now. width x height is the output size.
+            void begin(int _width, int _height)
+            {
+                PROFILE_SCOPE("DynamicResolution::Begin");
+
+                if (_width != width || _height != height)
+                    resize(_width, _height);
+
+                float scale = controller.current();
+                int w = std::max(1, (int)(width * scale + 0.5f));
+                int h = std::max(1, (int)(height * scale + 0.5f));
+                if (w != scaledWidth || h != scaledHeight)
+                {
+                    scaledWidth = w;
+                    scaledHeight = h;
+                    resizes++;
+                }
+
+                frames++;
+                scaleTotal += scale;
+                lowest = std::min(lowest, scale);
+
+                GLint bound = 0;
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+                outputFramebuffer = bound;
+
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                glViewport(0, 0, scaledWidth, scaledHeight);
+            }
+
+            // Scales the frame up into the output framebuffer and binds that again
+            void end()
+            {
+                PROFILE_SCOPE("DynamicResolution::End");
+
+                glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+                glViewport(0, 0, width, height);
+
+                // Until the sharpening program has compiled, plain bilinear. At full size a copy is enough.
+                bool scaled = scaledWidth != width || scaledHeight != height;
+                if (sharpen && scaled && shaders.ready(sharpen))
+                {
+                    Learus_GLState::StateCache & state = Learus_GLState::current();
+                    state.useProgram(sharpen->ID);
+                    state.bindVertexArray(emptyVertexArray);
+                    state.bindTexture(0, GL_TEXTURE_2D, color);
+
+                    sharpen->setInt("image", 0);
+                    sharpen->setVec2("extent", glm::vec2((float)scaledWidth / width, (float)scaledHeight / height));
+                    sharpen->setVec2("texel", glm::vec2(1.0f / width, 1.0f / height));
+                    sharpen->setFloat("sharpness", std::min(0.25f, 0.5f * (1.0f - controller.current())));
+
+                    glDisable(GL_DEPTH_TEST);
+                    glDrawArrays(GL_TRIANGLES, 0, 3);
+                    glEnable(GL_DEPTH_TEST);
+                }
+                else
+                {
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                    glBlitFramebuffer(0, 0, scaledWidth, scaledHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFramebuffer);
+                }
+            }
+
+            float scale() const
+            {
+                return controller.current();
+            }
+
+            // The frames the GPU has finished go to the controller
+            void gpuFrame(const Learus_Profiler::GpuProfiler & gpu)
+            {
+                double ms;
+                if (gpu.lastTime("Frame", ms))
+                    measure(ms);
+            }
+
+            // After the profiler's flush()
+            void printStats()
+            {
+                if (frames == 0)
+                    return;
+
+                std::cout << "Dynamic resolution: " << controller.target() << " ms target, scale " << controller.minScale << " - " << controller.maxScale
+                          << ", mean " << scaleTotal / frames << ", lowest " << lowest << ", " << resizes << " size changes";
+                if (measured)
+                    std::cout << ", GPU time with the upscale " << gpuTotal / measured << " ms mean, over target in " << overTarget << " of " << measured << " frames";
+                std::cout << std::endl;
+            }
+
+        private:
+            Controller controller;
+            Filter filter;
+            Learus_Shaders::ShaderManager & shaders;
+            Learus_Profiler::GpuProfiler & profiler;
+            Shader * sharpen;
+
+            GLuint framebuffer, color, depth;
+            GLuint emptyVertexArray;        // Core profile needs one bound even without attributes
+            int width, height;              // Output, and the size of the target
+            int scaledWidth, scaledHeight;  // The part of the target that gets rendered
+            GLuint outputFramebuffer;
+
+            unsigned long frames, measured;
+            double gpuTotal;
+            unsigned long overTarget;
+            double scaleTotal;
+            float lowest;
+            unsigned long resizes;
+
+            // The target is allocated at the full output size, smaller scales only use a corner of it
+            void resize(int _width, int _height)
+            {
+                width = std::max(_width, 1);
+                height = std::max(_height, 1);
+
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, color);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+                glBindRenderbuffer(GL_RENDERBUFFER, depth);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+                GLint bound = 0;
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                    std::cerr << "ERROR: Scaled render target is incomplete" << std::endl;
+                glBindFramebuffer(GL_FRAMEBUFFER, bound);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.resize(Learus_Resources::KIND_TEXTURE, color, (size_t)width * height * 4);
+                resources.resize(Learus_Resources::KIND_RENDERBUFFER, depth, (size_t)width * height * 4);
+            }
+
+            void measure(double ms)
+            {
+                measured++;
+                gpuTotal += ms;
+                if (ms > controller.target())
+                    overTarget++;
+
+                controller.update(ms);
+            }
+
+            DynamicResolution(const DynamicResolution &);
+            DynamicResolution & operator=(const DynamicResolution &);
+    };
+}
+
+#endif
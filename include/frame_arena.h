@@ -0,0 +1,207 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+namespace Learus_Memory
+{
+    const unsigned int FRAME_ARENA_MAX_FRAMES = 3;
+
+    struct ArenaStats
+    {
+        size_t capacity = 0;            // Bytes per frame
+        size_t peak = 0;                // Most bytes any frame asked for
+        unsigned long overflows = 0;    // Allocations that did not fit and went to malloc
+        size_t overflowBytes = 0;
+        unsigned long grows = 0;        // Times the blocks were resized to the peak
+    };
+
+    // Bump allocator for data that only lives for a frame or two. Allocating is a pointer bump and
+    // nothing is ever freed on its own: beginFrame() moves on to the next block and forgets all of it.
+    //
+    // With N blocks, memory handed out in one frame stays valid for N - 1 more beginFrame() calls, so a
+    // consumer that runs a frame behind (the GPU, another thread) can still read it.
+    // A frame that does not fit gets malloc'd memory instead, and the blocks grow to fit it the next time round.
+    class FrameArena
+    {
+        public:
+            ArenaStats stats;
+
+            FrameArena(size_t bytesPerFrame = 256 * 1024, unsigned int _frames = 2)
+            : frames(_frames < 1 ? 1 : (_frames > FRAME_ARENA_MAX_FRAMES ? FRAME_ARENA_MAX_FRAMES : _frames)), current(0), offset(0)
+            {
+                stats.capacity = bytesPerFrame;
+
+                for (unsigned int i = 0; i < frames; i++)
+                {
+                    blocks[i].memory = (char *)std::malloc(bytesPerFrame);
+                    blocks[i].size = bytesPerFrame;
+                }
+            }
+
+            ~FrameArena()
+            {
+                for (unsigned int i = 0; i < frames; i++)
+                {
+                    releaseOverflow(blocks[i]);
+                    std::free(blocks[i].memory);
+                }
+            }
+
+            // Everything from the frame before last (with double buffering) is gone after this
+            void beginFrame()
+            {
+                current = (current + 1) % frames;
+                offset = 0;
+
+                Block & block = blocks[current];
+                releaseOverflow(block);
+
+                // The last frames needed more, make every block big enough once they come round
+                if (block.size < stats.peak)
+                {
+                    std::free(block.memory);
+                    block.size = stats.peak + stats.peak / 4;
+                    block.memory = (char *)std::malloc(block.size);
+
+                    stats.capacity = block.size;
+                    stats.grows++;
+                }
+            }
+
+            void * allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+            {
+                Block & block = blocks[current];
+
+                // Align the address rather than the offset, malloc only promises max_align_t for the block itself
+                uintptr_t base = (uintptr_t)block.memory;
+                size_t start = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+                if (start + size > stats.peak)
+                    stats.peak = start + size;
+
+                if (start + size <= block.size)
+                {
+                    offset = start + size;
+                    return block.memory + start;
+                }
+
+                // Out of room. Still counted in offset, so the peak reflects what the frame really needed.
+                offset = start + size;
+                stats.overflows++;
+                stats.overflowBytes += size;
+
+                void * memory = NULL;
+                if (alignment <= alignof(std::max_align_t))
+                    memory = std::malloc(size ? size : 1);
+                else if (posix_memalign(&memory, alignment, size ? size : 1) != 0)
+                    memory = NULL;
+
+                if (!memory)
+                    throw std::bad_alloc();
+
+                block.overflow.push_back(memory);
+                return memory;
+            }
+
+            template <typename T>
+            T * allocateArray(size_t count)
+            {
+                return (T *)allocate(count * sizeof(T), alignof(T));
+            }
+
+            size_t used() const
+            {
+                return offset;
+            }
+
+            unsigned int bufferCount() const
+            {
+                return frames;
+            }
+
+            void printStats() const
+            {
+                std::cout << "Frame arena: peak " << stats.peak / 1024.0 << " KB of " << stats.capacity / 1024.0 << " KB per frame, "
+                          << frames << " buffers, " << stats.overflows << " overflows (" << stats.overflowBytes / 1024.0 << " KB), "
+                          << stats.grows << " grows" << std::endl;
+            }
+
+        private:
+            struct Block
+            {
+                char * memory;
+                size_t size;
+                std::vector<void *> overflow;
+            };
+
+            Block blocks[FRAME_ARENA_MAX_FRAMES];
+            unsigned int frames;
+            unsigned int current;
+            size_t offset;
+
+            void releaseOverflow(Block & block)
+            {
+                for (unsigned int i = 0; i < block.overflow.size(); i++)
+                    std::free(block.overflow[i]);
+
+                block.overflow.clear();
+            }
+
+            FrameArena(const FrameArena &);
+            FrameArena & operator=(const FrameArena &);
+    };
+
+    // The arena used by the render loop. Reset at the start of every Scene::Render.
+    inline FrameArena & frameArena()
+    {
+        static FrameArena arena;
+        return arena;
+    }
+
+    // Lets standard containers live in a FrameArena. deallocate does nothing, the memory goes away with the frame,
+    // so a container using it must not be touched after its arena has moved past the frame it was filled in.
+    template <typename T>
+    class FrameAllocator
+    {
+        public:
+            typedef T value_type;
+
+            FrameArena * arena;
+
+            FrameAllocator(FrameArena & _arena = frameArena()) : arena(&_arena) {}
+
+            template <typename U>
+            FrameAllocator(const FrameAllocator<U> & other) : arena(other.arena) {}
+
+            T * allocate(size_t count)
+            {
+                return arena->allocateArray<T>(count);
+            }
+
+            void deallocate(T *, size_t)
+            {
+            }
+
+            template <typename U>
+            bool operator==(const FrameAllocator<U> & other) const
+            {
+                return arena == other.arena;
+            }
+
+            template <typename U>
+            bool operator!=(const FrameAllocator<U> & other) const
+            {
+                return arena != other.arena;
+            }
+    };
+
+    template <typename T>
+    using FrameVector = std::vector<T, FrameAllocator<T> >;
+}
+
+#endif
@@ -0,0 +1,496 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include "../lib/glad/glad.h"
+
+#include "image_writer.h"
+#include "thread_pool.h"
+#include "resource_registry.h"
+#include "profiler.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams every rendered frame to disk without making the render thread wait for the GPU or the disk.
+//
+// capture() only queues an asynchronous glReadPixels into one of a ring of pixel pack buffers and puts a
+// fence behind it. By the time the ring comes round to that buffer again the GPU has long finished, so
+// mapping it does not stall, and the pixels are copied into a frame that goes to the writer thread. The writer
+// converts and writes frames with a pool of encoder threads: a Y4M video (8 bit 4:2:0) for paths ending in
+// .y4m, otherwise numbered PNG or PPM images through a printf pattern (frame_%05d.png).
+namespace Learus_Export
+{
+    const unsigned int READBACK_RING = 3;
+
+    // Frames waiting for the writer are capped by memory, not by count
+    const size_t QUEUE_BYTES = 256 * 1024 * 1024;
+
+    struct Stats
+    {
+        unsigned long captured = 0;
+        unsigned long written = 0;
+        unsigned long fenceWaits = 0;       // Readbacks that were not done when their turn came
+        unsigned long writerStalls = 0;     // Captures that had to wait for a free frame
+        unsigned int peakQueued = 0;
+        double captureSeconds = 0.0;        // Render thread time spent in capture()
+        double stallSeconds = 0.0;
+        double elapsedSeconds = 0.0;        // First capture to last frame on disk
+    };
+
+    class FrameExporter
+    {
+        public:
+            Stats stats;
+
+            // encoders 0 means one per hardware thread
+            FrameExporter(const std::string & _path, int _width, int _height, unsigned int encoders = 0)
+            : path(_path), width(_width), height(_height), video(isVideo(_path)), file(NULL),
+              encoderCount(encoders), nextSlot(0), queueHead(0), queueCount(0), closing(false), failed(false), running(false)
+            {
+                frameBytes = (size_t)width * height * 4;
+                maxFrames = (unsigned int)std::max<size_t>(2, std::min<size_t>(64, QUEUE_BYTES / std::max<size_t>(frameBytes, 1)));
+
+                queue.resize(maxFrames);
+                freeFrames.reserve(maxFrames);
+                allFrames.reserve(maxFrames);
+
+                glGenBuffers(READBACK_RING, buffers);
+                for (unsigned int i = 0; i < READBACK_RING; i++)
+                {
+                    slots[i].fence = 0;
+                    slots[i].frame = 0;
+
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+                    glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+                    Learus_Resources::registry().track(Learus_Resources::KIND_BUFFER, buffers[i], Learus_Resources::SUB_RENDER_TARGETS, frameBytes, "export readback");
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+
+            ~FrameExporter()
+            {
+                finish();
+
+                for (unsigned int i = 0; i < READBACK_RING; i++)
+                {
+                    if (slots[i].fence)
+                        glDeleteSync(slots[i].fence);
+                }
+
+                Learus_Resources::registry().release(Learus_Resources::KIND_BUFFER, READBACK_RING, buffers);
+                glDeleteBuffers(READBACK_RING, buffers);
+
+                for (unsigned int i = 0; i < allFrames.size(); i++)
+                    delete allFrames[i];
+            }
+
+            // Opens the output and starts the writer. fps only ends up in the Y4M header.
+            bool open(int fps)
+            {
+                if (video)
+                {
+                    file = std::fopen(path.c_str(), "wb");
+                    if (!file)
+                    {
+                        std::cerr << "ERROR: Could not open video for writing: " << path << std::endl;
+                        return false;
+                    }
+
+                    // C420jpeg: full range BT.601, chroma centered between the 2x2 pixels it covers
+                    std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, std::max(1, fps));
+                }
+                else if (path.find('%') == std::string::npos)
+                {
+                    std::cerr << "ERROR: --export expects a .y4m file or a numbered pattern such as frames/frame_%05d.png" << std::endl;
+                    return false;
+                }
+
+                running = true;
+                writer = std::thread(&FrameExporter::write, this);
+                return true;
+            }
+
+            // Reads the framebuffer back once the GPU gets there. Call after the frame was drawn into it
+            // (0 reads the window's back buffer).
+            void capture(GLuint framebuffer)
+            {
+                if (!running)
+                    return;
+
+                PROFILE_SCOPE("Export capture");
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                if (stats.captured == 0)
+                    firstCapture = start;
+
+                // The buffer about to be reused holds the frame from READBACK_RING - 1 captures ago
+                Slot & slot = slots[nextSlot];
+                if (slot.fence)
+                    retire(slot, buffers[nextSlot]);
+
+                GLint readFramebuffer = 0;
+                glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[nextSlot]);
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+                slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                slot.frame = stats.captured++;
+                nextSlot = (nextSlot + 1) % READBACK_RING;
+
+                stats.captureSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            // Hands over the last readbacks and waits until everything is on disk. Returns false if anything failed to write.
+            bool finish()
+            {
+                if (!running)
+                    return !failed;
+
+                // Oldest first, so frames reach the writer in order
+                for (unsigned int i = 0; i < READBACK_RING; i++)
+                {
+                    unsigned int index = (nextSlot + i) % READBACK_RING;
+                    if (slots[index].fence)
+                        retire(slots[index], buffers[index]);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    closing = true;
+                }
+                work.notify_one();
+                writer.join();
+                running = false;
+
+                if (file)
+                {
+                    if (std::fclose(file) != 0)
+                        failed = true;
+                    file = NULL;
+                }
+
+                if (stats.captured > 0)
+                    stats.elapsedSeconds = std::chrono::duration<double>(lastWrite - firstCapture).count();
+
+                return !failed;
+            }
+
+            void printStats() const
+            {
+                double sustained = stats.elapsedSeconds > 0.0 ? stats.written / stats.elapsedSeconds : 0.0;
+
+                std::cout << "Export: " << stats.written << " of " << stats.captured << " frames at " << width << "x" << height
+                          << " to " << path << ", " << sustained << " fps sustained, "
+                          << (stats.captured ? stats.captureSeconds * 1000.0 / stats.captured : 0.0) << " ms per frame on the render thread" << std::endl;
+
+                std::cout << "Export: " << stats.fenceWaits << " readbacks not ready in time, " << stats.writerStalls << " stalls on the writer ("
+                          << stats.stallSeconds * 1000.0 << " ms), peak " << stats.peakQueued << " of " << maxFrames << " frames queued, "
+                          << encoderCount << " encoder threads" << std::endl;
+            }
+
+        private:
+            struct Slot
+            {
+                GLsync fence;
+                unsigned long frame;
+            };
+
+            // RGBA, bottom row first as GL returns it
+            struct Frame
+            {
+                unsigned long index;
+                std::vector<unsigned char> pixels;
+            };
+
+            // Scratch space of one encoder thread
+            struct Scratch
+            {
+                std::vector<unsigned char> rgb;
+                std::vector<char> name;
+                Learus_Image::Buffers png;
+            };
+
+            struct EncodeImages
+            {
+                FrameExporter & e;
+                EncodeImages(FrameExporter & _e) : e(_e) {}
+                void operator()(unsigned int index, unsigned int thread) const { e.encodeImage(*e.batch[index], e.scratch[thread]); }
+            };
+
+            struct ConvertRows
+            {
+                FrameExporter & e;
+                const Frame & frame;
+                ConvertRows(FrameExporter & _e, const Frame & _frame) : e(_e), frame(_frame) {}
+                void operator()(unsigned int index, unsigned int) const { e.convertRows(frame, index * 16, std::min<int>(index * 16 + 16, e.height)); }
+            };
+
+            std::string path;
+            int width, height;
+            bool video;
+            FILE * file;
+            size_t frameBytes;
+            unsigned int maxFrames;
+            unsigned int encoderCount;
+
+            GLuint buffers[READBACK_RING];
+            Slot slots[READBACK_RING];
+            unsigned int nextSlot;
+
+            // Shared with the writer, under mutex
+            std::mutex mutex;
+            std::condition_variable work;       // Frames queued, or closing
+            std::condition_variable space;      // Frames returned to the free list
+            std::vector<Frame *> queue;         // Ring of maxFrames
+            unsigned int queueHead, queueCount;
+            std::vector<Frame *> freeFrames;
+            std::vector<Frame *> allFrames;
+            bool closing;
+            bool failed;
+
+            bool running;
+            std::thread writer;
+            std::chrono::steady_clock::time_point firstCapture, lastWrite;
+
+            // Writer thread only
+            std::vector<Frame *> batch;
+            std::vector<Scratch> scratch;
+            std::vector<unsigned char> planes;  // Y, then U, then V
+
+            static bool isVideo(const std::string & name)
+            {
+                return name.size() >= 4 && name.compare(name.size() - 4, 4, ".y4m") == 0;
+            }
+
+            // Render thread: moves a finished readback into a frame for the writer
+            void retire(Slot & slot, GLuint buffer)
+            {
+                GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                {
+                    stats.fenceWaits++;
+                    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                        ;
+                }
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+
+                Frame * frame = acquireFrame();
+                frame->index = slot.frame;
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+                const void * data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+                if (data)
+                {
+                    std::memcpy(&frame->pixels[0], data, frameBytes);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+                else
+                {
+                    std::cerr << "ERROR: Could not map export readback buffer" << std::endl;
+                    std::memset(&frame->pixels[0], 0, frameBytes);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue[(queueHead + queueCount) % maxFrames] = frame;
+                    queueCount++;
+                    stats.peakQueued = std::max(stats.peakQueued, queueCount);
+                }
+                work.notify_one();
+            }
+
+            // A free frame, a new one while under the memory cap, or else the next one the writer finishes
+            Frame * acquireFrame()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if (freeFrames.empty() && allFrames.size() < maxFrames)
+                {
+                    Frame * frame = new Frame();
+                    frame->pixels.resize(frameBytes);
+                    allFrames.push_back(frame);
+                    return frame;
+                }
+
+                if (freeFrames.empty())
+                {
+                    PROFILE_SCOPE("Export stall");
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                    stats.writerStalls++;
+                    while (freeFrames.empty())
+                        space.wait(lock);
+
+                    stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+
+                Frame * frame = freeFrames.back();
+                freeFrames.pop_back();
+                return frame;
+            }
+
+            // Writer thread: takes whatever is queued, in order, and encodes it on the pool
+            void write()
+            {
+                PROFILE_THREAD_NAME("Export writer");
+
+                Learus_Threads::ThreadPool pool(encoderCount);
+                encoderCount = pool.size();
+                scratch.resize(pool.size());
+                batch.reserve(maxFrames);
+
+                if (video)
+                    planes.resize((size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2));
+
+                for (;;)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while (queueCount == 0 && !closing)
+                            work.wait(lock);
+
+                        if (queueCount == 0)
+                            return;
+
+                        batch.clear();
+                        while (queueCount > 0)
+                        {
+                            batch.push_back(queue[queueHead]);
+                            queueHead = (queueHead + 1) % maxFrames;
+                            queueCount--;
+                        }
+                    }
+
+                    {
+                        PROFILE_SCOPE("Export write");
+
+                        if (video)
+                        {
+                            // One stream, so frames go out one after another with the conversion spread over the pool
+                            for (unsigned int i = 0; i < batch.size(); i++)
+                            {
+                                pool.parallelFor((height + 15) / 16, ConvertRows(*this, *batch[i]));
+                                writeVideoFrame();
+                            }
+                        }
+                        else
+                        {
+                            // Separate files, encoded side by side
+                            pool.parallelFor(batch.size(), EncodeImages(*this));
+                        }
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        for (unsigned int i = 0; i < batch.size(); i++)
+                            freeFrames.push_back(batch[i]);
+
+                        stats.written += batch.size();
+                        lastWrite = std::chrono::steady_clock::now();
+                    }
+                    space.notify_one();
+                }
+            }
+
+            void encodeImage(const Frame & frame, Scratch & local)
+            {
+                size_t row = (size_t)width * 3;
+                local.rgb.resize(row * height);
+
+                // Flip to top row first and drop alpha
+                for (int y = 0; y < height; y++)
+                {
+                    const unsigned char * in = &frame.pixels[(size_t)(height - 1 - y) * width * 4];
+                    unsigned char * out = &local.rgb[y * row];
+                    for (int x = 0; x < width; x++)
+                    {
+                        out[x * 3] = in[x * 4];
+                        out[x * 3 + 1] = in[x * 4 + 1];
+                        out[x * 3 + 2] = in[x * 4 + 2];
+                    }
+                }
+
+                local.name.resize(path.size() + 32);
+                std::snprintf(&local.name[0], local.name.size(), path.c_str(), (int)frame.index);
+
+                if (!Learus_Image::write(&local.name[0], width, height, &local.rgb[0], local.png))
+                    fail();
+            }
+
+            // Full range BT.601 in 8 bit fixed point, chroma averaged over each 2x2 block. Rows [begin, end) of
+            // the output, top first; begin is even.
+            void convertRows(const Frame & frame, int begin, int end)
+            {
+                int chromaWidth = (width + 1) / 2;
+                int chromaHeight = (height + 1) / 2;
+                unsigned char * yPlane = &planes[0];
+                unsigned char * uPlane = yPlane + (size_t)width * height;
+                unsigned char * vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+                for (int y = begin; y < end; y += 2)
+                {
+                    for (int x = 0; x < width; x += 2)
+                    {
+                        int sumU = 0, sumV = 0, count = 0;
+
+                        for (int dy = 0; dy < 2 && y + dy < height; dy++)
+                        {
+                            const unsigned char * in = &frame.pixels[(size_t)(height - 1 - y - dy) * width * 4];
+                            for (int dx = 0; dx < 2 && x + dx < width; dx++)
+                            {
+                                const unsigned char * p = in + (x + dx) * 4;
+                                int r = p[0], g = p[1], b = p[2];
+
+                                yPlane[(size_t)(y + dy) * width + x + dx] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+                                sumU += -43 * r - 85 * g + 128 * b;
+                                sumV += 128 * r - 107 * g - 21 * b;
+                                count++;
+                            }
+                        }
+
+                        size_t chroma = (size_t)(y / 2) * chromaWidth + x / 2;
+                        uPlane[chroma] = (unsigned char)std::min(255, std::max(0, 128 + ((sumU / count + 128) >> 8)));
+                        vPlane[chroma] = (unsigned char)std::min(255, std::max(0, 128 + ((sumV / count + 128) >> 8)));
+                    }
+                }
+            }
+
+            void writeVideoFrame()
+            {
+                size_t size = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+                static const char header[] = "FRAME\n";
+
+                if (std::fwrite(header, 1, sizeof(header) - 1, file) != sizeof(header) - 1 || std::fwrite(&planes[0], 1, size, file) != size)
+                    fail();
+            }
+
+            void fail()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failed)
+                    std::cerr << "ERROR: Could not write exported frames to " << path << std::endl;
+                failed = true;
+            }
+
+            FrameExporter(const FrameExporter &);
+            FrameExporter & operator=(const FrameExporter &);
+    };
+}
+
+#endif
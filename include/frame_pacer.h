@@ -0,0 +1,374 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include "../lib/glad/glad.h"
+
+#include "benchmark.h"
+#include "gpu_profiler.h"
+#include "profiler.h"
+#include "scene.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// Frame pacing for the window: frames start on a fixed schedule instead of whenever the swap returns, the camera is
+// taken from the simulation as late as possible, and the time from an input to its frame being done on the GPU is
+// measured stage by stage.
+namespace Learus_Pacing
+{
+    typedef std::chrono::steady_clock Clock;
+
+    inline double milliseconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    // Starts a frame every 1 / rate seconds. The wait sleeps until shortly before the deadline, then spins the rest
+    // of the way, since sleeps wake up late by an amount the scheduler decides. How much time is left for the spin
+    // follows the worst oversleep seen lately.
+    class FramePacer
+    {
+        public:
+            // rate 0 does not limit anything, only measures
+            explicit FramePacer(float _rate)
+            : rate(_rate), period(_rate > 0.0f ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / _rate)) : Clock::duration::zero()),
+              spinMargin(std::chrono::microseconds(1000)), started(false), frames(0), missed(0), resyncs(0),
+              sum(0.0), sumSquares(0.0), sleepMs(0.0), spinMs(0.0), oversleepMs(0.0), lastWaitMs(0.0)
+            {
+            }
+
+            // Until the next frame is due. Returns when it starts.
+            void wait()
+            {
+                PROFILE_SCOPE("Pacer");
+
+                Clock::time_point now = Clock::now();
+                Clock::time_point called = now;
+                lastWaitMs = 0.0;
+                if (!started)
+                {
+                    started = true;
+                    deadline = now;
+                    last = now;
+                    return;
+                }
+
+                if (period > Clock::duration::zero())
+                {
+                    deadline += period;
+
+                    // A whole frame late: start the schedule over instead of rushing frames out to catch up
+                    if (now > deadline + period)
+                    {
+                        deadline = now;
+                        missed++;
+                    }
+                    else if (now > deadline)
+                    {
+                        missed++;
+                    }
+
+                    sleepUntil(deadline);
+                    now = spinUntil(deadline);
+                    lastWaitMs = milliseconds(now - called);
+                }
+
+                double frameMs = milliseconds(now - last);
+                last = now;
+
+                frames++;
+                sum += frameMs;
+                sumSquares += frameMs * frameMs;
+                histogram.add(frameMs);
+            }
+
+            // How long the last wait() held the frame back, 0 without a rate
+            double waitedMs() const
+            {
+                return lastWaitMs;
+            }
+
+            // The loop was idle, the time since the last frame is not a frame time and the schedule starts over
+            void resync()
+            {
+                if (!started)
+                    return;
+
+                started = false;
+                resyncs++;
+            }
+
+            void printStats() const
+            {
+                if (frames == 0)
+                    return;
+
+                double mean = sum / frames;
+                double deviation = std::sqrt(std::max(0.0, sumSquares / frames - mean * mean));
+
+                std::cout << "Frame pacing: ";
+                if (rate > 0.0f)
+                    std::cout << "limited to " << rate << " fps, ";
+                std::cout << frames << " frames, " << mean << " ms mean, " << deviation << " ms standard deviation, p99 "
+                          << histogram.percentile(99.0) << " ms, worst " << histogram.max() << " ms";
+                if (rate > 0.0f)
+                    std::cout << ", " << missed << " late, slept " << sleepMs << " ms and spun " << spinMs << " ms, worst oversleep " << oversleepMs << " ms";
+                if (resyncs)
+                    std::cout << ", " << resyncs << " restarts after idling";
+                std::cout << std::endl;
+            }
+
+        private:
+            float rate;
+            Clock::duration period;
+            Clock::duration spinMargin;     // Left for spinning at the end of a wait
+
+            bool started;
+            Clock::time_point deadline;     // When the current frame was due
+            Clock::time_point last;         // When it actually started
+
+            unsigned long frames, missed, resyncs;
+            double sum, sumSquares;
+            Learus_Benchmark::Histogram histogram;
+            double sleepMs, spinMs, oversleepMs;
+            double lastWaitMs;
+
+            void sleepUntil(Clock::time_point target)
+            {
+                Clock::time_point wake = target - spinMargin;
+                Clock::time_point before = Clock::now();
+                if (before >= wake)
+                    return;
+
+                std::this_thread::sleep_until(wake);
+
+                Clock::time_point after = Clock::now();
+                sleepMs += milliseconds(after - before);
+
+                // The margin moves up to an oversleep straight away and comes back down slowly
+                Clock::duration oversleep = after - wake;
+                oversleepMs = std::max(oversleepMs, milliseconds(oversleep));
+                if (oversleep * 5 > spinMargin * 4)
+                    spinMargin = std::min<Clock::duration>(oversleep * 5 / 4, std::chrono::milliseconds(4));
+                else
+                    spinMargin = std::max<Clock::duration>(spinMargin - spinMargin / 16, std::chrono::microseconds(200));
+            }
+
+            Clock::time_point spinUntil(Clock::time_point target)
+            {
+                Clock::time_point before = Clock::now();
+                Clock::time_point now = before;
+                while (now < target)
+                {
+                    std::this_thread::yield();
+                    now = Clock::now();
+                }
+
+                spinMs += milliseconds(now - before);
+                return now;
+            }
+
+            FramePacer(const FramePacer &);
+            FramePacer & operator=(const FramePacer &);
+    };
+
+    // Timestamps a frame picks up on its way from an input to the screen
+    struct FrameTimes
+    {
+        Clock::time_point input;        // Oldest input in the frame's snapshot
+        Clock::time_point applied;      // The simulation published it
+        Clock::time_point latched;      // The render thread took the camera
+        Clock::time_point submitted;    // The frame went to the swap
+    };
+
+    // Takes the frame's snapshot, then a newer camera if the simulation published one while the frame was recorded
+    class LateLatch : public Learus_Scene::CameraLatch
+    {
+        public:
+            FrameTimes times;
+            bool hasInput;          // Some snapshot the frame used carried input
+            unsigned long step;     // Of the latest snapshot the frame used
+
+            explicit LateLatch(Learus_Simulation::Simulation & _simulation)
+            : hasInput(false), step(0), simulation(_simulation)
+            {
+            }
+
+            // At the start of the frame. The returned snapshot is only valid until latch().
+            const Learus_Simulation::Snapshot & begin()
+            {
+                hasInput = false;
+                const Learus_Simulation::Snapshot & snapshot = simulation.latest();
+                take(snapshot);
+                return snapshot;
+            }
+
+            bool latch(Camera & camera)
+            {
+                const Learus_Simulation::Snapshot * snapshot = simulation.relatch();
+                if (!snapshot)
+                    return false;
+
+                camera = snapshot->camera;
+                take(*snapshot);
+                return true;
+            }
+
+        private:
+            Learus_Simulation::Simulation & simulation;
+            Clock::time_point lastInput;    // Newest input any frame took, so a snapshot read again does not count it twice
+
+            // Published and latched both come from the snapshot the frame ends up showing, so the stages between
+            // them add up
+            void take(const Learus_Simulation::Snapshot & snapshot)
+            {
+                times.latched = Clock::now();
+                times.applied = snapshot.published;
+                step = snapshot.step;
+
+                // The oldest input is the one the latency is measured from. The simulation keeps an input in its
+                // snapshots until one is read, so the same one can come round again.
+                if (snapshot.inputTime <= lastInput)
+                    return;
+
+                lastInput = snapshot.inputTime;
+                if (!hasInput)
+                {
+                    times.input = snapshot.inputTime;
+                    hasInput = true;
+                }
+            }
+
+            LateLatch(const LateLatch &);
+            LateLatch & operator=(const LateLatch &);
+    };
+
+    // Input to photon latency, per stage. The last stage ends when the GPU has finished the frame, as the GPU profiler
+    // reads it back: the end of the frame's last scope, moved onto the CPU clock with the profiler's clock pair, so it
+    // does not depend on when the render thread gets round to looking. When the display scans the frame out is not
+    // visible to the application.
+    class LatencyTracker : public Learus_Profiler::FrameListener
+    {
+        public:
+            explicit LatencyTracker(Learus_Profiler::GpuProfiler & _profiler)
+            : profiler(_profiler), count(0), first(0), pendingCount(0), dropped(0)
+            {
+                for (unsigned int i = 0; i < STAGES; i++)
+                    total[i] = worst[i] = 0.0;
+
+                profiler.enable();
+                profiler.listen(this);
+            }
+
+            ~LatencyTracker()
+            {
+                profiler.unlisten(this);
+            }
+
+            // Right after the swap, for a frame that carries input
+            void submitted(const FrameTimes & times)
+            {
+                // The profiler left the frame untimed
+                unsigned long frame = profiler.frame();
+                if (frame == 0)
+                {
+                    dropped++;
+                    return;
+                }
+
+                if (pendingCount == MAX_PENDING)
+                {
+                    first = (first + 1) % MAX_PENDING;
+                    pendingCount--;
+                    dropped++;
+                }
+
+                Pending & slot = pending[(first + pendingCount++) % MAX_PENDING];
+                slot.times = times;
+                slot.frame = frame;
+            }
+
+            void gpuFrame(const Learus_Profiler::GpuProfiler & gpu)
+            {
+                // Frames that were never read back, having no scopes, are passed over
+                while (pendingCount > 0 && pending[first].frame <= gpu.lastFrame)
+                {
+                    const Pending & slot = pending[first];
+
+                    // A GPU that was done before the swap adds nothing
+                    if (slot.frame == gpu.lastFrame)
+                        add(slot.times, std::max(gpu.lastFinished, slot.times.submitted));
+                    else
+                        dropped++;
+
+                    first = (first + 1) % MAX_PENDING;
+                    pendingCount--;
+                }
+            }
+
+            void printStats() const
+            {
+                if (count == 0)
+                    return;
+
+                static const char * names[STAGES] = { "simulation", "render thread", "recording", "GPU", "total" };
+
+                std::cout << "Input latency over " << count << " frames (mean / worst ms):";
+                for (unsigned int i = 0; i < STAGES; i++)
+                    std::cout << (i ? ", " : " ") << names[i] << " " << total[i] / count << " / " << worst[i];
+                if (dropped)
+                    std::cout << ", " << dropped << " frames not measured";
+                std::cout << std::endl;
+            }
+
+        private:
+            static const unsigned int STAGES = 5;
+            static const unsigned int MAX_PENDING = Learus_Profiler::GpuProfiler::LATENCY + 1;
+
+            struct Pending
+            {
+                FrameTimes times;
+                unsigned long frame;    // The profiler's number for it
+            };
+
+            Learus_Profiler::GpuProfiler & profiler;
+
+            unsigned long count;
+            double total[STAGES];
+            double worst[STAGES];
+
+            // Oldest first, a ring of MAX_PENDING slots
+            Pending pending[MAX_PENDING];
+            unsigned int first;
+            unsigned int pendingCount;
+            unsigned long dropped;
+
+            void add(const FrameTimes & times, Clock::time_point presented)
+            {
+                double stages[STAGES] =
+                {
+                    milliseconds(times.applied - times.input),
+                    milliseconds(times.latched - times.applied),
+                    milliseconds(times.submitted - times.latched),
+                    milliseconds(presented - times.submitted),
+                    milliseconds(presented - times.input)
+                };
+
+                for (unsigned int i = 0; i < STAGES; i++)
+                {
+                    total[i] += stages[i];
+                    worst[i] = std::max(worst[i], stages[i]);
+                }
+                count++;
+            }
+
+            LatencyTracker(const LatencyTracker &);
+            LatencyTracker & operator=(const LatencyTracker &);
+    };
+}
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "frame_arena.h"
+#include "resource_registry.h"
+
+#include <cstddef>
+#include <vector>
+
+struct Vertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+namespace Learus_Geometry
+{
+    // Same layout as the struct glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Where a mesh lives inside the arena buffers
+    struct Allocation
+    {
+        GLuint firstIndex = 0;
+        GLuint indexCount = 0;
+        GLint baseVertex = 0;
+        GLuint vertexCount = 0;
+    };
+
+    struct DrawStats
+    {
+        unsigned long commands = 0;     // Meshes drawn
+        unsigned long drawCalls = 0;    // Actual GL draw calls issued for them
+        unsigned long triangles = 0;
+    };
+
+    // Collects draws against one GeometryArena and submits them as a single multi-draw.
+    // Uses glMultiDrawElementsIndirect when the driver has it, and glMultiDrawElementsBaseVertex (core 3.2) otherwise.
+    class DrawBuilder
+    {
+        public:
+            DrawStats stats;
+
+            DrawBuilder() : indirectBuffer(0), indirectCapacity(0) {}
+
+            ~DrawBuilder()
+            {
+                if (indirectBuffer != 0)
+                {
+                    Learus_Resources::registry().release(Learus_Resources::KIND_BUFFER, indirectBuffer);
+                    glDeleteBuffers(1, &indirectBuffer);
+                }
+            }
+
+            void add(const Allocation & allocation, GLuint instanceCount = 1)
+            {
+                DrawElementsIndirectCommand command;
+                command.count = allocation.indexCount;
+                command.instanceCount = instanceCount;
+                command.firstIndex = allocation.firstIndex;
+                command.baseVertex = allocation.baseVertex;
+                command.baseInstance = 0;
+
+                commands.push_back(command);
+            }
+
+            bool empty() const
+            {
+                return commands.empty();
+            }
+
+            // Expects the arena VAO to be bound
+            void submit(GLenum mode = GL_TRIANGLES)
+            {
+                if (commands.empty())
+                    return;
+
+                Learus_GLExt::Functions & ext = Learus_GLExt::get();
+
+                if (ext.MultiDrawElementsIndirect)
+                {
+                    GLsizeiptr size = commands.size() * sizeof(DrawElementsIndirectCommand);
+
+                    if (indirectBuffer == 0)
+                    {
+                        glGenBuffers(1, &indirectBuffer);
+                        Learus_Resources::registry().track(Learus_Resources::KIND_BUFFER, indirectBuffer, Learus_Resources::SUB_GEOMETRY, 0, "indirect draws");
+                    }
+
+                    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+                    // Orphan the old storage instead of waiting for the previous pass to finish with it
+                    if (size > indirectCapacity)
+                    {
+                        indirectCapacity = size * 2;
+                        Learus_Resources::registry().resize(Learus_Resources::KIND_BUFFER, indirectBuffer, indirectCapacity);
+                    }
+                    glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity, NULL, GL_STREAM_DRAW);
+                    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, &commands[0]);
+
+                    ext.MultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (void *)0, commands.size(), 0);
+
+                    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+                }
+                else
+                {
+                    // Only needed for this call, so they come out of the frame arena
+                    Learus_Memory::FrameArena & scratch = Learus_Memory::frameArena();
+                    GLsizei * counts = scratch.allocateArray<GLsizei>(commands.size());
+                    const void ** offsets = scratch.allocateArray<const void *>(commands.size());
+                    GLint * baseVertices = scratch.allocateArray<GLint>(commands.size());
+
+                    for (unsigned int i = 0; i < commands.size(); i++)
+                    {
+                        counts[i] = commands[i].count;
+                        offsets[i] = (const void *)(commands[i].firstIndex * sizeof(GLuint));
+                        baseVertices[i] = commands[i].baseVertex;
+                    }
+
+                    glMultiDrawElementsBaseVertex(mode, counts, GL_UNSIGNED_INT, offsets, commands.size(), baseVertices);
+                }
+
+                if (mode == GL_TRIANGLES)
+                {
+                    for (unsigned int i = 0; i < commands.size(); i++)
+                        stats.triangles += (unsigned long)commands[i].count / 3 * commands[i].instanceCount;
+                }
+
+                stats.commands += commands.size();
+                stats.drawCalls++;
+
+                commands.clear();
+            }
+
+        private:
+            std::vector<DrawElementsIndirectCommand> commands;
+
+            GLuint indirectBuffer;
+            GLsizeiptr indirectCapacity;
+
+            DrawBuilder(const DrawBuilder &);
+            DrawBuilder & operator=(const DrawBuilder &);
+    };
+
+    // Sub-allocates the vertex and index data of every Mesh from one VBO / EBO pair behind one VAO.
+    // Buffers grow by doubling and copying on the GPU, so allocations never move relative to each other.
+    class GeometryArena
+    {
+        public:
+            DrawBuilder draws;
+
+            GeometryArena(GLuint _vertex_capacity = 1 << 16, GLuint _index_capacity = 1 << 18)
+            : vertexCapacity(_vertex_capacity), indexCapacity(_index_capacity), vertexCount(0), indexCount(0)
+            {
+                glGenVertexArrays(1, &VAO);
+                glGenBuffers(1, &VBO);
+                glGenBuffers(1, &EBO);
+
+                Learus_GLState::current().bindVertexArray(VAO);
+
+                glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+                setupAttributes();
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_VERTEX_ARRAY, VAO, Learus_Resources::SUB_GEOMETRY, 0, "geometry arena");
+                resources.track(Learus_Resources::KIND_BUFFER, VBO, Learus_Resources::SUB_GEOMETRY, vertexCapacity * sizeof(Vertex), "arena vertices");
+                resources.track(Learus_Resources::KIND_BUFFER, EBO, Learus_Resources::SUB_GEOMETRY, indexCapacity * sizeof(GLuint), "arena indices");
+            }
+
+            ~GeometryArena()
+            {
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_VERTEX_ARRAY, VAO);
+                resources.release(Learus_Resources::KIND_BUFFER, VBO);
+                resources.release(Learus_Resources::KIND_BUFFER, EBO);
+
+                Learus_GLState::current().forgetVertexArray(VAO);
+                glDeleteVertexArrays(1, &VAO);
+                glDeleteBuffers(1, &VBO);
+                glDeleteBuffers(1, &EBO);
+            }
+
+            Allocation allocate(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices)
+            {
+                Allocation allocation;
+                allocation.baseVertex = vertexCount;
+                allocation.vertexCount = vertices.size();
+                allocation.firstIndex = indexCount;
+                allocation.indexCount = indices.size();
+
+                if (vertexCount + vertices.size() > vertexCapacity)
+                {
+                    GLuint capacity = vertexCapacity;
+                    while (vertexCount + vertices.size() > capacity)
+                        capacity *= 2;
+
+                    grow(GL_ARRAY_BUFFER, VBO, vertexCount * sizeof(Vertex), capacity * sizeof(Vertex), "arena vertices");
+                    vertexCapacity = capacity;
+                }
+
+                if (indexCount + indices.size() > indexCapacity)
+                {
+                    GLuint capacity = indexCapacity;
+                    while (indexCount + indices.size() > capacity)
+                        capacity *= 2;
+
+                    grow(GL_ELEMENT_ARRAY_BUFFER, EBO, indexCount * sizeof(GLuint), capacity * sizeof(GLuint), "arena indices");
+                    indexCapacity = capacity;
+                }
+
+                if (!vertices.empty())
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                    glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices.size() * sizeof(Vertex), &vertices[0]);
+                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+                }
+
+                if (!indices.empty())
+                {
+                    // The element buffer binding is VAO state, so go through a neutral target
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+                    glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                }
+
+                vertexCount += vertices.size();
+                indexCount += indices.size();
+
+                return allocation;
+            }
+
+            // Another index range over the vertices of an earlier allocation, e.g. a coarser level of detail
+            Allocation allocateIndices(const Allocation & shared, const std::vector<unsigned int> & indices)
+            {
+                Allocation allocation = allocate(std::vector<Vertex>(), indices);
+                allocation.baseVertex = shared.baseVertex;
+                allocation.vertexCount = shared.vertexCount;
+                return allocation;
+            }
+
+            void bind()
+            {
+                Learus_GLState::current().bindVertexArray(VAO);
+            }
+
+            // Copies an allocation back from the GPU, for code that needs the geometry on the CPU
+            void read(const Allocation & allocation, std::vector<Vertex> & vertices, std::vector<unsigned int> & indices)
+            {
+                vertices.resize(allocation.vertexCount);
+                indices.resize(allocation.indexCount);
+
+                if (!vertices.empty())
+                {
+                    glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+                    glGetBufferSubData(GL_COPY_READ_BUFFER, allocation.baseVertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), &vertices[0]);
+                }
+
+                if (!indices.empty())
+                {
+                    glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+                    glGetBufferSubData(GL_COPY_READ_BUFFER, allocation.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+                }
+
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+
+        private:
+            unsigned int VAO, VBO, EBO;
+
+            GLuint vertexCapacity, indexCapacity;
+            GLuint vertexCount, indexCount;
+
+            void setupAttributes()
+            {
+                // Vertex positions
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+                // Vertex normals
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+                // Vertex texture coordinates
+                glEnableVertexAttribArray(2);
+                glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+            }
+
+            // Replaces buffer with a bigger one holding the same first usedBytes, and re-points the VAO at it
+            void grow(GLenum target, unsigned int & buffer, GLsizeiptr usedBytes, GLsizeiptr newBytes, const char * label)
+            {
+                unsigned int bigger;
+                glGenBuffers(1, &bigger);
+
+                glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+                glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+
+                if (usedBytes > 0)
+                {
+                    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+                    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                }
+
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                Learus_Resources::registry().release(Learus_Resources::KIND_BUFFER, buffer);
+                glDeleteBuffers(1, &buffer);
+                buffer = bigger;
+                Learus_Resources::registry().track(Learus_Resources::KIND_BUFFER, buffer, Learus_Resources::SUB_GEOMETRY, newBytes, label);
+
+                Learus_GLState::current().bindVertexArray(VAO);
+                glBindBuffer(target, buffer);
+                if (target == GL_ARRAY_BUFFER)
+                {
+                    setupAttributes();
+                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+                }
+            }
+
+            GeometryArena(const GeometryArena &);
+            GeometryArena & operator=(const GeometryArena &);
+    };
+}
+
+#endif
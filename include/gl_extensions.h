@@ -0,0 +1,100 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include "../lib/glad/glad.h"
+#include <cstring>
+
+// The bundled glad loader only covers core GL 3.3. Anything newer is loaded here at runtime
+// and left as nullptr when the driver does not support it, so callers must check before use.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+    #define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    #define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+    #define GL_PROGRAM_BINARY_LENGTH 0x8741
+    #define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace Learus_GLExt
+{
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void * indirect, GLsizei drawcount, GLsizei stride);
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei * length, GLenum * binaryFormat, void * binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void * binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+    struct Functions
+    {
+        MultiDrawElementsIndirectProc MultiDrawElementsIndirect = nullptr;
+
+        // GL 4.1 / ARB_get_program_binary. Only set when the driver also offers at least one binary format.
+        GetProgramBinaryProc GetProgramBinary = nullptr;
+        ProgramBinaryProc ProgramBinary = nullptr;
+        ProgramParameteriProc ProgramParameteri = nullptr;
+
+        // KHR_parallel_shader_compile. When set, GL_COMPLETION_STATUS_KHR can be polled without blocking.
+        MaxShaderCompilerThreadsProc MaxShaderCompilerThreads = nullptr;
+    };
+
+    inline Functions & get()
+    {
+        static Functions functions;
+        return functions;
+    }
+
+    inline bool versionAtLeast(int major, int minor)
+    {
+        return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+    }
+
+    // Needs a current context
+    inline bool hasExtension(const char * name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+        for (GLint i = 0; i < count; i++)
+        {
+            const char * ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && std::strcmp(ext, name) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Call once after gladLoadGLLoader, with the same loader function
+    inline void load(GLADloadproc loader)
+    {
+        Functions & f = get();
+
+        if (versionAtLeast(4, 3) || hasExtension("GL_ARB_multi_draw_indirect"))
+            f.MultiDrawElementsIndirect = (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect");
+
+        if (versionAtLeast(4, 1) || hasExtension("GL_ARB_get_program_binary"))
+        {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+            if (formats > 0)
+            {
+                f.GetProgramBinary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+                f.ProgramBinary = (ProgramBinaryProc)loader("glProgramBinary");
+                f.ProgramParameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+            }
+        }
+
+        if (hasExtension("GL_KHR_parallel_shader_compile"))
+            f.MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+        else if (hasExtension("GL_ARB_parallel_shader_compile"))
+            f.MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+    }
+}
+
+#endif
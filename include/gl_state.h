@@ -0,0 +1,176 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "../lib/glad/glad.h"
+
+// Shadows the bits of GL state that change between draws and drops calls that would not change anything.
+// Every glUseProgram / glBindVertexArray / glActiveTexture / glBindTexture in the app must go through here,
+// otherwise the shadow copy goes stale.
+namespace Learus_GLState
+{
+    const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    struct Counter
+    {
+        unsigned long requested = 0;    // Calls the renderer asked for
+        unsigned long issued = 0;       // Calls that actually reached GL
+    };
+
+    struct Stats
+    {
+        Counter programs;
+        Counter vertexArrays;
+        Counter textures;
+        Counter activeTextures;
+        Counter depthMasks;
+
+        unsigned long requested() const
+        {
+            return programs.requested + vertexArrays.requested + textures.requested + activeTextures.requested + depthMasks.requested;
+        }
+
+        unsigned long issued() const
+        {
+            return programs.issued + vertexArrays.issued + textures.issued + activeTextures.issued + depthMasks.issued;
+        }
+    };
+
+    class StateCache
+    {
+        public:
+            Stats stats;
+
+            StateCache()
+            {
+                invalidate();
+            }
+
+            // Forget everything, e.g. after code outside the app touched the context
+            void invalidate()
+            {
+                program = INVALID;
+                vertexArray = INVALID;
+                activeUnit = INVALID;
+                depthMask = -1;
+
+                for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+                {
+                    texture2D[i] = INVALID;
+                    textureCube[i] = INVALID;
+                }
+            }
+
+            void useProgram(GLuint id)
+            {
+                stats.programs.requested++;
+                if (program == id)
+                    return;
+
+                glUseProgram(id);
+                program = id;
+                stats.programs.issued++;
+            }
+
+            void bindVertexArray(GLuint id)
+            {
+                stats.vertexArrays.requested++;
+                if (vertexArray == id)
+                    return;
+
+                glBindVertexArray(id);
+                vertexArray = id;
+                stats.vertexArrays.issued++;
+            }
+
+            void activeTexture(unsigned int unit)
+            {
+                stats.activeTextures.requested++;
+                if (activeUnit == unit)
+                    return;
+
+                glActiveTexture(GL_TEXTURE0 + unit);
+                activeUnit = unit;
+                stats.activeTextures.issued++;
+            }
+
+            // Binds texture to the given unit. Only switches the active unit when the binding actually changes.
+            void bindTexture(unsigned int unit, GLenum target, GLuint id)
+            {
+                stats.textures.requested++;
+
+                GLuint * slot = NULL;
+                if (unit < MAX_TEXTURE_UNITS)
+                    slot = (target == GL_TEXTURE_CUBE_MAP) ? &textureCube[unit] : &texture2D[unit];
+
+                if (slot && *slot == id)
+                    return;
+
+                activeTexture(unit);
+                glBindTexture(target, id);
+                stats.textures.issued++;
+
+                if (slot)
+                    *slot = id;
+            }
+
+            void setDepthMask(bool enabled)
+            {
+                stats.depthMasks.requested++;
+                if (depthMask == (int)enabled)
+                    return;
+
+                glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+                depthMask = enabled;
+                stats.depthMasks.issued++;
+            }
+
+            // GL unbinds deleted objects and may hand their names out again, so the shadow copy has to drop them too
+            void forgetProgram(GLuint id)
+            {
+                if (program == id)
+                    program = INVALID;
+            }
+
+            void forgetVertexArray(GLuint id)
+            {
+                if (vertexArray == id)
+                    vertexArray = INVALID;
+            }
+
+            void forgetTexture(GLuint id)
+            {
+                for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+                {
+                    if (texture2D[i] == id)
+                        texture2D[i] = INVALID;
+                    if (textureCube[i] == id)
+                        textureCube[i] = INVALID;
+                }
+            }
+
+            GLuint currentProgram() const
+            {
+                return program;
+            }
+
+        private:
+            static const GLuint INVALID = 0xFFFFFFFFu;
+
+            GLuint program;
+            GLuint vertexArray;
+            unsigned int activeUnit;
+            int depthMask;
+
+            GLuint texture2D[MAX_TEXTURE_UNITS];
+            GLuint textureCube[MAX_TEXTURE_UNITS];
+    };
+
+    // The app has a single GL context, so a single cache
+    inline StateCache & current()
+    {
+        static StateCache cache;
+        return cache;
+    }
+}
+
+#endif
@@ -0,0 +1,1236 @@
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#include "../lib/glad/glad.h"
+
+#include "gl_extensions.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// A layer between the renderer and the driver. install() swaps every glad function pointer the renderer uses (and the
+// runtime loaded ones in gl_extensions.h) for a wrapper, so that each call can be
+//   * counted per entry point and per frame, and checked against per frame budgets,
+//   * written to a binary trace that Replayer plays back on its own, without the scene or any assets,
+//   * swallowed by a null driver that needs no GL context at all, to measure the CPU side of rendering alone.
+namespace Learus_GLTrace
+{
+    // Every entry point the renderer calls, one line each:
+    //   return type, name without gl, parameters, arguments, what goes into a trace, null driver result, replay mode
+    // Pointer arguments have to say what they point at: data(pointer, bytes) is copied into the trace, offset() is an
+    // offset into a bound buffer, out() marks memory the call writes to.
+#define LEARUS_GL_CALLS(X) \
+    X(void, ActiveTexture, (GLenum texture), (texture), (texture), (void)0, REPLAY_CALL) \
+    X(void, AttachShader, (GLuint program, GLuint shader), (program, shader), (program, shader), (void)0, REPLAY_CALL) \
+    X(void, BeginQuery, (GLenum target, GLuint id), (target, id), (target, id), (void)0, REPLAY_CALL) \
+    X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer), (target, buffer), (void)0, REPLAY_CALL) \
+    X(void, BindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer), (target, index, buffer), (void)0, REPLAY_CALL) \
+    X(void, BindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer), (target, framebuffer), (void)0, REPLAY_CALL) \
+    X(void, BindRenderbuffer, (GLenum target, GLuint renderbuffer), (target, renderbuffer), (target, renderbuffer), (void)0, REPLAY_CALL) \
+    X(void, BindTexture, (GLenum target, GLuint texture), (target, texture), (target, texture), (void)0, REPLAY_CALL) \
+    X(void, BindVertexArray, (GLuint array), (array), (array), (void)0, REPLAY_CALL) \
+    X(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), (sfactor, dfactor), (void)0, REPLAY_CALL) \
+    X(void, BlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), \
+      (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter), (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter), (void)0, REPLAY_CALL) \
+    X(void, BufferData, (GLenum target, GLsizeiptr size, const void * data, GLenum usage), (target, size, data, usage), (target, size, Pointer::data(data, size), usage), (void)0, REPLAY_CALL) \
+    X(void, BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void * data), (target, offset, size, data), (target, offset, size, Pointer::data(data, size)), (void)0, REPLAY_CALL) \
+    X(GLenum, CheckFramebufferStatus, (GLenum target), (target), (target), (GLenum)GL_FRAMEBUFFER_COMPLETE, REPLAY_SKIP) \
+    X(void, Clear, (GLbitfield mask), (mask), (mask), (void)0, REPLAY_CALL) \
+    X(void, ClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha), (red, green, blue, alpha), (void)0, REPLAY_CALL) \
+    X(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout), (sync, flags, timeout), (GLenum)GL_ALREADY_SIGNALED, REPLAY_SKIP) \
+    X(void, CompileShader, (GLuint shader), (shader), (shader), (void)0, REPLAY_CALL) \
+    X(void, CopyBufferSubData, (GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size), \
+      (readTarget, writeTarget, readOffset, writeOffset, size), (readTarget, writeTarget, readOffset, writeOffset, size), (void)0, REPLAY_CALL) \
+    X(GLuint, CreateProgram, (void), (), (), l.nullName(), REPLAY_CREATE) \
+    X(GLuint, CreateShader, (GLenum type), (type), (type), l.nullName(), REPLAY_CREATE) \
+    X(void, DeleteBuffers, (GLsizei n, const GLuint * buffers), (n, buffers), (n, Pointer::data(buffers, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DeleteFramebuffers, (GLsizei n, const GLuint * framebuffers), (n, framebuffers), (n, Pointer::data(framebuffers, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DeleteProgram, (GLuint program), (program), (program), (void)0, REPLAY_CALL) \
+    X(void, DeleteQueries, (GLsizei n, const GLuint * ids), (n, ids), (n, Pointer::data(ids, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DeleteRenderbuffers, (GLsizei n, const GLuint * renderbuffers), (n, renderbuffers), (n, Pointer::data(renderbuffers, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DeleteShader, (GLuint shader), (shader), (shader), (void)0, REPLAY_CALL) \
+    X(void, DeleteSync, (GLsync sync), (sync), (sync), (void)0, REPLAY_CALL) \
+    X(void, DeleteTextures, (GLsizei n, const GLuint * textures), (n, textures), (n, Pointer::data(textures, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DeleteVertexArrays, (GLsizei n, const GLuint * arrays), (n, arrays), (n, Pointer::data(arrays, n * sizeof(GLuint))), (void)0, REPLAY_CALL) \
+    X(void, DepthMask, (GLboolean flag), (flag), (flag), (void)0, REPLAY_CALL) \
+    X(void, Disable, (GLenum cap), (cap), (cap), (void)0, REPLAY_CALL) \
+    X(void, DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count), (mode, first, count), (void)0, REPLAY_CALL) \
+    X(void, DrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount), (mode, first, count, instancecount), (mode, first, count, instancecount), (void)0, REPLAY_CALL) \
+    X(void, DrawElementsBaseVertex, (GLenum mode, GLsizei count, GLenum type, const void * indices, GLint basevertex), \
+      (mode, count, type, indices, basevertex), (mode, count, type, Pointer::offset(indices), basevertex), (void)0, REPLAY_CALL) \
+    X(void, Enable, (GLenum cap), (cap), (cap), (void)0, REPLAY_CALL) \
+    X(void, EnableVertexAttribArray, (GLuint index), (index), (index), (void)0, REPLAY_CALL) \
+    X(void, EndQuery, (GLenum target), (target), (target), (void)0, REPLAY_CALL) \
+    X(GLsync, FenceSync, (GLenum condition, GLbitfield flags), (condition, flags), (condition, flags), (GLsync)(uintptr_t)l.nullName(), REPLAY_CALL) \
+    X(void, Finish, (void), (), (), (void)0, REPLAY_CALL) \
+    X(void, Flush, (void), (), (), (void)0, REPLAY_CALL) \
+    X(void, FramebufferRenderbuffer, (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), \
+      (target, attachment, renderbuffertarget, renderbuffer), (target, attachment, renderbuffertarget, renderbuffer), (void)0, REPLAY_CALL) \
+    X(void, FramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), \
+      (target, attachment, textarget, texture, level), (target, attachment, textarget, texture, level), (void)0, REPLAY_CALL) \
+    X(void, GenBuffers, (GLsizei n, GLuint * buffers), (n, buffers), (n, Pointer::data(buffers, n * sizeof(GLuint))), l.nullNames(n, buffers), REPLAY_GEN) \
+    X(void, GenFramebuffers, (GLsizei n, GLuint * framebuffers), (n, framebuffers), (n, Pointer::data(framebuffers, n * sizeof(GLuint))), l.nullNames(n, framebuffers), REPLAY_GEN) \
+    X(void, GenQueries, (GLsizei n, GLuint * ids), (n, ids), (n, Pointer::data(ids, n * sizeof(GLuint))), l.nullNames(n, ids), REPLAY_GEN) \
+    X(void, GenRenderbuffers, (GLsizei n, GLuint * renderbuffers), (n, renderbuffers), (n, Pointer::data(renderbuffers, n * sizeof(GLuint))), l.nullNames(n, renderbuffers), REPLAY_GEN) \
+    X(void, GenTextures, (GLsizei n, GLuint * textures), (n, textures), (n, Pointer::data(textures, n * sizeof(GLuint))), l.nullNames(n, textures), REPLAY_GEN) \
+    X(void, GenVertexArrays, (GLsizei n, GLuint * arrays), (n, arrays), (n, Pointer::data(arrays, n * sizeof(GLuint))), l.nullNames(n, arrays), REPLAY_GEN) \
+    X(void, GenerateMipmap, (GLenum target), (target), (target), (void)0, REPLAY_CALL) \
+    X(void, GetActiveUniform, (GLuint program, GLuint index, GLsizei bufSize, GLsizei * length, GLint * size, GLenum * type, GLchar * name), \
+      (program, index, bufSize, length, size, type, name), (program, index, bufSize, Pointer::out(), Pointer::out(), Pointer::out(), Pointer::out()), l.nullString(bufSize, length, name), REPLAY_SKIP) \
+    X(void, GetActiveUniformBlockName, (GLuint program, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei * length, GLchar * uniformBlockName), \
+      (program, uniformBlockIndex, bufSize, length, uniformBlockName), (program, uniformBlockIndex, bufSize, Pointer::out(), Pointer::out()), l.nullString(bufSize, length, uniformBlockName), REPLAY_SKIP) \
+    X(void, GetBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, void * data), (target, offset, size, data), (target, offset, size, Pointer::out()), std::memset(data, 0, size), REPLAY_SKIP) \
+    X(void, GetInteger64v, (GLenum pname, GLint64 * data), (pname, data), (pname, Pointer::out()), *data = 0, REPLAY_SKIP) \
+    X(void, GetIntegerv, (GLenum pname, GLint * data), (pname, data), (pname, Pointer::out()), *data = 0, REPLAY_SKIP) \
+    X(void, GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei * length, GLchar * infoLog), (program, bufSize, length, infoLog), \
+      (program, bufSize, Pointer::out(), Pointer::out()), l.nullString(bufSize, length, infoLog), REPLAY_SKIP) \
+    X(void, GetProgramiv, (GLuint program, GLenum pname, GLint * params), (program, pname, params), (program, pname, Pointer::out()), \
+      *params = (pname == GL_LINK_STATUS || pname == GL_COMPLETION_STATUS_KHR) ? GL_TRUE : 0, REPLAY_SKIP) \
+    X(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint * params), (id, pname, params), (id, pname, Pointer::out()), *params = 1, REPLAY_SKIP) \
+    X(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64 * params), (id, pname, params), (id, pname, Pointer::out()), *params = 0, REPLAY_SKIP) \
+    X(void, GetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei * length, GLchar * infoLog), (shader, bufSize, length, infoLog), \
+      (shader, bufSize, Pointer::out(), Pointer::out()), l.nullString(bufSize, length, infoLog), REPLAY_SKIP) \
+    X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint * params), (shader, pname, params), (shader, pname, Pointer::out()), \
+      *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0, REPLAY_SKIP) \
+    X(const GLubyte *, GetString, (GLenum name), (name), (name), l.nullString(name), REPLAY_SKIP) \
+    X(const GLubyte *, GetStringi, (GLenum name, GLuint index), (name, index), (name, index), (const GLubyte *)"", REPLAY_SKIP) \
+    X(void, GetTexImage, (GLenum target, GLint level, GLenum format, GLenum type, void * pixels), (target, level, format, type, pixels), \
+      (target, level, format, type, Pointer::out()), (void)0, REPLAY_SKIP) \
+    X(void, GetTexLevelParameteriv, (GLenum target, GLint level, GLenum pname, GLint * params), (target, level, pname, params), \
+      (target, level, pname, Pointer::out()), *params = 0, REPLAY_SKIP) \
+    X(GLint, GetUniformLocation, (GLuint program, const GLchar * name), (program, name), (program, Pointer::string(name)), -1, REPLAY_SKIP) \
+    X(void, LinkProgram, (GLuint program), (program), (program), (void)0, REPLAY_CALL) \
+    X(void *, MapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access), \
+      (target, offset, length, access), l.nullMap(length), REPLAY_SKIP) \
+    X(void, MultiDrawElementsBaseVertex, (GLenum mode, const GLsizei * count, GLenum type, const void * const * indices, GLsizei drawcount, const GLint * basevertex), \
+      (mode, count, type, indices, drawcount, basevertex), \
+      (mode, Pointer::data(count, drawcount * sizeof(GLsizei)), type, Pointers::offsets(drawcount, indices), drawcount, Pointer::data(basevertex, drawcount * sizeof(GLint))), (void)0, REPLAY_CALL) \
+    X(void, PixelStorei, (GLenum pname, GLint param), (pname, param), (pname, param), (void)0, REPLAY_CALL) \
+    X(void, QueryCounter, (GLuint id, GLenum target), (id, target), (id, target), (void)0, REPLAY_CALL) \
+    X(void, ReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void * pixels), (x, y, width, height, format, type, pixels), \
+      (x, y, width, height, format, type, l.packBuffer ? Pointer::offset(pixels) : Pointer::out(imageBytes(width, height, format, type, l.packAlignment, l.packRowLength))), (void)0, REPLAY_CALL) \
+    X(void, RenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), (target, internalformat, width, height), \
+      (target, internalformat, width, height), (void)0, REPLAY_CALL) \
+    X(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar * const * string, const GLint * length), (shader, count, string, length), \
+      (shader, count, Pointers::strings(count, string, length), Pointer::data(length, count * sizeof(GLint))), (void)0, REPLAY_CALL) \
+    X(void, TexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void * pixels), \
+      (target, level, internalformat, width, height, border, format, type, pixels), \
+      (target, level, internalformat, width, height, border, format, type, l.unpackBuffer ? Pointer::offset(pixels) : Pointer::data(pixels, imageBytes(width, height, format, type, l.unpackAlignment, l.unpackRowLength))), (void)0, REPLAY_CALL) \
+    X(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param), (target, pname, param), (void)0, REPLAY_CALL) \
+    X(void, TexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels), \
+      (target, level, xoffset, yoffset, width, height, format, type, pixels), \
+      (target, level, xoffset, yoffset, width, height, format, type, l.unpackBuffer ? Pointer::offset(pixels) : Pointer::data(pixels, imageBytes(width, height, format, type, l.unpackAlignment, l.unpackRowLength))), (void)0, REPLAY_CALL) \
+    X(void, Uniform1f, (GLint location, GLfloat v0), (location, v0), (location, v0), (void)0, REPLAY_CALL) \
+    X(void, Uniform1i, (GLint location, GLint v0), (location, v0), (location, v0), (void)0, REPLAY_CALL) \
+    X(void, Uniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1), (location, v0, v1), (void)0, REPLAY_CALL) \
+    X(void, Uniform2fv, (GLint location, GLsizei count, const GLfloat * value), (location, count, value), (location, count, Pointer::data(value, count * 2 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(void, Uniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2), (location, v0, v1, v2), (void)0, REPLAY_CALL) \
+    X(void, Uniform3fv, (GLint location, GLsizei count, const GLfloat * value), (location, count, value), (location, count, Pointer::data(value, count * 3 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(void, Uniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), (location, v0, v1, v2, v3), (location, v0, v1, v2, v3), (void)0, REPLAY_CALL) \
+    X(void, Uniform4fv, (GLint location, GLsizei count, const GLfloat * value), (location, count, value), (location, count, Pointer::data(value, count * 4 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(void, UniformBlockBinding, (GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding), (program, uniformBlockIndex, uniformBlockBinding), \
+      (program, uniformBlockIndex, uniformBlockBinding), (void)0, REPLAY_CALL) \
+    X(void, UniformMatrix2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat * value), (location, count, transpose, value), \
+      (location, count, transpose, Pointer::data(value, count * 4 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(void, UniformMatrix3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat * value), (location, count, transpose, value), \
+      (location, count, transpose, Pointer::data(value, count * 9 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(void, UniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat * value), (location, count, transpose, value), \
+      (location, count, transpose, Pointer::data(value, count * 16 * sizeof(GLfloat))), (void)0, REPLAY_CALL) \
+    X(GLboolean, UnmapBuffer, (GLenum target), (target), (target), (GLboolean)GL_TRUE, REPLAY_SKIP) \
+    X(void, UseProgram, (GLuint program), (program), (program), (void)0, REPLAY_CALL) \
+    X(void, VertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor), (index, divisor), (void)0, REPLAY_CALL) \
+    X(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void * pointer), \
+      (index, size, type, normalized, stride, pointer), (index, size, type, normalized, stride, Pointer::offset(pointer)), (void)0, REPLAY_CALL) \
+    X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), (x, y, width, height), (void)0, REPLAY_CALL)
+
+    // The same for the functions gl_extensions.h loads. The null driver leaves them unset, like a driver without them.
+#define LEARUS_GL_EXT_CALLS(X) \
+    X(void, MultiDrawElementsIndirect, (GLenum mode, GLenum type, const void * indirect, GLsizei drawcount, GLsizei stride), (mode, type, indirect, drawcount, stride), \
+      (mode, type, Pointer::offset(indirect), drawcount, stride), (void)0, REPLAY_CALL) \
+    X(void, GetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei * length, GLenum * binaryFormat, void * binary), (program, bufSize, length, binaryFormat, binary), \
+      (program, bufSize, Pointer::out(), Pointer::out(), Pointer::out()), (void)0, REPLAY_SKIP) \
+    X(void, ProgramBinary, (GLuint program, GLenum binaryFormat, const void * binary, GLsizei length), (program, binaryFormat, binary, length), \
+      (program, binaryFormat, Pointer::data(binary, length), length), (void)0, REPLAY_CALL) \
+    X(void, ProgramParameteri, (GLuint program, GLenum pname, GLint value), (program, pname, value), (program, pname, value), (void)0, REPLAY_CALL) \
+    X(void, MaxShaderCompilerThreads, (GLuint count), (count), (count), (void)0, REPLAY_CALL)
+
+    enum Call
+    {
+#define LEARUS_GL_ENUM(R, name, params, args, recorded, null, replay) CALL_##name,
+        LEARUS_GL_CALLS(LEARUS_GL_ENUM)
+        LEARUS_GL_EXT_CALLS(LEARUS_GL_ENUM)
+#undef LEARUS_GL_ENUM
+        CALL_COUNT
+    };
+
+    enum ReplayMode
+    {
+        REPLAY_CALL,    // Called again
+        REPLAY_SKIP,    // Queries, only needed by the application that made them
+        REPLAY_GEN,     // Called, and the names it hands out are checked against the recorded ones
+        REPLAY_CREATE   // The same for glCreate*, which returns the name
+    };
+
+    inline const char * callName(unsigned int call)
+    {
+        static const char * names[CALL_COUNT] =
+        {
+#define LEARUS_GL_NAME(R, name, params, args, recorded, null, replay) "gl" #name,
+            LEARUS_GL_CALLS(LEARUS_GL_NAME)
+            LEARUS_GL_EXT_CALLS(LEARUS_GL_NAME)
+#undef LEARUS_GL_NAME
+        };
+
+        return call < CALL_COUNT ? names[call] : "?";
+    }
+
+    inline bool isDraw(unsigned int call)
+    {
+        return call == CALL_DrawArrays || call == CALL_DrawArraysInstanced || call == CALL_DrawElementsBaseVertex || call == CALL_MultiDrawElementsBaseVertex || call == CALL_MultiDrawElementsIndirect;
+    }
+
+    // What a budget can limit: an entry point, "draws" or "total"
+    inline bool isBudgetName(const std::string & name)
+    {
+        bool known = name == "draws" || name == "total";
+        for (unsigned int i = 0; i < CALL_COUNT && !known; i++)
+            known = name == callName(i);
+
+        return known;
+    }
+
+    // Bytes glReadPixels / glTexImage2D touch for an image with the given row alignment and GL_*_ROW_LENGTH
+    inline size_t imageBytes(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment, GLint rowLength)
+    {
+        if (width <= 0 || height <= 0)
+            return 0;
+
+        size_t components = 4;
+        if (format == GL_RED || format == GL_DEPTH_COMPONENT || format == GL_RED_INTEGER || format == GL_STENCIL_INDEX)
+            components = 1;
+        else if (format == GL_RG || format == GL_RG_INTEGER)
+            components = 2;
+        else if (format == GL_RGB || format == GL_BGR || format == GL_RGB_INTEGER)
+            components = 3;
+
+        size_t pixel;
+        if (type == GL_UNSIGNED_BYTE || type == GL_BYTE)
+            pixel = components;
+        else if (type == GL_UNSIGNED_SHORT || type == GL_SHORT || type == GL_HALF_FLOAT)
+            pixel = components * 2;
+        else if (type == GL_UNSIGNED_INT || type == GL_INT || type == GL_FLOAT)
+            pixel = components * 4;
+        else if (type == GL_UNSIGNED_SHORT_5_6_5 || type == GL_UNSIGNED_SHORT_4_4_4_4 || type == GL_UNSIGNED_SHORT_5_5_5_1)
+            pixel = 2;
+        else
+            pixel = 4;  // Packed 32 bit formats, GL_UNSIGNED_INT_24_8 and friends
+
+        size_t row = (size_t)width * pixel;
+        size_t stride = (size_t)(rowLength > 0 ? rowLength : width) * pixel;
+        size_t aligned = alignment > 1 ? (stride + alignment - 1) / alignment * alignment : stride;
+        return aligned * (height - 1) + row;
+    }
+
+    // How a pointer argument is written to a trace
+    struct Pointer
+    {
+        enum Tag { NONE = 0, OFFSET = 1, DATA = 2, OUT = 3 };
+
+        Tag tag;
+        const void * pointer;
+        uint64_t bytes;     // Offset value for OFFSET, output size for OUT
+
+        static Pointer data(const void * p, size_t size) { Pointer r = { p ? DATA : NONE, p, p ? (uint64_t)size : 0 }; return r; }
+        static Pointer offset(const void * p) { Pointer r = { OFFSET, NULL, (uint64_t)(uintptr_t)p }; return r; }
+        static Pointer out(size_t size = 0) { Pointer r = { OUT, NULL, (uint64_t)size }; return r; }
+        static Pointer string(const char * s) { return data(s, s ? std::strlen(s) + 1 : 0); }
+    };
+
+    // Arrays of pointers: shader sources, per draw index offsets
+    struct Pointers
+    {
+        unsigned int count;
+        const void * const * pointers;
+        const GLint * lengths;
+        bool text;
+
+        static Pointers offsets(GLsizei n, const void * const * p) { Pointers r = { (unsigned int)n, p, NULL, false }; return r; }
+        static Pointers strings(GLsizei n, const GLchar * const * p, const GLint * lengths) { Pointers r = { (unsigned int)n, (const void * const *)p, lengths, true }; return r; }
+    };
+
+    const char TRACE_MAGIC[8] = { 'L', 'G', 'L', 'T', 'R', 'A', 'C', 'E' };
+    const uint32_t TRACE_VERSION = 1;
+    const uint16_t TRACE_FRAME = 0xFFFF;    // Marks the end of a frame
+    const long TRACE_FRAMES_END = sizeof(TRACE_MAGIC) + sizeof(TRACE_VERSION);
+
+    // Header: where the last frame ends (everything after it is teardown, written when the trace is closed) and a name
+    // table. Then call records: the call's index into the name table, its arguments, then its result.
+    class Writer
+    {
+        public:
+            Writer() : file(NULL), bytes(0), framesEnd(0) {}
+
+            ~Writer()
+            {
+                close();
+            }
+
+            bool open(const std::string & path)
+            {
+                file = std::fopen(path.c_str(), "wb");
+                if (!file)
+                {
+                    std::cerr << "ERROR: Could not open GL trace for writing: " << path << std::endl;
+                    return false;
+                }
+
+                // Writes go out in large blocks
+                std::setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+                raw(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+                value(TRACE_VERSION);
+                value(framesEnd);
+                value((uint32_t)CALL_COUNT);
+                for (unsigned int i = 0; i < CALL_COUNT; i++)
+                {
+                    uint16_t length = std::strlen(callName(i));
+                    value(length);
+                    raw(callName(i), length);
+                }
+
+                return true;
+            }
+
+            bool close()
+            {
+                if (!file)
+                    return true;
+
+                bool ok = std::fseek(file, TRACE_FRAMES_END, SEEK_SET) == 0 && std::fwrite(&framesEnd, sizeof(framesEnd), 1, file) == 1;
+                ok = std::fclose(file) == 0 && ok;
+                file = NULL;
+                return ok;
+            }
+
+            bool isOpen() const
+            {
+                return file != NULL;
+            }
+
+            uint64_t size() const
+            {
+                return bytes;
+            }
+
+            void endFrame()
+            {
+                value(TRACE_FRAME);
+                framesEnd = bytes;
+            }
+
+            void raw(const void * data, size_t size)
+            {
+                std::fwrite(data, 1, size, file);
+                bytes += size;
+            }
+
+            template <typename T>
+            void value(const T & v)
+            {
+                static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Pointer arguments need Pointer::data / offset / out");
+                raw(&v, sizeof(T));
+            }
+
+            void value(GLsync sync)
+            {
+                uint64_t id = (uint64_t)(uintptr_t)sync;
+                raw(&id, sizeof(id));
+            }
+
+            void value(const Pointer & p)
+            {
+                uint8_t tag = p.tag;
+                raw(&tag, 1);
+
+                if (p.tag == Pointer::DATA)
+                {
+                    raw(&p.bytes, sizeof(p.bytes));
+                    raw(p.pointer, p.bytes);
+                }
+                else if (p.tag != Pointer::NONE)
+                {
+                    raw(&p.bytes, sizeof(p.bytes));
+                }
+            }
+
+            void value(const Pointers & p)
+            {
+                uint32_t count = p.pointers ? p.count : 0;
+                value(count);
+
+                for (unsigned int i = 0; i < count; i++)
+                {
+                    if (!p.text)
+                        value(Pointer::offset(p.pointers[i]));
+                    else if (p.lengths && p.lengths[i] >= 0)
+                        value(Pointer::data(p.pointers[i], p.lengths[i]));
+                    else
+                        value(Pointer::string((const char *)p.pointers[i]));
+                }
+            }
+
+            // Results: names and status codes are kept, pointers the application got back are not
+            template <typename T>
+            void result(const T & v) { value(v); }
+
+            void result(const GLubyte *) {}
+            void result(void *) {}
+
+            void values() {}
+
+            template <typename T, typename... Rest>
+            void values(const T & first, const Rest &... rest)
+            {
+                value(first);
+                values(rest...);
+            }
+
+        private:
+            FILE * file;
+            uint64_t bytes;
+            uint64_t framesEnd;
+
+            Writer(const Writer &);
+            Writer & operator=(const Writer &);
+    };
+
+    // Per entry point counts. A budget is an upper limit per steady state frame on one entry point, on all draw calls
+    // ("draws") or on all calls ("total").
+    struct Budget
+    {
+        std::string name;
+        unsigned long limit;
+        unsigned long worst;
+    };
+
+    // Original function pointers, and the current state of the layer
+    class Layer
+    {
+        public:
+            struct Real
+            {
+#define LEARUS_GL_REAL(R, name, params, args, recorded, null, replay) R (APIENTRYP name) params;
+                LEARUS_GL_CALLS(LEARUS_GL_REAL)
+                LEARUS_GL_EXT_CALLS(LEARUS_GL_REAL)
+#undef LEARUS_GL_REAL
+            };
+
+            Real real;
+            bool installed;
+            bool nullDriver;
+            Writer trace;
+
+            // Needed to know what the pointers of a recorded glReadPixels / glTexImage2D point at
+            GLuint packBuffer, unpackBuffer;
+            GLint packAlignment, unpackAlignment;
+            GLint packRowLength, unpackRowLength;
+
+            unsigned long frame[CALL_COUNT];        // Calls so far in the current frame
+            unsigned long total[CALL_COUNT];
+            unsigned long worst[CALL_COUNT];        // Most calls in one steady state frame
+            unsigned long frames, steadyFrames;
+            unsigned long worstTotal, worstDraws;
+            std::vector<Budget> budgets;
+
+            Layer()
+            : installed(false), nullDriver(false), packBuffer(0), unpackBuffer(0), packAlignment(4), unpackAlignment(4),
+              packRowLength(0), unpackRowLength(0),
+              frames(0), steadyFrames(0), worstTotal(0), worstDraws(0), nextName(0)
+            {
+                std::memset(&real, 0, sizeof(real));
+                std::memset(frame, 0, sizeof(frame));
+                std::memset(total, 0, sizeof(total));
+                std::memset(worst, 0, sizeof(worst));
+            }
+
+            // False if there is no such call, see isBudgetName()
+            bool addBudget(const std::string & name, unsigned long limit)
+            {
+                if (!isBudgetName(name))
+                    return false;
+
+                Budget budget = { name, limit, 0 };
+                budgets.push_back(budget);
+                return true;
+            }
+
+            // The end of a frame. Steady state frames count towards the worst case and the budgets.
+            void endFrame(bool steady)
+            {
+                if (!installed)
+                    return;
+
+                unsigned long calls = 0, draws = 0;
+                for (unsigned int i = 0; i < CALL_COUNT; i++)
+                {
+                    calls += frame[i];
+                    if (isDraw(i))
+                        draws += frame[i];
+
+                    total[i] += frame[i];
+                    if (steady)
+                        worst[i] = std::max(worst[i], frame[i]);
+                }
+
+                frames++;
+                if (steady)
+                {
+                    steadyFrames++;
+                    worstTotal = std::max(worstTotal, calls);
+                    worstDraws = std::max(worstDraws, draws);
+                }
+
+                std::memset(frame, 0, sizeof(frame));
+
+                if (trace.isOpen())
+                    trace.endFrame();
+            }
+
+            // False if a steady state frame went over a budget
+            bool withinBudgets()
+            {
+                bool ok = true;
+
+                for (unsigned int i = 0; i < budgets.size(); i++)
+                {
+                    Budget & budget = budgets[i];
+                    budget.worst = budget.name == "total" ? worstTotal : budget.name == "draws" ? worstDraws : 0;
+                    for (unsigned int j = 0; j < CALL_COUNT; j++)
+                    {
+                        if (budget.name == callName(j))
+                            budget.worst = worst[j];
+                    }
+
+                    if (budget.worst > budget.limit)
+                    {
+                        std::cerr << "ERROR: " << budget.name << " was called " << budget.worst << " times in one frame, the budget is " << budget.limit << std::endl;
+                        ok = false;
+                    }
+                }
+
+                return ok;
+            }
+
+            void printStats() const
+            {
+                if (!installed || frames == 0)
+                    return;
+
+                unsigned long calls = 0, draws = 0;
+                std::vector<std::pair<unsigned long, unsigned int> > order;
+                for (unsigned int i = 0; i < CALL_COUNT; i++)
+                {
+                    calls += total[i];
+                    if (isDraw(i))
+                        draws += total[i];
+                    if (total[i])
+                        order.push_back(std::make_pair(total[i], i));
+                }
+                std::sort(order.rbegin(), order.rend());
+
+                std::cout << "GL calls: " << (double)calls / frames << " per frame (" << (double)draws / frames << " draws), at most "
+                          << worstTotal << " (" << worstDraws << " draws) in a steady state frame" << (nullDriver ? ", null driver" : "") << std::endl;
+
+                char line[128];
+                std::snprintf(line, sizeof(line), "    %-32s %12s %12s", "entry point", "per frame", "worst");
+                std::cout << line << std::endl;
+                for (unsigned int i = 0; i < order.size() && i < 16; i++)
+                {
+                    std::snprintf(line, sizeof(line), "    %-32s %12.1f %12lu", callName(order[i].second), (double)order[i].first / frames, worst[order[i].second]);
+                    std::cout << line << std::endl;
+                }
+
+                if (trace.size() > 0)
+                    std::cout << "GL trace: " << trace.size() / 1048576.0 << " MB for " << frames << " frames" << std::endl;
+            }
+
+            // State the recorded pointers depend on
+            void bindBuffer(GLenum target, GLuint buffer)
+            {
+                if (target == GL_PIXEL_PACK_BUFFER)
+                    packBuffer = buffer;
+                else if (target == GL_PIXEL_UNPACK_BUFFER)
+                    unpackBuffer = buffer;
+            }
+
+            void pixelStore(GLenum pname, GLint param)
+            {
+                if (pname == GL_PACK_ALIGNMENT)
+                    packAlignment = param;
+                else if (pname == GL_UNPACK_ALIGNMENT)
+                    unpackAlignment = param;
+                else if (pname == GL_PACK_ROW_LENGTH)
+                    packRowLength = param;
+                else if (pname == GL_UNPACK_ROW_LENGTH)
+                    unpackRowLength = param;
+            }
+
+            // What the null driver hands out
+            GLuint nullName()
+            {
+                return ++nextName;
+            }
+
+            void nullNames(GLsizei n, GLuint * names)
+            {
+                for (GLsizei i = 0; i < n; i++)
+                    names[i] = ++nextName;
+            }
+
+            void nullString(GLsizei bufSize, GLsizei * length, GLchar * text)
+            {
+                if (length)
+                    *length = 0;
+                if (text && bufSize > 0)
+                    text[0] = '\0';
+            }
+
+            const GLubyte * nullString(GLenum name)
+            {
+                if (name == GL_VERSION)
+                    return (const GLubyte *)"3.3 (null driver)";
+                if (name == GL_SHADING_LANGUAGE_VERSION)
+                    return (const GLubyte *)"3.30";
+                return (const GLubyte *)"Null driver";
+            }
+
+            void * nullMap(GLsizeiptr length)
+            {
+                if ((size_t)length > mapped.size())
+                    mapped.resize(length);
+                return mapped.empty() ? NULL : &mapped[0];
+            }
+
+        private:
+            GLuint nextName;
+            std::vector<char> mapped;
+
+            Layer(const Layer &);
+            Layer & operator=(const Layer &);
+    };
+
+    inline Layer & layer()
+    {
+        static Layer instance;
+        return instance;
+    }
+
+    // State some recorded pointers depend on, kept up to date whether or not a trace is open
+    template <int C>
+    struct Track
+    {
+        template <typename... A>
+        static void run(const A &...) {}
+    };
+
+    template <>
+    struct Track<CALL_BindBuffer>
+    {
+        static void run(GLenum target, GLuint buffer) { layer().bindBuffer(target, buffer); }
+    };
+
+    template <>
+    struct Track<CALL_PixelStorei>
+    {
+        static void run(GLenum pname, GLint param) { layer().pixelStore(pname, param); }
+    };
+
+    // Calls the driver (or the null one), then writes the call and its result to the trace if one is open
+    template <typename R>
+    struct Dispatch
+    {
+        template <typename F, typename W>
+        static R run(Layer & l, unsigned int call, F function, W record)
+        {
+            R result = function();
+            if (l.trace.isOpen())
+            {
+                l.trace.value((uint16_t)call);
+                record();
+                l.trace.result(result);
+            }
+            return result;
+        }
+    };
+
+    template <>
+    struct Dispatch<void>
+    {
+        template <typename F, typename W>
+        static void run(Layer & l, unsigned int call, F function, W record)
+        {
+            function();
+            if (l.trace.isOpen())
+            {
+                l.trace.value((uint16_t)call);
+                record();
+            }
+        }
+    };
+
+#define LEARUS_GL_WRAPPER(R, name, params, args, recorded, null, replay) \
+    inline R APIENTRY wrap##name params \
+    { \
+        Layer & l = layer(); \
+        l.frame[CALL_##name]++; \
+        Track<CALL_##name>::run args; \
+        return Dispatch<R>::run(l, CALL_##name, \
+                                [&]() -> R { return l.nullDriver ? (R)(null) : l.real.name args; }, \
+                                [&]() { l.trace.values recorded; }); \
+    }
+
+    LEARUS_GL_CALLS(LEARUS_GL_WRAPPER)
+    LEARUS_GL_EXT_CALLS(LEARUS_GL_WRAPPER)
+#undef LEARUS_GL_WRAPPER
+
+    // Puts the wrappers in place. Call after gladLoadGLLoader and Learus_GLExt::load.
+    inline void install()
+    {
+        Layer & l = layer();
+        if (l.installed)
+            return;
+
+        Learus_GLExt::Functions & ext = Learus_GLExt::get();
+
+#define LEARUS_GL_INSTALL(R, name, params, args, recorded, null, replay) \
+        l.real.name = glad_gl##name; \
+        glad_gl##name = wrap##name;
+        LEARUS_GL_CALLS(LEARUS_GL_INSTALL)
+#undef LEARUS_GL_INSTALL
+
+        // Extensions stay unset when the driver does not have them
+#define LEARUS_GL_INSTALL_EXT(R, name, params, args, recorded, null, replay) \
+        l.real.name = ext.name; \
+        if (ext.name) \
+            ext.name = wrap##name;
+        LEARUS_GL_EXT_CALLS(LEARUS_GL_INSTALL_EXT)
+#undef LEARUS_GL_INSTALL_EXT
+
+        l.installed = true;
+    }
+
+    // Instead of a context and gladLoadGLLoader: every call the renderer makes returns without doing anything, with
+    // results that keep it going (objects get names, shaders compile, framebuffers are complete).
+    inline void installNullDriver()
+    {
+        Layer & l = layer();
+        l.nullDriver = true;
+
+        GLVersion.major = 3;
+        GLVersion.minor = 3;
+
+        install();
+    }
+
+    // Records every call from now on. Frames end at endFrame().
+    inline bool startTrace(const std::string & path)
+    {
+        return layer().trace.open(path);
+    }
+
+    inline bool finishTrace()
+    {
+        return layer().trace.close();
+    }
+
+    inline void endFrame(bool steady)
+    {
+        layer().endFrame(steady);
+    }
+
+    // Plays a trace back on the current context. Only needs glad and Learus_GLExt loaded.
+    class Replayer
+    {
+        public:
+            unsigned long calls, skipped, unsupported;
+            unsigned long nameMismatches;       // Objects that did not get the names they had when recording
+            std::vector<double> frameSeconds;   // Including a glFinish at the end of each frame
+
+            Replayer() : calls(0), skipped(0), unsupported(0), nameMismatches(0), file(NULL), failed(false), position(0), framesEnd(0), blobCount(0) {}
+
+            ~Replayer()
+            {
+                if (file)
+                    std::fclose(file);
+            }
+
+            // Plays every frame. The objects the trace created are still alive afterwards, until finish().
+            bool run(const std::string & path)
+            {
+                file = std::fopen(path.c_str(), "rb");
+                if (!file)
+                {
+                    std::cerr << "ERROR: Could not open GL trace: " << path << std::endl;
+                    return false;
+                }
+
+                if (!readHeader())
+                {
+                    std::cerr << "ERROR: Not a GL trace, or one from an incompatible version: " << path << std::endl;
+                    return false;
+                }
+
+                return replay(framesEnd);
+            }
+
+            // Plays the teardown that follows the last frame
+            bool finish()
+            {
+                return file && replay(UINT64_MAX);
+            }
+
+            void printStats() const
+            {
+                double total = 0.0, worst = 0.0;
+                for (unsigned int i = 0; i < frameSeconds.size(); i++)
+                {
+                    total += frameSeconds[i];
+                    worst = std::max(worst, frameSeconds[i]);
+                }
+
+                std::cout << "Replayed " << calls << " GL calls (" << skipped << " queries skipped) in " << frameSeconds.size() << " frames";
+                if (frameSeconds.size() > 1)
+                {
+                    // The first frame also creates every resource
+                    std::cout << ", " << (total - frameSeconds[0]) * 1000.0 / (frameSeconds.size() - 1) << " ms per frame after the first ("
+                              << frameSeconds[0] * 1000.0 << " ms), worst " << worst * 1000.0 << " ms";
+                }
+                std::cout << std::endl;
+
+                if (unsupported)
+                    std::cerr << "ERROR: " << unsupported << " calls need functions this driver does not have" << std::endl;
+                if (nameMismatches)
+                    std::cerr << "ERROR: " << nameMismatches << " objects got different names than when recording, the replay may be wrong" << std::endl;
+            }
+
+            // What the trace left in the bound framebuffer, flipped to the usual top down order
+            void readPixels(std::vector<unsigned char> & rgb, int & width, int & height)
+            {
+                GLint viewport[4] = { 0, 0, 0, 0 };
+                GLint framebuffer = 0;
+                glGetIntegerv(GL_VIEWPORT, viewport);
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+                width = std::max(viewport[2], 1);
+                height = std::max(viewport[3], 1);
+                rgb.resize((size_t)width * height * 3);
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+
+                size_t row = (size_t)width * 3;
+                for (int y = 0; y < height / 2; y++)
+                    std::swap_ranges(rgb.begin() + y * row, rgb.begin() + (y + 1) * row, rgb.begin() + (height - 1 - y) * row);
+            }
+
+            // Argument decoding, in the order the writer put them down
+            template <typename T>
+            T read()
+            {
+                return Arg<T>::read(*this);
+            }
+
+            template <typename T>
+            void readResult(const T & actual)
+            {
+                T recorded = Arg<T>::raw(*this);
+                (void)recorded;
+                (void)actual;
+            }
+
+            void readResult(GLsync actual)
+            {
+                uint64_t recorded = Arg<uint64_t>::raw(*this);
+                syncs[recorded] = actual;
+            }
+
+            void readResult(const GLubyte *) {}
+            void readResult(void *) {}
+
+            template <typename T>
+            void skipResult()
+            {
+                readResult(T());
+            }
+
+            // Gen calls: the names this driver hands out should match the recorded ones
+            void replayGen(void (APIENTRYP function)(GLsizei, GLuint *))
+            {
+                GLsizei n = read<GLsizei>();
+                const GLuint * recorded = read<const GLuint *>();
+
+                names.resize(std::max(n, 0));
+                if (function && n > 0)
+                {
+                    function(n, &names[0]);
+                    for (GLsizei i = 0; i < n; i++)
+                    {
+                        if (!recorded || names[i] != recorded[i])
+                            nameMismatches++;
+                    }
+                }
+                else if (!function)
+                {
+                    unsupported++;
+                }
+
+                calls++;
+            }
+
+            void checkName(GLuint actual)
+            {
+                if (actual != Arg<GLuint>::raw(*this))
+                    nameMismatches++;
+            }
+
+            bool readBytes(void * data, size_t size)
+            {
+                if (size > 0 && std::fread(data, 1, size, file) != size)
+                {
+                    failed = true;
+                    std::memset(data, 0, size);
+                }
+                position += size;
+                return !failed;
+            }
+
+            // Storage for one call's pointer arguments
+            char * blob(size_t size)
+            {
+                if (blobCount == blobs.size())
+                    blobs.push_back(std::vector<char>());
+
+                std::vector<char> & b = blobs[blobCount++];
+                if (b.size() < size)
+                    b.resize(size);
+                return b.empty() ? NULL : &b[0];
+            }
+
+            GLsync sync(uint64_t recorded) const
+            {
+                std::map<uint64_t, GLsync>::const_iterator it = syncs.find(recorded);
+                return it == syncs.end() ? (GLsync)0 : it->second;
+            }
+
+            unsigned long & callCount() { return calls; }
+            unsigned long & skipCount() { return skipped; }
+            unsigned long & unsupportedCount() { return unsupported; }
+
+        private:
+            typedef void (*ReplayFunction)(Replayer &);
+
+            FILE * file;
+            bool failed;
+            uint64_t position, framesEnd;       // Bytes read so far, where the last frame ends
+            std::vector<int> callMap;           // Index in the file to Call
+            std::map<uint64_t, GLsync> syncs;
+            std::vector<GLuint> names;
+
+            std::vector<std::vector<char> > blobs;
+            unsigned int blobCount;
+
+            template <typename T, typename Enable = void>
+            struct Arg
+            {
+                static T raw(Replayer & r)
+                {
+                    T value;
+                    r.readBytes(&value, sizeof(T));
+                    return value;
+                }
+
+                static T read(Replayer & r) { return raw(r); }
+            };
+
+            // Pointer arguments come back pointing at a copy of the recorded data, or at scratch memory for outputs
+            template <typename T>
+            struct Arg<T *, typename std::enable_if<!std::is_same<T *, GLsync>::value && !std::is_pointer<T>::value>::type>
+            {
+                static T * raw(Replayer & r) { return read(r); }
+
+                static T * read(Replayer & r)
+                {
+                    uint8_t tag = 0;
+                    r.readBytes(&tag, 1);
+                    if (tag == Pointer::NONE)
+                        return NULL;
+
+                    uint64_t bytes = 0;
+                    r.readBytes(&bytes, sizeof(bytes));
+
+                    if (tag == Pointer::OFFSET)
+                        return (T *)(uintptr_t)bytes;
+
+                    char * data = r.blob(bytes);
+                    if (tag == Pointer::DATA)
+                        r.readBytes(data, bytes);
+                    return (T *)data;
+                }
+            };
+
+            template <typename Enable>
+            struct Arg<GLsync, Enable>
+            {
+                static GLsync raw(Replayer & r) { return read(r); }
+
+                static GLsync read(Replayer & r)
+                {
+                    uint64_t id = Arg<uint64_t>::raw(r);
+                    return r.sync(id);
+                }
+            };
+
+            template <typename Enable>
+            struct Arg<const void * const *, Enable>
+            {
+                static const void * const * raw(Replayer & r) { return read(r); }
+
+                static const void * const * read(Replayer & r)
+                {
+                    uint32_t count = Arg<uint32_t>::raw(r);
+                    const void ** pointers = (const void **)r.blob(count * sizeof(void *));
+                    for (uint32_t i = 0; i < count; i++)
+                        pointers[i] = Arg<const void *>::read(r);
+                    return pointers;
+                }
+            };
+
+            template <typename Enable>
+            struct Arg<const GLchar * const *, Enable>
+            {
+                static const GLchar * const * raw(Replayer & r) { return read(r); }
+
+                static const GLchar * const * read(Replayer & r)
+                {
+                    return (const GLchar * const *)Arg<const void * const *>::read(r);
+                }
+            };
+
+            bool readHeader()
+            {
+                char magic[sizeof(TRACE_MAGIC)];
+                uint32_t version = 0, count = 0;
+                if (!readBytes(magic, sizeof(magic)) || std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+                    return false;
+                if (!readBytes(&version, sizeof(version)) || version != TRACE_VERSION)
+                    return false;
+                if (!readBytes(&framesEnd, sizeof(framesEnd)) || !readBytes(&count, sizeof(count)))
+                    return false;
+
+                // Not closed properly, there is no telling where the teardown starts
+                if (framesEnd == 0)
+                    framesEnd = UINT64_MAX;
+
+                callMap.assign(count, -1);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    uint16_t length = 0;
+                    readBytes(&length, sizeof(length));
+                    std::string name(length, ' ');
+                    if (length > 0)
+                        readBytes(&name[0], length);
+
+                    for (unsigned int j = 0; j < CALL_COUNT; j++)
+                    {
+                        if (name == callName(j))
+                            callMap[i] = j;
+                    }
+                }
+
+                return !failed;
+            }
+
+            static const ReplayFunction * replayers();
+
+            // Plays calls until end or the end of the file
+            bool replay(uint64_t end)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                while (position < end)
+                {
+                    uint16_t id;
+                    if (std::fread(&id, sizeof(id), 1, file) != 1)
+                        break;
+                    position += sizeof(id);
+
+                    if (id == TRACE_FRAME)
+                    {
+                        glFinish();
+                        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                        frameSeconds.push_back(std::chrono::duration<double>(now - start).count());
+                        start = now;
+                        continue;
+                    }
+
+                    if (id >= callMap.size() || callMap[id] < 0)
+                    {
+                        std::cerr << "ERROR: GL trace contains a call this build does not know" << std::endl;
+                        return false;
+                    }
+
+                    blobCount = 0;
+                    replayers()[callMap[id]](*this);
+
+                    if (failed)
+                    {
+                        std::cerr << "ERROR: GL trace is truncated" << std::endl;
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            Replayer(const Replayer &);
+            Replayer & operator=(const Replayer &);
+    };
+
+    // Calls function with arguments read from the trace, in order. Braced initialization reads them left to right.
+    template <unsigned int... I>
+    struct Indices {};
+
+    template <unsigned int N, unsigned int... I>
+    struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+    template <unsigned int... I>
+    struct MakeIndices<0, I...>
+    {
+        typedef Indices<I...> type;
+    };
+
+    template <typename R, typename... A, unsigned int... I>
+    R apply(R (APIENTRYP function)(A...), std::tuple<A...> & args, Indices<I...>)
+    {
+        return function(std::get<I>(args)...);
+    }
+
+    template <typename R>
+    struct Invoke
+    {
+        template <typename... A>
+        static void run(Replayer & r, R (APIENTRYP function)(A...), std::tuple<A...> & args)
+        {
+            R actual = apply(function, args, typename MakeIndices<sizeof...(A)>::type());
+            r.readResult(actual);
+        }
+    };
+
+    template <>
+    struct Invoke<void>
+    {
+        template <typename... A>
+        static void run(Replayer &, void (APIENTRYP function)(A...), std::tuple<A...> & args)
+        {
+            apply(function, args, typename MakeIndices<sizeof...(A)>::type());
+        }
+    };
+
+    template <typename R>
+    struct SkipResult
+    {
+        static void run(Replayer & r) { r.skipResult<R>(); }
+    };
+
+    template <>
+    struct SkipResult<void>
+    {
+        static void run(Replayer &) {}
+    };
+
+    template <int Mode>
+    struct Replay
+    {
+        template <typename R, typename... A>
+        static void run(Replayer & r, R (APIENTRYP function)(A...))
+        {
+            std::tuple<A...> args { r.read<A>()... };
+
+            if (Mode == REPLAY_SKIP || !function)
+            {
+                SkipResult<R>::run(r);
+                (Mode == REPLAY_SKIP ? r.skipCount() : r.unsupportedCount())++;
+                return;
+            }
+
+            Invoke<R>::run(r, function, args);
+            r.callCount()++;
+        }
+    };
+
+    template <>
+    struct Replay<REPLAY_GEN>
+    {
+        static void run(Replayer & r, void (APIENTRYP function)(GLsizei, GLuint *))
+        {
+            r.replayGen(function);
+        }
+    };
+
+    template <>
+    struct Replay<REPLAY_CREATE>
+    {
+        template <typename... A>
+        static void run(Replayer & r, GLuint (APIENTRYP function)(A...))
+        {
+            std::tuple<A...> args { r.read<A>()... };
+
+            if (!function)
+            {
+                SkipResult<GLuint>::run(r);
+                r.unsupportedCount()++;
+                return;
+            }
+
+            r.checkName(apply(function, args, typename MakeIndices<sizeof...(A)>::type()));
+            r.callCount()++;
+        }
+    };
+
+#define LEARUS_GL_REPLAY(R, name, params, args, recorded, null, replay) \
+    inline void replay##name(Replayer & r) { Replay<replay>::run(r, glad_gl##name); }
+    LEARUS_GL_CALLS(LEARUS_GL_REPLAY)
+#undef LEARUS_GL_REPLAY
+
+#define LEARUS_GL_REPLAY_EXT(R, name, params, args, recorded, null, replay) \
+    inline void replay##name(Replayer & r) { Replay<replay>::run(r, Learus_GLExt::get().name); }
+    LEARUS_GL_EXT_CALLS(LEARUS_GL_REPLAY_EXT)
+#undef LEARUS_GL_REPLAY_EXT
+
+    inline const Replayer::ReplayFunction * Replayer::replayers()
+    {
+        static const ReplayFunction table[CALL_COUNT] =
+        {
+#define LEARUS_GL_TABLE(R, name, params, args, recorded, null, replay) &replay##name,
+            LEARUS_GL_CALLS(LEARUS_GL_TABLE)
+            LEARUS_GL_EXT_CALLS(LEARUS_GL_TABLE)
+#undef LEARUS_GL_TABLE
+        };
+
+        return table;
+    }
+
+}
+
+#endif
@@ -0,0 +1,420 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "../lib/glad/glad.h"
+
+#include "profiler.h"
+#include "resource_registry.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace Learus_Profiler
+{
+    // Time spent by one named GPU scope, summed over the frames that were counted
+    struct PassTime
+    {
+        const char * name;
+        double totalMs;
+        unsigned long frames;
+        double lastMs;      // In the latest frame read back, counted or not. 0 if the scope did not run in it.
+        unsigned long lastFrame;    // The latest frame read back that it ran in
+
+        double meanMs() const { return frames ? totalMs / frames : 0.0; }
+    };
+
+    class GpuProfiler;
+
+    // Told about every frame the profiler reads back, oldest first, while the profiler's last* fields describe it
+    class FrameListener
+    {
+        public:
+            virtual ~FrameListener() {}
+            virtual void gpuFrame(const GpuProfiler & profiler) = 0;
+    };
+
+    // GPU scopes from GL_TIMESTAMP queries (core since 3.3, llvmpipe has them too). Everything in the program that
+    // times GPU work reads it from here, through passes or a FrameListener.
+    // Every frame gets its own set of queries in a ring of LATENCY frames, and a frame is read back once the GPU is
+    // done with it. The CPU never waits on the GPU: when the GPU is LATENCY frames behind, the next frame goes untimed.
+    // A frame runs from one beginFrame() to the next, so scopes after the scene's (the overlay) still belong to it.
+    //
+    // Resolved scopes are summed per name, and written into the CPU profiler's timeline as a "GPU" track,
+    // placed using a GPU / CPU clock pair taken at the start of each frame.
+    class GpuProfiler
+    {
+        public:
+            static const unsigned int LATENCY = 4;
+            static const unsigned int MAX_SCOPES = 32;     // Per frame, deeper or longer frames lose the rest
+            static const unsigned int MAX_LISTENERS = 8;
+
+            bool counting;      // Whether resolved frames add to passes, e.g. off during benchmark warmup
+            std::vector<PassTime> passes;
+            unsigned long resolved;     // Frames read back so far, lastMs changes when this does
+            unsigned long skipped;      // Frames that went untimed because the GPU was too far behind
+
+            // The latest frame read back: its number (see frame()), whether it was counted, and when the GPU
+            // finished its last scope, on the CPU's clock
+            unsigned long lastFrame;
+            bool lastCounted;
+            std::chrono::steady_clock::time_point lastFinished;
+
+            GpuProfiler()
+            : counting(true), resolved(0), skipped(0), lastFrame(0), lastCounted(false), enabled(false), open(false), current(0),
+              frameCount(0), depth(0), listenerCount(0), timeline(NULL)
+            {
+            }
+
+            ~GpuProfiler()
+            {
+                if (enabled)
+                {
+                    for (unsigned int i = 0; i < LATENCY; i++)
+                    {
+                        Learus_Resources::registry().release(Learus_Resources::KIND_QUERY, MAX_SCOPES * 2, frames[i].queries);
+                        glDeleteQueries(MAX_SCOPES * 2, frames[i].queries);
+                    }
+                }
+            }
+
+            // Needs a current context. Until this is called every other method does nothing.
+            void enable()
+            {
+                if (enabled)
+                    return;
+
+                for (unsigned int i = 0; i < LATENCY; i++)
+                {
+                    glGenQueries(MAX_SCOPES * 2, frames[i].queries);
+                    for (unsigned int j = 0; j < MAX_SCOPES * 2; j++)
+                        Learus_Resources::registry().track(Learus_Resources::KIND_QUERY, frames[i].queries[j], Learus_Resources::SUB_PROFILING, 0, "GPU scope");
+
+                    frames[i].scopeCount = 0;
+                    frames[i].pending = false;
+                }
+
+                timeline = &get().createBuffer("GPU");
+                enabled = true;
+
+                // Calibrates the CPU clock now rather than in the middle of a frame
+                get().ticksPerMicrosecond();
+            }
+
+            bool isEnabled() const
+            {
+                return enabled;
+            }
+
+            // Does not enable the profiler. A listener has to be removed again before it goes away.
+            void listen(FrameListener * listener)
+            {
+                if (listenerCount < MAX_LISTENERS)
+                    listeners[listenerCount++] = listener;
+            }
+
+            void unlisten(FrameListener * listener)
+            {
+                for (unsigned int i = 0; i < listenerCount; i++)
+                {
+                    if (listeners[i] == listener)
+                    {
+                        for (unsigned int j = i + 1; j < listenerCount; j++)
+                            listeners[j - 1] = listeners[j];
+                        listenerCount--;
+                        return;
+                    }
+                }
+            }
+
+            // The number of the frame being recorded, 0 when it goes untimed
+            unsigned long frame() const
+            {
+                return open ? frames[current].number : 0;
+            }
+
+            // The time of a scope in the latest frame read back, false if it did not run in it
+            bool lastTime(const char * name, double & ms) const
+            {
+                for (unsigned int i = 0; i < passes.size(); i++)
+                {
+                    if (passes[i].name == name || std::strcmp(passes[i].name, name) == 0)
+                    {
+                        ms = passes[i].lastMs;
+                        return passes[i].lastFrame == lastFrame && lastFrame != 0;
+                    }
+                }
+
+                return false;
+            }
+
+            // Ends the previous frame as well
+            void beginFrame()
+            {
+                if (!enabled)
+                    return;
+
+                endFrame();
+
+                // The frame about to be reused is the oldest. Reading it back before the GPU is done would stall, so
+                // this frame goes untimed and the slot is tried again next time.
+                Frame & frame = frames[current];
+                if (frame.pending && !ready(frame))
+                {
+                    skipped++;
+                    return;
+                }
+
+                // Newer ones that are done are collected early, in submission order so lastMs never goes back to an
+                // older frame
+                if (frame.pending)
+                    resolve(frame);
+
+                for (unsigned int i = 1; i < LATENCY; i++)
+                {
+                    Frame & newer = frames[(current + i) % LATENCY];
+                    if (!newer.pending)
+                        continue;
+                    if (!ready(newer))
+                        break;
+
+                    resolve(newer);
+                }
+
+                frame.scopeCount = 0;
+                frame.counted = counting;
+                frame.number = ++frameCount;
+
+                // Clock pair for moving GPU times onto the CPU timeline. Does not wait for queued commands.
+                GLint64 gpuNow = 0;
+                glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+                frame.gpuOrigin = gpuNow;
+                frame.cpuOrigin = timestamp();
+                frame.clockOrigin = std::chrono::steady_clock::now();
+
+                open = true;
+                depth = 0;
+            }
+
+            void begin(const char * name)
+            {
+                if (!enabled)
+                    return;
+
+                Frame & frame = frames[current];
+                if (!open || frame.scopeCount == MAX_SCOPES || depth == MAX_SCOPES)
+                {
+                    // Still has to balance the matching end()
+                    stack[depth++] = MAX_SCOPES;
+                    return;
+                }
+
+                unsigned int index = frame.scopeCount++;
+                frame.names[index] = name;
+                glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+
+                stack[depth++] = index;
+            }
+
+            void end()
+            {
+                if (!enabled || depth == 0)
+                    return;
+
+                unsigned int index = stack[--depth];
+                if (index == MAX_SCOPES)
+                    return;
+
+                glQueryCounter(frames[current].queries[index * 2 + 1], GL_TIMESTAMP);
+                frames[current].lastQuery = frames[current].queries[index * 2 + 1];
+            }
+
+            // Only needed before reading a frame back right away, beginFrame() ends the one before
+            void endFrame()
+            {
+                if (!enabled)
+                    return;
+
+                while (depth > 0)
+                    end();
+
+                if (!open)
+                    return;
+
+                frames[current].pending = frames[current].scopeCount > 0;
+                current = (current + 1) % LATENCY;
+                open = false;
+            }
+
+            // Collects everything still in flight, e.g. before printing the totals
+            void flush()
+            {
+                if (!enabled)
+                    return;
+
+                endFrame();
+
+                for (unsigned int i = 0; i < LATENCY; i++)
+                {
+                    Frame & frame = frames[(current + i) % LATENCY];
+                    if (frame.pending)
+                        resolve(frame);
+                }
+            }
+
+            void resetStats()
+            {
+                passes.clear();
+            }
+
+            void printStats() const
+            {
+                if (passes.empty())
+                    return;
+
+                std::cout << std::fixed << std::setprecision(3) << "GPU time per frame:";
+                for (unsigned int i = 0; i < passes.size(); i++)
+                    std::cout << (i ? ", " : " ") << passes[i].name << " " << passes[i].meanMs() << " ms";
+                if (skipped)
+                    std::cout << " (" << skipped << " frames untimed)";
+                std::cout << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
+            }
+
+        private:
+            struct Frame
+            {
+                GLuint queries[MAX_SCOPES * 2];     // start, end per scope
+                const char * names[MAX_SCOPES];
+                unsigned int scopeCount;
+                bool pending;
+                bool counted;
+                GLuint lastQuery;   // Written last, so finishes last
+                unsigned long number;
+
+                GLint64 gpuOrigin;
+                uint64_t cpuOrigin;
+                std::chrono::steady_clock::time_point clockOrigin;
+            };
+
+            bool enabled;
+            bool open;      // A frame is being recorded into frames[current]
+            Frame frames[LATENCY];
+            unsigned int current;
+            unsigned long frameCount;
+
+            unsigned int stack[MAX_SCOPES];
+            unsigned int depth;
+
+            FrameListener * listeners[MAX_LISTENERS];
+            unsigned int listenerCount;
+
+            ThreadBuffer * timeline;
+
+            bool ready(const Frame & frame) const
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(frame.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+                return available != 0;
+            }
+
+            void resolve(Frame & frame)
+            {
+                double ticksPerNanosecond = get().ticksPerMicrosecond() / 1000.0;
+
+                for (unsigned int i = 0; i < passes.size(); i++)
+                    passes[i].lastMs = 0.0;
+
+                GLuint64 finished = (GLuint64)frame.gpuOrigin;
+                for (unsigned int i = 0; i < frame.scopeCount; i++)
+                {
+                    GLuint64 start = 0, end = 0;
+                    glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &start);
+                    glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+                    if (end < start)
+                        end = start;
+                    finished = std::max(finished, end);
+
+                    // Entries are made even for frames that do not count, so counting later does not grow the vector
+                    PassTime & time = pass(frame.names[i]);
+                    time.lastMs += (end - start) / 1e6;
+                    time.lastFrame = frame.number;
+                    if (frame.counted)
+                        time.totalMs += (end - start) / 1e6;
+
+                    double offset = ((double)(int64_t)(start - frame.gpuOrigin)) * ticksPerNanosecond;
+                    uint64_t cpuStart = (uint64_t)((double)frame.cpuOrigin + offset);
+                    timeline->push(frame.names[i], cpuStart, cpuStart + (uint64_t)((end - start) * ticksPerNanosecond));
+                }
+
+                // A scope that ran several times in the frame still counts the frame once
+                if (frame.counted)
+                {
+                    for (unsigned int i = 0; i < passes.size(); i++)
+                    {
+                        for (unsigned int j = 0; j < frame.scopeCount; j++)
+                        {
+                            if (std::strcmp(passes[i].name, frame.names[j]) == 0)
+                            {
+                                passes[i].frames++;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                frame.pending = false;
+                resolved++;
+
+                lastFrame = frame.number;
+                lastCounted = frame.counted;
+                std::chrono::nanoseconds offset((int64_t)(finished - (GLuint64)frame.gpuOrigin));
+                lastFinished = frame.clockOrigin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+
+                for (unsigned int i = 0; i < listenerCount; i++)
+                    listeners[i]->gpuFrame(*this);
+            }
+
+            PassTime & pass(const char * name)
+            {
+                for (unsigned int i = 0; i < passes.size(); i++)
+                {
+                    if (passes[i].name == name || std::strcmp(passes[i].name, name) == 0)
+                        return passes[i];
+                }
+
+                PassTime time = { name, 0.0, 0, 0.0, 0 };
+                passes.push_back(time);
+                return passes.back();
+            }
+    };
+
+    // Times the enclosed GL commands on the GPU
+    class GpuScope
+    {
+        public:
+            GpuScope(GpuProfiler & _profiler, const char * name)
+            : profiler(_profiler)
+            {
+                profiler.begin(name);
+            }
+
+            ~GpuScope()
+            {
+                profiler.end();
+            }
+
+        private:
+            GpuProfiler & profiler;
+
+            GpuScope(const GpuScope &);
+            GpuScope & operator=(const GpuScope &);
+    };
+}
+
+#endif
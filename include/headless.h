@@ -0,0 +1,184 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "../lib/glad/glad.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Rendering without a window or X server: a surfaceless EGL context (Mesa llvmpipe works fine) plus an FBO to draw into.
+namespace Learus_Headless
+{
+    // A GL 3.3 core context with no surface. Made current on creation.
+    class Context
+    {
+        public:
+            Context()
+            : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+            {
+            }
+
+            ~Context()
+            {
+                if (display != EGL_NO_DISPLAY)
+                {
+                    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                    if (context != EGL_NO_CONTEXT)
+                        eglDestroyContext(display, context);
+                    eglTerminate(display);
+                }
+            }
+
+            bool create()
+            {
+                // Prefer Mesa's surfaceless platform, it needs no display server or GPU device at all
+                PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+                if (getPlatformDisplay)
+                    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+                if (display == EGL_NO_DISPLAY)
+                    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+                EGLint major, minor;
+                if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+                {
+                    std::cerr << "ERROR: Failed to initialize EGL" << std::endl;
+                    display = EGL_NO_DISPLAY;
+                    return false;
+                }
+
+                if (!eglBindAPI(EGL_OPENGL_API))
+                {
+                    std::cerr << "ERROR: EGL has no desktop OpenGL support" << std::endl;
+                    return false;
+                }
+
+                // No surface is ever created, so any config (or none) will do
+                EGLConfig config = NULL;
+                EGLint numConfigs = 0;
+                const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+                eglChooseConfig(display, configAttributes, &config, 1, &numConfigs);
+
+                const EGLint contextAttributes[] = {
+                    EGL_CONTEXT_MAJOR_VERSION, 3,
+                    EGL_CONTEXT_MINOR_VERSION, 3,
+                    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                    EGL_NONE
+                };
+
+                context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+                if (context == EGL_NO_CONTEXT)
+                {
+                    std::cerr << "ERROR: Failed to create EGL context (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+                    return false;
+                }
+
+                if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+                {
+                    std::cerr << "ERROR: Failed to make the EGL context current" << std::endl;
+                    return false;
+                }
+
+                return true;
+            }
+
+            // For gladLoadGLLoader and Learus_GLExt::load
+            static void * getProcAddress(const char * name)
+            {
+                return (void *)eglGetProcAddress(name);
+            }
+
+        private:
+            EGLDisplay display;
+            EGLContext context;
+    };
+
+    // Color + depth renderbuffers behind an FBO, the stand in for the default framebuffer
+    class RenderTarget
+    {
+        public:
+            int width, height;
+
+            RenderTarget(int _width, int _height)
+            : width(_width), height(_height)
+            {
+                glGenFramebuffers(1, &FBO);
+                glGenRenderbuffers(1, &color);
+                glGenRenderbuffers(1, &depth);
+
+                glBindRenderbuffer(GL_RENDERBUFFER, color);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+                glBindRenderbuffer(GL_RENDERBUFFER, depth);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+                glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                    std::cerr << "ERROR: Offscreen framebuffer is incomplete" << std::endl;
+
+                glViewport(0, 0, width, height);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_FRAMEBUFFER, FBO, Learus_Resources::SUB_RENDER_TARGETS, 0, "offscreen target");
+                resources.track(Learus_Resources::KIND_RENDERBUFFER, color, Learus_Resources::SUB_RENDER_TARGETS, (size_t)width * height * 4, "offscreen color");
+                resources.track(Learus_Resources::KIND_RENDERBUFFER, depth, Learus_Resources::SUB_RENDER_TARGETS, (size_t)width * height * 4, "offscreen depth");
+            }
+
+            ~RenderTarget()
+            {
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_FRAMEBUFFER, FBO);
+                resources.release(Learus_Resources::KIND_RENDERBUFFER, color);
+                resources.release(Learus_Resources::KIND_RENDERBUFFER, depth);
+
+                glDeleteFramebuffers(1, &FBO);
+                glDeleteRenderbuffers(1, &color);
+                glDeleteRenderbuffers(1, &depth);
+            }
+
+            void bind()
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+                glViewport(0, 0, width, height);
+            }
+
+            unsigned int framebuffer() const
+            {
+                return FBO;
+            }
+
+            // Tightly packed RGB, top row first (GL hands rows back bottom up)
+            void readPixels(std::vector<unsigned char> & rgb)
+            {
+                rgb.resize((size_t)width * height * 3);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+
+                size_t row = (size_t)width * 3;
+                std::vector<unsigned char> swap(row);
+                for (int y = 0; y < height / 2; y++)
+                {
+                    unsigned char * top = &rgb[y * row];
+                    unsigned char * bottom = &rgb[(height - 1 - y) * row];
+                    std::copy(top, top + row, swap.begin());
+                    std::copy(bottom, bottom + row, top);
+                    std::copy(swap.begin(), swap.end(), bottom);
+                }
+            }
+
+        private:
+            unsigned int FBO, color, depth;
+    };
+}
+
+#endif
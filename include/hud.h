@@ -0,0 +1,644 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "../lib/glad/glad.h"
+
+#include "shader.h"
+#include "shader_manager.h"
+#include "gl_state.h"
+#include "resource_registry.h"
+#include "gpu_profiler.h"
+#include "profiler.h"
+#include "scene.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// An overlay with the frame's numbers: frame and GPU times as a graph, CPU and GPU timings, draw counts, memory and
+// the simulation's step cost. Text and boxes are all quads in one instance buffer, drawn with a single instanced
+// call from a glyph atlas baked into the binary, so the overlay barely shows up in the numbers it draws.
+namespace Learus_Hud
+{
+    // 5x7 glyphs for ASCII 32 - 95, one row per byte, the leftmost pixel in bit 4. Lower case is drawn as upper case.
+    const unsigned int FIRST_CHAR = 32;
+    const unsigned int GLYPH_COUNT = 64;
+    const unsigned int GLYPH_WIDTH = 5;
+    const unsigned int GLYPH_HEIGHT = 7;
+
+    const unsigned char font[GLYPH_COUNT][GLYPH_HEIGHT] =
+    {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   // space
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },   // !
+        { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 },   // "
+        { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },   // #
+        { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },   // $
+        { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },   // %
+        { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },   // &
+        { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },   // '
+        { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },   // (
+        { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },   // )
+        { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },   // *
+        { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },   // +
+        { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },   // ,
+        { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },   // -
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },   // .
+        { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },   // /
+        { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },   // 0
+        { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },   // 1
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },   // 2
+        { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },   // 3
+        { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },   // 4
+        { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },   // 5
+        { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },   // 6
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },   // 7
+        { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },   // 8
+        { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },   // 9
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },   // :
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },   // ;
+        { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },   // <
+        { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },   // =
+        { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },   // >
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },   // ?
+        { 0x0E, 0x11, 0x17, 0x15, 0x17, 0x10, 0x0E },   // @
+        { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },   // A
+        { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },   // B
+        { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },   // C
+        { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },   // D
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },   // E
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },   // F
+        { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },   // G
+        { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },   // H
+        { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },   // I
+        { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },   // J
+        { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },   // K
+        { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },   // L
+        { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },   // M
+        { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },   // N
+        { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },   // O
+        { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },   // P
+        { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },   // Q
+        { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },   // R
+        { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },   // S
+        { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },   // T
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },   // U
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },   // V
+        { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },   // W
+        { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },   // X
+        { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },   // Y
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },   // Z
+        { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E },   // [
+        { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },   // backslash
+        { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E },   // ]
+        { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 },   // ^
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }    // _
+    };
+
+    // Each glyph sits in a cell with a free column and row after it, which is also the spacing between characters.
+    // The cell after the last glyph is filled in, so plain boxes come from the same atlas.
+    const unsigned int CELL_WIDTH = GLYPH_WIDTH + 1;
+    const unsigned int CELL_HEIGHT = GLYPH_HEIGHT + 1;
+    const unsigned int SOLID = GLYPH_COUNT;
+    const unsigned int ATLAS_WIDTH = (GLYPH_COUNT + 1) * CELL_WIDTH;
+
+    const char * hud_vertex_shader =    "#version 330 core\n"
+                                        "layout (location = 0) in vec4 rect;\n"      // x, y, width, height in pixels from the top left
+                                        "layout (location = 1) in vec4 color;\n"
+                                        "layout (location = 2) in float cell;\n"
+                                        "uniform vec2 screen;\n"
+                                        "out vec2 uv;\n"
+                                        "out vec4 tint;\n"
+                                        "flat out int glyph;\n"
+                                        "void main() {\n"
+                                        "    // A four vertex strip per instance, no vertex data\n"
+                                        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+                                        "    vec2 p = rect.xy + corner * rect.zw;\n"
+                                        "    uv = corner;\n"
+                                        "    tint = color;\n"
+                                        "    glyph = int(cell);\n"
+                                        "    gl_Position = vec4(p.x / screen.x * 2.0 - 1.0, 1.0 - p.y / screen.y * 2.0, 0.0, 1.0);\n"
+                                        "}\0";
+    const char * hud_fragment_shader =  "#version 330 core\n"
+                                        "in vec2 uv;\n"
+                                        "in vec4 tint;\n"
+                                        "flat in int glyph;\n"
+                                        "out vec4 FragColor;\n"
+                                        "uniform sampler2D atlas;\n"
+                                        "void main() {\n"
+                                        "    ivec2 texel = ivec2(glyph * 6 + min(int(uv.x * 6.0), 5), min(int(uv.y * 8.0), 7));\n"
+                                        "    FragColor = vec4(tint.rgb, tint.a * texelFetch(atlas, texel, 0).r);\n"
+                                        "}\0";
+
+    // One instance
+    struct Quad
+    {
+        float x, y, width, height;
+        float r, g, b, a;
+        float cell;
+    };
+
+    struct Color
+    {
+        float r, g, b, a;
+    };
+
+    const Color WHITE = { 1.0f, 1.0f, 1.0f, 1.0f };
+    const Color GREY = { 0.6f, 0.6f, 0.6f, 1.0f };
+    const Color GREEN = { 0.3f, 0.9f, 0.3f, 0.9f };
+    const Color YELLOW = { 1.0f, 0.85f, 0.2f, 0.9f };
+    const Color RED = { 1.0f, 0.3f, 0.25f, 0.9f };
+    const Color CYAN = { 0.3f, 0.8f, 1.0f, 0.9f };
+    const Color PANEL = { 0.0f, 0.0f, 0.0f, 0.6f };
+
+    // Text and boxes for one frame, drawn in the order they were added with one instanced call
+    class Batch
+    {
+        public:
+            static const unsigned int MAX_QUADS = 4096;     // Per frame, the rest is dropped
+
+            Batch(Learus_Shaders::ShaderManager & _shaders)
+            : shaders(_shaders), shader(NULL), atlas(0), vertexArray(0), instanceBuffer(0), dropped(0)
+            {
+                quads.reserve(MAX_QUADS);
+                shader = shaders.fromSource(hud_vertex_shader, hud_fragment_shader);
+
+                glGenTextures(1, &atlas);
+                glGenVertexArrays(1, &vertexArray);
+                glGenBuffers(1, &instanceBuffer);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_TEXTURE, atlas, Learus_Resources::SUB_PROFILING, ATLAS_WIDTH * CELL_HEIGHT, "HUD glyph atlas");
+                resources.track(Learus_Resources::KIND_VERTEX_ARRAY, vertexArray, Learus_Resources::SUB_PROFILING, 0, "HUD");
+                resources.track(Learus_Resources::KIND_BUFFER, instanceBuffer, Learus_Resources::SUB_PROFILING, MAX_QUADS * sizeof(Quad), "HUD instances");
+
+                bake();
+
+                Learus_GLState::current().bindVertexArray(vertexArray);
+                glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+                glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * sizeof(Quad), NULL, GL_STREAM_DRAW);
+
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (void *)offsetof(Quad, x));
+                glVertexAttribDivisor(0, 1);
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (void *)offsetof(Quad, r));
+                glVertexAttribDivisor(1, 1);
+                glEnableVertexAttribArray(2);
+                glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Quad), (void *)offsetof(Quad, cell));
+                glVertexAttribDivisor(2, 1);
+
+                Learus_GLState::current().bindVertexArray(0);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+            }
+
+            ~Batch()
+            {
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_TEXTURE, atlas);
+                resources.release(Learus_Resources::KIND_VERTEX_ARRAY, vertexArray);
+                resources.release(Learus_Resources::KIND_BUFFER, instanceBuffer);
+
+                Learus_GLState::StateCache & state = Learus_GLState::current();
+                state.forgetTexture(atlas);
+                state.forgetVertexArray(vertexArray);
+
+                glDeleteTextures(1, &atlas);
+                glDeleteVertexArrays(1, &vertexArray);
+                glDeleteBuffers(1, &instanceBuffer);
+            }
+
+            void clear()
+            {
+                quads.clear();
+            }
+
+            unsigned int size() const
+            {
+                return quads.size();
+            }
+
+            Quad & at(unsigned int index)
+            {
+                return quads[index];
+            }
+
+            void box(float x, float y, float width, float height, const Color & color)
+            {
+                add(x, y, width, height, color, SOLID);
+            }
+
+            // Returns the x after the last character. scale is pixels per glyph pixel.
+            float text(float x, float y, const char * string, const Color & color, float scale)
+            {
+                for (const char * c = string; *c; c++)
+                {
+                    unsigned int code = (unsigned char)*c;
+                    if (code >= 'a' && code <= 'z')
+                        code -= 'a' - 'A';
+
+                    unsigned int glyph = code >= FIRST_CHAR && code < FIRST_CHAR + GLYPH_COUNT ? code - FIRST_CHAR : '?' - FIRST_CHAR;
+                    if (glyph != 0)
+                        add(x, y, CELL_WIDTH * scale, CELL_HEIGHT * scale, color, glyph);
+
+                    x += CELL_WIDTH * scale;
+                }
+
+                return x;
+            }
+
+            // Everything added since clear(), over whatever the bound framebuffer has
+            void draw(int width, int height)
+            {
+                if (quads.empty() || !shaders.ready(shader))
+                    return;
+
+                Learus_GLState::StateCache & state = Learus_GLState::current();
+                state.useProgram(shader->ID);
+                state.bindVertexArray(vertexArray);
+                state.bindTexture(0, GL_TEXTURE_2D, atlas);
+                shader->setInt("atlas", 0);
+                shader->setVec2("screen", glm::vec2((float)width, (float)height));
+
+                // Orphan the old storage instead of waiting for the previous frame to finish with it
+                glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+                glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * sizeof(Quad), NULL, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, quads.size() * sizeof(Quad), &quads[0]);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+                glDisable(GL_DEPTH_TEST);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, quads.size());
+                glDisable(GL_BLEND);
+                glEnable(GL_DEPTH_TEST);
+            }
+
+            // Quads that did not fit in MAX_QUADS, over all frames
+            unsigned long droppedQuads() const
+            {
+                return dropped;
+            }
+
+        private:
+            Learus_Shaders::ShaderManager & shaders;
+            Shader * shader;
+            GLuint atlas;
+            GLuint vertexArray;
+            GLuint instanceBuffer;
+
+            std::vector<Quad> quads;
+            unsigned long dropped;
+
+            void add(float x, float y, float width, float height, const Color & color, unsigned int cell)
+            {
+                if (quads.size() == MAX_QUADS)
+                {
+                    dropped++;
+                    return;
+                }
+
+                Quad quad = { x, y, width, height, color.r, color.g, color.b, color.a, (float)cell };
+                quads.push_back(quad);
+            }
+
+            // One row of cells, a byte per texel
+            void bake()
+            {
+                std::vector<unsigned char> texels(ATLAS_WIDTH * CELL_HEIGHT, 0);
+                for (unsigned int glyph = 0; glyph < GLYPH_COUNT; glyph++)
+                {
+                    for (unsigned int row = 0; row < GLYPH_HEIGHT; row++)
+                    {
+                        for (unsigned int column = 0; column < GLYPH_WIDTH; column++)
+                        {
+                            if (font[glyph][row] & (1 << (GLYPH_WIDTH - 1 - column)))
+                                texels[row * ATLAS_WIDTH + glyph * CELL_WIDTH + column] = 255;
+                        }
+                    }
+                }
+
+                for (unsigned int row = 0; row < CELL_HEIGHT; row++)
+                    std::memset(&texels[row * ATLAS_WIDTH + SOLID * CELL_WIDTH], 255, CELL_WIDTH);
+
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, atlas);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, CELL_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, &texels[0]);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+
+            Batch(const Batch &);
+            Batch & operator=(const Batch &);
+    };
+
+    // The overlay itself. Call draw() once per frame after the scene, with its framebuffer still bound. Hidden it
+    // costs nothing but the check; shown it turns on the scene's GPU profiler for the per pass times, and times
+    // itself there as the "HUD" scope.
+    class Hud : public Learus_Profiler::FrameListener
+    {
+        public:
+            static const unsigned int SAMPLES = 120;        // Frames in the graph
+            static const unsigned int MAX_PASSES = 16;
+
+            Hud(Learus_Shaders::ShaderManager & shaders, Learus_Profiler::GpuProfiler & _profiler, bool _visible)
+            : visible(_visible), batch(shaders), profiler(_profiler), started(false), head(0),
+              intervalMs(0.0), gpuMs(0.0), sceneMs(0.0), recordMs(0.0), replayMs(0.0), stepMs(0.0), hudCpuMs(0.0), hudGpuMs(0.0),
+              previousIssued(0), frames(0), cpuTotal(0.0), gpuTotal(0.0), gpuFrames(0)
+            {
+                for (unsigned int i = 0; i < SAMPLES; i++)
+                    intervals[i] = gpuTimes[i] = 0.0f;
+                for (unsigned int i = 0; i < MAX_PASSES; i++)
+                    passMs[i] = 0.0;
+
+                profiler.listen(this);
+            }
+
+            ~Hud()
+            {
+                profiler.unlisten(this);
+            }
+
+            void toggle()
+            {
+                visible = !visible;
+                started = false;
+            }
+
+            bool isVisible() const
+            {
+                return visible;
+            }
+
+            // The loop waited for something else, the time until the next frame is no frame time
+            void resync()
+            {
+                started = false;
+            }
+
+            // Before the frame's scene, so the CPU time of the frame can be told apart from the time between frames
+            void beginFrame()
+            {
+                if (!visible)
+                    return;
+
+                frameStart = std::chrono::steady_clock::now();
+            }
+
+            // simulation may be NULL when frames are not driven by one
+            void draw(Learus_Scene::Scene & scene, const Learus_Simulation::Simulation * simulation, int width, int height)
+            {
+                if (!visible)
+                    return;
+
+                PROFILE_SCOPE("Hud::Draw");
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                if (!profiler.isEnabled())
+                    profiler.enable();
+
+                collect(scene, simulation, start);
+                layout(scene, simulation, height);
+
+                profiler.begin("HUD");
+                glViewport(0, 0, width, height);
+                batch.draw(width, height);
+                profiler.end();
+
+                // Its own state changes are not the scene's
+                previousDraws = scene.arena.draws.stats;
+                previousQueue = scene.renderQueue.stats;
+                previousIssued = Learus_GLState::current().stats.issued();
+
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                hudCpuMs = average(hudCpuMs, ms);
+                cpuTotal += ms;
+                frames++;
+            }
+
+            void gpuFrame(const Learus_Profiler::GpuProfiler & gpu)
+            {
+                double ms;
+                if (!gpu.lastTime("HUD", ms))
+                    return;
+
+                hudGpuMs = average(hudGpuMs, ms);
+                gpuTotal += ms;
+                gpuFrames++;
+            }
+
+            // After the profiler's flush()
+            void printStats()
+            {
+                if (frames == 0)
+                    return;
+
+                std::cout << "HUD: " << frames << " frames, " << cpuTotal / frames << " ms CPU";
+                if (gpuFrames)
+                    std::cout << ", " << gpuTotal / gpuFrames << " ms GPU";
+                std::cout << " per frame";
+                if (batch.droppedQuads())
+                    std::cout << ", " << batch.droppedQuads() << " quads did not fit";
+                std::cout << std::endl;
+            }
+
+        private:
+            static constexpr double SMOOTHING = 0.1;
+            static constexpr float GRAPH_MS = 33.3f;        // Top of the graph
+            static constexpr float TARGET_MS = 16.7f;       // Line across it, bars above it turn yellow, red above twice that
+
+            bool visible;
+            Batch batch;
+            Learus_Profiler::GpuProfiler & profiler;
+
+            std::chrono::steady_clock::time_point frameStart, lastDraw;
+            bool started;
+
+            float intervals[SAMPLES];
+            float gpuTimes[SAMPLES];
+            unsigned int head;
+
+            // Smoothed, so the text can be read
+            double intervalMs, gpuMs, sceneMs, recordMs, replayMs, stepMs, hudCpuMs, hudGpuMs;
+            double passMs[MAX_PASSES];
+
+            Learus_Geometry::DrawStats previousDraws, frameDraws;
+            Learus_Render::QueueStats previousQueue;
+            unsigned long previousIssued, frameIssued;
+
+            unsigned long frames;
+            double cpuTotal, gpuTotal;
+            unsigned long gpuFrames;
+
+            static double average(double current, double sample)
+            {
+                return current > 0.0 ? current + SMOOTHING * (sample - current) : sample;
+            }
+
+            // The numbers of the frame that was just drawn
+            void collect(Learus_Scene::Scene & scene, const Learus_Simulation::Simulation * simulation, std::chrono::steady_clock::time_point now)
+            {
+                float interval = 0.0f;
+                if (started)
+                {
+                    interval = std::chrono::duration<float, std::milli>(now - lastDraw).count();
+                    intervalMs = average(intervalMs, interval);
+                }
+                started = true;
+                lastDraw = now;
+
+                // Not there on the frame the overlay was turned on
+                if (frameStart.time_since_epoch().count() != 0)
+                    sceneMs = average(sceneMs, std::chrono::duration<double, std::milli>(now - frameStart).count());
+                frameStart = std::chrono::steady_clock::time_point();
+
+                const std::vector<Learus_Profiler::PassTime> & passes = scene.gpuProfiler.passes;
+                float gpu = 0.0f;
+                for (unsigned int i = 0; i < passes.size() && i < MAX_PASSES; i++)
+                {
+                    passMs[i] = average(passMs[i], passes[i].lastMs);
+                    if (std::strcmp(passes[i].name, "Frame") == 0)
+                    {
+                        gpu = passes[i].lastMs;
+                        gpuMs = passMs[i];
+                    }
+                }
+
+                intervals[head] = interval;
+                gpuTimes[head] = gpu;
+                head = (head + 1) % SAMPLES;
+
+                const Learus_Render::QueueStats & queue = scene.renderQueue.stats;
+                recordMs = average(recordMs, (queue.recordSeconds - previousQueue.recordSeconds) * 1000.0);
+                replayMs = average(replayMs, (queue.replaySeconds - previousQueue.replaySeconds) * 1000.0);
+
+                const Learus_Geometry::DrawStats & draws = scene.arena.draws.stats;
+                frameDraws.commands = draws.commands - previousDraws.commands;
+                frameDraws.drawCalls = draws.drawCalls - previousDraws.drawCalls;
+                frameDraws.triangles = draws.triangles - previousDraws.triangles;
+                frameIssued = Learus_GLState::current().stats.issued() - previousIssued;
+
+                if (simulation)
+                    stepMs = average(stepMs, simulation->stepMs());
+            }
+
+            // Fills the batch, top left of the screen
+            void layout(Learus_Scene::Scene & scene, const Learus_Simulation::Simulation * simulation, int height)
+            {
+                const float scale = (float)std::max(1, height / 360);
+                const float lineHeight = (CELL_HEIGHT + 2) * scale;
+                const float margin = 4.0f * scale;
+                const float panelWidth = 48 * CELL_WIDTH * scale;
+                const float graphHeight = 40.0f * scale;
+                const float barWidth = 2.0f * scale;
+
+                char line[128];
+                float x = margin * 2.0f;
+                float y = margin * 2.0f;
+
+                // The panel goes first so it is drawn under everything, its size is filled in at the end
+                batch.clear();
+                batch.box(0.0f, 0.0f, 0.0f, 0.0f, PANEL);
+
+                std::snprintf(line, sizeof(line), "Frame %.2f ms  %.0f fps  GPU %.2f ms", intervalMs, intervalMs > 0.0 ? 1000.0 / intervalMs : 0.0, gpuMs);
+                batch.text(x, y, line, WHITE, scale);
+                y += lineHeight;
+
+                // Frame times, oldest on the left, with the GPU's share of each frame on top
+                batch.box(x, y, SAMPLES * barWidth, graphHeight, PANEL);
+                for (unsigned int i = 0; i < SAMPLES; i++)
+                {
+                    unsigned int sample = (head + i) % SAMPLES;
+                    float bx = x + i * barWidth;
+
+                    float interval = intervals[sample];
+                    const Color & color = interval > 2.0f * TARGET_MS ? RED : interval > TARGET_MS ? YELLOW : GREEN;
+                    float h = std::min(interval, GRAPH_MS) / GRAPH_MS * graphHeight;
+                    if (h > 0.0f)
+                        batch.box(bx, y + graphHeight - h, barWidth, h, color);
+
+                    h = std::min(gpuTimes[sample], GRAPH_MS) / GRAPH_MS * graphHeight;
+                    if (h > 0.0f)
+                        batch.box(bx, y + graphHeight - h, barWidth * 0.5f, h, CYAN);
+                }
+                batch.box(x, y + graphHeight - TARGET_MS / GRAPH_MS * graphHeight, SAMPLES * barWidth, scale, GREY);
+                y += graphHeight + margin;
+
+                std::snprintf(line, sizeof(line), "CPU  scene %.2f  record %.2f  replay %.2f ms", sceneMs, recordMs, replayMs);
+                batch.text(x, y, line, WHITE, scale);
+                y += lineHeight;
+
+                // Every GPU scope but the whole frame and the overlay's own, wrapped to the panel
+                float px = batch.text(x, y, "GPU ", WHITE, scale);
+                const std::vector<Learus_Profiler::PassTime> & passes = scene.gpuProfiler.passes;
+                for (unsigned int i = 0; i < passes.size() && i < MAX_PASSES; i++)
+                {
+                    if (std::strcmp(passes[i].name, "Frame") == 0 || std::strcmp(passes[i].name, "HUD") == 0)
+                        continue;
+
+                    std::snprintf(line, sizeof(line), " %s %.2f", passes[i].name, passMs[i]);
+                    if (px + std::strlen(line) * CELL_WIDTH * scale > x + panelWidth)
+                    {
+                        y += lineHeight;
+                        px = x + 4 * CELL_WIDTH * scale;
+                    }
+                    px = batch.text(px, y, line, CYAN, scale);
+                }
+                y += lineHeight;
+
+                if (simulation)
+                {
+                    std::snprintf(line, sizeof(line), "SIM  step %.3f ms at %.0f Hz", stepMs, simulation->stepRate());
+                    batch.text(x, y, line, WHITE, scale);
+                    y += lineHeight;
+                }
+
+                std::snprintf(line, sizeof(line), "DRAW %lu calls  %lu meshes  %luk tris  %lu state", frameDraws.drawCalls, frameDraws.commands,
+                              (frameDraws.triangles + 500) / 1000, frameIssued);
+                batch.text(x, y, line, WHITE, scale);
+                y += lineHeight;
+
+                // GPU memory per subsystem, wrapped the same way
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                std::snprintf(line, sizeof(line), "MEM  %.1f MB:", resources.gpuBytes() / 1048576.0);
+                px = batch.text(x, y, line, WHITE, scale);
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    size_t bytes = resources.usage[i].gpuBytes;
+                    if (bytes == 0)
+                        continue;
+
+                    std::snprintf(line, sizeof(line), " %s %.1f", Learus_Resources::subsystem_names[i], bytes / 1048576.0);
+                    if (px + std::strlen(line) * CELL_WIDTH * scale > x + panelWidth)
+                    {
+                        y += lineHeight;
+                        px = x + 4 * CELL_WIDTH * scale;
+                    }
+                    px = batch.text(px, y, line, GREY, scale);
+                }
+                y += lineHeight;
+
+                std::snprintf(line, sizeof(line), "HUD  %.3f ms CPU  %.3f ms GPU  %u quads", hudCpuMs, hudGpuMs, batch.size());
+                batch.text(x, y, line, GREY, scale);
+                y += lineHeight;
+
+                Quad & panel = batch.at(0);
+                panel.x = margin;
+                panel.y = margin;
+                panel.width = panelWidth + margin * 2.0f;
+                panel.height = y - margin;
+            }
+
+            Hud(const Hud &);
+            Hud & operator=(const Hud &);
+    };
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes 8 bit RGB images, top row first. PNG output is uncompressed (stored deflate blocks),
+// which keeps this dependency free and fast to write at the cost of file size.
+namespace Learus_Image
+{
+    inline uint32_t crc32(const unsigned char * data, size_t size, uint32_t crc = 0)
+    {
+        static uint32_t table[256];
+        static bool ready = false;
+
+        if (!ready)
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            ready = true;
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+        return ~crc;
+    }
+
+    // Reused from one image to the next, so that writing a sequence of the same size does not allocate after the first
+    struct Buffers
+    {
+        std::vector<unsigned char> raw;
+        std::vector<unsigned char> zlib;
+    };
+
+    inline bool writePPM(const char * path, int width, int height, const unsigned char * rgb)
+    {
+        FILE * file = std::fopen(path, "wb");
+        if (!file)
+        {
+            std::cerr << "ERROR: Could not open image for writing: " << path << std::endl;
+            return false;
+        }
+
+        std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+        size_t size = (size_t)width * height * 3;
+        bool ok = std::fwrite(rgb, 1, size, file) == size;
+
+        std::fclose(file);
+        return ok;
+    }
+
+    inline void writeChunk(FILE * file, const char * type, const unsigned char * data, uint32_t size)
+    {
+        unsigned char length[4] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size };
+        std::fwrite(length, 1, 4, file);
+        std::fwrite(type, 1, 4, file);
+        if (size > 0)
+            std::fwrite(data, 1, size, file);
+
+        uint32_t crc = crc32((const unsigned char *)type, 4);
+        if (size > 0)
+            crc = crc32(data, size, crc);
+
+        unsigned char crcBytes[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+        std::fwrite(crcBytes, 1, 4, file);
+    }
+
+    inline bool writePNG(const char * path, int width, int height, const unsigned char * rgb, Buffers & buffers)
+    {
+        // Filter byte (0 = none) in front of every row
+        size_t rowSize = (size_t)width * 3 + 1;
+        std::vector<unsigned char> & raw = buffers.raw;
+        raw.resize(rowSize * height);
+        for (int y = 0; y < height; y++)
+        {
+            raw[y * rowSize] = 0;
+            std::copy(rgb + (size_t)y * width * 3, rgb + (size_t)(y + 1) * width * 3, raw.begin() + y * rowSize + 1);
+        }
+
+        // zlib stream of stored blocks, at most 65535 bytes each
+        std::vector<unsigned char> & zlib = buffers.zlib;
+        zlib.clear();
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+
+        uint32_t a = 1, b = 0;
+        for (size_t offset = 0; offset < raw.size() || offset == 0; )
+        {
+            size_t length = raw.size() - offset;
+            if (length > 65535)
+                length = 65535;
+
+            bool last = offset + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(length & 0xFF);
+            zlib.push_back((length >> 8) & 0xFF);
+            zlib.push_back(~length & 0xFF);
+            zlib.push_back((~length >> 8) & 0xFF);
+
+            for (size_t i = 0; i < length; i++)
+            {
+                unsigned char byte = raw[offset + i];
+                zlib.push_back(byte);
+
+                a = (a + byte) % 65521;
+                b = (b + a) % 65521;
+            }
+
+            offset += length;
+            if (last)
+                break;
+        }
+
+        uint32_t adler = (b << 16) | a;
+        zlib.push_back(adler >> 24);
+        zlib.push_back((adler >> 16) & 0xFF);
+        zlib.push_back((adler >> 8) & 0xFF);
+        zlib.push_back(adler & 0xFF);
+
+        FILE * file = std::fopen(path, "wb");
+        if (!file)
+        {
+            std::cerr << "ERROR: Could not open image for writing: " << path << std::endl;
+            return false;
+        }
+
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        std::fwrite(signature, 1, 8, file);
+
+        unsigned char header[13] = {
+            (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+            (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+            8,  // bit depth
+            2,  // RGB
+            0, 0, 0
+        };
+
+        writeChunk(file, "IHDR", header, sizeof(header));
+        writeChunk(file, "IDAT", &zlib[0], zlib.size());
+        writeChunk(file, "IEND", NULL, 0);
+
+        bool ok = !std::ferror(file);
+        std::fclose(file);
+        return ok;
+    }
+
+    // Picks the format from the extension. Anything that is not .png is written as PPM.
+    inline bool write(const char * path, int width, int height, const unsigned char * rgb, Buffers & buffers)
+    {
+        size_t length = std::strlen(path);
+        if (length >= 4 && std::strcmp(path + length - 4, ".png") == 0)
+            return writePNG(path, width, height, rgb, buffers);
+
+        return writePPM(path, width, height, rgb);
+    }
+
+    inline bool write(const std::string & path, int width, int height, const unsigned char * rgb)
+    {
+        Buffers buffers;
+        return write(path.c_str(), width, height, rgb, buffers);
+    }
+}
+
+#endif
@@ -5,19 +5,14 @@
 #include "../lib/glm/glm.hpp"
 
 #include "shader.h"
+#include "geometry_arena.h"
+#include "shader_variants.h"
+#include "command_list.h"
+#include "mesh_lod.h"
 
 #include <string>
 #include <vector>
 
-struct Vertex
-{
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-};
-
 struct Texture
 {
     unsigned int id;
@@ -28,88 +23,124 @@ struct Texture
 class Mesh
 {
     public:
-        // Mesh Data
+        // Mesh Data. Vertices and indices are only kept until they are uploaded to the arena.
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
-        unsigned int VAO;
+
+        // Where this mesh's vertices and indices live inside the shared arena
+        Learus_Geometry::Allocation allocation;
+
+        // Index ranges of the levels of detail over the same vertices, lods[0] is allocation
+        Learus_Geometry::Allocation lods[Learus_Lod::LEVELS];
+
+        // Learus_Shaders::Feature bits for the maps this mesh has, picks its shader variant
+        unsigned int features;
 
         // Methods
-        Mesh(std::vector<Vertex> _vertices, std::vector<unsigned int> _indices, std::vector<Texture> _textures)
-        : vertices(_vertices), indices(_indices), textures(_textures)
+        Mesh(std::vector<Vertex> _vertices, std::vector<unsigned int> _indices, std::vector<Texture> _textures, Learus_Geometry::GeometryArena & _arena)
+        : vertices(_vertices), indices(_indices), textures(_textures), features(0), arena(&_arena), samplerProgram(0)
         {
+            Learus_Resources::registry().trackCpu(Learus_Resources::SUB_GEOMETRY, cpuBytes());
             this->setupMesh();
+            this->nameSamplers();
         }
 
-        void Draw(Shader shader)
+        // Binds this mesh's textures to consecutive units and points the material samplers at them, as commands
+        void recordTextures(const Shader & shader, Learus_Commands::CommandList & commands)
         {
-            unsigned int diffuseNr = 1;
-            unsigned int specularNr = 1;
-            unsigned int normalNr   = 1;
-            unsigned int heightNr   = 1;
-            unsigned int emissionNr = 1;
+            if (samplerProgram != shader.ID)
+            {
+                samplerLocations.resize(samplerNames.size());
+                for (unsigned int i = 0; i < samplerNames.size(); i++)
+                    samplerLocations[i] = shader.location(samplerNames[i]);
+
+                samplerProgram = shader.ID;
+            }
 
             for (unsigned int i = 0; i < textures.size(); i++)
             {
-                glActiveTexture(GL_TEXTURE0 + i);
-
-                std::string number;
-                std::string name = textures[i].type;
+                commands.uniform(samplerLocations[i], (int)i);
+                commands.bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+            }
+        }
 
-                if (name == "texture_diffuse")
-                    number = std::to_string(diffuseNr++);
-                else if (name == "texture_specular")
-                    number = std::to_string(specularNr++);
-                else if (name == "texture_normal")
-                    number = std::to_string(normalNr++); // transfer unsigned int to stream
-                else if (name == "texture_height")
-                    number = std::to_string(heightNr++); // transfer unsigned int to stream
-                else if (name == "texture_emission")
-                    number = std::to_string(emissionNr++);
+        // True when both meshes bind exactly the same textures, so they can share one multi-draw
+        bool sameTextures(const Mesh & other) const
+        {
+            if (textures.size() != other.textures.size())
+                return false;
 
-                shader.setFloat(("material." + name + number).c_str(), i);
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            for (unsigned int i = 0; i < textures.size(); i++)
+            {
+                if (textures[i].id != other.textures[i].id || textures[i].type != other.textures[i].type)
+                    return false;
             }
 
-            // Draw the mesh
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-
-            // Set everything back (cleanup)
-            glBindVertexArray(0);
-            glActiveTexture(GL_TEXTURE0);
+            return true;
         }
 
     private:
         // Render Data
-        unsigned int VBO, EBO;
+        Learus_Geometry::GeometryArena * arena;
+
+        // "material.<type>" for every texture, and their locations in samplerProgram
+        std::vector<std::string> samplerNames;
+        std::vector<GLint> samplerLocations;
+        unsigned int samplerProgram;
 
         // Methods
         void setupMesh()
         {
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-            glGenBuffers(1, &EBO);
+            allocation = arena->allocate(vertices, indices);
 
-            glBindVertexArray(VAO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            lods[0] = allocation;
+            Learus_Lod::build(vertices, indices, *arena, lods);
 
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+            // The arena holds the only copy that is ever read again
+            Learus_Resources::registry().releaseCpu(Learus_Resources::SUB_GEOMETRY, cpuBytes());
+            std::vector<Vertex>().swap(vertices);
+            std::vector<unsigned int>().swap(indices);
+        }
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        size_t cpuBytes() const
+        {
+            return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+        }
 
-            // Vertex positions
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-            // Vertex normals
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
-            // Vertex texture coordinates
-            glEnableVertexAttribArray(2);
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+        // texture_diffuse -> material.diffuse, a second one -> material.diffuse2 and so on
+        void nameSamplers()
+        {
+            unsigned int diffuseNr = 1;
+            unsigned int specularNr = 1;
+            unsigned int normalNr   = 1;
+            unsigned int heightNr   = 1;
+            unsigned int emissionNr = 1;
 
-            glBindVertexArray(0);
+            for (unsigned int i = 0; i < textures.size(); i++)
+            {
+                unsigned int number = 0;
+                std::string name = textures[i].type;
+
+                if (name == "texture_diffuse")
+                    number = diffuseNr++;
+                else if (name == "texture_specular")
+                    number = specularNr++;
+                else if (name == "texture_normal")
+                    number = normalNr++;
+                else if (name == "texture_height")
+                    number = heightNr++;
+                else if (name == "texture_emission")
+                    number = emissionNr++;
+
+                std::string field = name.compare(0, 8, "texture_") == 0 ? name.substr(8) : name;
+                if (number > 1)
+                    field += std::to_string(number);
+
+                samplerNames.push_back("material." + field);
+
+                features |= Learus_Shaders::featureForTexture(name);
+            }
         }
 };
 
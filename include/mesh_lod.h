@@ -0,0 +1,162 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "../lib/glm/glm.hpp"
+
+#include "geometry_arena.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Coarser versions of a mesh for when it is small on screen. They are made by vertex clustering: the bounding box is
+// cut into a grid, every vertex moves onto the first vertex of its cell, and triangles that collapse are dropped.
+// Only the indices change, so every level draws from the vertices the full mesh already uploaded.
+// Cells are also split by texture coordinates, so the two sides of a texture seam are never merged. To keep the seam
+// closed, both sides pick the same position: seam vertices stand in for a cell first, the lowest position winning.
+namespace Learus_Lod
+{
+    // Level 0 is the mesh itself
+    const unsigned int LEVELS = 4;
+
+    // Grid cells along the longest side of the bounding box, per level
+    const unsigned int cells[LEVELS] = { 0, 48, 24, 12 };
+
+    // Texture coordinate cells per axis
+    const unsigned int UV_CELLS = 4;
+
+    inline unsigned int uvCell(const glm::vec2 & texCoords)
+    {
+        glm::vec2 uv = glm::clamp(texCoords, 0.0f, 1.0f) * (float)UV_CELLS;
+        return std::min((unsigned int)uv.x, UV_CELLS - 1) * UV_CELLS + std::min((unsigned int)uv.y, UV_CELLS - 1);
+    }
+
+    inline bool positionLess(const glm::vec3 & a, const glm::vec3 & b)
+    {
+        if (a.x != b.x)
+            return a.x < b.x;
+        if (a.y != b.y)
+            return a.y < b.y;
+        return a.z < b.z;
+    }
+
+    // Marks the vertices that share their position with a vertex in another texture coordinate cell
+    inline void findSeams(const std::vector<Vertex> & vertices, std::vector<unsigned char> & seam)
+    {
+        std::vector<unsigned int> order(vertices.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        std::sort(order.begin(), order.end(), [&vertices](unsigned int a, unsigned int b) { return positionLess(vertices[a].Position, vertices[b].Position); });
+
+        seam.assign(vertices.size(), 0);
+        for (unsigned int start = 0, end = 0; start < order.size(); start = end)
+        {
+            bool split = false;
+            for (end = start + 1; end < order.size() && vertices[order[end]].Position == vertices[order[start]].Position; end++)
+                split = split || uvCell(vertices[order[end]].TexCoords) != uvCell(vertices[order[start]].TexCoords);
+
+            for (unsigned int i = start; split && i < end; i++)
+                seam[order[i]] = 1;
+        }
+    }
+
+    // The triangles of indices that are still triangles once vertices are snapped to a grid of the given resolution
+    inline void cluster(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices, unsigned int resolution,
+                        std::vector<unsigned int> & result)
+    {
+        result.clear();
+        if (vertices.empty() || resolution == 0)
+            return;
+
+        glm::vec3 lower = vertices[0].Position;
+        glm::vec3 upper = vertices[0].Position;
+        for (unsigned int i = 1; i < vertices.size(); i++)
+        {
+            lower = glm::min(lower, vertices[i].Position);
+            upper = glm::max(upper, vertices[i].Position);
+        }
+
+        glm::vec3 extent = upper - lower;
+        float cell = std::max(extent.x, std::max(extent.y, extent.z)) / resolution;
+        if (!(cell > 0.0f))
+            return;
+
+        std::vector<unsigned char> seam;
+        findSeams(vertices, seam);
+
+        std::unordered_map<uint64_t, unsigned int> representatives;
+        std::vector<uint64_t> keys(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            glm::vec3 position = (vertices[i].Position - lower) / cell;
+            uint64_t x = std::min((uint64_t)position.x, (uint64_t)resolution - 1);
+            uint64_t y = std::min((uint64_t)position.y, (uint64_t)resolution - 1);
+            uint64_t z = std::min((uint64_t)position.z, (uint64_t)resolution - 1);
+
+            keys[i] = ((x * resolution + y) * resolution + z) * UV_CELLS * UV_CELLS + uvCell(vertices[i].TexCoords);
+
+            std::pair<std::unordered_map<uint64_t, unsigned int>::iterator, bool> inserted = representatives.insert(std::make_pair(keys[i], i));
+            unsigned int & representative = inserted.first->second;
+            if (!inserted.second && (seam[i] > seam[representative] || (seam[i] == seam[representative] && positionLess(vertices[i].Position, vertices[representative].Position))))
+                representative = i;
+        }
+
+        std::vector<unsigned int> remap(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            remap[i] = representatives[keys[i]];
+
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]];
+            unsigned int b = remap[indices[i + 1]];
+            unsigned int c = remap[indices[i + 2]];
+
+            if (a == b || b == c || a == c)
+                continue;
+
+            result.push_back(a);
+            result.push_back(b);
+            result.push_back(c);
+        }
+    }
+
+    // Uploads the coarser levels of a mesh whose full detail is at lods[0]. A level that would not save anything
+    // shares the index range of the one before it.
+    inline void build(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices,
+                      Learus_Geometry::GeometryArena & arena, Learus_Geometry::Allocation lods[LEVELS])
+    {
+        std::vector<unsigned int> simplified;
+
+        for (unsigned int level = 1; level < LEVELS; level++)
+        {
+            lods[level] = lods[level - 1];
+
+            cluster(vertices, indices, cells[level], simplified);
+            if (simplified.empty() || simplified.size() >= lods[level - 1].indexCount)
+                continue;
+
+            lods[level] = arena.allocateIndices(lods[0], simplified);
+        }
+    }
+
+    // The level for something diameter pixels across: full detail down to threshold pixels, one level coarser at
+    // every halving below that. threshold 0 always picks full detail.
+    inline unsigned int select(float diameter, float threshold)
+    {
+        if (threshold <= 0.0f || diameter >= threshold)
+            return 0;
+
+        unsigned int level = 1;
+        while (level + 1 < LEVELS && diameter * 2.0f < threshold)
+        {
+            diameter *= 2.0f;
+            level++;
+        }
+
+        return level;
+    }
+}
+
+#endif
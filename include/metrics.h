@@ -0,0 +1,453 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "alloc_tracker.h"
+#include "resource_registry.h"
+#include "gpu_profiler.h"
+#include "simulation.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Serves the app's numbers in the Prometheus text format on a localhost port, for monitoring machines that run it
+// unattended. The render thread only stores into atomics once per frame; a server thread formats them whenever
+// a scrape comes in, so a slow or stuck client never holds up a frame.
+namespace Learus_Metrics
+{
+    // Frame times in milliseconds, the upper bound of each bucket. Above the last one goes into +Inf.
+    const unsigned int BUCKETS = 12;
+    const double bucketBounds[BUCKETS] = { 1.0, 2.0, 4.0, 8.0, 12.0, 16.7, 20.0, 25.0, 33.3, 50.0, 100.0, 250.0 };
+
+    // One writer adds to it, any thread reads it. A reader may see an add half done (the bucket but not yet the sum),
+    // which a scrape can live with.
+    class Histogram
+    {
+        public:
+            Histogram() : sumMicroseconds(0)
+            {
+                for (unsigned int i = 0; i <= BUCKETS; i++)
+                    counts[i].store(0);
+            }
+
+            void add(double ms)
+            {
+                unsigned int bucket = 0;
+                while (bucket < BUCKETS && ms > bucketBounds[bucket])
+                    bucket++;
+
+                counts[bucket].fetch_add(1, std::memory_order_relaxed);
+                sumMicroseconds.fetch_add((uint64_t)(ms * 1000.0), std::memory_order_relaxed);
+            }
+
+            // Cumulative buckets in seconds, the way Prometheus wants them
+            void write(std::string & out, const char * name, const char * help) const
+            {
+                char line[256];
+                std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+                out += line;
+
+                uint64_t total = 0;
+                for (unsigned int i = 0; i <= BUCKETS; i++)
+                {
+                    total += counts[i].load(std::memory_order_relaxed);
+                    if (i < BUCKETS)
+                        std::snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name, bucketBounds[i] / 1000.0, (unsigned long long)total);
+                    else
+                        std::snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)total);
+                    out += line;
+                }
+
+                std::snprintf(line, sizeof(line), "%s_sum %.6f\n%s_count %llu\n", name, sumMicroseconds.load(std::memory_order_relaxed) / 1e6,
+                              name, (unsigned long long)total);
+                out += line;
+            }
+
+        private:
+            std::atomic<uint64_t> counts[BUCKETS + 1];
+            std::atomic<uint64_t> sumMicroseconds;
+
+            Histogram(const Histogram &);
+            Histogram & operator=(const Histogram &);
+    };
+
+    class Metrics
+    {
+        public:
+            static const unsigned int MAX_ASSETS = 16;
+
+            // framePeriodMs is how long a frame is supposed to take; frames that take half as long again count as dropped
+            Metrics(unsigned short _port, double _framePeriodMs)
+            : port(_port), framePeriodMs(_framePeriodMs), listener(-1), stopping(false), assetCount(0),
+              started(false), lastResolved(0), frames(0), droppedFrames(0), hasSimulation(false), simSteps(0),
+              simStepNanoseconds(0), simTargetRate(0.0f), scrapes(0), badRequests(0),
+              lastScrapeSteps(0), measuredStepRate(0.0), hasStepRate(false), hasLastScrape(false)
+            {
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    gpuBytes[i].store(0);
+                    cpuBytes[i].store(0);
+                }
+            }
+
+            ~Metrics()
+            {
+                stop();
+            }
+
+            // Before start(), the list is read-only once the server runs
+            void addLoadTime(const char * asset, double seconds)
+            {
+                if (assetCount == MAX_ASSETS)
+                    return;
+
+                assets[assetCount].name = asset;
+                assets[assetCount].seconds = seconds;
+                assetCount++;
+            }
+
+            // Listens on 127.0.0.1 only
+            bool start()
+            {
+                listener = socket(AF_INET, SOCK_STREAM, 0);
+                if (listener < 0)
+                {
+                    std::cerr << "ERROR: Could not create the metrics socket" << std::endl;
+                    return false;
+                }
+
+                int reuse = 1;
+                setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+                sockaddr_in address;
+                std::memset(&address, 0, sizeof(address));
+                address.sin_family = AF_INET;
+                address.sin_port = htons(port);
+                address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+                if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 4) != 0)
+                {
+                    std::cerr << "ERROR: Could not listen for metrics on 127.0.0.1:" << port << std::endl;
+                    close(listener);
+                    listener = -1;
+                    return false;
+                }
+
+                std::cout << "Metrics: serving http://127.0.0.1:" << port << "/metrics" << std::endl;
+
+                stopping.store(false);
+                thread = std::thread(&Metrics::run, this);
+                return true;
+            }
+
+            void stop()
+            {
+                if (thread.joinable())
+                {
+                    stopping.store(true);
+                    thread.join();
+                }
+
+                if (listener >= 0)
+                {
+                    close(listener);
+                    listener = -1;
+                }
+            }
+
+            // Render thread, before the frame's work
+            void beginFrame()
+            {
+                frameStart = std::chrono::steady_clock::now();
+            }
+
+            // Render thread, once the frame is presented. sim is NULL when frames are not driven by one.
+            void endFrame(const Learus_Profiler::GpuProfiler & gpuProfiler, const Learus_Simulation::Simulation * sim)
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                cpu.add(std::chrono::duration<double, std::milli>(now - frameStart).count());
+
+                if (started)
+                {
+                    double ms = std::chrono::duration<double, std::milli>(frameStart - lastStart).count();
+                    interval.add(ms);
+                    if (ms > framePeriodMs * DROP_FACTOR)
+                        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+                }
+                started = true;
+                lastStart = frameStart;
+                frames.fetch_add(1, std::memory_order_relaxed);
+
+                // Frames read back together only count the last of them
+                if (gpuProfiler.resolved != lastResolved)
+                {
+                    lastResolved = gpuProfiler.resolved;
+                    for (unsigned int i = 0; i < gpuProfiler.passes.size(); i++)
+                    {
+                        if (std::strcmp(gpuProfiler.passes[i].name, "Frame") == 0)
+                            gpu.add(gpuProfiler.passes[i].lastMs);
+                    }
+                }
+
+                const Learus_Resources::Registry & resources = Learus_Resources::registry();
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    gpuBytes[i].store(resources.usage[i].gpuBytes, std::memory_order_relaxed);
+                    cpuBytes[i].store(resources.usage[i].cpuBytes, std::memory_order_relaxed);
+                }
+
+                if (sim)
+                {
+                    simSteps.store(sim->publishedStep(), std::memory_order_relaxed);
+                    simStepNanoseconds.store((uint64_t)(sim->stepMs() * 1e6), std::memory_order_relaxed);
+                    simTargetRate.store(sim->stepRate(), std::memory_order_relaxed);
+                    hasSimulation.store(true, std::memory_order_release);
+                }
+            }
+
+            // The loop waited for something else, the time until the next frame is not a frame
+            void resync()
+            {
+                started = false;
+            }
+
+            // Once stopped
+            void printStats() const
+            {
+                std::cout << "Metrics: " << scrapes.load() << " scrapes on port " << port;
+                if (badRequests.load())
+                    std::cout << ", " << badRequests.load() << " other requests turned away";
+                std::cout << ", " << droppedFrames.load() << " of " << frames.load() << " frames over " << framePeriodMs * DROP_FACTOR << " ms" << std::endl;
+            }
+
+        private:
+            static constexpr double DROP_FACTOR = 1.5;
+            static const int POLL_MS = 200;                 // How often the server checks whether it should stop
+            static const int CLIENT_TIMEOUT_SECONDS = 2;    // For a client that connects and then says nothing
+
+            struct Asset
+            {
+                const char * name;
+                double seconds;
+            };
+
+            unsigned short port;
+            double framePeriodMs;
+
+            int listener;
+            std::atomic<bool> stopping;
+            std::thread thread;
+
+            Asset assets[MAX_ASSETS];
+            unsigned int assetCount;
+
+            // Render thread only
+            std::chrono::steady_clock::time_point frameStart, lastStart;
+            bool started;
+            unsigned long lastResolved;
+
+            // Written by the render thread, read by the server
+            Histogram interval;     // Start of one frame to the start of the next
+            Histogram cpu;          // Building, submitting and presenting the frame
+            Histogram gpu;          // The frame's GPU time
+            std::atomic<uint64_t> frames;
+            std::atomic<uint64_t> droppedFrames;
+            std::atomic<uint64_t> gpuBytes[Learus_Resources::SUB_COUNT];
+            std::atomic<uint64_t> cpuBytes[Learus_Resources::SUB_COUNT];
+            std::atomic<bool> hasSimulation;
+            std::atomic<uint64_t> simSteps;
+            std::atomic<uint64_t> simStepNanoseconds;
+            std::atomic<float> simTargetRate;
+
+            // Server thread
+            std::atomic<unsigned long> scrapes;
+            std::atomic<unsigned long> badRequests;
+            std::chrono::steady_clock::time_point lastScrape;
+            uint64_t lastScrapeSteps;
+            double measuredStepRate;    // Steps per second between the last two scrapes
+            bool hasStepRate;
+            bool hasLastScrape;
+
+            void run()
+            {
+                PROFILE_THREAD_NAME("Metrics");
+
+                // Answering a client allocates, at the client's pace rather than a frame's
+                Learus_Alloc::outsideFrames();
+
+                while (!stopping.load())
+                {
+                    pollfd listening = { listener, POLLIN, 0 };
+                    if (poll(&listening, 1, POLL_MS) <= 0)
+                        continue;
+
+                    int client = accept(listener, NULL, NULL);
+                    if (client < 0)
+                        continue;
+
+                    serve(client);
+                    close(client);
+                }
+            }
+
+            // One request per connection. GET /metrics (or /) gets the numbers, anything else a 404.
+            void serve(int client)
+            {
+                timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+                // Only the request line matters, the headers are read so the client is not cut off mid-send
+                char request[4096];
+                size_t length = 0;
+                while (length < sizeof(request) - 1)
+                {
+                    ssize_t got = recv(client, request + length, sizeof(request) - 1 - length, 0);
+                    if (got <= 0)
+                        break;
+
+                    length += got;
+                    request[length] = '\0';
+                    if (std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n"))
+                        break;
+                }
+                request[length] = '\0';
+
+                std::string body;
+                const char * status = "200 OK";
+                if (std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET / ", 6) == 0)
+                {
+                    measureStepRate();
+                    format(body);
+                    scrapes++;
+                }
+                else
+                {
+                    status = "404 Not Found";
+                    body = "Metrics are at /metrics\n";
+                    badRequests++;
+                }
+
+                char header[256];
+                std::snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+                              status, (unsigned long)body.size());
+
+                std::string response = header + body;
+                for (size_t sent = 0; sent < response.size(); )
+                {
+                    ssize_t wrote = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (wrote <= 0)
+                        break;
+                    sent += wrote;
+                }
+            }
+
+            // The step counter against the previous scrape, so the rate shows steps that actually ran
+            void measureStepRate()
+            {
+                if (!hasSimulation.load(std::memory_order_acquire))
+                    return;
+
+                uint64_t steps = simSteps.load(std::memory_order_relaxed);
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+                if (hasLastScrape)
+                {
+                    double seconds = std::chrono::duration<double>(now - lastScrape).count();
+                    if (seconds > 0.0)
+                    {
+                        measuredStepRate = (steps - lastScrapeSteps) / seconds;
+                        hasStepRate = true;
+                    }
+                }
+
+                lastScrape = now;
+                lastScrapeSteps = steps;
+                hasLastScrape = true;
+            }
+
+            void format(std::string & out) const
+            {
+                char line[256];
+
+                interval.write(out, "solar_frame_interval_seconds", "Time from the start of one frame to the start of the next.");
+                cpu.write(out, "solar_frame_cpu_seconds", "Time spent building, submitting and presenting a frame.");
+                gpu.write(out, "solar_frame_gpu_seconds", "GPU time of a frame, for the frames that were read back.");
+
+                std::snprintf(line, sizeof(line), "# HELP solar_frames_total Frames drawn.\n# TYPE solar_frames_total counter\nsolar_frames_total %llu\n",
+                              (unsigned long long)frames.load(std::memory_order_relaxed));
+                out += line;
+
+                std::snprintf(line, sizeof(line), "# HELP solar_dropped_frames_total Frames that took longer than %g times the frame period.\n"
+                              "# TYPE solar_dropped_frames_total counter\nsolar_dropped_frames_total %llu\n",
+                              DROP_FACTOR, (unsigned long long)droppedFrames.load(std::memory_order_relaxed));
+                out += line;
+
+                std::snprintf(line, sizeof(line), "# HELP solar_frame_period_seconds The frame time being aimed for.\n# TYPE solar_frame_period_seconds gauge\n"
+                              "solar_frame_period_seconds %g\n", framePeriodMs / 1000.0);
+                out += line;
+
+                if (hasSimulation.load(std::memory_order_acquire))
+                {
+                    std::snprintf(line, sizeof(line), "# HELP solar_sim_steps_total Simulation steps published.\n# TYPE solar_sim_steps_total counter\n"
+                                  "solar_sim_steps_total %llu\n", (unsigned long long)simSteps.load(std::memory_order_relaxed));
+                    out += line;
+
+                    if (hasStepRate)
+                    {
+                        std::snprintf(line, sizeof(line), "# HELP solar_sim_step_rate_hertz Simulation steps per second since the previous scrape.\n"
+                                      "# TYPE solar_sim_step_rate_hertz gauge\nsolar_sim_step_rate_hertz %g\n", measuredStepRate);
+                        out += line;
+                    }
+
+                    std::snprintf(line, sizeof(line), "# HELP solar_sim_step_target_hertz Simulation steps per second aimed for while something moves.\n"
+                                  "# TYPE solar_sim_step_target_hertz gauge\nsolar_sim_step_target_hertz %g\n", simTargetRate.load(std::memory_order_relaxed));
+                    out += line;
+
+                    std::snprintf(line, sizeof(line), "# HELP solar_sim_step_seconds Duration of the latest simulation step.\n"
+                                  "# TYPE solar_sim_step_seconds gauge\nsolar_sim_step_seconds %.9f\n", simStepNanoseconds.load(std::memory_order_relaxed) / 1e9);
+                    out += line;
+                }
+
+                out += "# HELP solar_gpu_memory_bytes GPU memory held per subsystem.\n# TYPE solar_gpu_memory_bytes gauge\n";
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    std::snprintf(line, sizeof(line), "solar_gpu_memory_bytes{subsystem=\"%s\"} %llu\n", Learus_Resources::subsystem_names[i],
+                                  (unsigned long long)gpuBytes[i].load(std::memory_order_relaxed));
+                    out += line;
+                }
+
+                out += "# HELP solar_cpu_memory_bytes CPU copies of GPU data held per subsystem.\n# TYPE solar_cpu_memory_bytes gauge\n";
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    std::snprintf(line, sizeof(line), "solar_cpu_memory_bytes{subsystem=\"%s\"} %llu\n", Learus_Resources::subsystem_names[i],
+                                  (unsigned long long)cpuBytes[i].load(std::memory_order_relaxed));
+                    out += line;
+                }
+
+                out += "# HELP solar_asset_load_seconds Time it took to load an asset at startup.\n# TYPE solar_asset_load_seconds gauge\n";
+                for (unsigned int i = 0; i < assetCount; i++)
+                {
+                    std::snprintf(line, sizeof(line), "solar_asset_load_seconds{asset=\"%s\"} %.6f\n", assets[i].name, assets[i].seconds);
+                    out += line;
+                }
+            }
+
+            Metrics(const Metrics &);
+            Metrics & operator=(const Metrics &);
+    };
+}
+
+#endif
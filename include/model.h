@@ -18,41 +18,170 @@
 
 
 #include "mesh.h"
+#include "render_queue.h"
+#include "profiler.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <string>
 
 unsigned int TextureFromFile(const char *path, const std::string &directory);
 
-class Model
+class Model : public Learus_Render::Renderable
 {
     public:
+        // Material
+        float shininess = 32.0f;
+
+        // Import, upload and levels of detail
+        double loadSeconds = 0.0;
+
         // Methods
 
-        Model(const char * path)
+        Model(const char * path, Learus_Geometry::GeometryArena & _arena)
+        : arena(&_arena), boundingRadius(0.0f)
         {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
             loadModel(path);
+            loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        ~Model()
+        {
+            for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            {
+                Learus_Resources::registry().release(Learus_Resources::KIND_TEXTURE, textures_loaded[i].id);
+                Learus_GLState::current().forgetTexture(textures_loaded[i].id);
+                glDeleteTextures(1, &textures_loaded[i].id);
+            }
         }
 
-        void Draw(Shader shader)
+        // Records every mesh with the shader variant made for its material. The variants have to be built (prepare()).
+        void Record(Learus_Shaders::ShaderVariants & variants, const glm::mat4 & model, Learus_Commands::CommandList & commands, unsigned int lod = 0)
         {
+            PROFILE_SCOPE("Model::Record");
+
+            if (meshes.empty())
+                return;
+
+            // Once per draw here instead of once per vertex in the shader
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+            Shader * current = NULL;
+            Shader * shader = NULL;
+
+            commands.bindGeometry(arena);
+
             for (unsigned int i = 0; i < meshes.size(); i++)
             {
-                meshes[i].Draw(shader);
+                if (i == 0 || !meshes[i].sameTextures(meshes[i - 1]))
+                {
+                    commands.submitDraws(arena);
+
+                    shader = variants.built(meshes[i].features);
+                    if (!shader)
+                        continue;
+
+                    if (shader != current)
+                    {
+                        commands.useProgram(shader);
+                        commands.uniform(shader->location("model"), model);
+                        commands.uniform(shader->location("normalMatrix"), normalMatrix);
+                        commands.uniform(shader->location("material.shininess"), shininess);
+                        current = shader;
+                    }
+
+                    meshes[i].recordTextures(*shader, commands);
+                }
+
+                if (shader)
+                    commands.drawMesh(arena, meshes[i].lods[lod]);
             }
+
+            commands.submitDraws(arena);
+        }
+
+        // Builds the variants this model's materials need, so they do not get compiled on the first frame
+        void prepare(Learus_Shaders::ShaderVariants & variants)
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                variants.get(meshes[i].features);
+        }
+
+        void Record(const Learus_Render::DrawItem & item, Learus_Commands::CommandList & commands)
+        {
+            if (item.variants)
+            {
+                Record(*item.variants, item.model, commands, item.lod);
+                return;
+            }
+
+            if (meshes.empty())
+                return;
+
+            commands.useProgram(item.shader);
+            commands.uniform(item.shader->location("model"), item.model);
+            commands.bindGeometry(arena);
+
+            for (unsigned int i = 0; i < meshes.size(); i++)
+            {
+                if (i == 0 || !meshes[i].sameTextures(meshes[i - 1]))
+                {
+                    commands.submitDraws(arena);
+                    meshes[i].recordTextures(*item.shader, commands);
+                }
+
+                commands.drawMesh(arena, meshes[i].lods[item.lod]);
+            }
+
+            commands.submitDraws(arena);
+        }
+
+        // Of a sphere around the model's origin holding every vertex, in model space
+        float radius() const
+        {
+            return boundingRadius;
+        }
+
+        // Identifies the textures of the model for sorting, so draws sharing them end up next to each other
+        unsigned int materialKey() const
+        {
+            if (meshes.empty() || meshes[0].textures.empty())
+                return 0;
+
+            return meshes[0].textures[0].id;
+        }
+
+        const std::vector<Mesh> & getMeshes() const
+        {
+            return meshes;
+        }
+
+        // Feature bits of the first mesh, for picking the program to sort by
+        unsigned int features() const
+        {
+            return meshes.empty() ? 0 : meshes[0].features;
         }
 
     private:
         // Model Data
         std::vector<Mesh> meshes;
+        Learus_Geometry::GeometryArena * arena;
         std::vector<Texture> textures_loaded;
         std::string directory;
-        
+        float boundingRadius;
+
+        // Owns its textures, so no copies
+        Model(const Model &);
+        Model & operator=(const Model &);
 
         // Methods
         void loadModel(std::string path)
         {
+            PROFILE_FUNCTION();
+
             Assimp::Importer importer;
             const aiScene * scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -100,6 +229,7 @@ class Model
                 v.y = mesh->mVertices[i].y;
                 v.z = mesh->mVertices[i].z;
                 vertex.Position = v;
+                boundingRadius = std::max(boundingRadius, glm::length(v));
 
                 v.x = mesh->mNormals[i].x;
                 v.y = mesh->mNormals[i].y;
@@ -142,9 +272,18 @@ class Model
 
                 std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
                 textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+
+                std::vector<Texture> emissionMaps = loadMaterialTextures(material, aiTextureType_EMISSIVE, "texture_emission");
+                textures.insert(textures.end(), emissionMaps.begin(), emissionMaps.end());
             }
 
-            return Mesh(vertices, indices, textures);
+            // The loader's copy lives until the mesh has uploaded its own
+            size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+            Learus_Resources::registry().trackCpu(Learus_Resources::SUB_GEOMETRY, bytes);
+            Mesh result(vertices, indices, textures, *arena);
+            Learus_Resources::registry().releaseCpu(Learus_Resources::SUB_GEOMETRY, bytes);
+
+            return result;
         }
 
         std::vector<Texture> loadMaterialTextures(aiMaterial * mat, aiTextureType type, std::string typeName)
@@ -186,6 +325,8 @@ class Model
 
         unsigned int TextureFromFile(const char *path, const std::string &directory)
         {
+            PROFILE_FUNCTION();
+
             std::string filename = std::string(path);
             filename = directory + '/' + filename;
 
@@ -204,10 +345,13 @@ class Model
                 else if (nrComponents == 4)
                     format = GL_RGBA;
 
-                glBindTexture(GL_TEXTURE_2D, textureID);
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, textureID);
                 glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
                 glGenerateMipmap(GL_TEXTURE_2D);
 
+                Learus_Resources::registry().track(Learus_Resources::KIND_TEXTURE, textureID, Learus_Resources::SUB_TEXTURES,
+                                                   Learus_Resources::textureBytes(width, height, nrComponents, true), "model texture");
+
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -219,6 +363,8 @@ class Model
             {
                 std::cout << "Texture failed to load at path: " << path << std::endl;
                 stbi_image_free(data);
+
+                Learus_Resources::registry().track(Learus_Resources::KIND_TEXTURE, textureID, Learus_Resources::SUB_TEXTURES, 0, "model texture");
             }
 
             return textureID;
@@ -0,0 +1,850 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+#include "../lib/glm/gtc/matrix_transform.hpp"
+
+#include "software_scene.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "profiler.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// An offline CPU renderer for reference images. Traces the scene's meshes through a bounding volume hierarchy
+// built with the surface area heuristic, and lights them like planet.fs / sun.fs, but with shadow rays towards
+// the light and diffuse bounces that pick up the skybox and the other planets.
+//
+// Samples accumulate for as long as the camera and the simulation time stay put, so a paused window keeps
+// refining the picture. Tiles are traced in parallel, and each pixel's random numbers only depend on its
+// position and sample number, so the result does not depend on the number of threads.
+namespace Learus_PathTracer
+{
+    using Learus_SIMD::Float8;
+
+    const int TILE_SIZE = 32;
+    const int LEAF_SIZE = 8;        // Triangles per leaf, intersected all at once
+    const int SAH_BINS = 16;
+    const int MAX_BOUNCES = 2;
+    const int STACK_SIZE = 64;
+    const float RAY_OFFSET = 1e-3f; // Pushes secondary rays off the surface they start on
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct Hit
+    {
+        float t;
+        float u, v;                 // Barycentric weights of vertices 1 and 2
+        uint32_t triangle;
+    };
+
+    // 32 bytes. Leaves point at a block of up to LEAF_SIZE triangles, inner nodes at their two children.
+    struct Node
+    {
+        float min[3];
+        uint32_t first;             // Block for a leaf, left child for an inner node (right is first + 1)
+        float max[3];
+        uint32_t count;             // Triangles, 0 for inner nodes
+    };
+
+    // A leaf's triangles laid out for Float8, vertex 0 and the two edges from it
+    struct TriangleBlock
+    {
+        float v0[3][8];
+        float e1[3][8];
+        float e2[3][8];
+        uint32_t triangle[8];
+        int lanes;                  // Bit per used lane
+        int shadowLanes;            // Lanes that block light, i.e. not the sun itself
+    };
+
+    // What shading needs once a triangle was hit
+    struct ShadeTriangle
+    {
+        glm::vec3 n0, n1, n2;
+        glm::vec2 uv0, uv1, uv2;
+        glm::vec3 geometricNormal;
+        const Learus_Software::Material * material;
+    };
+
+    struct Stats
+    {
+        unsigned long frames = 0;
+        unsigned long long cameraRays = 0;
+        unsigned long long bounceRays = 0;
+        unsigned long long shadowRays = 0;
+        double traceSeconds = 0.0;
+        unsigned long builds = 0;
+        double buildSeconds = 0.0;
+        unsigned int nodes = 0;
+        unsigned int leaves = 0;
+    };
+
+    // Small and stateless between pixels: seeded from pixel and sample, so any thread produces the same numbers
+    class Random
+    {
+        public:
+            Random(uint32_t x, uint32_t y, uint32_t sample)
+            : state(hash(x * 0x8da6b343u ^ hash(y * 0xd8163841u ^ hash(sample + 0x9e3779b9u))))
+            {
+            }
+
+            // [0, 1)
+            float next()
+            {
+                state = state * 747796405u + 2891336453u;
+                uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+                word = (word >> 22u) ^ word;
+                return (word >> 8) * (1.0f / 16777216.0f);
+            }
+
+        private:
+            uint32_t state;
+
+            static uint32_t hash(uint32_t x)
+            {
+                x ^= x >> 16;
+                x *= 0x7feb352du;
+                x ^= x >> 15;
+                x *= 0x846ca68bu;
+                x ^= x >> 16;
+                return x;
+            }
+    };
+
+    class PathTracer : public Learus_Software::Backend
+    {
+        public:
+            Stats stats;
+
+            // samples per pixel in a finished image, of which samplesPerFrame are added by every render()
+            PathTracer(Learus_Scene::Scene & scene, unsigned int threads, unsigned int _samples, unsigned int _samplesPerFrame)
+            : copy(scene), pool(threads), presenter("path traced frame"), samples(std::max(1u, _samples)),
+              samplesPerFrame(std::max(1u, std::min(_samplesPerFrame, _samples))), accumulated(0),
+              frameWidth(0), frameHeight(0), tilesX(0), tilesY(0), builtTime(0.0f), built(false)
+            {
+                PROFILE_SCOPE("Path tracer import");
+
+                size_t triangleCount = copy.triangleCount();
+                shadeTriangles.resize(triangleCount);
+                references.resize(triangleCount);
+                centroids.resize(triangleCount);
+                bounds.resize(triangleCount * 2);
+
+                // A binary tree with leaves of at least one triangle never needs more than this
+                nodes.reserve(triangleCount * 2);
+                blocks.reserve(triangleCount);
+
+                counters.resize(pool.size());
+
+                std::cout << "Path tracer: " << pool.size() << " threads, " << triangleCount << " triangles, "
+                          << samples << " samples per pixel" << std::endl;
+            }
+
+            // Adds samples to the image of the scene at simTime. Starts over whenever the view or the time changes.
+            void render(Camera & camera, float simTime, int width, int height)
+            {
+                PROFILE_SCOPE("PathTracer::Render");
+
+                width = std::max(width, 1);
+                height = std::max(height, 1);
+
+                float aspect = (float)width / (float)height;
+                glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), aspect, Learus_Scene::NEAR_PLANE, Learus_Scene::FAR_PLANE);
+                glm::mat4 view = camera.GetViewMatrix();
+
+                if (!built || simTime != builtTime)
+                {
+                    copy.animate(simTime);
+                    build();
+                    builtTime = simTime;
+                    built = true;
+                    accumulated = 0;
+                }
+
+                if (width != frameWidth || height != frameHeight || view != lastView || projection != lastProjection)
+                {
+                    resize(width, height);
+                    lastView = view;
+                    lastProjection = projection;
+                    accumulated = 0;
+                }
+
+                if (accumulated == 0)
+                    std::fill(accumulation.begin(), accumulation.end(), glm::vec3(0.0f));
+
+                if (accumulated >= samples)
+                    return;
+
+                eye = camera.Position;
+                light = copy.scene.light;
+                rays.setup(projection, view, frameWidth, frameHeight);
+
+                firstSample = accumulated;
+                passSamples = std::min(samplesPerFrame, samples - accumulated);
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                {
+                    PROFILE_SCOPE("Trace");
+                    pool.parallelFor(tilesX * tilesY, TraceStage(*this));
+                }
+                stats.traceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                accumulated += passSamples;
+                stats.frames++;
+
+                for (unsigned int i = 0; i < counters.size(); i++)
+                {
+                    stats.cameraRays += counters[i].camera;
+                    stats.bounceRays += counters[i].bounce;
+                    stats.shadowRays += counters[i].shadow;
+                    counters[i] = Counters();
+                }
+            }
+
+            // Copies the current image into the bound draw framebuffer
+            void present()
+            {
+                PROFILE_SCOPE("PathTracer::Present");
+
+                if (!color.empty())
+                    presenter.present(&color[0], frameWidth);
+            }
+
+            unsigned int samplesDone() const
+            {
+                return accumulated;
+            }
+
+            bool converged() const
+            {
+                return accumulated >= samples;
+            }
+
+            void printStats() const
+            {
+                unsigned long long rays = stats.cameraRays + stats.bounceRays + stats.shadowRays;
+
+                std::cout << "Path tracer: " << pool.size() << " threads, " << accumulated << " of " << samples << " samples per pixel, "
+                          << rays / 1e6 << " M rays in " << stats.traceSeconds * 1000.0 << " ms, "
+                          << (stats.traceSeconds > 0.0 ? rays / stats.traceSeconds / 1e6 : 0.0) << " M rays/s"
+                          << " (camera " << stats.cameraRays << ", bounce " << stats.bounceRays << ", shadow " << stats.shadowRays << ")" << std::endl;
+
+                std::cout << "BVH: " << shadeTriangles.size() << " triangles in " << stats.nodes << " nodes, " << stats.leaves << " leaves, "
+                          << stats.builds << " builds, " << (stats.builds ? stats.buildSeconds * 1000.0 / stats.builds : 0.0) << " ms per build" << std::endl;
+            }
+
+        private:
+            struct Counters
+            {
+                unsigned long long camera = 0;
+                unsigned long long bounce = 0;
+                unsigned long long shadow = 0;
+                char padding[64 - 3 * sizeof(unsigned long long)];     // One cache line per thread
+            };
+
+            struct TraceStage
+            {
+                PathTracer & p;
+                TraceStage(PathTracer & _p) : p(_p) {}
+                void operator()(unsigned int index, unsigned int thread) const { p.traceTile(index, p.counters[thread]); }
+            };
+
+            Learus_Software::SceneCopy copy;
+            Learus_Threads::ThreadPool pool;
+            Learus_Software::Presenter presenter;
+
+            unsigned int samples;
+            unsigned int samplesPerFrame;
+            unsigned int accumulated;
+            unsigned int firstSample;       // Of the current render()
+            unsigned int passSamples;
+
+            // World space triangles and the tree over them
+            std::vector<ShadeTriangle> shadeTriangles;
+            std::vector<uint32_t> references;
+            std::vector<glm::vec3> centroids;
+            std::vector<glm::vec3> bounds;      // Min and max per triangle
+            std::vector<glm::vec3> positions;   // Three per triangle, only while building
+            std::vector<Node> nodes;
+            std::vector<TriangleBlock> blocks;
+
+            std::vector<Counters> counters;
+
+            // Image, bottom row first like GL
+            int frameWidth, frameHeight;
+            int tilesX, tilesY;
+            std::vector<glm::vec3> accumulation;
+            std::vector<uint32_t> color;
+
+            // What the image was started with
+            float builtTime;
+            bool built;
+            glm::mat4 lastView, lastProjection;
+
+            glm::vec3 eye;
+            Learus_Uniforms::LightBlock light;
+            Learus_Software::ViewRays rays;
+
+            void resize(int width, int height)
+            {
+                if (width == frameWidth && height == frameHeight)
+                    return;
+
+                frameWidth = width;
+                frameHeight = height;
+                tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+                tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+                accumulation.assign((size_t)width * height, glm::vec3(0.0f));
+                color.assign((size_t)width * height, 0);
+                presenter.resize(width, height);
+            }
+
+            // Moves every triangle to world space and builds the tree over them
+            void build()
+            {
+                PROFILE_SCOPE("BVH build");
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                positions.resize(shadeTriangles.size() * 3);
+
+                uint32_t index = 0;
+                for (unsigned int d = 0; d < copy.draws.size(); d++)
+                {
+                    const Learus_Software::Draw & draw = copy.draws[d];
+                    const glm::mat4 & model = *draw.model;
+
+                    for (unsigned int i = 0; i + 2 < draw.indices.size(); i += 3, index++)
+                    {
+                        const Vertex & a = draw.vertices[draw.indices[i]];
+                        const Vertex & b = draw.vertices[draw.indices[i + 1]];
+                        const Vertex & c = draw.vertices[draw.indices[i + 2]];
+
+                        glm::vec3 * p = &positions[index * 3];
+                        p[0] = glm::vec3(model * glm::vec4(a.Position, 1.0f));
+                        p[1] = glm::vec3(model * glm::vec4(b.Position, 1.0f));
+                        p[2] = glm::vec3(model * glm::vec4(c.Position, 1.0f));
+
+                        ShadeTriangle & tri = shadeTriangles[index];
+                        tri.n0 = draw.normalMatrix * a.Normal;
+                        tri.n1 = draw.normalMatrix * b.Normal;
+                        tri.n2 = draw.normalMatrix * c.Normal;
+                        tri.uv0 = a.TexCoords;
+                        tri.uv1 = b.TexCoords;
+                        tri.uv2 = c.TexCoords;
+                        tri.material = &draw.material;
+
+                        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        float length = glm::length(normal);
+                        tri.geometricNormal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+                        bounds[index * 2] = glm::min(p[0], glm::min(p[1], p[2]));
+                        bounds[index * 2 + 1] = glm::max(p[0], glm::max(p[1], p[2]));
+                        centroids[index] = (p[0] + p[1] + p[2]) * (1.0f / 3.0f);
+                        references[index] = index;
+                    }
+                }
+
+                nodes.clear();
+                blocks.clear();
+                stats.leaves = 0;
+
+                if (!references.empty())
+                {
+                    nodes.push_back(Node());
+                    subdivide(0, 0, references.size());
+                }
+
+                stats.nodes = nodes.size();
+                stats.builds++;
+                stats.buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            static float area(const glm::vec3 & min, const glm::vec3 & max)
+            {
+                glm::vec3 size = max - min;
+                return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+            }
+
+            // Splits references[begin, end) where the surface area heuristic says it is cheapest, over SAH_BINS
+            // buckets of centroids per axis
+            void subdivide(uint32_t nodeIndex, uint32_t begin, uint32_t end)
+            {
+                glm::vec3 boxMin(INFINITY), boxMax(-INFINITY);
+                glm::vec3 centerMin(INFINITY), centerMax(-INFINITY);
+
+                for (uint32_t i = begin; i < end; i++)
+                {
+                    uint32_t t = references[i];
+                    boxMin = glm::min(boxMin, bounds[t * 2]);
+                    boxMax = glm::max(boxMax, bounds[t * 2 + 1]);
+                    centerMin = glm::min(centerMin, centroids[t]);
+                    centerMax = glm::max(centerMax, centroids[t]);
+                }
+
+                Node & node = nodes[nodeIndex];
+                for (int k = 0; k < 3; k++)
+                {
+                    node.min[k] = boxMin[k];
+                    node.max[k] = boxMax[k];
+                }
+
+                uint32_t count = end - begin;
+
+                // A full leaf costs one Float8 test, which no split can beat
+                if (count <= (uint32_t)LEAF_SIZE)
+                {
+                    makeLeaf(nodeIndex, begin, end);
+                    return;
+                }
+
+                int bestAxis = -1;
+                int bestSplit = 0;
+                float bestCost = INFINITY;
+
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    float extent = centerMax[axis] - centerMin[axis];
+                    if (extent <= 0.0f)
+                        continue;
+
+                    glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+                    uint32_t binCount[SAH_BINS];
+                    for (int b = 0; b < SAH_BINS; b++)
+                    {
+                        binMin[b] = glm::vec3(INFINITY);
+                        binMax[b] = glm::vec3(-INFINITY);
+                        binCount[b] = 0;
+                    }
+
+                    float scale = SAH_BINS / extent;
+                    for (uint32_t i = begin; i < end; i++)
+                    {
+                        uint32_t t = references[i];
+                        int b = std::min(SAH_BINS - 1, (int)((centroids[t][axis] - centerMin[axis]) * scale));
+                        binMin[b] = glm::min(binMin[b], bounds[t * 2]);
+                        binMax[b] = glm::max(binMax[b], bounds[t * 2 + 1]);
+                        binCount[b]++;
+                    }
+
+                    // Areas and counts left of every split, then sweep from the right
+                    float leftArea[SAH_BINS - 1];
+                    uint32_t leftCount[SAH_BINS - 1];
+                    glm::vec3 lMin(INFINITY), lMax(-INFINITY);
+                    uint32_t lCount = 0;
+                    for (int b = 0; b < SAH_BINS - 1; b++)
+                    {
+                        lMin = glm::min(lMin, binMin[b]);
+                        lMax = glm::max(lMax, binMax[b]);
+                        lCount += binCount[b];
+                        leftArea[b] = lCount ? area(lMin, lMax) : 0.0f;
+                        leftCount[b] = lCount;
+                    }
+
+                    glm::vec3 rMin(INFINITY), rMax(-INFINITY);
+                    uint32_t rCount = 0;
+                    for (int b = SAH_BINS - 1; b > 0; b--)
+                    {
+                        rMin = glm::min(rMin, binMin[b]);
+                        rMax = glm::max(rMax, binMax[b]);
+                        rCount += binCount[b];
+
+                        if (leftCount[b - 1] == 0 || rCount == 0)
+                            continue;
+
+                        float cost = leftArea[b - 1] * leftCount[b - 1] + area(rMin, rMax) * rCount;
+                        if (cost < bestCost)
+                        {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestSplit = b;
+                        }
+                    }
+                }
+
+                uint32_t middle;
+                if (bestAxis < 0)
+                {
+                    // Every centroid in the same spot, any split is as good as another
+                    middle = begin + count / 2;
+                }
+                else
+                {
+                    float extent = centerMax[bestAxis] - centerMin[bestAxis];
+                    float scale = SAH_BINS / extent;
+                    float minimum = centerMin[bestAxis];
+
+                    uint32_t * split = std::partition(&references[0] + begin, &references[0] + end, BinBelow(centroids, bestAxis, minimum, scale, bestSplit));
+                    middle = split - &references[0];
+
+                    if (middle == begin || middle == end)
+                        middle = begin + count / 2;
+                }
+
+                uint32_t left = nodes.size();
+                nodes.push_back(Node());
+                nodes.push_back(Node());
+
+                nodes[nodeIndex].first = left;
+                nodes[nodeIndex].count = 0;
+
+                subdivide(left, begin, middle);
+                subdivide(left + 1, middle, end);
+            }
+
+            struct BinBelow
+            {
+                const std::vector<glm::vec3> & centroids;
+                int axis;
+                float minimum, scale;
+                int split;
+
+                BinBelow(const std::vector<glm::vec3> & _centroids, int _axis, float _minimum, float _scale, int _split)
+                : centroids(_centroids), axis(_axis), minimum(_minimum), scale(_scale), split(_split) {}
+
+                bool operator()(uint32_t t) const
+                {
+                    return std::min(SAH_BINS - 1, (int)((centroids[t][axis] - minimum) * scale)) < split;
+                }
+            };
+
+            void makeLeaf(uint32_t nodeIndex, uint32_t begin, uint32_t end)
+            {
+                Node & node = nodes[nodeIndex];
+                node.first = blocks.size();
+                node.count = end - begin;
+
+                blocks.push_back(TriangleBlock());
+                TriangleBlock & block = blocks.back();
+                block.lanes = 0;
+                block.shadowLanes = 0;
+
+                for (int lane = 0; lane < LEAF_SIZE; lane++)
+                {
+                    glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+                    uint32_t t = 0;
+
+                    if (begin + lane < end)
+                    {
+                        t = references[begin + lane];
+                        const glm::vec3 * p = &positions[t * 3];
+                        v0 = p[0];
+                        e1 = p[1] - p[0];
+                        e2 = p[2] - p[0];
+
+                        block.lanes |= 1 << lane;
+                        if (shadeTriangles[t].material->lit)
+                            block.shadowLanes |= 1 << lane;
+                    }
+
+                    for (int k = 0; k < 3; k++)
+                    {
+                        block.v0[k][lane] = v0[k];
+                        block.e1[k][lane] = e1[k];
+                        block.e2[k][lane] = e2[k];
+                    }
+                    block.triangle[lane] = t;
+                }
+
+                stats.leaves++;
+            }
+
+            // Slab test, the entry distance or INFINITY
+            static float enter(const Node & node, const glm::vec3 & origin, const glm::vec3 & inverse, float tMax)
+            {
+                float t0 = 0.0f, t1 = tMax;
+                for (int k = 0; k < 3; k++)
+                {
+                    float a = (node.min[k] - origin[k]) * inverse[k];
+                    float b = (node.max[k] - origin[k]) * inverse[k];
+                    t0 = std::max(t0, std::min(a, b));
+                    t1 = std::min(t1, std::max(a, b));
+                }
+
+                return t0 <= t1 ? t0 : INFINITY;
+            }
+
+            // Möller-Trumbore on all of a block's triangles at once. Lanes that hit within (0, tMax) come back as bits,
+            // their distances and barycentrics in t, u and v. Every test is written so NaN lanes (padding, edge-on triangles) miss.
+            static int intersectBlock(const TriangleBlock & block, const Ray & ray, float tMax, float * t, float * u, float * v)
+            {
+                Float8 dx = Float8::splat(ray.direction.x), dy = Float8::splat(ray.direction.y), dz = Float8::splat(ray.direction.z);
+                Float8 e1x = Float8::load(block.e1[0]), e1y = Float8::load(block.e1[1]), e1z = Float8::load(block.e1[2]);
+                Float8 e2x = Float8::load(block.e2[0]), e2y = Float8::load(block.e2[1]), e2z = Float8::load(block.e2[2]);
+
+                Float8 px = dy * e2z - dz * e2y;
+                Float8 py = dz * e2x - dx * e2z;
+                Float8 pz = dx * e2y - dy * e2x;
+                Float8 inverse = Float8::splat(1.0f) / (e1x * px + e1y * py + e1z * pz);
+
+                Float8 sx = Float8::splat(ray.origin.x) - Float8::load(block.v0[0]);
+                Float8 sy = Float8::splat(ray.origin.y) - Float8::load(block.v0[1]);
+                Float8 sz = Float8::splat(ray.origin.z) - Float8::load(block.v0[2]);
+                Float8 bu = (sx * px + sy * py + sz * pz) * inverse;
+
+                Float8 qx = sy * e1z - sz * e1y;
+                Float8 qy = sz * e1x - sx * e1z;
+                Float8 qz = sx * e1y - sy * e1x;
+                Float8 bv = (dx * qx + dy * qy + dz * qz) * inverse;
+                Float8 distance = (e2x * qx + e2y * qy + e2z * qz) * inverse;
+
+                const Float8 zero = Float8::splat(-1e-7f);
+                int mask = block.lanes
+                         & Float8::lessMask(zero, bu) & Float8::lessMask(zero, bv)
+                         & Float8::lessMask(bu + bv, Float8::splat(1.0f + 1e-7f))
+                         & Float8::lessMask(Float8::splat(0.0f), distance) & Float8::lessMask(distance, Float8::splat(tMax));
+
+                if (mask)
+                {
+                    distance.store(t);
+                    bu.store(u);
+                    bv.store(v);
+                }
+
+                return mask;
+            }
+
+            static glm::vec3 inverseDirection(const glm::vec3 & direction)
+            {
+                glm::vec3 inverse;
+                for (int k = 0; k < 3; k++)
+                {
+                    float d = direction[k];
+                    if (std::fabs(d) < 1e-20f)
+                        d = d < 0.0f ? -1e-20f : 1e-20f;
+                    inverse[k] = 1.0f / d;
+                }
+
+                return inverse;
+            }
+
+            // Nearest hit along the ray, or with shadow set, whether anything that casts shadows is closer than tMax
+            bool intersect(const Ray & ray, float tMax, Hit & hit, bool shadow) const
+            {
+                if (nodes.empty())
+                    return false;
+
+                glm::vec3 inverse = inverseDirection(ray.direction);
+                if (enter(nodes[0], ray.origin, inverse, tMax) == INFINITY)
+                    return false;
+
+                uint32_t stack[STACK_SIZE];
+                int top = 0;
+                uint32_t current = 0;
+                bool found = false;
+                hit.t = tMax;
+
+                float t[8], u[8], v[8];
+
+                for (;;)
+                {
+                    const Node & node = nodes[current];
+
+                    if (node.count > 0)
+                    {
+                        const TriangleBlock & block = blocks[node.first];
+                        int mask = intersectBlock(block, ray, hit.t, t, u, v);
+                        if (shadow)
+                            mask &= block.shadowLanes;
+
+                        if (mask)
+                        {
+                            if (shadow)
+                                return true;
+
+                            for (int lane = 0; lane < LEAF_SIZE; lane++)
+                            {
+                                if ((mask & (1 << lane)) && t[lane] < hit.t)
+                                {
+                                    hit.t = t[lane];
+                                    hit.u = u[lane];
+                                    hit.v = v[lane];
+                                    hit.triangle = block.triangle[lane];
+                                    found = true;
+                                }
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // Nearer child first, the other one waits on the stack
+                        uint32_t near = node.first, far = node.first + 1;
+                        float tNear = enter(nodes[near], ray.origin, inverse, hit.t);
+                        float tFar = enter(nodes[far], ray.origin, inverse, hit.t);
+
+                        if (tFar < tNear)
+                        {
+                            std::swap(near, far);
+                            std::swap(tNear, tFar);
+                        }
+
+                        if (tNear != INFINITY)
+                        {
+                            if (tFar != INFINITY && top < STACK_SIZE)
+                                stack[top++] = far;
+
+                            current = near;
+                            continue;
+                        }
+                    }
+
+                    if (top == 0)
+                        break;
+
+                    current = stack[--top];
+                }
+
+                return found;
+            }
+
+            void traceTile(unsigned int tile, Counters & counter)
+            {
+                int x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+                int x1 = std::min(x0 + TILE_SIZE, frameWidth), y1 = std::min(y0 + TILE_SIZE, frameHeight);
+                float scale = 1.0f / (firstSample + passSamples);
+
+                for (int y = y0; y < y1; y++)
+                {
+                    for (int x = x0; x < x1; x++)
+                    {
+                        size_t index = (size_t)y * frameWidth + x;
+                        glm::vec3 sum = accumulation[index];
+
+                        for (unsigned int s = firstSample; s < firstSample + passSamples; s++)
+                        {
+                            Random random(x, y, s);
+
+                            Ray ray;
+                            ray.origin = eye;
+                            ray.direction = glm::normalize(rays.at(x + random.next(), y + random.next()));
+                            counter.camera++;
+
+                            sum += trace(ray, random, counter);
+                        }
+
+                        accumulation[index] = sum;
+                        color[index] = Learus_Software::pack(glm::vec4(sum * scale, 1.0f));
+                    }
+                }
+            }
+
+            glm::vec3 trace(Ray ray, Random & random, Counters & counter) const
+            {
+                glm::vec3 radiance(0.0f);
+                glm::vec3 throughput(1.0f);
+
+                for (int bounce = 0; ; bounce++)
+                {
+                    Hit hit;
+                    if (!intersect(ray, INFINITY, hit, false))
+                    {
+                        // The skybox, infinitely far away like in the GL renderer
+                        radiance += throughput * glm::vec3(copy.sky.sample(ray.direction));
+                        break;
+                    }
+
+                    const ShadeTriangle & tri = shadeTriangles[hit.triangle];
+                    const Learus_Software::Material & material = *tri.material;
+                    float w = 1.0f - hit.u - hit.v;
+                    glm::vec2 uv = tri.uv0 * w + tri.uv1 * hit.u + tri.uv2 * hit.v;
+
+                    // sun.fs. Bounce rays ignore it, the point light already stands in for its light.
+                    if (!material.lit)
+                    {
+                        if (bounce == 0)
+                            radiance += throughput * glm::vec3(sampleMap(material.diffuse, uv, glm::vec4(1.0f)));
+                        break;
+                    }
+
+                    glm::vec3 position = ray.origin + ray.direction * hit.t;
+                    glm::vec3 normal = glm::normalize(tri.n0 * w + tri.n1 * hit.u + tri.n2 * hit.v);
+                    glm::vec3 viewDir = -ray.direction;
+
+                    // Offset towards the side the ray came from, so the new rays do not hit this triangle again
+                    glm::vec3 offsetNormal = glm::dot(tri.geometricNormal, viewDir) < 0.0f ? -tri.geometricNormal : tri.geometricNormal;
+                    glm::vec3 surface = position + offsetNormal * RAY_OFFSET;
+
+                    // planet.fs, with the light's diffuse and specular terms shadowed
+                    glm::vec3 albedo = glm::vec3(sampleMap(material.diffuse, uv, glm::vec4(1.0f)));
+                    glm::vec3 specularColor = material.specular ? glm::vec3(sampleMap(material.specular, uv, glm::vec4(1.0f))) : albedo;
+
+                    glm::vec3 toLight = light.position - surface;
+                    float lightDistance = glm::length(toLight);
+                    glm::vec3 lightDir = toLight / lightDistance;
+
+                    glm::vec3 color = light.ambient * albedo;
+
+                    float diff = std::max(glm::dot(normal, lightDir), 0.0f);
+                    glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+                    float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), material.shininess);
+
+                    if (diff > 0.0f || spec > 0.0f)
+                    {
+                        Ray shadowRay = { surface, lightDir };
+                        Hit blocker;
+                        counter.shadow++;
+
+                        if (!intersect(shadowRay, lightDistance, blocker, true))
+                            color += light.diffuse * diff * albedo + light.specular * spec * specularColor;
+                    }
+
+                    if (material.emission)
+                        color += glm::vec3(sampleMap(material.emission, uv, glm::vec4(0.0f)));
+
+                    radiance += throughput * color;
+
+                    if (bounce == MAX_BOUNCES)
+                        break;
+
+                    // Cosine weighted diffuse bounce, whose weight comes down to the albedo
+                    glm::vec3 shading = glm::dot(normal, offsetNormal) < 0.0f ? -normal : normal;
+                    ray.origin = surface;
+                    ray.direction = cosineSample(shading, random.next(), random.next());
+                    throughput *= albedo;
+                    counter.bounce++;
+
+                    if (throughput.x + throughput.y + throughput.z < 1e-3f)
+                        break;
+                }
+
+                return radiance;
+            }
+
+            // Level 0, bilinear. Supersampling does the filtering.
+            static glm::vec4 sampleMap(const Learus_Software::Texture * map, const glm::vec2 & uv, const glm::vec4 & missing)
+            {
+                if (!map)
+                    return missing;
+
+                return map->sample(uv.x, uv.y, 0.0f, 0.0f, 0.0f, 0.0f);
+            }
+
+            static glm::vec3 cosineSample(const glm::vec3 & normal, float r1, float r2)
+            {
+                float phi = 6.28318530718f * r1;
+                float radius = std::sqrt(r2);
+
+                glm::vec3 tangent = std::fabs(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                tangent = glm::normalize(glm::cross(tangent, normal));
+                glm::vec3 bitangent = glm::cross(normal, tangent);
+
+                return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(std::max(0.0f, 1.0f - r2)));
+            }
+
+            PathTracer(const PathTracer &);
+            PathTracer & operator=(const PathTracer &);
+    };
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Scoped CPU profiler. Build with -DSOLAR_PROFILE (make PROFILE=1) to turn it on, without it every
+// PROFILE_* macro expands to nothing.
+//
+//   void loadModel() { PROFILE_FUNCTION(); ... }
+//   { PROFILE_SCOPE("Upload"); ... }
+//
+// A scope costs two timestamp reads and one store into a ring owned by the calling thread, no locks
+// and no allocation. The oldest events are overwritten once a ring is full.
+namespace Learus_Profiler
+{
+    inline uint64_t timestamp()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    struct Event
+    {
+        const char * name;  // Must outlive the capture, string literals only
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Written only by its own thread. head is published with release, so a reader that acquires it sees whole events.
+    struct ThreadBuffer
+    {
+        static const uint32_t CAPACITY = 1 << 16;
+
+        Event events[CAPACITY];
+        std::atomic<uint64_t> head;
+        uint32_t id;
+        std::string name;
+
+        ThreadBuffer() : head(0), id(0) {}
+
+        void push(const char * eventName, uint64_t start, uint64_t end)
+        {
+            uint64_t index = head.load(std::memory_order_relaxed);
+
+            Event & event = events[index & (CAPACITY - 1)];
+            event.name = eventName;
+            event.start = start;
+            event.end = end;
+
+            head.store(index + 1, std::memory_order_release);
+        }
+    };
+
+    class Profiler
+    {
+        public:
+            // Buffers live until exit, so events from finished threads can still be written out
+            ThreadBuffer & threadBuffer()
+            {
+                static thread_local ThreadBuffer * buffer = NULL;
+
+                if (!buffer)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    buffer = new ThreadBuffer();
+                    buffer->id = buffers.size() + 1;
+                    buffer->name = buffers.empty() ? "main" : "thread " + std::to_string(buffer->id);
+                    buffers.push_back(buffer);
+                }
+
+                return *buffer;
+            }
+
+            // A track that is not tied to a thread, e.g. GPU times. Only one thread may push into it.
+            ThreadBuffer & createBuffer(const std::string & name)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                ThreadBuffer * buffer = new ThreadBuffer();
+                buffer->id = buffers.size() + 1;
+                buffer->name = name;
+                buffers.push_back(buffer);
+
+                return *buffer;
+            }
+
+            void setThreadName(const std::string & name)
+            {
+                ThreadBuffer & buffer = threadBuffer();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                buffer.name = name;
+            }
+
+            // Ticks per microsecond, measured against steady_clock over a few milliseconds on first use
+            double ticksPerMicrosecond()
+            {
+                if (tickRate == 0.0)
+                {
+#if defined(__x86_64__) || defined(__i386__)
+                    std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+                    uint64_t tickStart = timestamp();
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+                    uint64_t ticks = timestamp() - tickStart;
+                    double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - clockStart).count();
+                    tickRate = ticks / microseconds;
+#else
+                    tickRate = 1000.0;
+#endif
+                }
+
+                return tickRate;
+            }
+
+            // Chrome trace-event JSON, load it in chrome://tracing or ui.perfetto.dev.
+            // Call when the other threads are idle, events still being written may be torn.
+            bool writeChromeTrace(const std::string & path)
+            {
+                std::ofstream out(path.c_str());
+                if (!out)
+                {
+                    std::cerr << "ERROR: Could not write profile: " << path << std::endl;
+                    return false;
+                }
+
+                double rate = ticksPerMicrosecond();
+                unsigned long count = 0;
+
+                std::lock_guard<std::mutex> lock(mutex);
+
+                uint64_t origin = UINT64_MAX;
+                for (unsigned int i = 0; i < buffers.size(); i++)
+                {
+                    uint64_t head = buffers[i]->head.load(std::memory_order_acquire);
+                    uint64_t first = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+                    for (uint64_t e = first; e < head; e++)
+                        origin = std::min(origin, buffers[i]->events[e & (ThreadBuffer::CAPACITY - 1)].start);
+                }
+
+                out << "{\"traceEvents\":[\n";
+
+                bool firstEvent = true;
+                for (unsigned int i = 0; i < buffers.size(); i++)
+                {
+                    ThreadBuffer & buffer = *buffers[i];
+
+                    out << (firstEvent ? "" : ",\n")
+                        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id
+                        << ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+                    firstEvent = false;
+
+                    uint64_t head = buffer.head.load(std::memory_order_acquire);
+                    uint64_t first = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+
+                    for (uint64_t e = first; e < head; e++)
+                    {
+                        const Event & event = buffer.events[e & (ThreadBuffer::CAPACITY - 1)];
+
+                        out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+                            << ",\"ts\":" << (event.start - origin) / rate
+                            << ",\"dur\":" << (event.end - event.start) / rate << "}";
+                        count++;
+                    }
+                }
+
+                out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+                std::cout << "Profile: " << count << " events from " << buffers.size() << " threads written to " << path << std::endl;
+                return true;
+            }
+
+            // Events recorded so far on every thread, including overwritten ones
+            uint64_t recorded()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                uint64_t total = 0;
+                for (unsigned int i = 0; i < buffers.size(); i++)
+                    total += buffers[i]->head.load(std::memory_order_relaxed);
+
+                return total;
+            }
+
+        private:
+            std::mutex mutex;
+            std::vector<ThreadBuffer *> buffers;
+            double tickRate = 0.0;
+    };
+
+    inline Profiler & get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    class Scope
+    {
+        public:
+            explicit Scope(const char * _name)
+            : name(_name), buffer(get().threadBuffer()), start(timestamp())
+            {
+            }
+
+            ~Scope()
+            {
+                buffer.push(name, start, timestamp());
+            }
+
+        private:
+            const char * name;
+            ThreadBuffer & buffer;
+            uint64_t start;
+
+            Scope(const Scope &);
+            Scope & operator=(const Scope &);
+    };
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef SOLAR_PROFILE
+    #define PROFILE_SCOPE(name) Learus_Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+    #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+    #define PROFILE_THREAD_NAME(name) Learus_Profiler::get().setThreadName(name)
+#else
+    #define PROFILE_SCOPE(name) do {} while (0)
+    #define PROFILE_FUNCTION() do {} while (0)
+    #define PROFILE_THREAD_NAME(name) do {} while (0)
+#endif
+
+#endif
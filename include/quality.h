@@ -0,0 +1,274 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "../lib/glad/glad.h"
+
+#include "gpu_profiler.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// One quality level for the whole scene, picked at startup or stepped at runtime to keep frames inside a time budget.
+namespace Learus_Quality
+{
+    // What a level draws. The highest one is what the scene drew before there were levels.
+    struct Level
+    {
+        const char * name;
+        float lodPixels;                // Meshes narrower than this on screen drop a level of detail, 0 keeps full detail
+        unsigned int orbitVertices;
+        float mipBias;                  // Added to the texture LOD, positive picks smaller mips
+        float drawDistance;             // In multiples of a planet's radius, farther ones are left out. 0 draws everything.
+    };
+
+    const unsigned int LEVEL_COUNT = 4;
+
+    const Level levels[LEVEL_COUNT] =
+    {
+        { "low",    256.0f, 375,  1.5f, 60.0f },
+        { "medium", 128.0f, 750,  1.0f, 120.0f },
+        { "high",   64.0f,  1500, 0.5f, 0.0f },
+        { "ultra",  0.0f,   3000, 0.0f, 0.0f }
+    };
+
+    // -1 for a name that is not a level
+    inline int levelFromName(const char * name)
+    {
+        for (unsigned int i = 0; i < LEVEL_COUNT; i++)
+        {
+            if (std::strcmp(levels[i].name, name) == 0)
+                return i;
+        }
+
+        return -1;
+    }
+
+    // Steps the level down when frames run over the target and back up when there is room left, with hysteresis:
+    // going down needs a short run of slow frames, going up a long run of frames well under the target, and nothing
+    // moves for a while after a change. A level that had to be given up again soon after being reached waits twice
+    // as long before it is tried again, so a budget that sits between two levels does not make them alternate.
+    //
+    // Going down follows the time from one frame to the next, less what the frame limiter held it back, which catches
+    // work that neither clock below sees, such as a driver that only renders when the frame is presented. Waiting for
+    // vsync is still in it, so the target has to be at least the display's frame period. Going up follows the larger
+    // of the frame's CPU time (building and submitting it) and its GPU time, the profiler's "Frame" scope. Neither
+    // includes any waiting, so the headroom shows even when the frame rate is capped.
+    class Governor : public Learus_Profiler::FrameListener
+    {
+        public:
+            // adaptive false keeps the level at start
+            Governor(Learus_Profiler::GpuProfiler & _profiler, double _targetMs, unsigned int start, bool _adaptive)
+            : profiler(_profiler), targetMs(_targetMs), adaptive(_adaptive), current(std::min(start, LEVEL_COUNT - 1)), pendingChange(true),
+              started(false), waitMs(0.0), intervalAverage(0.0), cpuAverage(0.0), gpuAverage(0.0),
+              over(0), under(0), hold(HOLD_FRAMES), raiseFrames(RAISE_FRAMES), sinceRaise(0), raised(false),
+              frames(0), changes(0), drops(0), raises(0)
+            {
+                for (unsigned int i = 0; i < LEVEL_COUNT; i++)
+                    framesAt[i] = 0;
+
+                if (adaptive)
+                {
+                    profiler.enable();
+                    profiler.listen(this);
+                }
+            }
+
+            ~Governor()
+            {
+                profiler.unlisten(this);
+            }
+
+            // At the start of the frame's GL work, after the profiler's beginFrame(). Returns true when the level changed since the last frame
+            // (and on the first one), so the scene applies it before drawing.
+            bool beginFrame()
+            {
+                frames++;
+                framesAt[current]++;
+
+                if (adaptive)
+                {
+                    PROFILE_SCOPE("Quality::Begin");
+
+                    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                    if (started)
+                    {
+                        double ms = std::chrono::duration<double, std::milli>(now - cpuStart).count() - waitMs;
+                        intervalAverage = average(intervalAverage, std::max(ms, 0.0));
+                    }
+                    started = true;
+                    waitMs = 0.0;
+
+                    step();
+                    cpuStart = now;
+                }
+
+                bool changed = pendingChange;
+                pendingChange = false;
+                return changed;
+            }
+
+            // Once the frame's commands are submitted
+            void endFrame()
+            {
+                if (!adaptive)
+                    return;
+
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+                cpuAverage = average(cpuAverage, ms);
+            }
+
+            void gpuFrame(const Learus_Profiler::GpuProfiler & gpu)
+            {
+                double ms;
+                if (gpu.lastTime("Frame", ms))
+                    gpuAverage = average(gpuAverage, ms);
+            }
+
+            // The frame limiter held the next frame back this long, it is not part of the frame's cost
+            void waited(double ms)
+            {
+                waitMs += ms;
+            }
+
+            // The loop waited for something else (input, an idle window), the time until the next frame is no frame time
+            void resync()
+            {
+                started = false;
+            }
+
+            const Level & level() const
+            {
+                return levels[current];
+            }
+
+            unsigned int index() const
+            {
+                return current;
+            }
+
+            // The smoothed cost of a frame, as the decision to go down sees it
+            double frameMs() const
+            {
+                return std::max(intervalAverage, workMs());
+            }
+
+            void printStats() const
+            {
+                if (frames == 0)
+                    return;
+
+                std::cout << "Quality: " << levels[current].name;
+                if (adaptive)
+                    std::cout << ", " << targetMs << " ms target, " << changes << " changes (" << drops << " down, " << raises << " up)";
+                std::cout << ", frames at";
+                for (unsigned int i = 0; i < LEVEL_COUNT; i++)
+                    std::cout << (i ? ", " : " ") << levels[i].name << " " << 100.0 * framesAt[i] / frames << "%";
+                std::cout << std::endl;
+            }
+
+        private:
+            static const unsigned int DROP_FRAMES = 10;         // Slow frames in a row before stepping down
+            static const unsigned int RAISE_FRAMES = 120;       // Fast frames in a row before stepping up, at first
+            static const unsigned int MAX_RAISE_FRAMES = 1920;
+            static const unsigned int HOLD_FRAMES = 30;         // No decisions right after a change
+            static const unsigned int PROBATION_FRAMES = 300;   // A raise undone sooner than this did not hold
+            static constexpr double DROP_MARGIN = 0.05;         // Over the target by more than this is slow
+            static constexpr double RAISE_MARGIN = 0.3;         // Under it by more than this is fast
+            static constexpr double SMOOTHING = 0.1;
+
+            Learus_Profiler::GpuProfiler & profiler;
+            double targetMs;
+            bool adaptive;
+            unsigned int current;
+            bool pendingChange;
+
+            std::chrono::steady_clock::time_point cpuStart;
+            bool started;
+            double waitMs;                                      // Limiter waits since the frame started
+            double intervalAverage, cpuAverage, gpuAverage;     // Zero until the first sample
+
+            unsigned int over, under, hold;
+            unsigned int raiseFrames, sinceRaise;
+            bool raised;
+
+            unsigned long frames, changes, drops, raises;
+            unsigned long framesAt[LEVEL_COUNT];
+
+            static double average(double current, double sample)
+            {
+                return current > 0.0 ? current + SMOOTHING * (sample - current) : sample;
+            }
+
+            double workMs() const
+            {
+                return std::max(cpuAverage, gpuAverage);
+            }
+
+            void step()
+            {
+                if (raised && ++sinceRaise >= PROBATION_FRAMES)
+                {
+                    // The last raise held, so the next one does not need to wait as long
+                    raised = false;
+                    raiseFrames = std::max(raiseFrames / 2, RAISE_FRAMES);
+                }
+
+                if (hold > 0)
+                {
+                    hold--;
+                    return;
+                }
+
+                if (frameMs() > targetMs * (1.0 + DROP_MARGIN))
+                {
+                    over++;
+                    under = 0;
+                }
+                else if (workMs() < targetMs * (1.0 - RAISE_MARGIN))
+                {
+                    under++;
+                    over = 0;
+                }
+                else
+                {
+                    over = under = 0;
+                }
+
+                if (over >= DROP_FRAMES && current > 0)
+                {
+                    if (raised)
+                    {
+                        raised = false;
+                        raiseFrames = std::min(raiseFrames * 2, MAX_RAISE_FRAMES);
+                    }
+
+                    change(current - 1);
+                    drops++;
+                }
+                else if (under >= raiseFrames && current + 1 < LEVEL_COUNT)
+                {
+                    change(current + 1);
+                    raises++;
+                    raised = true;
+                    sinceRaise = 0;
+                }
+            }
+
+            void change(unsigned int level)
+            {
+                current = level;
+                pendingChange = true;
+                changes++;
+                over = under = 0;
+                hold = HOLD_FRAMES;
+            }
+
+            Governor(const Governor &);
+            Governor & operator=(const Governor &);
+    };
+}
+
+#endif
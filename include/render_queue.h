@@ -0,0 +1,331 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "../lib/glm/glm.hpp"
+
+#include "shader.h"
+#include "shader_variants.h"
+#include "gpu_profiler.h"
+#include "frame_arena.h"
+#include "command_list.h"
+#include "thread_pool.h"
+#include "profiler.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace Learus_Render
+{
+    // Passes run in this order. Lower value draws first.
+    enum Pass
+    {
+        PASS_SKYBOX = 0,
+        PASS_OPAQUE = 1,
+        PASS_LINES = 2
+    };
+
+    class Renderable;
+
+    // What to draw. The sort key decides when.
+    struct DrawItem
+    {
+        Renderable * object;
+        Shader * shader;
+        glm::mat4 model;
+
+        // For objects whose meshes pick a program per material, shader is then only used for sorting
+        Learus_Shaders::ShaderVariants * variants;
+
+        // GPU timing scope. Consecutive items with the same label are timed together.
+        const char * label;
+
+        // Level of detail for objects that have them, 0 is full detail
+        unsigned int lod;
+    };
+
+    // Anything the queue can draw. Record() may run on any thread and must not call GL: it only writes the commands
+    // that draw the item. An object is recorded by one thread at a time, so it may cache per program lookups.
+    class Renderable
+    {
+        public:
+            virtual ~Renderable() {}
+            virtual void Record(const DrawItem & item, Learus_Commands::CommandList & commands) = 0;
+    };
+
+    struct QueueStats
+    {
+        unsigned long frames = 0;
+        unsigned long items = 0;
+        unsigned long commands = 0;
+        double recordSeconds = 0.0;
+        double replaySeconds = 0.0;
+    };
+
+    // Key layout, most significant first:
+    //   4 bits pass | 16 bits shader | 16 bits material | 24 bits depth | 4 bits unused
+    // so sorting by key groups draws by pass, then program, then textures, then front to back.
+    inline uint64_t makeKey(Pass pass, unsigned int shader, unsigned int material, uint32_t depth)
+    {
+        return ((uint64_t)(pass & 0xF) << 60) |
+               ((uint64_t)(shader & 0xFFFF) << 44) |
+               ((uint64_t)(material & 0xFFFF) << 28) |
+               ((uint64_t)(depth & 0xFFFFFF) << 4);
+    }
+
+    // Maps a view space distance in [near, far] to the 24 bit depth field. Pass backToFront for blended draws.
+    inline uint32_t quantizeDepth(float distance, float near, float far, bool backToFront = false)
+    {
+        float t = (distance - near) / (far - near);
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+
+        uint32_t depth = (uint32_t)(t * 0xFFFFFF);
+        return backToFront ? 0xFFFFFF - depth : depth;
+    }
+
+    // Distance along the view direction of a world position
+    inline float viewDepth(const glm::mat4 & view, const glm::vec3 & position)
+    {
+        return -(view * glm::vec4(position, 1.0f)).z;
+    }
+
+    // Items and sort buffers live in a frame arena: begin() starts them over in the arena's current block each frame.
+    // record() turns the items into command lists, on a thread pool when setThreads() asked for one, and execute()
+    // replays them on the context thread in sorted order.
+    class RenderQueue
+    {
+        public:
+            QueueStats stats;
+
+            RenderQueue(Learus_Memory::FrameArena & _arena = Learus_Memory::frameArena())
+            : arena(&_arena), items(_arena), entries(_arena), scratch(_arena), lastSize(0), mostCommands(0), pool(NULL), lists(1)
+            {
+            }
+
+            ~RenderQueue()
+            {
+                delete pool;
+            }
+
+            // Recording threads, counting the calling one. 1 records on the context thread, 0 uses every core.
+            void setThreads(unsigned int threads)
+            {
+                delete pool;
+                pool = threads == 1 ? NULL : new Learus_Threads::ThreadPool(threads);
+                lists.resize(pool ? pool->size() : 1);
+            }
+
+            unsigned int threads() const
+            {
+                return lists.size();
+            }
+
+            // Call once per frame, after the arena's beginFrame(). Last frame's items are gone by then.
+            void begin()
+            {
+                Learus_Memory::FrameVector<DrawItem>(*arena).swap(items);
+                Learus_Memory::FrameVector<SortEntry>(*arena).swap(entries);
+                Learus_Memory::FrameVector<SortEntry>(*arena).swap(scratch);
+
+                // Growing a vector in a bump allocator leaves the old storage behind, so size it up front
+                items.reserve(lastSize);
+                entries.reserve(lastSize);
+            }
+
+            void submit(uint64_t key, const DrawItem & item)
+            {
+                SortEntry entry;
+                entry.key = key;
+                entry.index = items.size();
+
+                entries.push_back(entry);
+                items.push_back(item);
+            }
+
+            // LSD radix sort on the keys, one byte per pass. Bytes that are equal across all keys are skipped.
+            void sort()
+            {
+                unsigned int n = entries.size();
+                if (n < 2)
+                    return;
+
+                scratch.resize(n);
+
+                for (unsigned int shift = 0; shift < 64; shift += 8)
+                {
+                    unsigned int histogram[256] = {0};
+
+                    for (unsigned int i = 0; i < n; i++)
+                        histogram[(entries[i].key >> shift) & 0xFF]++;
+
+                    // Every key has the same byte here, the pass would be a plain copy
+                    if (histogram[(entries[0].key >> shift) & 0xFF] == n)
+                        continue;
+
+                    unsigned int offset = 0;
+                    for (unsigned int b = 0; b < 256; b++)
+                    {
+                        unsigned int count = histogram[b];
+                        histogram[b] = offset;
+                        offset += count;
+                    }
+
+                    for (unsigned int i = 0; i < n; i++)
+                        scratch[histogram[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+
+                    entries.swap(scratch);
+                }
+            }
+
+            // Every item writes its commands into the list of the thread that picked it up. Touches no GL.
+            void record()
+            {
+                PROFILE_SCOPE("Record");
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                // Whichever thread picks up the items, its list already holds a whole frame
+                for (unsigned int i = 0; i < lists.size(); i++)
+                {
+                    lists[i].commands.clear();
+                    lists[i].commands.reserve(mostCommands);
+                }
+
+                ranges.resize(items.size());
+
+                if (pool)
+                {
+                    pool->parallelFor(items.size(), RecordItem(*this));
+                }
+                else
+                {
+                    for (unsigned int i = 0; i < items.size(); i++)
+                        recordItem(i, 0);
+                }
+
+                unsigned int recorded = 0;
+                for (unsigned int i = 0; i < lists.size(); i++)
+                    recorded += lists[i].commands.size();
+                mostCommands = std::max(mostCommands, recorded);
+
+                stats.recordSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            // Replays the recorded items in key order
+            void execute(Learus_Profiler::GpuProfiler * gpu = NULL)
+            {
+                PROFILE_SCOPE("Replay");
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                const char * label = NULL;
+
+                for (unsigned int i = 0; i < entries.size(); i++)
+                {
+                    const DrawItem & item = items[entries[i].index];
+                    const Range & range = ranges[entries[i].index];
+
+                    if (gpu && item.label != label)
+                    {
+                        if (label)
+                            gpu->end();
+                        if (item.label)
+                            gpu->begin(item.label);
+                        label = item.label;
+                    }
+
+                    Learus_Commands::replay(lists[range.list].commands.data() + range.begin, range.count);
+                    stats.commands += range.count;
+                }
+
+                if (gpu && label)
+                    gpu->end();
+
+                stats.frames++;
+                stats.items += entries.size();
+                stats.replaySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            void printStats() const
+            {
+                if (stats.frames == 0)
+                    return;
+
+                std::cout << "Commands: " << (double)stats.commands / stats.frames << " per frame for " << (double)stats.items / stats.frames
+                          << " draws, recorded on " << lists.size() << " threads in " << stats.recordSeconds * 1000.0 / stats.frames
+                          << " ms, replayed in " << stats.replaySeconds * 1000.0 / stats.frames << " ms per frame" << std::endl;
+            }
+
+            void clear()
+            {
+                lastSize = entries.size();
+
+                entries.clear();
+                items.clear();
+            }
+
+            unsigned int size() const
+            {
+                return entries.size();
+            }
+
+        private:
+            struct SortEntry
+            {
+                uint64_t key;
+                uint32_t index;
+            };
+
+            // Where an item's commands ended up
+            struct Range
+            {
+                unsigned int list;
+                unsigned int begin;
+                unsigned int count;
+            };
+
+            struct RecordItem
+            {
+                RenderQueue & queue;
+                RecordItem(RenderQueue & _queue) : queue(_queue) {}
+                void operator()(unsigned int index, unsigned int thread) const { queue.recordItem(index, thread); }
+            };
+
+            Learus_Memory::FrameArena * arena;
+
+            Learus_Memory::FrameVector<DrawItem> items;
+            Learus_Memory::FrameVector<SortEntry> entries;
+            Learus_Memory::FrameVector<SortEntry> scratch;
+
+            unsigned int lastSize;
+            unsigned int mostCommands;      // The most any frame recorded
+
+            struct ThreadList
+            {
+                Learus_Commands::CommandList commands;
+                char padding[64];   // Keeps the next thread's list off this one's cache line
+            };
+
+            Learus_Threads::ThreadPool * pool;
+            std::vector<ThreadList> lists;                      // One per recording thread
+            std::vector<Range> ranges;                          // Per item, in submission order
+
+            void recordItem(unsigned int index, unsigned int thread)
+            {
+                Learus_Commands::CommandList & list = lists[thread].commands;
+                const DrawItem & item = items[index];
+
+                Range & range = ranges[index];
+                range.list = thread;
+                range.begin = list.size();
+                item.object->Record(item, list);
+                range.count = list.size() - range.begin;
+            }
+
+            RenderQueue(const RenderQueue &);
+            RenderQueue & operator=(const RenderQueue &);
+    };
+}
+
+#endif
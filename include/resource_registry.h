@@ -0,0 +1,282 @@
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+// Book keeping for every GL object the program creates: what it is, who made it and roughly how big it is.
+// Creation sites call track() / resize(), deletion sites call release(). Whatever is still registered when
+// the report is printed at shutdown was never deleted, and shows up in the leak list.
+namespace Learus_Resources
+{
+    enum Kind
+    {
+        KIND_BUFFER,
+        KIND_VERTEX_ARRAY,
+        KIND_TEXTURE,
+        KIND_PROGRAM,
+        KIND_QUERY,
+        KIND_FRAMEBUFFER,
+        KIND_RENDERBUFFER,
+        KIND_COUNT
+    };
+
+    const char * const kind_names[KIND_COUNT] = {
+        "buffer", "vertex array", "texture", "program", "query", "framebuffer", "renderbuffer"
+    };
+
+    enum Subsystem
+    {
+        SUB_GEOMETRY,
+        SUB_TEXTURES,
+        SUB_SKYBOX,
+        SUB_ORBITS,
+        SUB_SHADERS,
+        SUB_UNIFORMS,
+        SUB_PROFILING,
+        SUB_RENDER_TARGETS,
+        SUB_COUNT
+    };
+
+    const char * const subsystem_names[SUB_COUNT] = {
+        "geometry", "textures", "skybox", "orbits", "shaders", "uniforms", "profiling", "render_targets"
+    };
+
+    // Estimated size of an 8 bit per channel texture, a full mip chain adds a third
+    inline size_t textureBytes(int width, int height, int channels, bool mipmapped)
+    {
+        size_t bytes = (size_t)width * height * channels;
+        return mipmapped ? bytes + bytes / 3 : bytes;
+    }
+
+    inline int subsystemFromName(const char * name)
+    {
+        for (int i = 0; i < SUB_COUNT; i++)
+        {
+            if (std::strcmp(subsystem_names[i], name) == 0)
+                return i;
+        }
+
+        return -1;
+    }
+
+    struct Usage
+    {
+        unsigned long created = 0;
+        unsigned long objects = 0;      // Still alive
+        size_t gpuBytes = 0;
+        size_t gpuPeak = 0;
+        size_t cpuBytes = 0;
+        size_t cpuPeak = 0;
+        size_t cpuReleased = 0;     // CPU copies dropped once the GPU had the data
+        size_t budget = 0;          // GPU + CPU bytes, 0 for none
+        bool overBudget = false;
+    };
+
+    class Registry
+    {
+        public:
+            Usage usage[SUB_COUNT];
+
+            void track(Kind kind, unsigned int id, Subsystem subsystem, size_t bytes, const char * label = NULL)
+            {
+                if (id == 0)
+                    return;
+
+                uint64_t key = makeKey(kind, id);
+
+                // GL reused a name we still hold, the old object must have been deleted behind our back
+                std::unordered_map<uint64_t, Entry>::iterator found = objects.find(key);
+                if (found != objects.end())
+                    remove(found->second);
+
+                Entry entry;
+                entry.kind = kind;
+                entry.id = id;
+                entry.subsystem = subsystem;
+                entry.bytes = bytes;
+                entry.label = label;
+                objects[key] = entry;
+
+                usage[subsystem].created++;
+                usage[subsystem].objects++;
+                addGpu(subsystem, bytes);
+            }
+
+            // For buffers that are re-specified with glBufferData
+            void resize(Kind kind, unsigned int id, size_t bytes)
+            {
+                std::unordered_map<uint64_t, Entry>::iterator found = objects.find(makeKey(kind, id));
+                if (found == objects.end())
+                    return;
+
+                Entry & entry = found->second;
+                usage[entry.subsystem].gpuBytes -= entry.bytes;
+                entry.bytes = bytes;
+                addGpu(entry.subsystem, bytes);
+            }
+
+            void release(Kind kind, unsigned int id)
+            {
+                std::unordered_map<uint64_t, Entry>::iterator found = objects.find(makeKey(kind, id));
+                if (found == objects.end())
+                    return;
+
+                remove(found->second);
+                objects.erase(found);
+            }
+
+            void release(Kind kind, unsigned int count, const unsigned int * ids)
+            {
+                for (unsigned int i = 0; i < count; i++)
+                    release(kind, ids[i]);
+            }
+
+            // CPU side copies of GPU data, e.g. mesh vertices
+            void trackCpu(Subsystem subsystem, size_t bytes)
+            {
+                Usage & use = usage[subsystem];
+                use.cpuBytes += bytes;
+                if (use.cpuBytes > use.cpuPeak)
+                    use.cpuPeak = use.cpuBytes;
+
+                checkBudget(subsystem);
+            }
+
+            void releaseCpu(Subsystem subsystem, size_t bytes)
+            {
+                Usage & use = usage[subsystem];
+                bytes = bytes > use.cpuBytes ? use.cpuBytes : bytes;
+
+                use.cpuBytes -= bytes;
+                use.cpuReleased += bytes;
+            }
+
+            void setBudget(Subsystem subsystem, size_t bytes)
+            {
+                usage[subsystem].budget = bytes;
+                checkBudget(subsystem);
+            }
+
+            bool overBudget() const
+            {
+                for (int i = 0; i < SUB_COUNT; i++)
+                {
+                    if (usage[i].overBudget)
+                        return true;
+                }
+
+                return false;
+            }
+
+            size_t gpuBytes() const
+            {
+                size_t total = 0;
+                for (int i = 0; i < SUB_COUNT; i++)
+                    total += usage[i].gpuBytes;
+
+                return total;
+            }
+
+            void printReport() const
+            {
+                std::printf("%-16s %8s %8s %12s %12s %12s %12s %10s\n", "Memory", "created", "alive", "GPU now", "GPU peak", "CPU peak", "CPU freed", "budget");
+
+                for (int i = 0; i < SUB_COUNT; i++)
+                {
+                    const Usage & use = usage[i];
+                    if (use.created == 0 && use.cpuPeak == 0)
+                        continue;
+
+                    char budget[32] = "-";
+                    if (use.budget)
+                        std::snprintf(budget, sizeof(budget), "%.1f MB%s", use.budget / 1048576.0, use.overBudget ? "!" : "");
+
+                    std::printf("%-16s %8lu %8lu %9.2f MB %9.2f MB %9.2f MB %9.2f MB %10s\n", subsystem_names[i], use.created, use.objects,
+                                use.gpuBytes / 1048576.0, use.gpuPeak / 1048576.0, use.cpuPeak / 1048576.0, use.cpuReleased / 1048576.0, budget);
+                }
+                std::fflush(stdout);
+            }
+
+            // Everything created but never deleted. Call after the owners are gone, with the context still alive.
+            unsigned int printLeaks() const
+            {
+                if (objects.empty())
+                {
+                    std::cout << "GL objects: none leaked" << std::endl;
+                    return 0;
+                }
+
+                std::cerr << "ERROR: " << objects.size() << " GL objects were never deleted:" << std::endl;
+
+                std::unordered_map<uint64_t, Entry>::const_iterator it;
+                for (it = objects.begin(); it != objects.end(); ++it)
+                {
+                    const Entry & entry = it->second;
+                    std::cerr << "  " << kind_names[entry.kind] << " " << entry.id << " (" << subsystem_names[entry.subsystem];
+                    if (entry.label)
+                        std::cerr << ", " << entry.label;
+                    std::cerr << ", " << entry.bytes << " bytes)" << std::endl;
+                }
+
+                return objects.size();
+            }
+
+        private:
+            struct Entry
+            {
+                Kind kind;
+                unsigned int id;
+                Subsystem subsystem;
+                size_t bytes;
+                const char * label;     // String literal or NULL
+            };
+
+            std::unordered_map<uint64_t, Entry> objects;
+
+            static uint64_t makeKey(Kind kind, unsigned int id)
+            {
+                return ((uint64_t)kind << 32) | id;
+            }
+
+            void addGpu(Subsystem subsystem, size_t bytes)
+            {
+                Usage & use = usage[subsystem];
+                use.gpuBytes += bytes;
+                if (use.gpuBytes > use.gpuPeak)
+                    use.gpuPeak = use.gpuBytes;
+
+                checkBudget(subsystem);
+            }
+
+            void remove(const Entry & entry)
+            {
+                Usage & use = usage[entry.subsystem];
+                use.objects--;
+                use.gpuBytes -= entry.bytes;
+            }
+
+            // Complains once per subsystem, the first time it goes over
+            void checkBudget(Subsystem subsystem)
+            {
+                Usage & use = usage[subsystem];
+                if (use.budget == 0 || use.overBudget || use.gpuBytes + use.cpuBytes <= use.budget)
+                    return;
+
+                use.overBudget = true;
+                std::cerr << "ERROR: " << subsystem_names[subsystem] << " went over its memory budget: "
+                          << (use.gpuBytes + use.cpuBytes) / 1048576.0 << " MB of " << use.budget / 1048576.0 << " MB" << std::endl;
+            }
+    };
+
+    inline Registry & registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+}
+
+#endif
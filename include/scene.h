@@ -0,0 +1,316 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+#include "../lib/glm/gtc/matrix_transform.hpp"
+
+#include "shader.h"
+#include "shader_manager.h"
+#include "shader_variants.h"
+#include "geometry_arena.h"
+#include "uniform_blocks.h"
+#include "render_queue.h"
+#include "camera.h"
+#include "model.h"
+#include "circle.h"
+#include "skybox.h"
+#include "profiler.h"
+#include "gpu_profiler.h"
+#include "dynamic_resolution.h"
+#include "quality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// The Sun, Earth and Moon with their orbits and the skybox. Independent of how the GL context was created,
+// so the window and the headless mode render exactly the same thing.
+namespace Learus_Scene
+{
+    const float NEAR_PLANE = 0.1f;
+    const float FAR_PLANE = 100.0f;
+
+    // Asked for the camera once more right before the recorded draws go to GL. The view only reaches the shaders
+    // through the camera block, so a newer camera can be swapped in after recording.
+    class CameraLatch
+    {
+        public:
+            virtual ~CameraLatch() {}
+
+            // False to keep the camera the frame started with
+            virtual bool latch(Camera & camera) = 0;
+    };
+
+    class Scene
+    {
+        public:
+            float earthOrbitRadius;
+            float moonOrbitRadius;
+            glm::vec3 sunPos;
+            glm::vec3 earthPos;
+            glm::vec3 moonPos;
+
+            // Model matrices for the current frame, set by animate()
+            glm::mat4 sunModel;
+            glm::mat4 earthModel;
+            glm::mat4 moonModel;
+
+            // Every program goes through the manager, so identical ones are shared and binaries are reused between runs
+            Learus_Shaders::ShaderManager shaders;
+            // Each model material gets the permutation matching the maps it has
+            Learus_Shaders::ShaderVariants planetShaders;
+            Learus_Shaders::ShaderVariants sunShaders;
+
+            // Data every program shares. Uploaded once per frame instead of once per program.
+            Learus_Uniforms::UniformBuffer<Learus_Uniforms::CameraBlock> cameraUniforms;
+            Learus_Uniforms::UniformBuffer<Learus_Uniforms::LightBlock> lightUniforms;
+            Learus_Uniforms::LightBlock light;
+
+            // Load the models. All of their meshes share one set of buffers.
+            Learus_Geometry::GeometryArena arena;
+            Model Sun;
+            Model Earth;
+            Model Moon;
+
+            Learus_Circle::Circle EarthOrbitCircle;
+            Learus_Circle::Circle MoonOrbitCircle;
+            Learus_Skybox::Skybox skyBox;
+
+            Learus_Render::RenderQueue renderQueue;
+
+            // Per pass GPU times, off until enable() is called
+            Learus_Profiler::GpuProfiler gpuProfiler;
+
+            // Optional, see CameraLatch
+            CameraLatch * cameraLatch;
+
+            // Optional, renders the frame at a lower resolution and scales it up into the bound framebuffer
+            Learus_DynamicRes::DynamicResolution * resolution;
+
+            // Optional, the quality level to draw at. Without one everything is drawn at full detail.
+            Learus_Quality::Governor * quality;
+
+            // Needs a current GL context
+            Scene()
+            : earthOrbitRadius(100.0f), moonOrbitRadius(20.0f),
+              sunPos(0.0f, -1.0f, 0.0f), earthPos(sunPos + glm::vec3(0.0f, 0.0f, earthOrbitRadius)), moonPos(earthPos),
+              planetShaders("./src/planet.vs", "./src/planet.fs", shaders),
+              sunShaders("./src/sun.vs", "./src/sun.fs", shaders),
+              cameraUniforms(Learus_Uniforms::CAMERA_BINDING),
+              lightUniforms(Learus_Uniforms::LIGHT_BINDING),
+              Sun("./models/Planet/planet.obj", arena),
+              Earth("./models/Earth/Globe.obj", arena),
+              Moon("./models/Rock/rock.obj", arena),
+              EarthOrbitCircle(sunPos, earthOrbitRadius, glm::vec3(0.0f, 1.0f, 1.0f), 3000, shaders),
+              MoonOrbitCircle(earthPos, moonOrbitRadius, glm::vec3(1.0f, 1.0f, 0.0f), 3000, shaders),
+              skyBox("./images/top.png", "./images/bottom.png", "./images/left.png", "./images/right.png", "./images/front.png", "./images/back.png", shaders),
+              cameraLatch(NULL), resolution(NULL), quality(NULL), lodPixels(0.0f), mipBias(0.0f), drawDistance(0.0f), pixelsPerUnit(0.0f), leftOut(0)
+            {
+                light.position = sunPos;
+                light.ambient = glm::vec3(0.25f, 0.25f, 0.25f);
+                light.diffuse = glm::vec3(1.8f, 1.8f, 1.8f);
+                light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+                light.constant = 1.0f;
+                light.linear = 0.045f;
+                light.quadratic = 0.0075f;
+
+                Sun.prepare(sunShaders);
+                Earth.prepare(planetShaders);
+                Moon.prepare(planetShaders);
+            }
+
+            // Draws one frame into the bound framebuffer. simTime drives the orbits.
+            void Render(Camera & camera, float simTime, int width, int height)
+            {
+                PROFILE_SCOPE("Scene::Render");
+
+                // Swap in programs that finished compiling in the background
+                shaders.update();
+
+                // First, so the governor and the scaler hear about the frames the GPU finished before deciding
+                gpuProfiler.beginFrame();
+
+                if (quality && quality->beginFrame())
+                    applyQuality(quality->level());
+
+                // Scratch memory from two frames ago is free again
+                Learus_Memory::frameArena().beginFrame();
+                renderQueue.begin();
+
+                gpuProfiler.begin("Frame");
+
+                if (resolution)
+                    resolution->begin(width, height);
+
+                glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                // view / projection
+                float aspect = height > 0 ? (float)width / (float)height : 1.0f;
+                glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), aspect, NEAR_PLANE, FAR_PLANE);
+                glm::mat4 view = camera.GetViewMatrix();
+                pixelsPerUnit = projection[1][1] * 0.5f * height;
+
+                // Per frame uniforms, shared by every program through the uniform blocks
+                Learus_Uniforms::CameraBlock cameraBlock;
+                cameraBlock.projection = projection;
+                cameraBlock.view = view;
+                cameraBlock.viewPos = camera.Position;
+                cameraBlock.mipBias = mipBias;
+
+                animate(simTime);
+                lightUniforms.update(light);
+
+                Learus_Render::DrawItem skyBoxItem = { &skyBox, skyBox.shader, glm::mat4(1.0f), NULL, "Skybox", 0 };
+                renderQueue.submit(Learus_Render::makeKey(Learus_Render::PASS_SKYBOX, skyBox.shader->ID, 0, 0), skyBoxItem);
+
+                submitModel(Sun, sunShaders, sunModel, view, "Sun");
+                submitModel(Earth, planetShaders, earthModel, view, "Planets");
+                submitModel(Moon, planetShaders, moonModel, view, "Planets");
+
+                Learus_Render::DrawItem earthOrbitItem = { &EarthOrbitCircle, EarthOrbitCircle.shader, glm::mat4(1.0f), NULL, "Orbits", 0 };
+                renderQueue.submit(Learus_Render::makeKey(Learus_Render::PASS_LINES, EarthOrbitCircle.shader->ID, 0, 0), earthOrbitItem);
+
+                Learus_Render::DrawItem moonOrbitItem = { &MoonOrbitCircle, MoonOrbitCircle.shader, glm::mat4(1.0f), NULL, "Orbits", 0 };
+                renderQueue.submit(Learus_Render::makeKey(Learus_Render::PASS_LINES, MoonOrbitCircle.shader->ID, 0, 0), moonOrbitItem);
+
+                {
+                    PROFILE_SCOPE("Sort");
+                    renderQueue.sort();
+                }
+                renderQueue.record();
+
+                // The draw order above was sorted with the old view, which only matters for depth ties
+                if (cameraLatch && cameraLatch->latch(camera))
+                {
+                    cameraBlock.projection = glm::perspective(glm::radians(camera.zoom), aspect, NEAR_PLANE, FAR_PLANE);
+                    cameraBlock.view = camera.GetViewMatrix();
+                    cameraBlock.viewPos = camera.Position;
+                }
+                cameraUniforms.update(cameraBlock);
+
+                renderQueue.execute(&gpuProfiler);
+                renderQueue.clear();
+
+                if (resolution)
+                    resolution->end();
+
+                if (quality)
+                    quality->endFrame();
+
+                // The frame stays open for the overlay, the next beginFrame() ends it
+                gpuProfiler.end();
+            }
+
+            // Moves everything to where it is at simTime. Shared by every renderer, so they all draw the same frame.
+            void animate(float simTime)
+            {
+                light.position = sunPos;
+
+                // The sun
+                sunModel = glm::translate(glm::mat4(1.0f), sunPos); // Center it (kinda)
+
+                // The Earth
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+
+                // Orbit around the sun
+                earthPos = sunPos + glm::vec3(sin(simTime) * earthOrbitRadius, 0.0f, cos(simTime) * earthOrbitRadius);
+                model = glm::translate(model, earthPos);
+                // Rotate around itself
+                earthModel = glm::rotate(model, simTime * 1.5f * glm::radians(-50.0f), glm::vec3(0.1f, 1.0f, 0.0f));
+
+                // A circle showing the earth's orbit around the sun
+                EarthOrbitCircle.setUniforms();
+                EarthOrbitCircle.scale(glm::vec3(0.1f, 0.1f, 0.1f));
+                EarthOrbitCircle.rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+                // The Moon
+                model = glm::mat4(1.0f);
+                model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+                // Orbit around the earth
+                moonPos = earthPos + glm::vec3(0.0f, sin(simTime) * moonOrbitRadius , cos(simTime) * moonOrbitRadius);
+                moonModel = glm::translate(model, moonPos);
+
+                // A circle showing the moon's orbit around the earth
+                MoonOrbitCircle.setUniforms();
+                MoonOrbitCircle.scale(glm::vec3(0.1f, 0.1f, 0.1f));
+                MoonOrbitCircle.translate(earthPos);
+                MoonOrbitCircle.rotate(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            }
+
+            void printStats()
+            {
+                std::cout << "Drew " << arena.draws.stats.commands << " meshes with " << arena.draws.stats.drawCalls << " draw calls" << std::endl;
+
+                const Learus_GLState::Stats & stateStats = Learus_GLState::current().stats;
+                std::cout << "State changes: " << stateStats.issued() << " issued out of " << stateStats.requested() << " requested"
+                          << " (programs " << stateStats.programs.issued << "/" << stateStats.programs.requested
+                          << ", vertex arrays " << stateStats.vertexArrays.issued << "/" << stateStats.vertexArrays.requested
+                          << ", textures " << stateStats.textures.issued << "/" << stateStats.textures.requested << ")" << std::endl;
+
+                renderQueue.printStats();
+                Learus_Memory::frameArena().printStats();
+
+                gpuProfiler.flush();
+                gpuProfiler.printStats();
+
+                if (resolution)
+                    resolution->printStats();
+
+                if (quality)
+                {
+                    quality->printStats();
+                    if (leftOut)
+                        std::cout << "Left out " << leftOut << " planets beyond the draw distance" << std::endl;
+                }
+            }
+
+            // Sets every knob the level turns
+            void applyQuality(const Learus_Quality::Level & level)
+            {
+                lodPixels = level.lodPixels;
+                mipBias = level.mipBias;
+                drawDistance = level.drawDistance;
+
+                EarthOrbitCircle.setVertexCount(level.orbitVertices);
+                MoonOrbitCircle.setVertexCount(level.orbitVertices);
+            }
+
+        private:
+            // From the quality level
+            float lodPixels, mipBias, drawDistance;
+
+            // Screen size of one unit at a depth of one, for picking levels of detail
+            float pixelsPerUnit;
+
+            unsigned long leftOut;
+
+            // Queues a model for drawing, keyed so that it sorts next to draws sharing its program and textures
+            void submitModel(Model & object, Learus_Shaders::ShaderVariants & variants, const glm::mat4 & model, const glm::mat4 & view, const char * label)
+            {
+                Shader * shader = variants.get(object.features());
+
+                float depth = Learus_Render::viewDepth(view, glm::vec3(model[3]));
+
+                // The radius after the model matrix's largest scale
+                float radius = object.radius() * std::sqrt(std::max(glm::dot(model[0], model[0]), std::max(glm::dot(model[1], model[1]), glm::dot(model[2], model[2]))));
+                // The sun lights everything else, so it always stays
+                if (drawDistance > 0.0f && &object != &Sun && depth > drawDistance * radius)
+                {
+                    leftOut++;
+                    return;
+                }
+
+                unsigned int lod = depth > 0.0f ? Learus_Lod::select(2.0f * radius * pixelsPerUnit / depth, lodPixels) : 0;
+
+                uint64_t key = Learus_Render::makeKey(Learus_Render::PASS_OPAQUE, shader->ID, object.materialKey(), Learus_Render::quantizeDepth(depth, NEAR_PLANE, FAR_PLANE));
+
+                Learus_Render::DrawItem item = { &object, shader, model, &variants, label, lod };
+                renderQueue.submit(key, item);
+            }
+    };
+}
+
+#endif
@@ -3,7 +3,13 @@
 
 #include "../lib/glad/glad.h"
 #include "../lib/glm/glm.hpp"
+#include "gl_state.h"
+#include "uniform_blocks.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -14,6 +20,9 @@ class Shader
         // Program Id
         unsigned int ID;
 
+        // An empty shader, to be filled in later with adopt()
+        Shader() : ID(0) {}
+
         Shader(const char * vertexPath, const char * fragmentPath, bool _src = false)
         {
             std::string vertexCode;
@@ -58,73 +67,189 @@ class Shader
             
         }
 
+        // Takes over an already linked program: caches its uniforms and binds its uniform blocks
+        void adopt(unsigned int program)
+        {
+            ID = program;
+            locations.clear();
+            reflect();
+        }
+
         // Use / Activate the shader
         void use()
         {
-            glUseProgram(ID);
+            Learus_GLState::current().useProgram(ID);
         }
 
-        void setBool(const std::string &name, bool value) const
+        // Location of an active uniform, or -1 if the program does not use it. No GL call, the table is built at link time.
+        // Takes a plain C string so that passing a literal does not build (and allocate) a std::string.
+        GLint location(const char * name) const
+        {
+            std::vector<Location>::const_iterator it = std::lower_bound(locations.begin(), locations.end(), name, Location::less);
+            return (it == locations.end() || it->name != name) ? -1 : it->loc;
+        }
+        GLint location(const std::string &name) const
+        {
+            return location(name.c_str());
+        }
+
+        void setBool(const char * name, bool value) const
         {         
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+            setBool(location(name), value);
+        }
+        void setBool(GLint loc, bool value) const
+        {
+            glUniform1i(loc, (int)value);
         }
         
-        void setInt(const std::string &name, int value) const
+        void setInt(const char * name, int value) const
         { 
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+            setInt(location(name), value);
+        }
+        void setInt(GLint loc, int value) const
+        {
+            glUniform1i(loc, value);
         }
         
-        void setFloat(const std::string &name, float value) const
+        void setFloat(const char * name, float value) const
         { 
-            glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+            setFloat(location(name), value);
+        }
+        void setFloat(GLint loc, float value) const
+        {
+            glUniform1f(loc, value);
         }
         
-        void setVec2(const std::string &name, const glm::vec2 &value) const
+        void setVec2(const char * name, const glm::vec2 &value) const
         { 
-            glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+            glUniform2fv(location(name), 1, &value[0]); 
         }
-        void setVec2(const std::string &name, float x, float y) const
+        void setVec2(const char * name, float x, float y) const
         { 
-            glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+            glUniform2f(location(name), x, y); 
         }
         
-        void setVec3(const std::string &name, const glm::vec3 &value) const
+        void setVec3(const char * name, const glm::vec3 &value) const
         { 
-            glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+            setVec3(location(name), value);
+        }
+        void setVec3(GLint loc, const glm::vec3 &value) const
+        {
+            glUniform3fv(loc, 1, &value[0]);
         }
-        void setVec3(const std::string &name, float x, float y, float z) const
+        void setVec3(const char * name, float x, float y, float z) const
         { 
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+            glUniform3f(location(name), x, y, z); 
         }
         
-        void setVec4(const std::string &name, const glm::vec4 &value) const
+        void setVec4(const char * name, const glm::vec4 &value) const
         { 
-            glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+            glUniform4fv(location(name), 1, &value[0]); 
         }
-        void setVec4(const std::string &name, float x, float y, float z, float w) 
+        void setVec4(const char * name, float x, float y, float z, float w) 
         { 
-            glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+            glUniform4f(location(name), x, y, z, w); 
         }
         
-        void setMat2(const std::string &name, const glm::mat2 &mat) const
+        void setMat2(const char * name, const glm::mat2 &mat) const
         {
-            glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
         }
         
-        void setMat3(const std::string &name, const glm::mat3 &mat) const
+        void setMat3(const char * name, const glm::mat3 &mat) const
         {
-            glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            setMat3(location(name), mat);
+        }
+        void setMat3(GLint loc, const glm::mat3 &mat) const
+        {
+            glUniformMatrix3fv(loc, 1, GL_FALSE, &mat[0][0]);
         }
         
-        void setMat4(const std::string &name, const glm::mat4 &mat) const
+        void setMat4(const char * name, const glm::mat4 &mat) const
         {
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+            setMat4(location(name), mat);
+        }
+        void setMat4(GLint loc, const glm::mat4 &mat) const
+        {
+            glUniformMatrix4fv(loc, 1, GL_FALSE, &mat[0][0]);
         }
 
     private:
+        struct Location
+        {
+            std::string name;
+            GLint loc;
+
+            static bool less(const Location & entry, const char * name)
+            {
+                return std::strcmp(entry.name.c_str(), name) < 0;
+            }
+
+            static bool sorted(const Location & a, const Location & b)
+            {
+                return a.name < b.name;
+            }
+        };
+
+        // Active uniforms sorted by name, filled in by reflect()
+        std::vector<Location> locations;
+
+        // Caches every active uniform location and attaches the program's uniform blocks to their shared binding points
+        void reflect()
+        {
+            GLint count = 0, maxLength = 0;
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+            std::vector<char> name(maxLength + 1);
+
+            for (GLint i = 0; i < count; i++)
+            {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type;
+                glGetActiveUniform(ID, i, name.size(), &length, &size, &type, &name[0]);
+
+                std::string uniform(&name[0], length);
+
+                // Members of uniform blocks have no location
+                GLint loc = glGetUniformLocation(ID, uniform.c_str());
+                if (loc < 0)
+                    continue;
+
+                Location entry = { uniform, loc };
+                locations.push_back(entry);
+
+                // Arrays are reported as "name[0]", but should also be reachable as "name"
+                if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+                {
+                    Location alias = { uniform.substr(0, uniform.size() - 3), loc };
+                    locations.push_back(alias);
+                }
+            }
+
+            std::sort(locations.begin(), locations.end(), Location::sorted);
+
+            GLint blocks = 0;
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+            name.resize(maxLength + 1);
+
+            for (GLint i = 0; i < blocks; i++)
+            {
+                glGetActiveUniformBlockName(ID, i, name.size(), NULL, &name[0]);
+
+                int binding = Learus_Uniforms::bindingPoint(&name[0]);
+                if (binding >= 0)
+                    glUniformBlockBinding(ID, i, binding);
+            }
+        }
 
         bool compile(const char * vShaderCode, const char * fShaderCode)
         {
+            PROFILE_SCOPE("Shader compile");
+
             unsigned int vertex, fragment;
             int success;
             char infoLog[512];
@@ -161,7 +286,7 @@ class Shader
             glGetProgramiv(ID, GL_LINK_STATUS, &success);
             if (!success)
             {
-                glGetShaderInfoLog(ID, 512, NULL, infoLog);
+                glGetProgramInfoLog(ID, 512, NULL, infoLog);
                 std::cerr << "Error while linking program" << std::endl << infoLog << std::endl;
                 return false;
             }
@@ -169,6 +294,11 @@ class Shader
             glDeleteShader(vertex);
             glDeleteShader(fragment);
 
+            // Nothing deletes a program built this way, ShaderManager owns the ones it hands out
+            Learus_Resources::registry().track(Learus_Resources::KIND_PROGRAM, ID, Learus_Resources::SUB_SHADERS, 0, "standalone shader");
+
+            reflect();
+
             return true;
         }
 };
@@ -0,0 +1,530 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include "../lib/glad/glad.h"
+
+#include "shader.h"
+#include "gl_extensions.h"
+#include "profiler.h"
+#include "resource_registry.h"
+
+#include <sys/stat.h>
+#include <stdint.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Learus_Shaders
+{
+    // Drawn in place of a program while it is still compiling. Same inputs as the real shaders, flat grey output.
+    const char * fallback_vertex_shader =   "#version 330 core\n"
+                                            "layout (location = 0) in vec3 aPos;\n"
+                                            "layout (std140) uniform Camera {\n"
+                                            "    mat4 projection;\n"
+                                            "    mat4 view;\n"
+                                            "    vec3 viewPos;\n"
+                                            "};\n"
+                                            "uniform mat4 model;\n"
+                                            "void main() {\n"
+                                            "    gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+                                            "}\0";
+
+    const char * fallback_fragment_shader = "#version 330 core\n"
+                                            "out vec4 FragColor;\n"
+                                            "void main() {\n"
+                                            "    FragColor = vec4(0.5, 0.5, 0.5, 1.0);\n"
+                                            "}\0";
+
+    // 64 bit FNV-1a. Pass the previous result as seed to hash several pieces as one.
+    inline uint64_t hashBytes(const void * data, size_t size, uint64_t seed = 14695981039346656037ULL)
+    {
+        const unsigned char * bytes = (const unsigned char *)data;
+        uint64_t hash = seed;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    inline uint64_t hashString(const std::string & str, uint64_t seed = 14695981039346656037ULL)
+    {
+        // Include the terminator so ("ab", "c") and ("a", "bc") differ
+        return hashBytes(str.c_str(), str.size() + 1, seed);
+    }
+
+    struct Stats
+    {
+        unsigned int requests = 0;      // Programs asked for
+        unsigned int programs = 0;      // Programs actually created (including the fallback)
+        unsigned int shared = 0;        // Requests answered with a program that already existed
+        unsigned int cacheHits = 0;     // Programs restored from a stored binary
+        unsigned int cacheWrites = 0;   // Binaries stored for the next run
+        double seconds = 0.0;           // Time spent inside the manager on the calling thread
+        double linkSeconds = 0.0;       // Wall time from starting a background compile until the last one linked
+    };
+
+    // Hands out one Shader per distinct (vertex, fragment) source pair, so identical programs are only built once.
+    // Linked programs are stored with glGetProgramBinary under cacheDir and restored on the next run, keyed by
+    // source hash and driver version. When the driver supports KHR_parallel_shader_compile, programs link in the
+    // background and the returned Shader draws with the fallback program until update() sees them finish.
+    class ShaderManager
+    {
+        public:
+            Stats stats;
+
+            ShaderManager(const std::string & _cache_dir = "./cache/shaders")
+            : cacheDir(_cache_dir), settled(false)
+            {
+                Clock::time_point start = Clock::now();
+
+                Learus_GLExt::Functions & ext = Learus_GLExt::get();
+
+                cacheEnabled = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && !cacheDir.empty();
+                if (cacheEnabled)
+                    cacheEnabled = makeDirectories(cacheDir);
+
+                // Any change in the driver invalidates every stored binary
+                std::string driver;
+                driver += (const char *)glGetString(GL_VENDOR);
+                driver += '|';
+                driver += (const char *)glGetString(GL_RENDERER);
+                driver += '|';
+                driver += (const char *)glGetString(GL_VERSION);
+                driverKey = hashString(driver);
+
+                if (ext.MaxShaderCompilerThreads)
+                    ext.MaxShaderCompilerThreads(0xFFFFFFFFu);  // Let the driver pick
+
+                // The fallback has to be usable right away, so it always links synchronously
+                Pending pending;
+                pending.shader = &fallback;
+                pending.hash = 0;
+                startCompile(pending, fallback_vertex_shader, fallback_fragment_shader, false);
+                finish(pending, false);
+
+                stats.seconds += seconds(start);
+            }
+
+            ~ShaderManager()
+            {
+                Learus_GLState::StateCache & state = Learus_GLState::current();
+
+                // Programs still linking were never adopted by their shader
+                for (unsigned int i = 0; i < pending.size(); i++)
+                {
+                    glDeleteShader(pending[i].vertex);
+                    glDeleteShader(pending[i].fragment);
+                    glDeleteProgram(pending[i].program);
+                }
+
+                // Shaders that never got their own program share the fallback's
+                for (unsigned int i = 0; i < owned.size(); i++)
+                {
+                    if (owned[i]->ID != fallback.ID)
+                        deleteProgram(owned[i]->ID, state);
+
+                    delete owned[i];
+                }
+
+                deleteProgram(fallback.ID, state);
+            }
+
+            // Reads both stages from disk. The returned pointer stays valid for the lifetime of the manager.
+            Shader * load(const char * vertexPath, const char * fragmentPath)
+            {
+                std::string vertexCode;
+                std::string fragmentCode;
+
+                std::ifstream vShaderFile;
+                std::ifstream fShaderFile;
+
+                // Ensure ifstream objects can throw exceptions
+                vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+                fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+                try
+                {
+                    vShaderFile.open(vertexPath);
+                    fShaderFile.open(fragmentPath);
+                    std::stringstream vShaderStream, fShaderStream;
+
+                    vShaderStream << vShaderFile.rdbuf();
+                    fShaderStream << fShaderFile.rdbuf();
+
+                    vertexCode = vShaderStream.str();
+                    fragmentCode = fShaderStream.str();
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << "Error while reading shader files: " << e.what() << std::endl;
+                }
+
+                return fromSource(vertexCode, fragmentCode);
+            }
+
+            Shader * fromSource(const std::string & vertexCode, const std::string & fragmentCode)
+            {
+                Clock::time_point start = Clock::now();
+
+                stats.requests++;
+
+                uint64_t hash = hashString(fragmentCode, hashString(vertexCode));
+
+                std::unordered_map<uint64_t, Shader *>::iterator found = programs.find(hash);
+                if (found != programs.end())
+                {
+                    stats.shared++;
+                    stats.seconds += seconds(start);
+                    return found->second;
+                }
+
+                Shader * shader = new Shader();
+                owned.push_back(shader);
+                programs[hash] = shader;
+
+                // Draw with the fallback until the real program is ready
+                *shader = fallback;
+
+                GLuint program;
+                if (loadBinary(hash, program))
+                {
+                    trackProgram(program);
+                    shader->adopt(program);
+                    stats.programs++;
+                    stats.cacheHits++;
+                }
+                else
+                {
+                    bool async = Learus_GLExt::get().MaxShaderCompilerThreads != nullptr;
+
+                    Pending compile;
+                    compile.shader = shader;
+                    compile.hash = hash;
+                    startCompile(compile, vertexCode.c_str(), fragmentCode.c_str(), cacheEnabled);
+
+                    if (async)
+                    {
+                        if (pending.empty())
+                            compileStart = start;
+
+                        pending.push_back(compile);
+                        settled = false;
+                    }
+                    else
+                        finish(compile, cacheEnabled);
+                }
+
+                stats.seconds += seconds(start);
+                return shader;
+            }
+
+            // Swaps in every program that finished linking since the last call. Call once per frame.
+            void update()
+            {
+                if (pending.empty())
+                {
+                    settle();
+                    return;
+                }
+
+                Clock::time_point start = Clock::now();
+
+                for (unsigned int i = 0; i < pending.size(); )
+                {
+                    GLint done = GL_FALSE;
+                    glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS_KHR, &done);
+
+                    if (done)
+                    {
+                        finish(pending[i], cacheEnabled);
+                        pending[i] = pending.back();
+                        pending.pop_back();
+                    }
+                    else
+                    {
+                        i++;
+                    }
+                }
+
+                stats.seconds += seconds(start);
+
+                if (pending.empty())
+                {
+                    stats.linkSeconds += seconds(compileStart);
+                    settle();
+                }
+            }
+
+            // Blocks until every program has linked, e.g. before timing anything
+            void finishAll()
+            {
+                if (!pending.empty())
+                {
+                    for (unsigned int i = 0; i < pending.size(); i++)
+                        finish(pending[i], cacheEnabled);
+
+                    pending.clear();
+                    stats.linkSeconds += seconds(compileStart);
+                }
+
+                settle();
+            }
+
+            // Whether a shader from fromSource() / load() draws with its own program yet
+            bool ready(const Shader * shader) const
+            {
+                return shader->ID != fallback.ID;
+            }
+
+            bool busy() const
+            {
+                return !pending.empty();
+            }
+
+        private:
+            typedef std::chrono::steady_clock Clock;
+
+            struct Pending
+            {
+                Shader * shader;
+                uint64_t hash;
+                GLuint program;
+                GLuint vertex;
+                GLuint fragment;
+            };
+
+            // Header in front of every stored binary
+            struct BinaryHeader
+            {
+                uint32_t magic;
+                uint32_t format;
+                uint64_t driverKey;
+                uint64_t sourceHash;
+                uint32_t length;
+                uint32_t _pad0;
+            };
+
+            static const uint32_t BINARY_MAGIC = 0x4253504C;   // "LPSB"
+
+            std::string cacheDir;
+            bool cacheEnabled;
+            uint64_t driverKey;
+
+            Shader fallback;
+
+            std::unordered_map<uint64_t, Shader *> programs;
+            std::vector<Shader *> owned;
+            std::vector<Pending> pending;
+            Clock::time_point compileStart;
+            bool settled;   // Whether the stats were reported since the last background compile started
+
+            static double seconds(Clock::time_point start)
+            {
+                return std::chrono::duration<double>(Clock::now() - start).count();
+            }
+
+            // Reports the stats once nothing is left linking, so the times include the driver's background work
+            void settle()
+            {
+                if (settled)
+                    return;
+
+                settled = true;
+
+                std::cout << "Shaders: " << stats.programs << " programs for " << stats.requests << " requests, "
+                          << stats.shared << " shared, " << stats.cacheHits << " loaded from the binary cache, "
+                          << stats.cacheWrites << " stored to it, " << stats.seconds * 1000.0 << " ms on this thread, "
+                          << stats.linkSeconds * 1000.0 << " ms linking in the background" << std::endl;
+            }
+
+            // Issues compile and link without asking for their status, so a parallel compiling driver does not block
+            void startCompile(Pending & compile, const char * vShaderCode, const char * fShaderCode, bool retrievable)
+            {
+                PROFILE_SCOPE("Shader compile");
+
+                compile.vertex = glCreateShader(GL_VERTEX_SHADER);
+                glShaderSource(compile.vertex, 1, &vShaderCode, NULL);
+                glCompileShader(compile.vertex);
+
+                compile.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+                glShaderSource(compile.fragment, 1, &fShaderCode, NULL);
+                glCompileShader(compile.fragment);
+
+                compile.program = glCreateProgram();
+                if (retrievable)
+                    Learus_GLExt::get().ProgramParameteri(compile.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+                glAttachShader(compile.program, compile.vertex);
+                glAttachShader(compile.program, compile.fragment);
+                glLinkProgram(compile.program);
+            }
+
+            // Checks the result of startCompile. On success the shader switches to the new program.
+            void finish(Pending & compile, bool store)
+            {
+                PROFILE_SCOPE("Shader link");
+
+                int success;
+                char infoLog[512];
+
+                glGetShaderiv(compile.vertex, GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(compile.vertex, 512, NULL, infoLog);
+                    std::cerr << "Error while compiling vertex shader:" << std::endl << infoLog << std::endl;
+                }
+
+                glGetShaderiv(compile.fragment, GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(compile.fragment, 512, NULL, infoLog);
+                    std::cerr << "Error while compiling fragment shader:" << std::endl << infoLog << std::endl;
+                }
+
+                glDeleteShader(compile.vertex);
+                glDeleteShader(compile.fragment);
+
+                glGetProgramiv(compile.program, GL_LINK_STATUS, &success);
+                if (!success)
+                {
+                    glGetProgramInfoLog(compile.program, 512, NULL, infoLog);
+                    std::cerr << "Error while linking program" << std::endl << infoLog << std::endl;
+
+                    // Keep drawing with the fallback
+                    glDeleteProgram(compile.program);
+                    return;
+                }
+
+                trackProgram(compile.program);
+                compile.shader->adopt(compile.program);
+                stats.programs++;
+
+                if (store)
+                    storeBinary(compile.hash, compile.program);
+            }
+
+            // The size of the program binary is the closest thing GL offers to the program's memory use
+            void trackProgram(GLuint program)
+            {
+                GLint length = 0;
+                if (Learus_GLExt::get().GetProgramBinary)
+                    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+                Learus_Resources::registry().track(Learus_Resources::KIND_PROGRAM, program, Learus_Resources::SUB_SHADERS,
+                                                   length > 0 ? length : 0, "program");
+            }
+
+            static void deleteProgram(GLuint program, Learus_GLState::StateCache & state)
+            {
+                Learus_Resources::registry().release(Learus_Resources::KIND_PROGRAM, program);
+                state.forgetProgram(program);
+                glDeleteProgram(program);
+            }
+
+            std::string binaryPath(uint64_t hash) const
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+                return cacheDir + "/" + name;
+            }
+
+            bool loadBinary(uint64_t hash, GLuint & program)
+            {
+                PROFILE_SCOPE("Shader binary load");
+
+                if (!cacheEnabled)
+                    return false;
+
+                std::ifstream file(binaryPath(hash).c_str(), std::ios::binary);
+                if (!file)
+                    return false;
+
+                BinaryHeader header;
+                if (!file.read((char *)&header, sizeof(header)))
+                    return false;
+
+                if (header.magic != BINARY_MAGIC || header.driverKey != driverKey || header.sourceHash != hash)
+                    return false;
+
+                std::vector<char> binary(header.length);
+                if (header.length == 0 || !file.read(&binary[0], header.length))
+                    return false;
+
+                program = glCreateProgram();
+                Learus_GLExt::get().ProgramBinary(program, header.format, &binary[0], header.length);
+
+                // Drivers may reject a binary for reasons the key does not cover. Just compile from source then.
+                GLint success = GL_FALSE;
+                glGetProgramiv(program, GL_LINK_STATUS, &success);
+                if (!success)
+                {
+                    glDeleteProgram(program);
+                    return false;
+                }
+
+                return true;
+            }
+
+            void storeBinary(uint64_t hash, GLuint program)
+            {
+                GLint length = 0;
+                glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+                if (length <= 0)
+                    return;
+
+                std::vector<char> binary(length);
+                GLenum format = 0;
+                Learus_GLExt::get().GetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+                BinaryHeader header;
+                header.magic = BINARY_MAGIC;
+                header.format = format;
+                header.driverKey = driverKey;
+                header.sourceHash = hash;
+                header.length = length;
+                header._pad0 = 0;
+
+                std::ofstream file(binaryPath(hash).c_str(), std::ios::binary | std::ios::trunc);
+                if (!file)
+                    return;
+
+                file.write((const char *)&header, sizeof(header));
+                file.write(&binary[0], length);
+
+                if (file)
+                    stats.cacheWrites++;
+            }
+
+            // mkdir -p
+            static bool makeDirectories(const std::string & path)
+            {
+                for (size_t i = 1; i <= path.size(); i++)
+                {
+                    if (i == path.size() || path[i] == '/')
+                    {
+                        std::string part = path.substr(0, i);
+                        struct stat info;
+
+                        if (stat(part.c_str(), &info) != 0 && mkdir(part.c_str(), 0755) != 0)
+                        {
+                            std::cerr << "ERROR: Could not create shader cache directory: " << part << std::endl;
+                            return false;
+                        }
+                    }
+                }
+
+                return true;
+            }
+    };
+}
+
+#endif
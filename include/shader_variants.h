@@ -0,0 +1,174 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+#include "shader_manager.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Learus_Shaders
+{
+    // What a material actually has. Each bit turns into a #define, so the shader only does the work its material needs.
+    enum Feature
+    {
+        FEATURE_DIFFUSE_MAP = 1 << 0,
+        FEATURE_SPECULAR_MAP = 1 << 1,
+        FEATURE_EMISSION_MAP = 1 << 2
+    };
+
+    const unsigned int FEATURE_COUNT = 3;
+
+    const char * feature_defines[FEATURE_COUNT] = {
+        "HAS_DIFFUSE_MAP",
+        "HAS_SPECULAR_MAP",
+        "HAS_EMISSION_MAP"
+    };
+
+    // Feature bit for a Texture::type, 0 if no shader cares about it
+    inline unsigned int featureForTexture(const std::string & type)
+    {
+        if (type == "texture_diffuse")
+            return FEATURE_DIFFUSE_MAP;
+        if (type == "texture_specular")
+            return FEATURE_SPECULAR_MAP;
+        if (type == "texture_emission")
+            return FEATURE_EMISSION_MAP;
+
+        return 0;
+    }
+
+    // Reads a shader file and splices in every  #include "file"  line, relative to the including file.
+    // Each file is included once. #line directives keep compiler errors pointing at the right line.
+    inline bool preprocess(const std::string & path, std::string & out, std::vector<std::string> & included, int depth = 0)
+    {
+        for (unsigned int i = 0; i < included.size(); i++)
+        {
+            if (included[i] == path)
+                return true;
+        }
+        included.push_back(path);
+
+        if (depth > 16)
+        {
+            std::cerr << "ERROR: Shader includes nested too deep at: " << path << std::endl;
+            return false;
+        }
+
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cerr << "Error while reading shader file: " << path << std::endl;
+            return false;
+        }
+
+        std::string directory;
+        size_t slash = path.find_last_of('/');
+        if (slash != std::string::npos)
+            directory = path.substr(0, slash + 1);
+
+        std::string line;
+        unsigned int number = 0;
+
+        while (std::getline(file, line))
+        {
+            number++;
+
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start);
+                size_t close = (open == std::string::npos) ? open : line.find('"', open + 1);
+
+                if (close == std::string::npos)
+                {
+                    std::cerr << "ERROR: Malformed #include in " << path << ":" << number << std::endl;
+                    return false;
+                }
+
+                if (!preprocess(directory + line.substr(open + 1, close - open - 1), out, included, depth + 1))
+                    return false;
+
+                std::ostringstream directive;
+                directive << "#line " << number + 1 << "\n";
+                out += directive.str();
+                continue;
+            }
+
+            out += line;
+            out += '\n';
+        }
+
+        return true;
+    }
+
+    // Puts one #define per feature bit right after the #version line
+    inline std::string specialize(const std::string & source, unsigned int features)
+    {
+        std::string defines;
+        for (unsigned int i = 0; i < FEATURE_COUNT; i++)
+        {
+            if (features & (1u << i))
+            {
+                defines += "#define ";
+                defines += feature_defines[i];
+                defines += "\n";
+            }
+        }
+
+        if (defines.empty())
+            return source;
+
+        size_t version = source.find("#version");
+        size_t insertAt = (version == std::string::npos) ? 0 : source.find('\n', version);
+        insertAt = (insertAt == std::string::npos) ? source.size() : insertAt + 1;
+
+        std::string result = source;
+        result.insert(insertAt, defines);
+        return result;
+    }
+
+    // All the permutations of one vertex / fragment shader pair. Variants are built on first use and cached by feature bits.
+    class ShaderVariants
+    {
+        public:
+            ShaderVariants(const char * vertexPath, const char * fragmentPath, ShaderManager & _manager)
+            : manager(&_manager), variants(1u << FEATURE_COUNT, (Shader *)NULL)
+            {
+                std::vector<std::string> included;
+                preprocess(vertexPath, vertexCode, included);
+
+                included.clear();
+                preprocess(fragmentPath, fragmentCode, included);
+            }
+
+            Shader * get(unsigned int features)
+            {
+                features &= (1u << FEATURE_COUNT) - 1;
+
+                if (!variants[features])
+                    variants[features] = manager->fromSource(specialize(vertexCode, features), specialize(fragmentCode, features));
+
+                return variants[features];
+            }
+
+            // The variant if it was built already, NULL otherwise. Never builds one, so it is safe off the context thread.
+            Shader * built(unsigned int features) const
+            {
+                return variants[features & ((1u << FEATURE_COUNT) - 1)];
+            }
+
+        private:
+            ShaderManager * manager;
+
+            std::string vertexCode;
+            std::string fragmentCode;
+
+            std::vector<Shader *> variants;
+    };
+}
+
+#endif
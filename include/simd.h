@@ -0,0 +1,172 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define LEARUS_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define LEARUS_SIMD_SSE2
+#endif
+
+// Just enough 8 lane integer / float math for the software rasterizer and the path tracer. One AVX2 register when the compiler
+// is allowed to use AVX2, two SSE2 registers on any other x86-64, and plain arrays everywhere else.
+// Masks come back as an int with bit i set for lane i.
+namespace Learus_SIMD
+{
+#if defined(LEARUS_SIMD_AVX2)
+
+    struct Int8
+    {
+        __m256i v;
+
+        static Int8 splat(int value) { Int8 r; r.v = _mm256_set1_epi32(value); return r; }
+
+        // 0, step, 2 * step, ... 7 * step
+        static Int8 ramp(int step) { Int8 r; r.v = _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); return r; }
+
+        Int8 operator+(const Int8 & other) const { Int8 r; r.v = _mm256_add_epi32(v, other.v); return r; }
+        Int8 operator|(const Int8 & other) const { Int8 r; r.v = _mm256_or_si256(v, other.v); return r; }
+
+        // Lanes that are negative
+        int signMask() const { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+    };
+
+    struct Float8
+    {
+        __m256 v;
+
+        static Float8 splat(float value) { Float8 r; r.v = _mm256_set1_ps(value); return r; }
+        static Float8 load(const float * p) { Float8 r; r.v = _mm256_loadu_ps(p); return r; }
+        static Float8 convert(const Int8 & i) { Float8 r; r.v = _mm256_cvtepi32_ps(i.v); return r; }
+
+        void store(float * p) const { _mm256_storeu_ps(p, v); }
+
+        Float8 operator+(const Float8 & other) const { Float8 r; r.v = _mm256_add_ps(v, other.v); return r; }
+        Float8 operator-(const Float8 & other) const { Float8 r; r.v = _mm256_sub_ps(v, other.v); return r; }
+        Float8 operator*(const Float8 & other) const { Float8 r; r.v = _mm256_mul_ps(v, other.v); return r; }
+        Float8 operator/(const Float8 & other) const { Float8 r; r.v = _mm256_div_ps(v, other.v); return r; }
+
+        static Float8 min(const Float8 & a, const Float8 & b) { Float8 r; r.v = _mm256_min_ps(a.v, b.v); return r; }
+        static Float8 max(const Float8 & a, const Float8 & b) { Float8 r; r.v = _mm256_max_ps(a.v, b.v); return r; }
+
+        // Lanes where a < b
+        static int lessMask(const Float8 & a, const Float8 & b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+    };
+
+#elif defined(LEARUS_SIMD_SSE2)
+
+    struct Int8
+    {
+        __m128i lo, hi;
+
+        static Int8 splat(int value) { Int8 r; r.lo = r.hi = _mm_set1_epi32(value); return r; }
+
+        static Int8 ramp(int step)
+        {
+            Int8 r;
+            r.lo = _mm_setr_epi32(0, step, 2 * step, 3 * step);
+            r.hi = _mm_add_epi32(r.lo, _mm_set1_epi32(4 * step));
+            return r;
+        }
+
+        Int8 operator+(const Int8 & other) const { Int8 r; r.lo = _mm_add_epi32(lo, other.lo); r.hi = _mm_add_epi32(hi, other.hi); return r; }
+        Int8 operator|(const Int8 & other) const { Int8 r; r.lo = _mm_or_si128(lo, other.lo); r.hi = _mm_or_si128(hi, other.hi); return r; }
+
+        int signMask() const { return _mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4); }
+    };
+
+    struct Float8
+    {
+        __m128 lo, hi;
+
+        static Float8 splat(float value) { Float8 r; r.lo = r.hi = _mm_set1_ps(value); return r; }
+        static Float8 load(const float * p) { Float8 r; r.lo = _mm_loadu_ps(p); r.hi = _mm_loadu_ps(p + 4); return r; }
+        static Float8 convert(const Int8 & i) { Float8 r; r.lo = _mm_cvtepi32_ps(i.lo); r.hi = _mm_cvtepi32_ps(i.hi); return r; }
+
+        void store(float * p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+
+        Float8 operator+(const Float8 & other) const { Float8 r; r.lo = _mm_add_ps(lo, other.lo); r.hi = _mm_add_ps(hi, other.hi); return r; }
+        Float8 operator-(const Float8 & other) const { Float8 r; r.lo = _mm_sub_ps(lo, other.lo); r.hi = _mm_sub_ps(hi, other.hi); return r; }
+        Float8 operator*(const Float8 & other) const { Float8 r; r.lo = _mm_mul_ps(lo, other.lo); r.hi = _mm_mul_ps(hi, other.hi); return r; }
+        Float8 operator/(const Float8 & other) const { Float8 r; r.lo = _mm_div_ps(lo, other.lo); r.hi = _mm_div_ps(hi, other.hi); return r; }
+
+        static Float8 min(const Float8 & a, const Float8 & b) { Float8 r; r.lo = _mm_min_ps(a.lo, b.lo); r.hi = _mm_min_ps(a.hi, b.hi); return r; }
+        static Float8 max(const Float8 & a, const Float8 & b) { Float8 r; r.lo = _mm_max_ps(a.lo, b.lo); r.hi = _mm_max_ps(a.hi, b.hi); return r; }
+
+        static int lessMask(const Float8 & a, const Float8 & b)
+        {
+            return _mm_movemask_ps(_mm_cmplt_ps(a.lo, b.lo)) | (_mm_movemask_ps(_mm_cmplt_ps(a.hi, b.hi)) << 4);
+        }
+    };
+
+#else
+
+    struct Int8
+    {
+        int32_t v[8];
+
+        static Int8 splat(int value) { Int8 r; for (int i = 0; i < 8; i++) r.v[i] = value; return r; }
+        static Int8 ramp(int step) { Int8 r; for (int i = 0; i < 8; i++) r.v[i] = i * step; return r; }
+
+        Int8 operator+(const Int8 & other) const { Int8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] + other.v[i]; return r; }
+        Int8 operator|(const Int8 & other) const { Int8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] | other.v[i]; return r; }
+
+        int signMask() const { int m = 0; for (int i = 0; i < 8; i++) m |= (v[i] < 0) << i; return m; }
+    };
+
+    struct Float8
+    {
+        float v[8];
+
+        static Float8 splat(float value) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = value; return r; }
+        static Float8 load(const float * p) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = p[i]; return r; }
+        static Float8 convert(const Int8 & in) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = (float)in.v[i]; return r; }
+
+        void store(float * p) const { for (int i = 0; i < 8; i++) p[i] = v[i]; }
+
+        Float8 operator+(const Float8 & other) const { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] + other.v[i]; return r; }
+        Float8 operator-(const Float8 & other) const { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] - other.v[i]; return r; }
+        Float8 operator*(const Float8 & other) const { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] * other.v[i]; return r; }
+        Float8 operator/(const Float8 & other) const { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = v[i] / other.v[i]; return r; }
+
+        static Float8 min(const Float8 & a, const Float8 & b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+
+        static Float8 max(const Float8 & a, const Float8 & b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+
+        static int lessMask(const Float8 & a, const Float8 & b) { int m = 0; for (int i = 0; i < 8; i++) m |= (a.v[i] < b.v[i]) << i; return m; }
+    };
+
+#endif
+
+    inline float horizontalMax(const Float8 & value)
+    {
+        float lanes[8];
+        value.store(lanes);
+
+        float result = lanes[0];
+        for (int i = 1; i < 8; i++)
+            result = lanes[i] > result ? lanes[i] : result;
+
+        return result;
+    }
+
+    // out = m * (x, y, z, w) for a column major 4x4 matrix, e.g. glm::value_ptr of a glm::mat4
+    inline void transform(const float * m, float x, float y, float z, float w, float * out)
+    {
+#if defined(LEARUS_SIMD_AVX2) || defined(LEARUS_SIMD_SSE2)
+        __m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(x));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(y)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(z)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(w)));
+        _mm_storeu_ps(out, r);
+#else
+        for (int i = 0; i < 4; i++)
+            out[i] = m[i] * x + m[4 + i] * y + m[8 + i] * z + m[12 + i] * w;
+#endif
+    }
+}
+
+#endif
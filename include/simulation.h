@@ -0,0 +1,478 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "../lib/glm/glm.hpp"
+
+#include "camera.h"
+#include "profiler.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// Runs the simulation (camera orbiting, zoom, the animation clock) on its own thread at a fixed rate. The window's
+// render loop only sends input and draws the latest finished Snapshot, so a slow frame or vsync no longer slows the
+// simulation down, and a slow step does not hold up a frame. With nothing moving and no input, the thread sleeps until
+// input arrives.
+namespace Learus_Simulation
+{
+    const unsigned int CACHE_LINE = 64;
+
+    // One writer, one reader, never blocks either of them. The writer fills its own slot and swaps it with the shared
+    // middle one, the reader swaps the middle one for its own when it has something newer. The reader always ends up
+    // with the most recent complete value, and nobody ever sees a slot that is still being written.
+    template <typename T>
+    class TripleBuffer
+    {
+        public:
+            explicit TripleBuffer(const T & initial = T())
+            : middle(1), back(2), front(0)
+            {
+                for (unsigned int i = 0; i < 3; i++)
+                    slots[i] = initial;
+            }
+
+            // Writer: the slot to fill, then publish()
+            T & write()
+            {
+                return slots[back];
+            }
+
+            void publish()
+            {
+                back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+            }
+
+            // Reader: the latest published value. fresh says whether it changed since the last read.
+            const T & read(bool * fresh = NULL)
+            {
+                bool changed = (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+                if (changed)
+                    front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+
+                if (fresh)
+                    *fresh = changed;
+                return slots[front];
+            }
+
+        private:
+            static const unsigned int INDEX = 3;
+            static const unsigned int FRESH = 4;
+
+            T slots[3];
+
+            // Index of the shared slot, FRESH while the reader has not taken it yet
+            alignas(CACHE_LINE) std::atomic<unsigned int> middle;
+            alignas(CACHE_LINE) unsigned int back;      // Writer only
+            alignas(CACHE_LINE) unsigned int front;     // Reader only
+    };
+
+    // Fixed size ring for a single producer and a single consumer, without locks. push() fails when it is full.
+    template <typename T, unsigned int Capacity>
+    class SpscQueue
+    {
+        public:
+            SpscQueue()
+            : head(0), tail(0)
+            {
+            }
+
+            bool push(const T & item)
+            {
+                unsigned int t = tail.load(std::memory_order_relaxed);
+                if (t - head.load(std::memory_order_acquire) == Capacity)
+                    return false;
+
+                items[t % Capacity] = item;
+                tail.store(t + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool pop(T & item)
+            {
+                unsigned int h = head.load(std::memory_order_relaxed);
+                if (h == tail.load(std::memory_order_acquire))
+                    return false;
+
+                item = items[h % Capacity];
+                head.store(h + 1, std::memory_order_release);
+                return true;
+            }
+
+        private:
+            T items[Capacity];
+
+            // Free running counters, only the consumer moves head and only the producer moves tail
+            alignas(CACHE_LINE) std::atomic<unsigned int> head;
+            alignas(CACHE_LINE) std::atomic<unsigned int> tail;
+    };
+
+    enum InputType
+    {
+        INPUT_KEYS,             // The orbit keys that are held down changed, keys is a mask of ORBIT_* bits
+        INPUT_TOGGLE_ANIMATION,
+        INPUT_ZOOM,             // Scroll wheel, by amount
+        INPUT_SET_ANIMATION,    // On when amount is not 0
+        INPUT_SET_TIME,         // Jump to simulation time amount
+        INPUT_SET_WARP,         // Simulation seconds per real second
+        INPUT_PLACE_CAMERA      // At position facing target, with field of view amount (0 keeps it)
+    };
+
+    enum OrbitKey
+    {
+        ORBIT_UP = 1,
+        ORBIT_DOWN = 2,
+        ORBIT_LEFT = 4,
+        ORBIT_RIGHT = 8
+    };
+
+    struct Input
+    {
+        InputType type;
+        unsigned int keys;
+        float amount;
+        glm::vec3 position;
+        glm::vec3 target;
+        std::chrono::steady_clock::time_point time;     // When the render thread saw it
+    };
+
+    // Everything a frame needs from the simulation
+    struct Snapshot
+    {
+        Camera camera;
+        float simTime;
+        float warp;
+        bool animating;
+        unsigned long step;
+
+        // For latency measurements: the oldest input the render thread has not read in a snapshot yet (the clock's epoch
+        // if none), and when the step was published
+        std::chrono::steady_clock::time_point inputTime;
+        std::chrono::steady_clock::time_point published;
+    };
+
+    struct Stats
+    {
+        unsigned long steps = 0;
+        unsigned long inputs = 0;
+        unsigned long droppedInputs = 0;    // Queue was full, the render thread got too far ahead
+        unsigned long skippedSteps = 0;     // Steps given up on after falling too far behind
+        unsigned long sleeps = 0;           // Times it went to sleep with nothing moving
+        unsigned long frames = 0;           // Frames drawn, counted by the render thread
+        unsigned long staleFrames = 0;      // Frames that drew a snapshot that had been drawn before
+        unsigned long relatched = 0;        // Frames that picked up a newer camera right before submitting
+        double stepSeconds = 0.0;           // Spent inside steps
+    };
+
+    class Simulation
+    {
+        public:
+            Stats stats;
+
+            // orbitSpeed in degrees per second
+            Simulation(const Camera & camera, float _orbitRadius, float _orbitSpeed, float _rate)
+            : orbitRadius(_orbitRadius), orbitSpeed(_orbitSpeed), rate(_rate > 0.0f ? _rate : 120.0f),
+              keys(0), animation(false), warp(1.0f), carriedStep(0), moving(false), sent(0), processed(0), readStep(0),
+              stepNanoseconds(0), stopping(false)
+            {
+                current.camera = camera;
+                current.simTime = 0.0f;
+                current.warp = warp;
+                current.animating = animation;
+                current.step = 0;
+                published.store(0);
+
+                snapshots.write() = current;
+                snapshots.publish();
+            }
+
+            ~Simulation()
+            {
+                stop();
+            }
+
+            void start()
+            {
+                stopping.store(false);
+                thread = std::thread(&Simulation::run, this);
+            }
+
+            void stop()
+            {
+                if (!thread.joinable())
+                    return;
+
+                stopping.store(true);
+                wake();
+                thread.join();
+            }
+
+            // Render thread
+            void send(InputType type, unsigned int keys = 0, float amount = 0.0f)
+            {
+                Input input = { type, keys, amount, glm::vec3(0.0f), glm::vec3(0.0f), std::chrono::steady_clock::now() };
+                push(input);
+            }
+
+            // Render thread: puts the camera at position facing target, zoom 0 keeps its field of view
+            void placeCamera(glm::vec3 position, glm::vec3 target, float zoom)
+            {
+                Input input = { INPUT_PLACE_CAMERA, 0, zoom, position, target, std::chrono::steady_clock::now() };
+                push(input);
+            }
+
+            // Render thread: true when nothing is moving and every input sent so far shows in the latest snapshot, so
+            // the snapshot will not change until more input is sent
+            bool idle() const
+            {
+                return caughtUp() && !moving.load(std::memory_order_relaxed);
+            }
+
+            // Render thread: every input sent so far shows in the latest snapshot
+            bool caughtUp() const
+            {
+                return processed.load(std::memory_order_acquire) == sent.load(std::memory_order_relaxed);
+            }
+
+            // Render thread: the step of the latest published snapshot, without taking it
+            unsigned long publishedStep() const
+            {
+                return published.load(std::memory_order_acquire);
+            }
+
+            // Any thread: how long the latest step took
+            double stepMs() const
+            {
+                return stepNanoseconds.load(std::memory_order_relaxed) / 1e6;
+            }
+
+            float stepRate() const
+            {
+                return rate;
+            }
+
+            // Render thread: the newest complete state
+            const Snapshot & latest()
+            {
+                bool fresh;
+                const Snapshot & snapshot = snapshots.read(&fresh);
+
+                stats.frames++;
+                if (fresh)
+                    readStep.store(snapshot.step, std::memory_order_release);
+                else
+                    stats.staleFrames++;
+
+                return snapshot;
+            }
+
+            // Render thread: a snapshot newer than the one latest() gave this frame, or NULL. The reference latest()
+            // returned is not valid anymore once this found one.
+            const Snapshot * relatch()
+            {
+                bool fresh;
+                const Snapshot & snapshot = snapshots.read(&fresh);
+                if (!fresh)
+                    return NULL;
+
+                readStep.store(snapshot.step, std::memory_order_release);
+                stats.relatched++;
+                return &snapshot;
+            }
+
+            // Once stopped
+            void printStats()
+            {
+                std::cout << "Simulation: " << stats.steps << " steps at " << rate << " Hz for " << stats.frames << " frames ("
+                          << stats.staleFrames << " drew an unchanged snapshot, " << stats.relatched << " took a newer camera late), " << stats.inputs << " inputs";
+                if (stats.steps)
+                    std::cout << ", " << stats.stepSeconds * 1e6 / stats.steps << " us per step";
+                if (stats.droppedInputs)
+                    std::cout << ", " << stats.droppedInputs << " dropped";
+                if (stats.skippedSteps)
+                    std::cout << ", " << stats.skippedSteps << " steps skipped after falling behind";
+                if (stats.sleeps)
+                    std::cout << ", slept " << stats.sleeps << " times with nothing moving";
+                std::cout << std::endl;
+            }
+
+        private:
+            float orbitRadius;
+            float orbitSpeed;
+            float rate;
+
+            // Simulation thread only
+            Snapshot current;
+            unsigned int keys;
+            bool animation;
+            float warp;
+            std::chrono::steady_clock::time_point carriedInput;     // Oldest input not read yet, see Snapshot
+            unsigned long carriedStep;                              // First step that carried it
+
+            TripleBuffer<Snapshot> snapshots;
+            SpscQueue<Input, 256> inputs;
+
+            // Inputs sent by the render thread and taken into a published snapshot, for idle()
+            std::atomic<bool> moving;
+            std::atomic<unsigned long> sent;
+            std::atomic<unsigned long> processed;
+            std::atomic<unsigned long> published;
+            std::atomic<unsigned long> readStep;    // Of the latest snapshot the render thread took
+
+            std::atomic<uint32_t> stepNanoseconds;
+
+            // The thread waits here while idle
+            std::mutex sleepMutex;
+            std::condition_variable sleeping;
+
+            std::atomic<bool> stopping;
+            std::thread thread;
+
+            void push(const Input & input)
+            {
+                if (!inputs.push(input))
+                {
+                    stats.droppedInputs++;
+                    return;
+                }
+
+                sent.store(sent.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                wake();
+            }
+
+            void wake()
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                sleeping.notify_one();
+            }
+
+            // Until there is input or it is time to stop
+            void sleep()
+            {
+                PROFILE_SCOPE("Simulation idle");
+
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleeping.wait(lock, [this]() { return stopping.load() || sent.load(std::memory_order_acquire) != processed.load(std::memory_order_relaxed); });
+                stats.sleeps++;
+            }
+
+            void run()
+            {
+                PROFILE_THREAD_NAME("Simulation");
+
+                typedef std::chrono::steady_clock Clock;
+                Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+                Clock::time_point next = Clock::now();
+
+                // More than this many steps behind and it stops trying to catch up
+                const unsigned int MAX_CATCH_UP = 8;
+
+                while (!stopping.load())
+                {
+                    step(1.0f / rate);
+                    next += period;
+
+                    // Nothing would change until the next input, and the steps start again from when it arrives
+                    if (!moving.load(std::memory_order_relaxed) && sent.load(std::memory_order_acquire) == processed.load(std::memory_order_relaxed))
+                    {
+                        sleep();
+                        next = Clock::now();
+                        continue;
+                    }
+
+                    Clock::time_point now = Clock::now();
+                    if (now - next > period * MAX_CATCH_UP)
+                    {
+                        unsigned long behind = (now - next) / period;
+                        stats.skippedSteps += behind;
+                        next += period * behind;
+                    }
+
+                    std::this_thread::sleep_until(next);
+                }
+            }
+
+            void step(float deltaTime)
+            {
+                PROFILE_SCOPE("Simulation step");
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                // An input stays in the snapshots until the render thread reads one, a step it overwrote before
+                // that would lose it
+                if (carriedInput != std::chrono::steady_clock::time_point() && readStep.load(std::memory_order_acquire) >= carriedStep)
+                    carriedInput = std::chrono::steady_clock::time_point();
+
+                Input input;
+                unsigned long taken = 0;
+                while (inputs.pop(input))
+                {
+                    stats.inputs++;
+                    if (taken++ == 0 && carriedInput == std::chrono::steady_clock::time_point())
+                    {
+                        carriedInput = input.time;
+                        carriedStep = stats.steps + 1;
+                    }
+
+                    if (input.type == INPUT_KEYS)
+                        keys = input.keys;
+                    else if (input.type == INPUT_TOGGLE_ANIMATION)
+                        animation = !animation;
+                    else if (input.type == INPUT_ZOOM)
+                        current.camera.Zoom(input.amount);
+                    else if (input.type == INPUT_SET_ANIMATION)
+                        animation = input.amount != 0.0f;
+                    else if (input.type == INPUT_SET_TIME)
+                        current.simTime = input.amount;
+                    else if (input.type == INPUT_SET_WARP)
+                        warp = input.amount;
+                    else if (input.type == INPUT_PLACE_CAMERA)
+                    {
+                        current.camera.LookAt(input.position, input.target);
+                        if (input.amount > 0.0f)
+                            current.camera.zoom = glm::clamp(input.amount, 1.0f, 45.0f);
+                    }
+                }
+
+                float angle = orbitSpeed * deltaTime;
+                if (keys & ORBIT_UP)
+                    current.camera.Orbit(UP, orbitRadius, angle);
+                if (keys & ORBIT_DOWN)
+                    current.camera.Orbit(DOWN, orbitRadius, angle);
+                if (keys & ORBIT_RIGHT)
+                    current.camera.Orbit(RIGHT, orbitRadius, angle);
+                if (keys & ORBIT_LEFT)
+                    current.camera.Orbit(LEFT, orbitRadius, angle);
+
+                if (animation)
+                    current.simTime += deltaTime * warp;
+                current.warp = warp;
+                current.animating = animation;
+
+                current.step = ++stats.steps;
+                current.inputTime = carriedInput;
+                current.published = std::chrono::steady_clock::now();
+
+                snapshots.write() = current;
+                snapshots.publish();
+
+                moving.store(keys != 0 || animation, std::memory_order_relaxed);
+                published.store(current.step, std::memory_order_release);
+                processed.store(processed.load(std::memory_order_relaxed) + taken, std::memory_order_release);
+
+                std::chrono::nanoseconds took = std::chrono::steady_clock::now() - start;
+                stats.stepSeconds += took.count() / 1e9;
+                stepNanoseconds.store((uint32_t)std::min<int64_t>(took.count(), UINT32_MAX), std::memory_order_relaxed);
+            }
+
+            Simulation(const Simulation &);
+            Simulation & operator=(const Simulation &);
+    };
+}
+
+#endif
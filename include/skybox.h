@@ -1,6 +1,13 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
 #include "../lib/glad/glad.h"
+#include <chrono>
 #include <string>
 #include "shader.h"
+#include "shader_manager.h"
+#include "render_queue.h"
+#include "resource_registry.h"
 
 #ifndef STB_IMAGE_IMPLEMENTATION
     #define STB_IMAGE_IMPLEMENTATION
@@ -13,11 +20,15 @@ namespace Learus_Skybox
     const char * vertex_shader =    "#version 330 core\n"
                                     "layout (location = 0) in vec3 aPos;\n"
                                     "out vec3 TexCoords;\n"
-                                    "uniform mat4 projection;\n"
-                                    "uniform mat4 view;\n"
+                                    "layout (std140) uniform Camera {\n"
+                                    "    mat4 projection;\n"
+                                    "    mat4 view;\n"
+                                    "    vec3 viewPos;\n"
+                                    "};\n"
                                     "void main() {\n"
                                     "   TexCoords = aPos;\n"
-                                    "   gl_Position = projection * view * vec4(aPos, 1.0);\n"
+                                    "   // Drop the translation so the box stays centered on the camera\n"
+                                    "   gl_Position = projection * mat4(mat3(view)) * vec4(aPos, 1.0);\n"
                                     "}\0";
 
     const char * fragment_shader =  "#version 330 core\n"
@@ -28,16 +39,19 @@ namespace Learus_Skybox
                                     "   FragColor = texture(skybox, TexCoords);\n"
                                     "}\0";
                                     
-    class Skybox
+    class Skybox : public Learus_Render::Renderable
     {
         public:
             unsigned int textureID;
             unsigned int VAO;
-            Shader shader;
+            Shader * shader;
+            double loadSeconds;     // Reading and uploading the six faces
 
-            Skybox(std::string top, std::string bottom, std::string left, std::string right, std::string front, std::string back)
-            : shader(Learus_Skybox::vertex_shader, Learus_Skybox::fragment_shader, true)
+            Skybox(std::string top, std::string bottom, std::string left, std::string right, std::string front, std::string back, Learus_Shaders::ShaderManager & shaders)
+            : shader(shaders.fromSource(Learus_Skybox::vertex_shader, Learus_Skybox::fragment_shader)), loadSeconds(0.0), cubemapBytes(0)
             {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
                 // Create Vertices of the cube, VBO, VAO
                 float vertices[] = {
                     // positions          
@@ -87,7 +101,7 @@ namespace Learus_Skybox
                 glGenVertexArrays(1, &VAO);
                 glGenBuffers(1, &VBO);
 
-                glBindVertexArray(VAO);
+                Learus_GLState::current().bindVertexArray(VAO);
 
                 glBindBuffer(GL_ARRAY_BUFFER, VBO);
                 glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -96,12 +110,12 @@ namespace Learus_Skybox
                 glEnableVertexAttribArray(0);
                 glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
 
-                glBindVertexArray(0);
+                Learus_GLState::current().bindVertexArray(0);
 
 
                 // Bind Textures
                 glGenTextures(1, &textureID);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
                 loadTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, front);
                 loadTexture(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, back);
@@ -115,35 +129,45 @@ namespace Learus_Skybox
                 glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-            }
 
-            void Draw()
-            {
-                glDepthMask(GL_FALSE);
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_VERTEX_ARRAY, VAO, Learus_Resources::SUB_SKYBOX, 0, "skybox");
+                resources.track(Learus_Resources::KIND_BUFFER, VBO, Learus_Resources::SUB_SKYBOX, sizeof(vertices), "skybox cube");
+                resources.track(Learus_Resources::KIND_TEXTURE, textureID, Learus_Resources::SUB_SKYBOX, cubemapBytes, "skybox cubemap");
 
-                shader.use();
-                shader.setMat4("projection", projection);
-                shader.setMat4("view", view);
-                
-                glBindVertexArray(VAO);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
 
-                glDepthMask(GL_TRUE);
+            ~Skybox()
+            {
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_VERTEX_ARRAY, VAO);
+                resources.release(Learus_Resources::KIND_BUFFER, VBO);
+                resources.release(Learus_Resources::KIND_TEXTURE, textureID);
+
+                Learus_GLState::StateCache & state = Learus_GLState::current();
+                state.forgetVertexArray(VAO);
+                state.forgetTexture(textureID);
+
+                glDeleteVertexArrays(1, &VAO);
+                glDeleteBuffers(1, &VBO);
+                glDeleteTextures(1, &textureID);
             }
 
-            void setUniforms(glm::mat4 _projection, glm::mat4 _view)
+            void Record(const Learus_Render::DrawItem & item, Learus_Commands::CommandList & commands)
             {
-                projection = _projection;
-                view = _view;
+                commands.depthMask(false);
+                commands.useProgram(shader);
+                commands.bindVertexArray(VAO);
+                commands.bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
+                commands.drawArrays(GL_TRIANGLES, 0, 36);
+                commands.depthMask(true);
             }
 
         private:
 
             unsigned int VBO;
-
-            glm::mat4 projection;
-            glm::mat4 view;
+            size_t cubemapBytes;    // All six faces
 
             void loadTexture(GLenum target, std::string path)
             {
@@ -153,6 +177,7 @@ namespace Learus_Skybox
                 if (data)
                 {
                     glTexImage2D(target, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+                    cubemapBytes += Learus_Resources::textureBytes(width, height, 3, false);
                 }
                 else
                 {
@@ -161,5 +186,10 @@ namespace Learus_Skybox
 
                 stbi_image_free(data);
             }
+
+            Skybox(const Skybox &);
+            Skybox & operator=(const Skybox &);
     };
 }
+
+#endif
@@ -0,0 +1,866 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+#include "../lib/glm/gtc/matrix_transform.hpp"
+#include "../lib/glm/gtc/type_ptr.hpp"
+
+#include "software_scene.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "profiler.h"
+#include "resource_registry.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// A CPU renderer for machines without a usable GPU. Draws the same models, orbits and skybox as Scene::Render
+// with the shading of planet.fs / sun.fs / the skybox shader, and only uses GL to put the finished image on screen.
+//
+// A frame goes through three parallel stages: vertices are transformed in chunks, triangles are clipped, set up
+// and binned into 64x64 pixel tiles (also in chunks, each with its own bins), and then every thread takes whole
+// tiles and rasterizes them. Edge functions run 8 pixels at a time in 4 bit subpixel fixed point, and every 8x8
+// block keeps its farthest depth so triangles that cannot win a block skip it. Chunks are walked in submission
+// order inside each tile, so the image does not depend on the number of threads.
+namespace Learus_Software
+{
+    const int TILE_SIZE = 64;
+    const int BLOCK_SIZE = 8;
+    const int BLOCKS_PER_TILE = (TILE_SIZE / BLOCK_SIZE) * (TILE_SIZE / BLOCK_SIZE);
+    const int SUBPIXEL_BITS = 4;
+    const int SUBPIXEL = 1 << SUBPIXEL_BITS;
+
+    // Triangles are clipped to this many pixels around the origin, which keeps the per tile edge functions in 32 bits.
+    // Also the largest supported framebuffer.
+    const int GUARD_BAND = 8192;
+
+    const unsigned int VERTEX_CHUNK = 4096;
+    const unsigned int TRIANGLE_CHUNK = 2048;
+
+    // World position, normal, texture coordinates
+    const int ATTRIBUTES = 8;
+
+    struct ClipVertex
+    {
+        float position[4];
+        float attributes[ATTRIBUTES];
+    };
+
+    // A triangle ready to rasterize. Edge function e is A * x + B * y + C at fixed point pixel positions,
+    // positive inside, and is the (unnormalized) barycentric weight of vertex e.
+    struct Triangle
+    {
+        int64_t C[3];       // Fill rule bias included
+        int A[3];
+        int B[3];
+        int minX, minY, maxX, maxY;     // Pixel bounds, inclusive
+        float invArea;
+        float zMin;
+
+        // Values at vertex 0 and their differences towards vertices 1 and 2. Depth is linear on screen,
+        // the attributes are divided by w so they interpolate perspective correctly.
+        float z0, dz1, dz2;
+        float q0, dq1, dq2;     // 1 / w
+        float a0[ATTRIBUTES], da1[ATTRIBUTES], da2[ATTRIBUTES];
+
+        const Material * material;
+    };
+
+    struct Line
+    {
+        float x0, y0, z0;
+        float x1, y1, z1;       // Window coordinates
+        int minX, minY, maxX, maxY;
+        uint32_t color;
+    };
+
+    // Which triangles or lines touch which tile, as one list sorted by tile. Built with a counting pass and a
+    // writing pass over the items' pixel bounds, so memory only grows when a frame needs more than any before it.
+    class TileBins
+    {
+        public:
+            void resize(int tiles, size_t expectedItems)
+            {
+                offsets.assign(tiles + 1, 0);
+                cursor.assign(tiles, 0);
+                items.reserve(expectedItems);
+            }
+
+            template <typename T>
+            void build(const std::vector<T> & things, int tilesX)
+            {
+                std::fill(offsets.begin(), offsets.end(), 0);
+
+                for (unsigned int i = 0; i < things.size(); i++)
+                {
+                    const T & thing = things[i];
+                    for (int ty = thing.minY / TILE_SIZE; ty <= thing.maxY / TILE_SIZE; ty++)
+                    {
+                        for (int tx = thing.minX / TILE_SIZE; tx <= thing.maxX / TILE_SIZE; tx++)
+                            offsets[ty * tilesX + tx + 1]++;
+                    }
+                }
+
+                for (unsigned int t = 0; t < cursor.size(); t++)
+                {
+                    offsets[t + 1] += offsets[t];
+                    cursor[t] = offsets[t];
+                }
+
+                items.resize(offsets.back());
+
+                for (unsigned int i = 0; i < things.size(); i++)
+                {
+                    const T & thing = things[i];
+                    for (int ty = thing.minY / TILE_SIZE; ty <= thing.maxY / TILE_SIZE; ty++)
+                    {
+                        for (int tx = thing.minX / TILE_SIZE; tx <= thing.maxX / TILE_SIZE; tx++)
+                            items[cursor[ty * tilesX + tx]++] = i;
+                    }
+                }
+            }
+
+            const uint32_t * begin(int tile) const
+            {
+                return items.empty() ? NULL : &items[0] + offsets[tile];
+            }
+
+            const uint32_t * end(int tile) const
+            {
+                return items.empty() ? NULL : &items[0] + offsets[tile + 1];
+            }
+
+        private:
+            std::vector<uint32_t> offsets;      // Tile t holds items[offsets[t]] up to items[offsets[t + 1]]
+            std::vector<uint32_t> cursor;
+            std::vector<uint32_t> items;
+    };
+
+    struct Stats
+    {
+        unsigned long frames = 0;
+        unsigned long long triangles = 0;       // Submitted
+        unsigned long long rasterized = 0;      // Left after clipping and culling
+    };
+
+    class Renderer : public Backend
+    {
+        public:
+            Stats stats;
+
+            // Copies the scene's geometry and textures back from GL. Needs a current context.
+            Renderer(Learus_Scene::Scene & scene, unsigned int threads = 0)
+            : copy(scene), pool(threads), presenter("software frame"), frameWidth(0), frameHeight(0), tilesX(0), tilesY(0), stride(0)
+            {
+                PROFILE_SCOPE("Software import");
+
+                // Fixed chunks, so the binning order never depends on the thread count
+                unsigned int vertexCount = 0;
+                for (unsigned int d = 0; d < copy.draws.size(); d++)
+                {
+                    const Draw & draw = copy.draws[d];
+                    firstVertices.push_back(vertexCount);
+                    vertexCount += draw.vertices.size();
+
+                    for (unsigned int begin = 0; begin < draw.vertices.size(); begin += VERTEX_CHUNK)
+                    {
+                        VertexJob job = { d, begin, std::min<unsigned int>(begin + VERTEX_CHUNK, draw.vertices.size()) };
+                        vertexJobs.push_back(job);
+                    }
+
+                    unsigned int triangles = draw.indices.size() / 3;
+                    for (unsigned int begin = 0; begin < triangles; begin += TRIANGLE_CHUNK)
+                    {
+                        triangleJobs.push_back(TriangleJob());
+                        triangleJobs.back().draw = d;
+                        triangleJobs.back().begin = begin;
+                        triangleJobs.back().end = std::min(begin + TRIANGLE_CHUNK, triangles);
+                    }
+                }
+
+                transformed.resize(vertexCount);
+
+                std::cout << "Software renderer: " << pool.size() << " threads, " << copy.draws.size() << " meshes, "
+                          << vertexCount << " vertices" << std::endl;
+            }
+
+            // Renders the scene at simTime into the CPU framebuffer
+            void render(Camera & camera, float simTime, int width, int height)
+            {
+                PROFILE_SCOPE("Software::Render");
+
+                resize(width, height);
+                copy.animate(simTime);
+
+                // Same camera as Scene::Render
+                float aspect = height > 0 ? (float)width / (float)height : 1.0f;
+                glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), aspect, Learus_Scene::NEAR_PLANE, Learus_Scene::FAR_PLANE);
+                glm::mat4 view = camera.GetViewMatrix();
+
+                viewProjection = projection * view;
+                viewPos = camera.Position;
+                light = copy.scene.light;
+                sky.setup(projection, view, frameWidth, frameHeight);
+
+                {
+                    PROFILE_SCOPE("Vertices");
+                    pool.parallelFor(vertexJobs.size(), VertexStage(*this));
+                }
+                {
+                    PROFILE_SCOPE("Setup");
+                    pool.parallelFor(triangleJobs.size(), TriangleStage(*this));
+                    binLines();
+                }
+                {
+                    PROFILE_SCOPE("Raster");
+                    pool.parallelFor(tilesX * tilesY, RasterStage(*this));
+                }
+
+                stats.frames++;
+                for (unsigned int i = 0; i < triangleJobs.size(); i++)
+                {
+                    stats.triangles += triangleJobs[i].end - triangleJobs[i].begin;
+                    stats.rasterized += triangleJobs[i].triangles.size();
+                }
+            }
+
+            // Copies the last rendered frame into the bound draw framebuffer
+            void present()
+            {
+                PROFILE_SCOPE("Software::Present");
+
+                if (!color.empty())
+                    presenter.present(&color[0], stride);
+            }
+
+            unsigned int threadCount() const
+            {
+                return pool.size();
+            }
+
+            void printStats() const
+            {
+                if (stats.frames == 0)
+                    return;
+
+                std::cout << "Software renderer: " << pool.size() << " threads, " << tilesX * tilesY << " tiles, "
+                          << stats.triangles / stats.frames << " triangles per frame, "
+                          << stats.rasterized / stats.frames << " after clipping and culling" << std::endl;
+            }
+
+        private:
+            struct VertexJob
+            {
+                unsigned int draw, begin, end;
+            };
+
+            // A chunk of one draw's triangles, with what it produced this frame
+            struct TriangleJob
+            {
+                unsigned int draw, begin, end;
+                std::vector<Triangle> triangles;
+                TileBins bins;
+            };
+
+            // Function objects for the thread pool, C++11 lambdas would do the same
+            struct VertexStage
+            {
+                Renderer & r;
+                VertexStage(Renderer & _r) : r(_r) {}
+                void operator()(unsigned int index, unsigned int) const { r.transformVertices(r.vertexJobs[index]); }
+            };
+
+            struct TriangleStage
+            {
+                Renderer & r;
+                TriangleStage(Renderer & _r) : r(_r) {}
+                void operator()(unsigned int index, unsigned int) const { r.setupTriangles(r.triangleJobs[index]); }
+            };
+
+            struct RasterStage
+            {
+                Renderer & r;
+                RasterStage(Renderer & _r) : r(_r) {}
+                void operator()(unsigned int index, unsigned int) const { r.rasterTile(index); }
+            };
+
+            SceneCopy copy;
+            Learus_Threads::ThreadPool pool;
+            Presenter presenter;
+
+            std::vector<unsigned int> firstVertices;    // Of each draw, into transformed
+            std::vector<VertexJob> vertexJobs;
+            std::vector<TriangleJob> triangleJobs;
+            std::vector<ClipVertex> transformed;
+
+            std::vector<Line> lines;
+            TileBins lineBins;
+            std::vector<glm::vec4> orbitPoints;
+
+            // Per frame constants
+            glm::mat4 viewProjection;
+            glm::vec3 viewPos;
+            Learus_Uniforms::LightBlock light;
+            ViewRays sky;
+
+            // Framebuffer, padded to whole tiles, bottom row first like GL
+            int frameWidth, frameHeight;
+            int tilesX, tilesY;
+            int stride;
+            std::vector<uint32_t> color;
+            std::vector<float> depth;
+            std::vector<float> farthest;    // Largest depth in every 8x8 block, BLOCKS_PER_TILE per tile
+
+            void resize(int width, int height)
+            {
+                width = std::min(std::max(width, 1), GUARD_BAND);
+                height = std::min(std::max(height, 1), GUARD_BAND);
+
+                if (width == frameWidth && height == frameHeight)
+                    return;
+
+                frameWidth = width;
+                frameHeight = height;
+                tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+                tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+                stride = tilesX * TILE_SIZE;
+
+                color.assign((size_t)stride * tilesY * TILE_SIZE, 0);
+                depth.assign(color.size(), 1.0f);
+                farthest.assign((size_t)tilesX * tilesY * BLOCKS_PER_TILE, 1.0f);
+
+                // Most triangles touch a single tile, a few straddle two or four. Clipping rarely adds any.
+                for (unsigned int i = 0; i < triangleJobs.size(); i++)
+                {
+                    TriangleJob & job = triangleJobs[i];
+                    job.triangles.reserve((job.end - job.begin) * 5 / 4);
+                    job.bins.resize(tilesX * tilesY, (job.end - job.begin) * 4);
+                }
+
+                size_t orbitPointCount = 0;
+                for (unsigned int i = 0; i < copy.orbits.size(); i++)
+                    orbitPointCount += copy.orbits[i].points.size();
+
+                lines.reserve(orbitPointCount);
+                lineBins.resize(tilesX * tilesY, orbitPointCount * 4);
+
+                presenter.resize(width, height);
+            }
+
+            void transformVertices(const VertexJob & job)
+            {
+                const Draw & draw = copy.draws[job.draw];
+                const float * model = glm::value_ptr(*draw.model);
+                const float * clip = glm::value_ptr(viewProjection);
+
+                for (unsigned int i = job.begin; i < job.end; i++)
+                {
+                    const Vertex & in = draw.vertices[i];
+                    ClipVertex & out = transformed[firstVertices[job.draw] + i];
+
+                    float world[4];
+                    Learus_SIMD::transform(model, in.Position.x, in.Position.y, in.Position.z, 1.0f, world);
+                    Learus_SIMD::transform(clip, world[0], world[1], world[2], 1.0f, out.position);
+
+                    glm::vec3 normal = draw.normalMatrix * in.Normal;
+
+                    out.attributes[0] = world[0];
+                    out.attributes[1] = world[1];
+                    out.attributes[2] = world[2];
+                    out.attributes[3] = normal.x;
+                    out.attributes[4] = normal.y;
+                    out.attributes[5] = normal.z;
+                    out.attributes[6] = in.TexCoords.x;
+                    out.attributes[7] = in.TexCoords.y;
+                }
+            }
+
+            void setupTriangles(TriangleJob & job)
+            {
+                job.triangles.clear();
+
+                const Draw & draw = copy.draws[job.draw];
+                const ClipVertex * vertices = &transformed[firstVertices[job.draw]];
+
+                for (unsigned int t = job.begin; t < job.end; t++)
+                {
+                    const unsigned int * index = &draw.indices[t * 3];
+                    clip(vertices[index[0]], vertices[index[1]], vertices[index[2]], draw.material, job);
+                }
+
+                job.bins.build(job.triangles, tilesX);
+            }
+
+            // Signed distance to clip plane p, inside when >= 0: near, then the guard band left, right, bottom, top
+            float planeDistance(const ClipVertex & v, int plane) const
+            {
+                float gx = 2.0f * GUARD_BAND / frameWidth - 1.0f;
+                float gy = 2.0f * GUARD_BAND / frameHeight - 1.0f;
+                const float * p = v.position;
+
+                switch (plane)
+                {
+                    case 0: return p[2] + p[3];
+                    case 1: return p[0] + gx * p[3];
+                    case 2: return gx * p[3] - p[0];
+                    case 3: return p[1] + gy * p[3];
+                    default: return gy * p[3] - p[1];
+                }
+            }
+
+            unsigned int outcode(const ClipVertex & v) const
+            {
+                unsigned int code = 0;
+                for (int plane = 0; plane < 5; plane++)
+                {
+                    if (planeDistance(v, plane) < 0.0f)
+                        code |= 1 << plane;
+                }
+                return code;
+            }
+
+            void clip(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2, const Material & material, TriangleJob & job)
+            {
+                unsigned int c0 = outcode(v0), c1 = outcode(v1), c2 = outcode(v2);
+
+                // Entirely behind one plane
+                if (c0 & c1 & c2)
+                    return;
+
+                if ((c0 | c1 | c2) == 0)
+                {
+                    setup(v0, v1, v2, material, job);
+                    return;
+                }
+
+                // Sutherland-Hodgman against only the planes that cut the triangle
+                ClipVertex polygons[2][8];
+                ClipVertex * in = polygons[0];
+                ClipVertex * out = polygons[1];
+                int count = 3;
+                in[0] = v0;
+                in[1] = v1;
+                in[2] = v2;
+
+                unsigned int planes = c0 | c1 | c2;
+                for (int plane = 0; plane < 5 && count >= 3; plane++)
+                {
+                    if (!(planes & (1 << plane)))
+                        continue;
+
+                    int outCount = 0;
+                    for (int i = 0; i < count; i++)
+                    {
+                        const ClipVertex & a = in[i];
+                        const ClipVertex & b = in[(i + 1) % count];
+                        float da = planeDistance(a, plane), db = planeDistance(b, plane);
+
+                        if (da >= 0.0f)
+                            out[outCount++] = a;
+
+                        if ((da >= 0.0f) != (db >= 0.0f) && outCount < 8)
+                            lerp(a, b, da / (da - db), out[outCount++]);
+                    }
+
+                    std::swap(in, out);
+                    count = outCount;
+                }
+
+                for (int i = 1; i + 1 < count; i++)
+                    setup(in[0], in[i], in[i + 1], material, job);
+            }
+
+            static void lerp(const ClipVertex & a, const ClipVertex & b, float t, ClipVertex & out)
+            {
+                for (int i = 0; i < 4; i++)
+                    out.position[i] = a.position[i] + (b.position[i] - a.position[i]) * t;
+                for (int i = 0; i < ATTRIBUTES; i++)
+                    out.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+            }
+
+            void setup(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2, const Material & material, TriangleJob & job)
+            {
+                const ClipVertex * v[3] = { &v0, &v1, &v2 };
+                float q[3], z[3];
+                int X[3], Y[3];
+
+                for (int i = 0; i < 3; i++)
+                {
+                    const float * p = v[i]->position;
+                    q[i] = 1.0f / p[3];
+
+                    float x = (p[0] * q[i] * 0.5f + 0.5f) * frameWidth;
+                    float y = (p[1] * q[i] * 0.5f + 0.5f) * frameHeight;
+                    z[i] = p[2] * q[i] * 0.5f + 0.5f;
+
+                    X[i] = (int)std::floor(x * SUBPIXEL + 0.5f);
+                    Y[i] = (int)std::floor(y * SUBPIXEL + 0.5f);
+                }
+
+                int64_t area = (int64_t)(X[1] - X[0]) * (Y[2] - Y[0]) - (int64_t)(X[2] - X[0]) * (Y[1] - Y[0]);
+                if (area == 0)
+                    return;
+
+                // GL_CULL_FACE is off, so clockwise triangles are drawn too, turned around
+                int order[3] = { 0, 1, 2 };
+                if (area < 0)
+                {
+                    order[1] = 2;
+                    order[2] = 1;
+                    area = -area;
+                }
+
+                Triangle tri;
+                tri.minX = std::max(0, std::min(X[0], std::min(X[1], X[2])) >> SUBPIXEL_BITS);
+                tri.minY = std::max(0, std::min(Y[0], std::min(Y[1], Y[2])) >> SUBPIXEL_BITS);
+                tri.maxX = std::min(frameWidth - 1, std::max(X[0], std::max(X[1], X[2])) >> SUBPIXEL_BITS);
+                tri.maxY = std::min(frameHeight - 1, std::max(Y[0], std::max(Y[1], Y[2])) >> SUBPIXEL_BITS);
+                if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+                    return;
+
+                for (int e = 0; e < 3; e++)
+                {
+                    int a = order[(e + 1) % 3];
+                    int b = order[(e + 2) % 3];
+
+                    tri.A[e] = Y[a] - Y[b];
+                    tri.B[e] = X[b] - X[a];
+                    tri.C[e] = -(int64_t)tri.A[e] * X[a] - (int64_t)tri.B[e] * Y[a];
+
+                    // Top-left rule: pixels exactly on an edge belong to the triangle on its left or top side only
+                    bool topLeft = tri.A[e] > 0 || (tri.A[e] == 0 && tri.B[e] < 0);
+                    if (!topLeft)
+                        tri.C[e] -= 1;
+                }
+
+                int i0 = order[0], i1 = order[1], i2 = order[2];
+
+                tri.invArea = 1.0f / (float)area;
+                tri.zMin = std::min(z[0], std::min(z[1], z[2]));
+                tri.z0 = z[i0];
+                tri.dz1 = z[i1] - z[i0];
+                tri.dz2 = z[i2] - z[i0];
+                tri.q0 = q[i0];
+                tri.dq1 = q[i1] - q[i0];
+                tri.dq2 = q[i2] - q[i0];
+
+                for (int k = 0; k < ATTRIBUTES; k++)
+                {
+                    float a0 = v[i0]->attributes[k] * q[i0];
+                    tri.a0[k] = a0;
+                    tri.da1[k] = v[i1]->attributes[k] * q[i1] - a0;
+                    tri.da2[k] = v[i2]->attributes[k] * q[i2] - a0;
+                }
+
+                tri.material = &material;
+                job.triangles.push_back(tri);
+            }
+
+            // GL_LINE_LOOP orbits. Few enough to set up on one thread.
+            void binLines()
+            {
+                lines.clear();
+
+                for (unsigned int o = 0; o < copy.orbits.size(); o++)
+                {
+                    const Orbit & orbit = copy.orbits[o];
+                    glm::mat4 matrix = viewProjection * orbit.circle->modelMatrix();
+
+                    orbitPoints.resize(orbit.points.size());
+                    for (unsigned int i = 0; i < orbit.points.size(); i++)
+                        orbitPoints[i] = matrix * glm::vec4(orbit.points[i], 1.0f);
+
+                    for (unsigned int i = 0; i < orbitPoints.size(); i++)
+                        addLine(orbitPoints[i], orbitPoints[(i + 1) % orbitPoints.size()], orbit.color);
+                }
+
+                lineBins.build(lines, tilesX);
+            }
+
+            void addLine(glm::vec4 a, glm::vec4 b, uint32_t lineColor)
+            {
+                // Near plane
+                float da = a.z + a.w, db = b.z + b.w;
+                if (da < 0.0f && db < 0.0f)
+                    return;
+                if (da < 0.0f)
+                    a = a + (b - a) * (da / (da - db));
+                else if (db < 0.0f)
+                    b = b + (a - b) * (db / (db - da));
+
+                Line line;
+                line.x0 = (a.x / a.w * 0.5f + 0.5f) * frameWidth;
+                line.y0 = (a.y / a.w * 0.5f + 0.5f) * frameHeight;
+                line.z0 = a.z / a.w * 0.5f + 0.5f;
+                line.x1 = (b.x / b.w * 0.5f + 0.5f) * frameWidth;
+                line.y1 = (b.y / b.w * 0.5f + 0.5f) * frameHeight;
+                line.z1 = b.z / b.w * 0.5f + 0.5f;
+                line.color = lineColor;
+
+                float minX = std::max(0.0f, std::min(line.x0, line.x1)), maxX = std::min(frameWidth - 1.0f, std::max(line.x0, line.x1));
+                float minY = std::max(0.0f, std::min(line.y0, line.y1)), maxY = std::min(frameHeight - 1.0f, std::max(line.y0, line.y1));
+                if (minX > maxX || minY > maxY)
+                    return;
+
+                line.minX = (int)minX;
+                line.minY = (int)minY;
+                line.maxX = (int)maxX;
+                line.maxY = (int)maxY;
+                lines.push_back(line);
+            }
+
+            void rasterTile(unsigned int tile)
+            {
+                int tileX = (tile % tilesX) * TILE_SIZE;
+                int tileY = (tile / tilesX) * TILE_SIZE;
+                float * blocks = &farthest[(size_t)tile * BLOCKS_PER_TILE];
+
+                drawSky(tileX, tileY, blocks);
+
+                for (unsigned int j = 0; j < triangleJobs.size(); j++)
+                {
+                    const TriangleJob & job = triangleJobs[j];
+                    for (const uint32_t * i = job.bins.begin(tile); i != job.bins.end(tile); i++)
+                        rasterTriangle(job.triangles[*i], tileX, tileY, blocks);
+                }
+
+                // Drawn last, so they do not bother keeping the block depths up to date
+                for (const uint32_t * i = lineBins.begin(tile); i != lineBins.end(tile); i++)
+                    drawLine(lines[*i], tileX, tileY);
+            }
+
+            // Also clears the tile's depth. The skybox does not write depth in GL either.
+            void drawSky(int tileX, int tileY, float * blocks)
+            {
+                for (int y = tileY; y < tileY + TILE_SIZE; y++)
+                {
+                    uint32_t * colorRow = &color[(size_t)y * stride];
+                    float * depthRow = &depth[(size_t)y * stride];
+
+                    glm::vec3 direction = sky.at(tileX + 0.5f, y + 0.5f);
+                    for (int x = tileX; x < tileX + TILE_SIZE; x++)
+                    {
+                        colorRow[x] = pack(copy.sky.sample(direction));
+                        depthRow[x] = 1.0f;
+                        direction += sky.stepX;
+                    }
+                }
+
+                for (int i = 0; i < BLOCKS_PER_TILE; i++)
+                    blocks[i] = 1.0f;
+            }
+
+            void rasterTriangle(const Triangle & tri, int tileX, int tileY, float * blocks)
+            {
+                using Learus_SIMD::Int8;
+                using Learus_SIMD::Float8;
+
+                int x0 = std::max(tri.minX, tileX) - tileX, x1 = std::min(tri.maxX, tileX + TILE_SIZE - 1) - tileX;
+                int y0 = std::max(tri.minY, tileY) - tileY, y1 = std::min(tri.maxY, tileY + TILE_SIZE - 1) - tileY;
+                if (x0 > x1 || y0 > y1)
+                    return;
+
+                // Edge functions at the center of the tile's first pixel. Anything beyond 2^30 keeps its sign over
+                // the whole tile, so clamping it keeps the sums inside 32 bits without changing any coverage.
+                const int64_t LIMIT = (int64_t)1 << 30;
+                int edge[3], stepX[3], stepY[3];
+                Int8 ramp[3];
+
+                for (int e = 0; e < 3; e++)
+                {
+                    int64_t value = tri.C[e] + (int64_t)tri.A[e] * (tileX * SUBPIXEL + SUBPIXEL / 2) + (int64_t)tri.B[e] * (tileY * SUBPIXEL + SUBPIXEL / 2);
+                    edge[e] = (int)std::max(-LIMIT, std::min(LIMIT, value));
+                    stepX[e] = tri.A[e] * SUBPIXEL;
+                    stepY[e] = tri.B[e] * SUBPIXEL;
+                    ramp[e] = Int8::ramp(stepX[e]);
+                }
+
+                Float8 invArea = Float8::splat(tri.invArea);
+                Float8 z0 = Float8::splat(tri.z0), dz1 = Float8::splat(tri.dz1), dz2 = Float8::splat(tri.dz2);
+
+                for (int by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++)
+                {
+                    for (int bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++)
+                    {
+                        float & blockFarthest = blocks[by * (TILE_SIZE / BLOCK_SIZE) + bx];
+
+                        // Every pixel in the block is already nearer than anything this triangle has
+                        if (tri.zMin >= blockFarthest)
+                            continue;
+
+                        int blockEdge[3];
+                        bool outside = false;
+                        for (int e = 0; e < 3; e++)
+                        {
+                            blockEdge[e] = edge[e] + stepX[e] * bx * BLOCK_SIZE + stepY[e] * by * BLOCK_SIZE;
+
+                            int largest = blockEdge[e] + std::max(0, stepX[e] * (BLOCK_SIZE - 1)) + std::max(0, stepY[e] * (BLOCK_SIZE - 1));
+                            if (largest < 0)
+                                outside = true;
+                        }
+                        if (outside)
+                            continue;
+
+                        int px = tileX + bx * BLOCK_SIZE;
+                        bool wrote = false;
+
+                        for (int row = 0; row < BLOCK_SIZE; row++)
+                        {
+                            Int8 e0 = Int8::splat(blockEdge[0] + stepY[0] * row) + ramp[0];
+                            Int8 e1 = Int8::splat(blockEdge[1] + stepY[1] * row) + ramp[1];
+                            Int8 e2 = Int8::splat(blockEdge[2] + stepY[2] * row) + ramp[2];
+
+                            int covered = ~(e0 | e1 | e2).signMask() & 0xFF;
+                            if (!covered)
+                                continue;
+
+                            Float8 b1 = Float8::convert(e1) * invArea;
+                            Float8 b2 = Float8::convert(e2) * invArea;
+                            Float8 z = z0 + b1 * dz1 + b2 * dz2;
+
+                            int py = tileY + by * BLOCK_SIZE + row;
+                            float * depthRow = &depth[(size_t)py * stride + px];
+                            int pass = covered & Float8::lessMask(z, Float8::load(depthRow));
+                            if (!pass)
+                                continue;
+
+                            float zs[8], b1s[8], b2s[8];
+                            z.store(zs);
+                            b1.store(b1s);
+                            b2.store(b2s);
+
+                            uint32_t * colorRow = &color[(size_t)py * stride + px];
+                            for (int lane = 0; lane < 8; lane++)
+                            {
+                                if (!(pass & (1 << lane)))
+                                    continue;
+
+                                depthRow[lane] = zs[lane];
+                                colorRow[lane] = shade(tri, b1s[lane], b2s[lane]);
+                            }
+
+                            wrote = true;
+                        }
+
+                        if (wrote)
+                            blockFarthest = blockDepth(px, tileY + by * BLOCK_SIZE);
+                    }
+                }
+            }
+
+            float blockDepth(int x, int y) const
+            {
+                const float * row = &depth[(size_t)y * stride + x];
+
+                Learus_SIMD::Float8 result = Learus_SIMD::Float8::load(row);
+                for (int i = 1; i < BLOCK_SIZE; i++)
+                    result = Learus_SIMD::Float8::max(result, Learus_SIMD::Float8::load(row + (size_t)i * stride));
+
+                return Learus_SIMD::horizontalMax(result);
+            }
+
+            // planet.fs or sun.fs for one pixel. b1 and b2 are the barycentric weights of vertices 1 and 2.
+            uint32_t shade(const Triangle & tri, float b1, float b2) const
+            {
+                float q = tri.q0 + b1 * tri.dq1 + b2 * tri.dq2;
+                float w = 1.0f / q;
+
+                float a[ATTRIBUTES];
+                for (int k = 0; k < ATTRIBUTES; k++)
+                    a[k] = (tri.a0[k] + b1 * tri.da1[k] + b2 * tri.da2[k]) * w;
+
+                // Screen space derivatives of the texture coordinates, for picking mip levels
+                float scale = SUBPIXEL * tri.invArea;
+                float b1dx = tri.A[1] * scale, b1dy = tri.B[1] * scale;
+                float b2dx = tri.A[2] * scale, b2dy = tri.B[2] * scale;
+                float qdx = b1dx * tri.dq1 + b2dx * tri.dq2;
+                float qdy = b1dy * tri.dq1 + b2dy * tri.dq2;
+
+                float dudx = (b1dx * tri.da1[6] + b2dx * tri.da2[6] - a[6] * qdx) * w;
+                float dvdx = (b1dx * tri.da1[7] + b2dx * tri.da2[7] - a[7] * qdx) * w;
+                float dudy = (b1dy * tri.da1[6] + b2dy * tri.da2[6] - a[6] * qdy) * w;
+                float dvdy = (b1dy * tri.da1[7] + b2dy * tri.da2[7] - a[7] * qdy) * w;
+
+                const Material & material = *tri.material;
+
+                if (!material.lit)
+                {
+                    if (!material.diffuse)
+                        return pack(glm::vec4(1.0f));
+
+                    return pack(material.diffuse->sample(a[6], a[7], dudx, dvdx, dudy, dvdy));
+                }
+
+                glm::vec3 fragPos(a[0], a[1], a[2]);
+                glm::vec3 normal = glm::normalize(glm::vec3(a[3], a[4], a[5]));
+                glm::vec3 viewDir = glm::normalize(viewPos - fragPos);
+                glm::vec3 lightDir = glm::normalize(light.position - fragPos);
+
+                float diff = std::max(glm::dot(normal, lightDir), 0.0f);
+                glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+                float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), material.shininess);
+
+                glm::vec3 albedo(1.0f);
+                if (material.diffuse)
+                    albedo = glm::vec3(material.diffuse->sample(a[6], a[7], dudx, dvdx, dudy, dvdy));
+
+                glm::vec3 specularColor = albedo;
+                if (material.specular)
+                    specularColor = glm::vec3(material.specular->sample(a[6], a[7], dudx, dvdx, dudy, dvdy));
+
+                glm::vec3 result = light.ambient * albedo + light.diffuse * diff * albedo + light.specular * spec * specularColor;
+
+                if (material.emission)
+                    result += glm::vec3(material.emission->sample(a[6], a[7], dudx, dvdx, dudy, dvdy));
+
+                return pack(glm::vec4(result, 1.0f));
+            }
+
+            // One pixel per step along the major axis, sampled at pixel centers, depth tested and written
+            void drawLine(const Line & line, int tileX, int tileY)
+            {
+                float dx = line.x1 - line.x0, dy = line.y1 - line.y0;
+                bool xMajor = std::fabs(dx) >= std::fabs(dy);
+
+                float start = xMajor ? line.x0 : line.y0;
+                float delta = xMajor ? dx : dy;
+                if (delta == 0.0f)
+                    return;
+
+                int tileStart = xMajor ? tileX : tileY;
+                int limit = (xMajor ? frameWidth : frameHeight) - 1;
+
+                // Pixel centers in [start, end), so the shared end point of two segments is only drawn once
+                float first = std::max((float)tileStart, std::ceil(std::min(start, start + delta) - 0.5f));
+                float last = std::min((float)std::min(tileStart + TILE_SIZE - 1, limit), std::ceil(std::max(start, start + delta) - 0.5f) - 1.0f);
+
+                for (int i = (int)first; i <= (int)last; i++)
+                {
+                    float t = (i + 0.5f - start) / delta;
+                    float other = std::floor(xMajor ? line.y0 + t * dy : line.x0 + t * dx);
+
+                    int x = xMajor ? i : (int)other;
+                    int y = xMajor ? (int)other : i;
+                    if (x < tileX || x >= tileX + TILE_SIZE || y < tileY || y >= tileY + TILE_SIZE || x >= frameWidth || y >= frameHeight)
+                        continue;
+
+                    float z = line.z0 + t * (line.z1 - line.z0);
+                    size_t index = (size_t)y * stride + x;
+                    if (z < depth[index])
+                    {
+                        depth[index] = z;
+                        color[index] = line.color;
+                    }
+                }
+            }
+
+            Renderer(const Renderer &);
+            Renderer & operator=(const Renderer &);
+    };
+}
+
+#endif
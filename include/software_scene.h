@@ -0,0 +1,497 @@
+#ifndef SOFTWARE_SCENE_H
+#define SOFTWARE_SCENE_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+
+#include "scene.h"
+#include "gl_state.h"
+#include "resource_registry.h"
+
+#include <stdint.h>
+#include <cmath>
+#include <map>
+#include <vector>
+
+// What the CPU renderers (software_renderer.h, path_tracer.h) need from the scene, copied back from GL once:
+// mesh geometry with its materials and textures, the orbit circles and the skybox. Plus the small bits of GL
+// both of them use to show their image.
+namespace Learus_Software
+{
+    inline uint32_t pack(const glm::vec4 & color)
+    {
+        glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+    }
+
+    inline glm::vec4 unpack(uint32_t texel)
+    {
+        return glm::vec4(texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF, texel >> 24) * (1.0f / 255.0f);
+    }
+
+    // One RGBA8 image, e.g. a mip level or a cubemap face
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint32_t> texels;
+
+        // Copies a level of the texture bound to target's binding point back from the driver
+        bool read(GLenum target, int level)
+        {
+            GLint w = 0, h = 0;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &w);
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &h);
+            if (w <= 0 || h <= 0)
+                return false;
+
+            width = w;
+            height = h;
+            texels.resize((size_t)w * h);
+            glGetTexImage(target, level, GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+            return true;
+        }
+
+        uint32_t at(int x, int y) const
+        {
+            return texels[(size_t)y * width + x];
+        }
+    };
+
+    // A texture with its mip chain, sampled like GL_LINEAR_MIPMAP_LINEAR with GL_REPEAT
+    class Texture
+    {
+        public:
+            std::vector<Image> levels;
+
+            void read(GLuint id)
+            {
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, id);
+
+                for (int level = 0; level < 32; level++)
+                {
+                    levels.push_back(Image());
+                    if (!levels.back().read(GL_TEXTURE_2D, level))
+                    {
+                        levels.pop_back();
+                        break;
+                    }
+
+                    if (levels.back().width == 1 && levels.back().height == 1)
+                        break;
+                }
+            }
+
+            // The derivatives of u and v across a pixel pick the mip level, as in GLSL texture()
+            glm::vec4 sample(float u, float v, float dudx, float dvdx, float dudy, float dvdy) const
+            {
+                // Incomplete textures read as black in GL too
+                if (levels.empty())
+                    return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+                float w = (float)levels[0].width, h = (float)levels[0].height;
+                float rhoX = dudx * dudx * w * w + dvdx * dvdx * h * h;
+                float rhoY = dudy * dudy * w * w + dvdy * dvdy * h * h;
+                float lod = 0.5f * std::log2(std::max(rhoX, rhoY));
+
+                u -= std::floor(u);
+                v -= std::floor(v);
+
+                if (!(lod > 0.0f) || levels.size() == 1)
+                    return bilinear(levels[0], u, v);
+
+                float last = (float)(levels.size() - 1);
+                if (lod >= last)
+                    return bilinear(levels.back(), u, v);
+
+                int level = (int)lod;
+                return glm::mix(bilinear(levels[level], u, v), bilinear(levels[level + 1], u, v), lod - level);
+            }
+
+        private:
+            // u, v in [0, 1)
+            static glm::vec4 bilinear(const Image & image, float u, float v)
+            {
+                float x = u * image.width - 0.5f;
+                float y = v * image.height - 0.5f;
+                float fx = std::floor(x), fy = std::floor(y);
+
+                int x0 = (int)fx, y0 = (int)fy;
+                int x1 = x0 + 1, y1 = y0 + 1;
+                if (x0 < 0) x0 += image.width;
+                if (y0 < 0) y0 += image.height;
+                if (x1 >= image.width) x1 -= image.width;
+                if (y1 >= image.height) y1 -= image.height;
+
+                glm::vec4 bottom = glm::mix(unpack(image.at(x0, y0)), unpack(image.at(x1, y0)), x - fx);
+                glm::vec4 top = glm::mix(unpack(image.at(x0, y1)), unpack(image.at(x1, y1)), x - fx);
+                return glm::mix(bottom, top, y - fy);
+            }
+    };
+
+    // Six faces sampled like GL_LINEAR with GL_CLAMP_TO_EDGE
+    class Cubemap
+    {
+        public:
+            Image faces[6];     // In GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+
+            void read(GLuint id)
+            {
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_CUBE_MAP, id);
+
+                for (int i = 0; i < 6; i++)
+                    faces[i].read(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0);
+            }
+
+            // Face selection and s / t as in the GL spec's cube map table
+            glm::vec4 sample(const glm::vec3 & d) const
+            {
+                float ax = std::fabs(d.x), ay = std::fabs(d.y), az = std::fabs(d.z);
+                int face;
+                float sc, tc, ma;
+
+                if (ax >= ay && ax >= az)
+                {
+                    face = d.x > 0.0f ? 0 : 1;
+                    sc = d.x > 0.0f ? -d.z : d.z;
+                    tc = -d.y;
+                    ma = ax;
+                }
+                else if (ay >= az)
+                {
+                    face = d.y > 0.0f ? 2 : 3;
+                    sc = d.x;
+                    tc = d.y > 0.0f ? d.z : -d.z;
+                    ma = ay;
+                }
+                else
+                {
+                    face = d.z > 0.0f ? 4 : 5;
+                    sc = d.z > 0.0f ? d.x : -d.x;
+                    tc = -d.y;
+                    ma = az;
+                }
+
+                const Image & image = faces[face];
+                if (image.texels.empty() || ma == 0.0f)
+                    return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+                float x = 0.5f * (sc / ma + 1.0f) * image.width - 0.5f;
+                float y = 0.5f * (tc / ma + 1.0f) * image.height - 0.5f;
+                float fx = std::floor(x), fy = std::floor(y);
+
+                int x0 = clampIndex((int)fx, image.width), x1 = clampIndex((int)fx + 1, image.width);
+                int y0 = clampIndex((int)fy, image.height), y1 = clampIndex((int)fy + 1, image.height);
+
+                glm::vec4 bottom = glm::mix(unpack(image.at(x0, y0)), unpack(image.at(x1, y0)), x - fx);
+                glm::vec4 top = glm::mix(unpack(image.at(x0, y1)), unpack(image.at(x1, y1)), x - fx);
+                return glm::mix(bottom, top, y - fy);
+            }
+
+        private:
+            static int clampIndex(int i, int size)
+            {
+                return i < 0 ? 0 : (i >= size ? size - 1 : i);
+            }
+    };
+
+    // What planet.fs / sun.fs read from their material. NULL means the variant without that map.
+    struct Material
+    {
+        const Texture * diffuse;
+        const Texture * specular;
+        const Texture * emission;
+        float shininess;
+        bool lit;           // planet.fs, otherwise sun.fs
+    };
+
+
+    // One mesh of a model
+    struct Draw
+    {
+        const glm::mat4 * model;    // Owned by the scene, updated by Scene::animate
+        glm::mat3 normalMatrix;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        Material material;
+    };
+
+    struct Orbit
+    {
+        const Learus_Circle::Circle * circle;
+        std::vector<glm::vec3> points;
+        uint32_t color;
+    };
+
+    class SceneCopy
+    {
+        public:
+            Learus_Scene::Scene & scene;
+            std::vector<Draw> draws;
+            std::vector<Orbit> orbits;
+            Cubemap sky;
+
+            // Needs a current context
+            SceneCopy(Learus_Scene::Scene & _scene)
+            : scene(_scene)
+            {
+                importModel(scene.Sun, scene.sunModel, false);
+                importModel(scene.Earth, scene.earthModel, true);
+                importModel(scene.Moon, scene.moonModel, true);
+
+                importCircle(scene.EarthOrbitCircle);
+                importCircle(scene.MoonOrbitCircle);
+
+                sky.read(scene.skyBox.textureID);
+
+                // Everything here is a CPU copy of what the GL scene already holds
+                for (unsigned int i = 0; i < draws.size(); i++)
+                    bytes[Learus_Resources::SUB_GEOMETRY] += draws[i].vertices.capacity() * sizeof(Vertex) + draws[i].indices.capacity() * sizeof(unsigned int);
+                for (unsigned int i = 0; i < orbits.size(); i++)
+                    bytes[Learus_Resources::SUB_ORBITS] += orbits[i].points.capacity() * sizeof(glm::vec3);
+                for (std::map<GLuint, Texture>::const_iterator i = textures.begin(); i != textures.end(); ++i)
+                {
+                    for (unsigned int level = 0; level < i->second.levels.size(); level++)
+                        bytes[Learus_Resources::SUB_TEXTURES] += i->second.levels[level].texels.capacity() * sizeof(uint32_t);
+                }
+                for (int i = 0; i < 6; i++)
+                    bytes[Learus_Resources::SUB_SKYBOX] += sky.faces[i].texels.capacity() * sizeof(uint32_t);
+
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    if (bytes[i])
+                        Learus_Resources::registry().trackCpu((Learus_Resources::Subsystem)i, bytes[i]);
+                }
+            }
+
+            ~SceneCopy()
+            {
+                for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+                {
+                    if (bytes[i])
+                        Learus_Resources::registry().releaseCpu((Learus_Resources::Subsystem)i, bytes[i]);
+                }
+            }
+
+            // Moves the scene to simTime and updates the normal matrices
+            void animate(float simTime)
+            {
+                scene.animate(simTime);
+
+                for (unsigned int i = 0; i < draws.size(); i++)
+                    draws[i].normalMatrix = glm::transpose(glm::inverse(glm::mat3(*draws[i].model)));
+            }
+
+            size_t vertexCount() const
+            {
+                size_t count = 0;
+                for (unsigned int i = 0; i < draws.size(); i++)
+                    count += draws[i].vertices.size();
+
+                return count;
+            }
+
+            size_t triangleCount() const
+            {
+                size_t count = 0;
+                for (unsigned int i = 0; i < draws.size(); i++)
+                    count += draws[i].indices.size() / 3;
+
+                return count;
+            }
+
+        private:
+            std::map<GLuint, Texture> textures;     // By GL name, so shared textures are copied once
+            size_t bytes[Learus_Resources::SUB_COUNT] = {};     // Tracked with the registry, by subsystem
+
+            const Texture * textureFor(const Mesh & mesh, const char * type)
+            {
+                for (unsigned int i = 0; i < mesh.textures.size(); i++)
+                {
+                    if (mesh.textures[i].type == type)
+                    {
+                        std::map<GLuint, Texture>::iterator found = textures.find(mesh.textures[i].id);
+                        if (found == textures.end())
+                        {
+                            found = textures.insert(std::make_pair(mesh.textures[i].id, Texture())).first;
+                            found->second.read(mesh.textures[i].id);
+                        }
+
+                        return &found->second;
+                    }
+                }
+
+                return NULL;
+            }
+
+            void importModel(const Model & model, const glm::mat4 & matrix, bool lit)
+            {
+                const std::vector<Mesh> & meshes = model.getMeshes();
+
+                for (unsigned int i = 0; i < meshes.size(); i++)
+                {
+                    draws.push_back(Draw());
+                    Draw & draw = draws.back();
+
+                    draw.model = &matrix;
+                    scene.arena.read(meshes[i].allocation, draw.vertices, draw.indices);
+
+                    // Only the first map of each kind is sampled, like material.diffuse in the shaders
+                    draw.material.diffuse = textureFor(meshes[i], "texture_diffuse");
+                    draw.material.specular = textureFor(meshes[i], "texture_specular");
+                    draw.material.emission = textureFor(meshes[i], "texture_emission");
+                    draw.material.shininess = model.shininess;
+                    draw.material.lit = lit;
+                }
+            }
+
+            void importCircle(const Learus_Circle::Circle & circle)
+            {
+                std::vector<Learus_Circle::Circle::Vertex> vertices(circle.vertexCount);
+                if (vertices.empty())
+                    return;
+
+                glBindBuffer(GL_COPY_READ_BUFFER, circle.vertexBuffer());
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertices.size() * sizeof(vertices[0]), &vertices[0]);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+                orbits.push_back(Orbit());
+                Orbit & orbit = orbits.back();
+                orbit.circle = &circle;
+                orbit.color = pack(glm::vec4(vertices[0].Color, 1.0f));
+
+                for (unsigned int i = 0; i < vertices.size(); i++)
+                    orbit.points.push_back(vertices[i].Position);
+            }
+
+            SceneCopy(const SceneCopy &);
+            SceneCopy & operator=(const SceneCopy &);
+    };
+
+    // World space view direction through any point of the screen, in pixels with (0, 0) the bottom left corner
+    // of the bottom left pixel. Not normalized. The skybox samples along these, and they are the path tracer's camera rays.
+    struct ViewRays
+    {
+        glm::vec3 origin, stepX, stepY;
+
+        void setup(const glm::mat4 & projection, const glm::mat4 & view, int width, int height)
+        {
+            glm::mat4 inverseProjection = glm::inverse(projection);
+            glm::mat3 rotation = glm::transpose(glm::mat3(view));
+
+            glm::vec4 center = inverseProjection * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            glm::vec4 right = inverseProjection * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+            glm::vec4 up = inverseProjection * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f);
+
+            glm::vec3 base = rotation * (glm::vec3(center) / center.w);
+            glm::vec3 perX = rotation * (glm::vec3(right) / right.w) - base;     // Per unit of NDC
+            glm::vec3 perY = rotation * (glm::vec3(up) / up.w) - base;
+
+            stepX = perX * (2.0f / width);
+            stepY = perY * (2.0f / height);
+            origin = base - perX - perY;
+        }
+
+        glm::vec3 at(float x, float y) const
+        {
+            return origin + x * stepX + y * stepY;
+        }
+    };
+
+    // A renderer that draws on the CPU and only uses GL to show the result
+    class Backend
+    {
+        public:
+            virtual ~Backend() {}
+
+            // Draws the scene at simTime into the renderer's own image
+            virtual void render(Camera & camera, float simTime, int width, int height) = 0;
+
+            // Copies that image into the bound draw framebuffer
+            virtual void present() = 0;
+
+            // False while drawing the same view again would still change the image
+            virtual bool converged() const
+            {
+                return true;
+            }
+
+            virtual void printStats() const = 0;
+    };
+
+    // Puts a CPU image on screen: uploads it into a texture and blits that into the bound draw framebuffer
+    class Presenter
+    {
+        public:
+            Presenter(const char * label)
+            : texture(0), framebuffer(0), width(0), height(0)
+            {
+                glGenTextures(1, &texture);
+                glGenFramebuffers(1, &framebuffer);
+
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.track(Learus_Resources::KIND_TEXTURE, texture, Learus_Resources::SUB_RENDER_TARGETS, 0, label);
+                resources.track(Learus_Resources::KIND_FRAMEBUFFER, framebuffer, Learus_Resources::SUB_RENDER_TARGETS, 0, label);
+            }
+
+            ~Presenter()
+            {
+                Learus_Resources::Registry & resources = Learus_Resources::registry();
+                resources.release(Learus_Resources::KIND_TEXTURE, texture);
+                resources.release(Learus_Resources::KIND_FRAMEBUFFER, framebuffer);
+
+                Learus_GLState::current().forgetTexture(texture);
+                glDeleteTextures(1, &texture);
+                glDeleteFramebuffers(1, &framebuffer);
+            }
+
+            void resize(int _width, int _height)
+            {
+                if (_width == width && _height == height)
+                    return;
+
+                width = _width;
+                height = _height;
+
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+                Learus_Resources::registry().resize(Learus_Resources::KIND_TEXTURE, texture, (size_t)width * height * 4);
+            }
+
+            // RGBA8 pixels, bottom row first, rows stride pixels apart
+            void present(const uint32_t * pixels, int stride)
+            {
+                if (width == 0 || height == 0)
+                    return;
+
+                Learus_GLState::current().bindTexture(0, GL_TEXTURE_2D, texture);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+                GLint readFramebuffer = 0;
+                glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+            }
+
+        private:
+            GLuint texture;
+            GLuint framebuffer;
+            int width, height;
+
+            Presenter(const Presenter &);
+            Presenter & operator=(const Presenter &);
+    };
+}
+
+#endif
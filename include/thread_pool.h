@@ -0,0 +1,159 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "profiler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Learus_Threads
+{
+    // A fixed set of worker threads for data parallel loops. run() hands indices out of a shared counter to every
+    // worker and to the calling thread, and returns once all of them are done. Nothing is allocated per call.
+    class ThreadPool
+    {
+        public:
+            typedef void (*Job)(void * context, unsigned int index, unsigned int thread);
+
+            // 0 means one thread per hardware thread. The calling thread counts as one of them.
+            explicit ThreadPool(unsigned int threads = 0)
+            : job(NULL), context(NULL), count(0), generation(0), busy(0), stopping(false), next(0)
+            {
+                if (threads == 0)
+                    threads = std::thread::hardware_concurrency();
+                if (threads == 0)
+                    threads = 1;
+
+                for (unsigned int i = 1; i < threads; i++)
+                    workers.push_back(std::thread(&ThreadPool::work, this, i));
+            }
+
+            ~ThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_all();
+
+                for (unsigned int i = 0; i < workers.size(); i++)
+                    workers[i].join();
+            }
+
+            unsigned int size() const
+            {
+                return workers.size() + 1;
+            }
+
+            // Calls job(context, index, thread) for every index below _count. thread is 0 for the caller, 1.. for workers.
+            void run(unsigned int _count, Job _job, void * _context)
+            {
+                if (_count == 0)
+                    return;
+
+                if (workers.empty() || _count == 1)
+                {
+                    for (unsigned int i = 0; i < _count; i++)
+                        _job(_context, i, 0);
+                    return;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    job = _job;
+                    context = _context;
+                    count = _count;
+                    next.store(0);
+                    busy = workers.size();
+                    generation++;
+                }
+                wake.notify_all();
+
+                execute(0);
+
+                std::unique_lock<std::mutex> lock(mutex);
+                while (busy > 0)
+                    done.wait(lock);
+            }
+
+            // function(index, thread) for every index below count
+            template <typename F>
+            void parallelFor(unsigned int count, const F & function)
+            {
+                run(count, &call<F>, (void *)&function);
+            }
+
+        private:
+            std::vector<std::thread> workers;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::condition_variable done;
+
+            // The current run, written under the mutex before generation changes
+            Job job;
+            void * context;
+            unsigned int count;
+            unsigned long generation;
+            unsigned int busy;      // Workers still inside the current run
+            bool stopping;
+
+            std::atomic<unsigned int> next;
+
+            template <typename F>
+            static void call(void * function, unsigned int index, unsigned int thread)
+            {
+                (*(const F *)function)(index, thread);
+            }
+
+            void execute(unsigned int thread)
+            {
+                for (;;)
+                {
+                    unsigned int index = next.fetch_add(1);
+                    if (index >= count)
+                        return;
+
+                    job(context, index, thread);
+                }
+            }
+
+            void work(unsigned int thread)
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name), "Worker %u", thread);
+                PROFILE_THREAD_NAME(name);
+                (void)name;
+
+                unsigned long seen = 0;
+
+                for (;;)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while (!stopping && generation == seen)
+                            wake.wait(lock);
+
+                        if (stopping)
+                            return;
+
+                        seen = generation;
+                    }
+
+                    execute(thread);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (--busy == 0)
+                        done.notify_one();
+                }
+            }
+
+            ThreadPool(const ThreadPool &);
+            ThreadPool & operator=(const ThreadPool &);
+    };
+}
+
+#endif
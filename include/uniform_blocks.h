@@ -0,0 +1,97 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include "../lib/glad/glad.h"
+#include "../lib/glm/glm.hpp"
+
+#include "resource_registry.h"
+
+#include <cstring>
+
+// Data shared by every program lives in std140 uniform blocks, uploaded once per frame.
+// The structs below mirror the GLSL blocks byte for byte, so keep them in sync with the shaders.
+namespace Learus_Uniforms
+{
+    enum Binding
+    {
+        CAMERA_BINDING = 0,
+        LIGHT_BINDING = 1
+    };
+
+    // layout (std140) uniform Camera { mat4 projection; mat4 view; vec3 viewPos; float mipBias; };
+    struct CameraBlock
+    {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 viewPos;
+        float mipBias;
+    };
+
+    // layout (std140) uniform Light { vec3 position; float constant; vec3 ambient; float linear;
+    //                                 vec3 diffuse; float quadratic; vec3 specular; } light;
+    struct LightBlock
+    {
+        glm::vec3 position;
+        float constant;
+        glm::vec3 ambient;
+        float linear;
+        glm::vec3 diffuse;
+        float quadratic;
+        glm::vec3 specular;
+        float _pad0;
+    };
+
+    static_assert(sizeof(CameraBlock) == 144, "CameraBlock does not match the std140 layout");
+    static_assert(sizeof(LightBlock) == 64, "LightBlock does not match the std140 layout");
+
+    // Binding point for a block name, or -1 if the block is not one of ours. Used by Shader when it links.
+    inline int bindingPoint(const char * blockName)
+    {
+        if (std::strcmp(blockName, "Camera") == 0)
+            return CAMERA_BINDING;
+        if (std::strcmp(blockName, "Light") == 0)
+            return LIGHT_BINDING;
+
+        return -1;
+    }
+
+    template <typename T>
+    class UniformBuffer
+    {
+        public:
+            UniformBuffer(Binding _binding)
+            : binding(_binding)
+            {
+                glGenBuffers(1, &UBO);
+                glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+                glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+                glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+
+                Learus_Resources::registry().track(Learus_Resources::KIND_BUFFER, UBO, Learus_Resources::SUB_UNIFORMS, sizeof(T), "uniform block");
+            }
+
+            ~UniformBuffer()
+            {
+                Learus_Resources::registry().release(Learus_Resources::KIND_BUFFER, UBO);
+                glDeleteBuffers(1, &UBO);
+            }
+
+            void update(const T & data)
+            {
+                glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+
+        private:
+            unsigned int UBO;
+            Binding binding;
+
+            UniformBuffer(const UniformBuffer &);
+            UniformBuffer & operator=(const UniformBuffer &);
+    };
+}
+
+#endif
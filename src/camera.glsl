@@ -0,0 +1,8 @@
+// Shared by every program, see CameraBlock in uniform_blocks.h
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float mipBias;      // Added to every texture lookup by the quality level
+};
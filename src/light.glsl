@@ -0,0 +1,14 @@
+// Scalars fill the padding after each vec3, see LightBlock in uniform_blocks.h
+layout (std140) uniform Light
+{
+    vec3 position;
+    float constant;
+
+    vec3 ambient;
+    float linear;
+
+    vec3 diffuse;
+    float quadratic;
+
+    vec3 specular;
+} light;
@@ -5,53 +5,198 @@
 #include "../lib/glm/gtc/matrix_transform.hpp"
 #include "../lib/glm/gtc/type_ptr.hpp"
 
-#include "../include/shader.h"
+#include "../include/gl_extensions.h"
 #include "../include/camera.h"
-#include "../include/skybox.h"
-#include "../include/model.h"
-#include "../include/circle.h"
+#include "../include/scene.h"
+#include "../include/headless.h"
+#include "../include/image_writer.h"
+#include "../include/camera_path.h"
+#include "../include/benchmark.h"
+#include "../include/profiler.h"
+#include "../include/resource_registry.h"
+#include "../include/software_renderer.h"
+#include "../include/path_tracer.h"
+#include "../include/frame_export.h"
+#include "../include/simulation.h"
+#include "../include/gl_trace.h"
+#include "../include/frame_pacer.h"
+#include "../include/quality.h"
+#include "../include/hud.h"
+#include "../include/metrics.h"
+#include "../include/control.h"
 
+#define ALLOC_TRACKER_IMPLEMENTATION
+#include "../include/alloc_tracker.h"
 
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Scene = Learus_Scene::Scene;
+
+// The window's simulation thread, input goes to it
+Learus_Simulation::Simulation * simulation = NULL;
 
-using Skybox = Learus_Skybox::Skybox;
-using Circle = Learus_Circle::Circle;
+// The performance overlay, always there in a window (H shows it), only with --hud headless
+Learus_Hud::Hud * hud = NULL;
 
-// Globals
-bool animation = false;
+// Prometheus endpoint, with --metrics-port
+Learus_Metrics::Metrics * metrics = NULL;
 
-// Timing
-float lastFrame = 0.0f;
-float frameToggled = 0.0f;
-float timeSinceLastToggle = 1.0f;
+// Command channel for scripts driving the window, with --control
+Learus_Control::Server * control = NULL;
 
 // Some settings
 const unsigned int SCR_WIDTH = 1080;
 const unsigned int SCR_HEIGHT = 720;
+int viewportWidth = SCR_WIDTH;
+int viewportHeight = SCR_HEIGHT;
 
-float earthOrbitRadius = 100.0f;
-float moonOrbitRadius = 20.0f;
-glm::vec3 sunPos = glm::vec3(0.0f, -1.0f, 0.0f);
-glm::vec3 earthPos = sunPos + glm::vec3(sin(frameToggled) * earthOrbitRadius, 0.0f, cos(frameToggled) * earthOrbitRadius);
+// Frames after this one should not touch the heap anymore
+const unsigned int STEADY_STATE_FRAME = 8;
+
+// With nothing changing the window waits for events, checking back at least this often (seconds)
+const double IDLE_TIMEOUT = 0.5;
+
+// Set when the window has to be drawn again even though the scene did not change (resized, uncovered)
+bool windowDamaged = true;
 
 // Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 30.0f));
 float cameraOrbitRadius = 30.0f;
-float rotateAngle = 1.0f;
+float orbitSpeed = 60.0f;   // Degrees per second
+
+// Keyboard Input
+unsigned int heldKeys = 0;
+bool enterHeld = false;
+bool hudKeyHeld = false;
 
 // Mouse Input
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// Command line
+struct Options
+{
+    bool headless = false;
+    unsigned int frames = 1;
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    std::string output = "frame.png";   // A printf pattern such as frame_%04d.png writes every frame
+    std::string benchmark;              // Camera path to play instead of taking input
+    std::string results = "benchmark.json";
+    std::string trace;                  // Chrome trace output, needs a PROFILE=1 build
+    bool assertNoAlloc = false;         // Fail if a steady state frame allocates
+    std::vector<std::pair<int, size_t> > budgets;  // Learus_Resources::Subsystem, bytes
+    std::string renderer = "gl";        // gl, software or pathtracer
+    unsigned int threads = 0;           // CPU renderer threads, 0 for one per core
+    unsigned int samples = 64;          // Path tracer samples per pixel
+    std::string exportPath;             // Every headless frame to a .y4m video or a numbered image pattern
+    float simRate = 120.0f;             // Simulation steps per second in a window
+    unsigned int recordThreads = 1;     // Threads recording draw commands, 0 for one per core
+    float fps = 0.0f;                   // Window frame rate limit, 0 leaves it to vsync
+    bool glCalls = false;               // Count GL calls per entry point
+    std::string glTrace;                // Every GL call to a binary trace
+    std::string glReplay;               // Play a GL trace back instead of rendering the scene
+    bool nullDriver = false;            // GL calls do nothing, no context needed
+    std::vector<std::pair<std::string, unsigned long> > callBudgets;   // Entry point, "draws" or "total", calls per frame
+    float dynamicRes = 0.0f;            // Scene GPU time to hold by scaling the resolution (ms), 0 renders at full size
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    Learus_DynamicRes::Filter upscale = Learus_DynamicRes::FILTER_SHARPEN;
+    int quality = -1;                   // Learus_Quality level, -1 for none (full detail)
+    bool adaptiveQuality = false;       // Step the level to hold qualityTarget
+    float qualityTarget = 16.7f;        // Frame time in milliseconds, raised to the frame period
+    bool hud = false;                   // Start with the performance overlay shown
+    unsigned short metricsPort = 0;     // Serve Prometheus metrics on 127.0.0.1:port, 0 for none
+    std::string controlPath;            // Unix socket taking commands for the window, empty for none
+};
+
+// What commands from --control left for the window's render loop to carry on with over the next frames
+struct Automation
+{
+    Learus_Benchmark::CameraPath * path = NULL;     // Played instead of the simulation's camera
+    Learus_Control::Command pathCommand;            // Answered when the path ends
+    std::chrono::steady_clock::time_point pathStart;
+    unsigned long pathFrames = 0;
+    bool pathEnded = false;                         // Its last camera is on the way to the simulation
+    bool capturing = false;                         // The next frame is written out for captureCommand
+    Learus_Control::Command captureCommand;
+
+    // The last frame drawn, for stats
+    unsigned long frames = 0;
+    float simTime = 0.0f;
+    float warp = 1.0f;
+    bool animating = false;
+    unsigned long step = 0;
+    double frameMs = 0.0;
+    Learus_Geometry::DrawStats draws;
+};
 
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
+void windowRefreshCallback(GLFWwindow * window);
 void mouseInput(GLFWwindow * window, double xpos, double ypos);
 void scrollInput(GLFWwindow * window, double xoffset, double yoffset);
-void keyboardInput(GLFWwindow * window, float deltaTime);
+void keyboardInput(GLFWwindow * window);
+bool parseOptions(int argc, char ** argv, Options & options);
+int runWindowed(const Options & options);
+int renderLoop(Scene & scene, Learus_Software::Backend * software, const Options & options, GLFWwindow * window);
+int runHeadless(const Options & options);
+int renderFrames(Scene & scene, Learus_Software::Backend * software, Learus_Export::FrameExporter * exporter, const Options & options, Learus_Headless::RenderTarget & target);
+int runBenchmark(Scene & scene, Learus_Software::Backend * software, Learus_Export::FrameExporter * exporter, const Options & options, GLFWwindow * window, Learus_Headless::RenderTarget * target);
+bool finishExport(Learus_Export::FrameExporter * exporter);
+bool startGLLayer(const Options & options);
+bool finishGLLayer(const Options & options);
+int replayGLTrace(const Options & options);
+Learus_Software::Backend * createRenderer(Scene & scene, const Options & options);
+Learus_DynamicRes::DynamicResolution * createScaler(Scene & scene, const Options & options);
+Learus_Quality::Governor * createGovernor(Scene & scene, const Options & options, double framePeriodMs);
+void drawHud(Scene & scene, const Learus_Simulation::Simulation * sim, int width, int height);
+Learus_Metrics::Metrics * startMetrics(Scene & scene, const Options & options, double framePeriodMs);
+bool startControl(Learus_Control::Server & server, Scene & scene);
+void controlInput(Scene & scene, Learus_Simulation::Simulation & sim, GLFWwindow * window, Automation & automation);
+float playPath(Learus_Simulation::Simulation & sim, Automation & automation);
+void captureWindow(Automation & automation, int width, int height);
+void drawFrame(Scene & scene, Learus_Software::Backend * software, float simTime, int width, int height);
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return -1;
+
+    Learus_Resources::Registry & resources = Learus_Resources::registry();
+    for (unsigned int i = 0; i < options.budgets.size(); i++)
+        resources.setBudget((Learus_Resources::Subsystem)options.budgets[i].first, options.budgets[i].second);
+
+    int result = options.headless ? runHeadless(options) : runWindowed(options);
+
+    if (!finishGLLayer(options) && result == 0)
+        result = 1;
+
+    // Everything that owns GL objects is gone by now, whatever is still registered leaked
+    resources.printReport();
+    unsigned int leaks = resources.printLeaks();
+    if (result == 0 && (leaks > 0 || resources.overBudget()))
+        result = 1;
 
-int main()
+#ifdef SOLAR_PROFILE
+    if (!options.trace.empty())
+        Learus_Profiler::get().writeChromeTrace(options.trace);
+#endif
+
+    return result;
+}
+
+int runWindowed(const Options & options)
 {
     // Initialize and configure GLFW
     glfwInit();
@@ -59,10 +204,10 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    GLFWwindow * window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Solar System", NULL, NULL);
+    GLFWwindow * window = glfwCreateWindow(options.width, options.height, "Solar System", NULL, NULL);
     if (window == NULL)
     {
-        std::cerr << "ERROR: Failed to create GLFW window" << std::endl;
+        std::cerr << "ERROR: Failed to create GLFW window (use --headless on machines without a display)" << std::endl;
         glfwTerminate();
         return -1;
     }
@@ -70,6 +215,7 @@ int main()
     glfwMakeContextCurrent(window);
 
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+    glfwSetWindowRefreshCallback(window, windowRefreshCallback);
     glfwSetScrollCallback(window, scrollInput);
 
     // Load glad
@@ -79,118 +225,1069 @@ int main()
         return -1;
     }
 
+    Learus_GLExt::load((GLADloadproc)glfwGetProcAddress);
+
+    if (!startGLLayer(options))
+        return -1;
+
+    glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+
     glEnable(GL_DEPTH_TEST);
 
-    Shader planetShader("./src/planet.vs", "./src/planet.fs");
-    Shader sunShader("./src/sun.vs", "./src/sun.fs");
+    int result;
+    {
+        Scene scene;
+        scene.renderQueue.setThreads(options.recordThreads);
+        if (!options.trace.empty())
+            scene.gpuProfiler.enable();
+
+        Learus_Software::Backend * software = createRenderer(scene, options);
+        // Frames are due at the --fps rate, or the monitor's
+        double framePeriodMs = 1000.0 / 60.0;
+        const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (options.fps > 0.0f)
+            framePeriodMs = 1000.0 / options.fps;
+        else if (mode && mode->refreshRate > 0)
+            framePeriodMs = 1000.0 / mode->refreshRate;
+
+        scene.resolution = createScaler(scene, options);
+        // A benchmark runs without vsync or a limiter
+        scene.quality = createGovernor(scene, options, options.benchmark.empty() ? framePeriodMs : 0.0);
+        hud = new Learus_Hud::Hud(scene.shaders, scene.gpuProfiler, options.hud);
 
-    // Load the models
-    Model Sun("./models/Planet/planet.obj");
-    Model Earth("./models/Earth/Globe.obj");
-    Model Moon("./models/Rock/rock.obj");
+        if (options.metricsPort)
+            metrics = startMetrics(scene, options, framePeriodMs);
 
-    Circle EarthOrbitCircle(sunPos, earthOrbitRadius, glm::vec3(0.0f, 1.0f, 1.0f), 3000);
-    Circle MoonOrbitCircle(earthPos, moonOrbitRadius, glm::vec3(1.0f, 1.0f, 0.0f), 3000);
-    Skybox skyBox("./images/top.png", "./images/bottom.png", "./images/left.png", "./images/right.png", "./images/front.png", "./images/back.png");
+        // Not on the heap, its queues are aligned to cache lines
+        Learus_Control::Server server(options.controlPath, glfwPostEmptyEvent);
+        if (!options.controlPath.empty() && startControl(server, scene))
+            control = &server;
 
+        if ((options.metricsPort && !metrics) || (!options.controlPath.empty() && !control))
+            result = -1;
+        else if (!options.benchmark.empty())
+        {
+            // Measure the frames, not the monitor's refresh rate
+            glfwSwapInterval(0);
+            result = runBenchmark(scene, software, NULL, options, window, NULL);
+        }
+        else
+        {
+            // The pacer sets the rate instead of the monitor
+            if (options.fps > 0.0f)
+                glfwSwapInterval(0);
+            result = renderLoop(scene, software, options, window);
+        }
+
+        control = NULL;
+        delete metrics;
+        metrics = NULL;
+        delete hud;
+        hud = NULL;
+        delete scene.quality;
+        delete scene.resolution;
+        delete software;
+    }
+
+    // The scene deletes its GL objects, so it has to be gone before the context is
+    glfwTerminate();
+    return result;
+}
+
+// Interactive rendering until the window is closed. Only draws when something changed: the simulation moved, the
+// window needs repainting, shaders are still compiling or a progressive renderer is still refining. Otherwise it
+// sleeps until the next event. Frames start on the pacer's schedule, and input is read after its wait so that it is
+// as fresh as possible. Commands from --control are taken along with the input.
+int renderLoop(Scene & scene, Learus_Software::Backend * software, const Options & options, GLFWwindow * window)
+{
+    Learus_Alloc::SteadyStateCheck heap;
+    Automation automation;
+    unsigned long frameCount = 0;
+    unsigned long drawnStep = (unsigned long)-1;
+    unsigned long idleWaits = 0;
+    double idleSeconds = 0.0;
+
+    // The simulation runs at its own rate, every frame draws whatever it finished last
+    Learus_Simulation::Simulation sim(camera, cameraOrbitRadius, orbitSpeed, options.simRate);
+    simulation = &sim;
+    sim.start();
+
+    Learus_Pacing::FramePacer pacer(options.fps);
+    Learus_Pacing::LatencyTracker latency(scene.gpuProfiler);
+    Learus_Pacing::LateLatch latch(sim);
+    scene.cameraLatch = &latch;
 
     // Render Loop
     while(!glfwWindowShouldClose(window))
     {
-        float currentFrame = glfwGetTime();
-        float deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        pacer.wait();
+        if (scene.quality)
+            scene.quality->waited(pacer.waitedMs());
+        {
+            PROFILE_SCOPE("Events");
+            glfwPollEvents();
+        }
+        keyboardInput(window);
+        if (control)
+            controlInput(scene, sim, window, automation);
 
-        timeSinceLastToggle += deltaTime;
-        if (animation)
-            frameToggled += deltaTime;
+        // The simulation has to be idle first, so that nothing it publishes afterwards is missed
+        bool damaged = !sim.idle() || sim.publishedStep() != drawnStep || windowDamaged || scene.shaders.busy() || (software && !software->converged()) ||
+                       automation.path || automation.capturing;
+        if (!damaged)
+        {
+            PROFILE_SCOPE("Idle");
 
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            glfwWaitEventsTimeout(IDLE_TIMEOUT);
+            idleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            idleWaits++;
+            pacer.resync();
+            if (scene.quality)
+                scene.quality->resync();
+            hud->resync();
+            if (metrics)
+                metrics->resync();
+            continue;
+        }
+
+        PROFILE_SCOPE("Frame");
+        heap.beginFrame();
+        windowDamaged = false;
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        Learus_Geometry::DrawStats draws = scene.arena.draws.stats;
+
+        // A path that ended stays on screen until the simulation has taken its last camera
+        if (automation.pathEnded && sim.caughtUp())
+        {
+            delete automation.path;
+            automation.path = NULL;
+            automation.pathEnded = false;
+        }
+
+        const Learus_Simulation::Snapshot & snapshot = latch.begin();
+        camera = snapshot.camera;
+        automation.simTime = snapshot.simTime;
+        automation.warp = snapshot.warp;
+        automation.animating = snapshot.animating;
+        automation.step = snapshot.step;
+
+        // The scene asks the latch for a newer camera once its draws are recorded, unless a path has the camera
+        if (automation.path)
+            automation.simTime = playPath(sim, automation);
+        scene.cameraLatch = automation.path ? NULL : &latch;
+
+        hud->beginFrame();
+        if (metrics)
+            metrics->beginFrame();
+        drawFrame(scene, software, automation.simTime, viewportWidth, viewportHeight);
+        drawHud(scene, &sim, viewportWidth, viewportHeight);
+        drawnStep = latch.step;
+
+        // The pixels are allocated for it, so a capture frame is not a steady one
+        bool captured = automation.capturing;
+        if (captured)
+            captureWindow(automation, viewportWidth, viewportHeight);
+
+        latch.times.submitted = Learus_Pacing::Clock::now();
+        {
+            PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(window);
+        }
+        // While a path has the camera, the frames do not show the simulation's input
+        if (latch.hasInput && !automation.path)
+            latency.submitted(latch.times);
+        if (metrics)
+            metrics->endFrame(scene.gpuProfiler, &sim);
+
+        automation.frames = frameCount + 1;
+        automation.frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        automation.draws.commands = scene.arena.draws.stats.commands - draws.commands;
+        automation.draws.drawCalls = scene.arena.draws.stats.drawCalls - draws.drawCalls;
+        automation.draws.triangles = scene.arena.draws.stats.triangles - draws.triangles;
+
+        bool steady = ++frameCount > STEADY_STATE_FRAME;
+        heap.endFrame(steady && !captured);
+        Learus_GLTrace::endFrame(steady);
+    }
+
+    // Answers what is still queued (a quit, say) and hangs up
+    if (control)
+        control->stop();
+    delete automation.path;
+    sim.stop();
+    simulation = NULL;
+    scene.cameraLatch = NULL;
+
+    std::cout << "Window: " << frameCount << " frames drawn, waited for events " << idleWaits << " times (" << idleSeconds << " s)" << std::endl;
+    scene.printStats();
+    sim.printStats();
+    pacer.printStats();
+    latency.printStats();
+    if (software)
+        software->printStats();
+    hud->printStats();
+    if (metrics)
+        metrics->printStats();
+    if (control)
+        control->printStats();
+    heap.print();
+
+    return (options.assertNoAlloc && !heap.clean()) ? 1 : 0;
+}
+
+// Renders into an offscreen framebuffer through a surfaceless EGL context. No window system needed.
+// With --null-driver there is no context at all, every GL call returns straight away.
+int runHeadless(const Options & options)
+{
+    Learus_Headless::Context context;
+    if (options.nullDriver)
+    {
+        Learus_GLTrace::installNullDriver();
+    }
+    else
+    {
+        if (!context.create())
+            return -1;
 
-        keyboardInput(window, deltaTime);
+        if (!gladLoadGLLoader((GLADloadproc)Learus_Headless::Context::getProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
 
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        Learus_GLExt::load((GLADloadproc)Learus_Headless::Context::getProcAddress);
+    }
 
+    if (!options.glReplay.empty())
+        return replayGLTrace(options);
 
-        // view / projection
-        glm::mat4 projection = glm::perspective(glm::radians(camera.zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
+    if (!startGLLayer(options))
+        return -1;
 
-        skyBox.setUniforms(projection, glm::mat4(glm::mat3(view)));
-        skyBox.Draw();
+    std::cout << "Headless: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
 
-        // Render the sun object
-        sunShader.use();
-        sunShader.setMat4("projection", projection);
-        sunShader.setMat4("view", view);
-        
-        model = glm::translate(model, sunPos); // Center it (kinda)
-        sunShader.setMat4("model", model);
-        Sun.Draw(sunShader);
+    Learus_Headless::RenderTarget target(options.width, options.height);
 
+    glEnable(GL_DEPTH_TEST);
 
-        planetShader.use();
+    Scene scene;
+    scene.resolution = createScaler(scene, options);
+    scene.quality = createGovernor(scene, options, 0.0);
+    if (options.hud)
+        hud = new Learus_Hud::Hud(scene.shaders, scene.gpuProfiler, true);
+    scene.shaders.finishAll();
+    scene.renderQueue.setThreads(options.recordThreads);
+    if (!options.trace.empty())
+        scene.gpuProfiler.enable();
 
-        // Set the lighting
-        planetShader.setVec3("viewPos", camera.Position);
-        planetShader.setFloat("material.shininess", 32.0f);
+    Learus_Software::Backend * software = createRenderer(scene, options);
 
-        planetShader.setVec3("light.position", sunPos);
-        planetShader.setVec3("light.ambient", 0.25f, 0.25f, 0.25f);
-        planetShader.setVec3("light.diffuse", 1.8f, 1.8f, 1.8f);
-        planetShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-        planetShader.setFloat("pointLights[0].constant", 1.0f);
-        planetShader.setFloat("pointLights[0].linear", 0.045);
-        planetShader.setFloat("pointLights[0].quadratic", 0.0075);
+    Learus_Export::FrameExporter * exporter = NULL;
+    if (!options.exportPath.empty())
+        exporter = new Learus_Export::FrameExporter(options.exportPath, target.width, target.height, options.threads);
 
+    // Headless frames are not paced, 60 Hz is what they stand for
+    if (options.metricsPort)
+        metrics = startMetrics(scene, options, 1000.0 / 60.0);
 
-        // Render the Earth object
-        planetShader.setMat4("projection", projection);
-        planetShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+    int result = 0;
+    if (options.metricsPort && !metrics)
+        result = -1;
+    else if (!options.benchmark.empty())
+        result = runBenchmark(scene, software, exporter, options, NULL, &target);
+    else
+        result = renderFrames(scene, software, exporter, options, target);
 
-        
-        // Orbit around the sun
-        earthPos = sunPos + glm::vec3(sin(frameToggled) * earthOrbitRadius, 0.0f, cos(frameToggled) * earthOrbitRadius);
-        model = glm::translate(model, earthPos);
-        // Rotate around itself
-        model = glm::rotate(model, frameToggled * 1.5f * glm::radians(-50.0f), glm::vec3(0.1f, 1.0f, 0.0f));
+    delete metrics;
+    metrics = NULL;
+    delete exporter;
+    delete hud;
+    hud = NULL;
+    delete scene.quality;
+    delete scene.resolution;
+    delete software;
+    return result;
+}
 
-        planetShader.setMat4("model", model);
-        Earth.Draw(planetShader);
+// The headless frames, written out as images
+int renderFrames(Scene & scene, Learus_Software::Backend * software, Learus_Export::FrameExporter * exporter, const Options & options, Learus_Headless::RenderTarget & target)
+{
+    // Fixed simulation step, so the same frame count always gives the same images
+    const float timeStep = 1.0f / 60.0f;
+    bool everyFrame = options.output.find('%') != std::string::npos;
+    std::vector<unsigned char> pixels;
 
-        // Draw a circle showing the earth's orbit around the sun
-        EarthOrbitCircle.setUniforms(projection, view);
-        EarthOrbitCircle.scale(glm::vec3(0.1f, 0.1f, 0.1f));
-        EarthOrbitCircle.rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        EarthOrbitCircle.Draw();
+    if (exporter && !exporter->open(60))
+        return -1;
 
+    Learus_Alloc::SteadyStateCheck heap;
 
-        // Render the Moon object
-        model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        // Orbit around the earth
-        glm::vec3 moonPos = earthPos + glm::vec3(0.0f, sin(frameToggled) * moonOrbitRadius , cos(frameToggled) * moonOrbitRadius);
-        model = glm::translate(model, moonPos);
-        planetShader.use();
-        planetShader.setMat4("model", model);
-        Moon.Draw(planetShader);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-        // Draw a circle showing the moon's orbit around the earth
-        MoonOrbitCircle.setUniforms(projection, view);
-        MoonOrbitCircle.scale(glm::vec3(0.1f, 0.1f, 0.1f));
-        MoonOrbitCircle.translate(earthPos);
-        MoonOrbitCircle.rotate(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        MoonOrbitCircle.Draw();
+    for (unsigned int frame = 0; frame < options.frames; frame++)
+    {
+        PROFILE_SCOPE("Frame");
+
+        // Writing images out allocates, only the rendering is checked
+        heap.beginFrame();
+        target.bind();
+        if (hud)
+            hud->beginFrame();
+        if (metrics)
+            metrics->beginFrame();
+        drawFrame(scene, software, frame * timeStep, target.width, target.height);
+        drawHud(scene, NULL, target.width, target.height);
+        if (metrics)
+            metrics->endFrame(scene.gpuProfiler, NULL);
+        heap.endFrame(frame >= STEADY_STATE_FRAME);
+        Learus_GLTrace::endFrame(frame >= STEADY_STATE_FRAME);
+
+        if (exporter)
+            exporter->capture(target.framebuffer());
+
+        // The null driver has nothing to read back
+        if (!options.nullDriver && (everyFrame || frame + 1 == options.frames))
+        {
+            std::string path = options.output;
+            if (everyFrame)
+            {
+                std::vector<char> name(options.output.size() + 32);
+                std::snprintf(&name[0], name.size(), options.output.c_str(), frame);
+                path = &name[0];
+            }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            target.readPixels(pixels);
+            if (!Learus_Image::write(path, target.width, target.height, &pixels[0]))
+                return -1;
+        }
     }
 
-    glfwTerminate();
-    return 0;
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Rendered " << options.frames << " frames at " << options.width << "x" << options.height
+              << " in " << seconds * 1000.0 << " ms (" << seconds * 1000.0 / options.frames << " ms per frame)" << std::endl;
+
+    scene.printStats();
+    if (software)
+        software->printStats();
+    if (hud)
+        hud->printStats();
+    if (metrics)
+        metrics->printStats();
+    heap.print();
+
+    if (!finishExport(exporter))
+        return -1;
+
+    return (options.assertNoAlloc && !heap.clean()) ? 1 : 0;
+}
+
+// Plays a camera path at its fixed step and records frame times. Renders to the window if there is one, to target otherwise.
+int runBenchmark(Scene & scene, Learus_Software::Backend * software, Learus_Export::FrameExporter * exporter, const Options & options, GLFWwindow * window, Learus_Headless::RenderTarget * target)
+{
+    Learus_Benchmark::CameraPath path;
+    if (!path.load(options.benchmark))
+        return -1;
+
+    if (exporter && !exporter->open((int)(1.0f / path.step + 0.5f)))
+        return -1;
+
+    // Compile stalls do not belong in the numbers
+    scene.shaders.finishAll();
+
+    Learus_Benchmark::Recorder recorder(scene.gpuProfiler);
+    const Learus_GLState::Stats & stateStats = Learus_GLState::current().stats;
+    unsigned int frames = path.frameCount();
+    Learus_Alloc::SteadyStateCheck heap;
+
+    // Warmup frames all render the first frame of the path
+    for (unsigned int i = 0; i < path.warmup + frames; i++)
+    {
+        PROFILE_SCOPE("Frame");
+
+        bool recording = i >= path.warmup;
+        scene.gpuProfiler.counting = recording;
+        heap.beginFrame();
+        unsigned int frame = recording ? i - path.warmup : 0;
+
+        float simTime = path.apply(frame * path.step, camera);
+
+        int width = target ? target->width : viewportWidth;
+        int height = target ? target->height : viewportHeight;
+        if (target)
+            target->bind();
+
+        Learus_Geometry::DrawStats drawsBefore = scene.arena.draws.stats;
+        unsigned long stateBefore = stateStats.issued();
+
+        if (recording)
+            recorder.beginFrame();
+
+        unsigned int levelBefore = scene.quality ? scene.quality->index() : 0;
+
+        if (hud)
+            hud->beginFrame();
+        if (metrics)
+            metrics->beginFrame();
+        drawFrame(scene, software, simTime, width, height);
+
+        if (recording && scene.quality && scene.quality->index() != levelBefore)
+            recorder.levelChanged(scene.quality->level().name, scene.quality->frameMs());
+
+        if (recording)
+        {
+            recorder.endSubmit();
+            recorder.drawCalls += scene.arena.draws.stats.drawCalls - drawsBefore.drawCalls;
+            recorder.meshes += scene.arena.draws.stats.commands - drawsBefore.commands;
+            recorder.triangles += scene.arena.draws.stats.triangles - drawsBefore.triangles;
+            recorder.stateChanges += stateStats.issued() - stateBefore;
+        }
+
+        // After the counts, it is not part of the scene
+        drawHud(scene, NULL, width, height);
+
+        if (window)
+        {
+            PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            if (glfwWindowShouldClose(window))
+            {
+                std::cerr << "ERROR: Benchmark interrupted, no results written" << std::endl;
+                return -1;
+            }
+        }
+
+        if (metrics)
+            metrics->endFrame(scene.gpuProfiler, NULL);
+
+        heap.endFrame(recording);
+        Learus_GLTrace::endFrame(recording);
+
+        // Warmup frames are not part of the video
+        if (exporter && recording)
+            exporter->capture(target->framebuffer());
+    }
+
+    scene.gpuProfiler.flush();
+    scene.gpuProfiler.printStats();
+    if (scene.resolution)
+        scene.resolution->printStats();
+    if (scene.quality)
+        scene.quality->printStats();
+    recorder.print();
+    if (software)
+        software->printStats();
+    if (hud)
+        hud->printStats();
+    if (metrics)
+        metrics->printStats();
+    heap.print();
+
+    if (!finishExport(exporter))
+        return -1;
+
+    int width = target ? target->width : viewportWidth;
+    int height = target ? target->height : viewportHeight;
+    if (!recorder.writeJSON(options.results, path.name, (const char *)glGetString(GL_RENDERER), width, height, path.step, scene.gpuProfiler.passes))
+        return -1;
+
+    std::cout << "Results written to " << options.results << std::endl;
+    return (options.assertNoAlloc && !heap.clean()) ? 1 : 0;
+}
+
+// The CPU renderer --renderer asked for, NULL for the usual GL one
+Learus_Software::Backend * createRenderer(Scene & scene, const Options & options)
+{
+    if (options.renderer == "software")
+        return new Learus_Software::Renderer(scene, options.threads);
+
+    // Headless images are written finished, a window or a benchmark adds a sample per frame
+    if (options.renderer == "pathtracer")
+    {
+        bool finished = options.headless && options.benchmark.empty();
+        return new Learus_PathTracer::PathTracer(scene, options.threads, options.samples, finished ? options.samples : 1);
+    }
+
+    return NULL;
+}
+
+// The scene's resolution scaler when --dynamic-res asked for one
+Learus_DynamicRes::DynamicResolution * createScaler(Scene & scene, const Options & options)
+{
+    if (options.dynamicRes <= 0.0f)
+        return NULL;
+
+    return new Learus_DynamicRes::DynamicResolution(scene.shaders, scene.gpuProfiler, options.dynamicRes, options.minScale, options.maxScale, options.upscale);
+}
+
+// The scene's quality level when --quality asked for one, auto starts at the top. Frames are never shown faster
+// than framePeriodMs (0 when nothing holds them back), so a target below it is raised to it.
+Learus_Quality::Governor * createGovernor(Scene & scene, const Options & options, double framePeriodMs)
+{
+    if (options.quality < 0 && !options.adaptiveQuality)
+        return NULL;
+
+    double targetMs = options.qualityTarget;
+    if (options.adaptiveQuality && targetMs < framePeriodMs)
+    {
+        std::cout << "Quality: the " << targetMs << " ms target is below the " << framePeriodMs << " ms frame period, using that instead" << std::endl;
+        targetMs = framePeriodMs;
+    }
+
+    unsigned int start = options.adaptiveQuality ? Learus_Quality::LEVEL_COUNT - 1 : options.quality;
+    return new Learus_Quality::Governor(scene.gpuProfiler, targetMs, start, options.adaptiveQuality);
+}
+
+// The metrics server for --metrics-port, with the startup load times. NULL if the port could not be opened.
+Learus_Metrics::Metrics * startMetrics(Scene & scene, const Options & options, double framePeriodMs)
+{
+    Learus_Metrics::Metrics * server = new Learus_Metrics::Metrics(options.metricsPort, framePeriodMs);
+    server->addLoadTime("sun", scene.Sun.loadSeconds);
+    server->addLoadTime("earth", scene.Earth.loadSeconds);
+    server->addLoadTime("moon", scene.Moon.loadSeconds);
+    server->addLoadTime("skybox", scene.skyBox.loadSeconds);
+    server->addLoadTime("shaders", scene.shaders.stats.seconds);
+
+    // For the GPU frame times
+    scene.gpuProfiler.enable();
+
+    if (!server->start())
+    {
+        delete server;
+        return NULL;
+    }
+
+    return server;
+}
+
+// The command channel for --control. False if the socket could not be opened.
+bool startControl(Learus_Control::Server & server, Scene & scene)
+{
+    // For the GPU time in stats
+    scene.gpuProfiler.enable();
+
+    return server.start();
+}
+
+// Carries out the commands that came in since the last frame. Those that change the simulation are answered once
+// the change is sent to it, and show in the next snapshot.
+void controlInput(Scene & scene, Learus_Simulation::Simulation & sim, GLFWwindow * window, Automation & automation)
+{
+    bool playing = automation.path && !automation.pathEnded;
+
+    Learus_Control::Command command;
+    while (control->next(command))
+    {
+        if ((command.type == Learus_Control::COMMAND_TIME || command.type == Learus_Control::COMMAND_CAMERA) && playing)
+        {
+            control->fail(command, "a camera path is playing");
+        }
+        else if (command.type == Learus_Control::COMMAND_TIME)
+        {
+            sim.send(Learus_Simulation::INPUT_SET_TIME, 0, command.value);
+            control->reply(command, NULL);
+        }
+        else if (command.type == Learus_Control::COMMAND_WARP)
+        {
+            sim.send(Learus_Simulation::INPUT_SET_WARP, 0, command.value);
+            control->reply(command, NULL);
+        }
+        else if (command.type == Learus_Control::COMMAND_CAMERA)
+        {
+            sim.placeCamera(command.position, command.target, command.zoom);
+            control->reply(command, NULL);
+        }
+        else if (command.type == Learus_Control::COMMAND_ANIMATE)
+        {
+            if (command.on < 0)
+                sim.send(Learus_Simulation::INPUT_TOGGLE_ANIMATION);
+            else
+                sim.send(Learus_Simulation::INPUT_SET_ANIMATION, 0, (float)command.on);
+            control->reply(command, NULL);
+        }
+        else if (command.type == Learus_Control::COMMAND_LOAD)
+        {
+            if (playing)
+                control->fail(automation.pathCommand, "replaced by another path");
+            delete automation.path;
+
+            automation.path = command.cameraPath;
+            automation.pathCommand = command;
+            automation.pathStart = std::chrono::steady_clock::now();
+            automation.pathFrames = 0;
+            automation.pathEnded = false;
+            playing = true;
+        }
+        else if (command.type == Learus_Control::COMMAND_CAPTURE)
+        {
+            if (automation.capturing)
+            {
+                control->fail(command, "another capture is waiting for the next frame");
+                continue;
+            }
+
+            // Minimized
+            if (viewportWidth <= 0 || viewportHeight <= 0)
+            {
+                control->fail(command, "window has no pixels");
+                continue;
+            }
+
+            automation.capturing = true;
+            automation.captureCommand = command;
+        }
+        else if (command.type == Learus_Control::COMMAND_STATS)
+        {
+            const Learus_Resources::Registry & resources = Learus_Resources::registry();
+            unsigned long long gpuBytes = 0, cpuBytes = 0;
+            for (int i = 0; i < Learus_Resources::SUB_COUNT; i++)
+            {
+                gpuBytes += resources.usage[i].gpuBytes;
+                cpuBytes += resources.usage[i].cpuBytes;
+            }
+
+            double gpuMs = 0.0;
+            for (unsigned int i = 0; i < scene.gpuProfiler.passes.size(); i++)
+            {
+                if (std::strcmp(scene.gpuProfiler.passes[i].name, "Frame") == 0)
+                    gpuMs = scene.gpuProfiler.passes[i].lastMs;
+            }
+
+            char quality[32] = "null";
+            if (scene.quality)
+                std::snprintf(quality, sizeof(quality), "\"%s\"", scene.quality->level().name);
+
+            char fields[Learus_Control::MAX_REPLY - Learus_Control::MAX_ID - 32];
+            std::snprintf(fields, sizeof(fields),
+                          "\"frames\":%lu,\"simTime\":%g,\"warp\":%g,\"animating\":%s,\"step\":%lu,\"playing\":%s,"
+                          "\"position\":[%g,%g,%g],\"front\":[%g,%g,%g],\"zoom\":%g,\"frameMs\":%.3f,\"gpuMs\":%.3f,"
+                          "\"meshes\":%lu,\"drawCalls\":%lu,\"triangles\":%lu,\"gpuBytes\":%llu,\"cpuBytes\":%llu,\"quality\":%s",
+                          automation.frames, automation.simTime, automation.warp, automation.animating ? "true" : "false", automation.step, playing ? "true" : "false",
+                          camera.Position.x, camera.Position.y, camera.Position.z, camera.Front.x, camera.Front.y, camera.Front.z, camera.zoom,
+                          automation.frameMs, gpuMs, automation.draws.commands, automation.draws.drawCalls, automation.draws.triangles, gpuBytes, cpuBytes, quality);
+            control->reply(command, fields);
+        }
+        else if (command.type == Learus_Control::COMMAND_QUIT)
+        {
+            glfwSetWindowShouldClose(window, true);
+            control->reply(command, NULL);
+        }
+    }
+}
+
+// Puts the camera where the --control path is for this frame and returns its simulation time. When the path is over
+// the simulation carries on from its last keyframe, and the command that loaded it is answered.
+float playPath(Learus_Simulation::Simulation & sim, Automation & automation)
+{
+    const Learus_Benchmark::CameraPath & path = *automation.path;
+    if (automation.pathEnded)
+        return path.apply(path.duration(), camera);
+
+    float t = std::chrono::duration<float>(std::chrono::steady_clock::now() - automation.pathStart).count();
+    automation.pathFrames++;
+    if (t < path.duration())
+        return path.apply(t, camera);
+
+    Learus_Benchmark::Keyframe last = path.sample(path.duration());
+    sim.placeCamera(last.position, last.target, last.zoom);
+    sim.send(Learus_Simulation::INPUT_SET_TIME, 0, last.simTime);
+    automation.pathEnded = true;
+
+    char fields[64];
+    std::snprintf(fields, sizeof(fields), "\"frames\":%lu,\"seconds\":%.3f", automation.pathFrames, t);
+    control->reply(automation.pathCommand, fields);
+
+    return path.apply(path.duration(), camera);
+}
+
+// Reads the frame just drawn back from the window's back buffer, the control server writes it out
+void captureWindow(Automation & automation, int width, int height)
+{
+    PROFILE_SCOPE("Capture");
+
+    // Minimized since the capture was asked for
+    if (width <= 0 || height <= 0)
+    {
+        control->fail(automation.captureCommand, "window has no pixels");
+        automation.capturing = false;
+        return;
+    }
+
+    std::vector<unsigned char> * pixels = new std::vector<unsigned char>((size_t)width * height * 3);
+
+    GLint readFramebuffer = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &(*pixels)[0]);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+    control->capture(automation.captureCommand, pixels, width, height);
+    automation.capturing = false;
+}
+
+// Waits for the exported frames to reach the disk
+bool finishExport(Learus_Export::FrameExporter * exporter)
+{
+    if (!exporter)
+        return true;
+
+    bool written = exporter->finish();
+    exporter->printStats();
+    return written;
+}
+
+// Puts the GL call layer in place if an option needs it
+bool startGLLayer(const Options & options)
+{
+    if (!options.glCalls && options.glTrace.empty() && options.callBudgets.empty() && !options.nullDriver)
+        return true;
+
+    Learus_GLTrace::Layer & layer = Learus_GLTrace::layer();
+    for (unsigned int i = 0; i < options.callBudgets.size(); i++)
+        layer.addBudget(options.callBudgets[i].first, options.callBudgets[i].second);
+
+    Learus_GLTrace::install();
+    return options.glTrace.empty() || Learus_GLTrace::startTrace(options.glTrace);
+}
+
+// Call counts and budgets. False if a budget was broken or the trace could not be written.
+bool finishGLLayer(const Options & options)
+{
+    Learus_GLTrace::Layer & layer = Learus_GLTrace::layer();
+    if (!layer.installed)
+        return true;
+
+    layer.printStats();
+    bool ok = layer.withinBudgets();
+
+    if (!Learus_GLTrace::finishTrace())
+    {
+        std::cerr << "ERROR: Could not write GL trace: " << options.glTrace << std::endl;
+        ok = false;
+    }
+    else if (!options.glTrace.empty())
+    {
+        std::cout << "GL trace written to " << options.glTrace << std::endl;
+    }
+
+    return ok;
+}
+
+// Plays a GL trace back on the headless context, then writes whatever it left in its framebuffer to --output
+int replayGLTrace(const Options & options)
+{
+    std::cout << "Replaying " << options.glReplay << " on " << glGetString(GL_RENDERER) << std::endl;
+
+    Learus_GLTrace::Replayer replayer;
+    if (!replayer.run(options.glReplay))
+        return -1;
+
+    bool written = true;
+    if (!options.nullDriver)
+    {
+        int width, height;
+        std::vector<unsigned char> pixels;
+        replayer.readPixels(pixels, width, height);
+        written = Learus_Image::write(options.output, width, height, &pixels[0]);
+    }
+
+    bool finished = replayer.finish();
+    replayer.printStats();
+    if (!written || !finished)
+        return -1;
+
+    return replayer.unsupported || replayer.nameMismatches ? 1 : 0;
+}
+
+// One frame into the bound framebuffer
+void drawFrame(Scene & scene, Learus_Software::Backend * software, float simTime, int width, int height)
+{
+    if (!software)
+    {
+        scene.Render(camera, simTime, width, height);
+        return;
+    }
+
+    // The scene's profiler frame, so the overlay and the latency have one to go into
+    scene.gpuProfiler.beginFrame();
+    scene.gpuProfiler.begin("Frame");
+    software->render(camera, simTime, width, height);
+    software->present();
+    scene.gpuProfiler.end();
+}
+
+// The overlay over the frame just drawn, if there is one. sim is NULL when the frames are not driven by one.
+void drawHud(Scene & scene, const Learus_Simulation::Simulation * sim, int width, int height)
+{
+    if (hud)
+        hud->draw(scene, sim, width, height);
+}
+
+// --headless [--frames N] [--size WxH] [--output path] [--benchmark camera.path] [--results results.json] [--trace trace.json]
+// [--renderer gl|software|pathtracer] [--threads N] [--samples N] [--export video.y4m] [--sim-rate HZ] [--fps N] [--record-threads N]
+// [--gl-calls] [--gl-trace calls.gltrace] [--gl-replay calls.gltrace] [--null-driver] [--call-budget NAME=N]
+// [--dynamic-res MS] [--res-scale MIN:MAX] [--upscale bilinear|sharpen] [--quality low|medium|high|ultra|auto] [--quality-target MS]
+// [--hud] [--metrics-port PORT] [--control socket] [--assert-no-alloc]
+bool parseOptions(int argc, char ** argv, Options & options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (arg == "--frames" && hasValue)
+        {
+            options.frames = std::strtoul(argv[++i], NULL, 10);
+        }
+        else if (arg == "--size" && hasValue)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            {
+                std::cerr << "ERROR: --size expects WIDTHxHEIGHT, e.g. 1920x1080" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--output" && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if (arg == "--benchmark" && hasValue)
+        {
+            options.benchmark = argv[++i];
+        }
+        else if (arg == "--results" && hasValue)
+        {
+            options.results = argv[++i];
+        }
+        else if (arg == "--assert-no-alloc")
+        {
+            options.assertNoAlloc = true;
+        }
+        else if (arg == "--budget" && hasValue)
+        {
+            // subsystem=megabytes, e.g. textures=64
+            std::string budget = argv[++i];
+            size_t equals = budget.find('=');
+            int subsystem = equals == std::string::npos ? -1 : Learus_Resources::subsystemFromName(budget.substr(0, equals).c_str());
+            double megabytes = subsystem < 0 ? 0.0 : std::atof(budget.c_str() + equals + 1);
+
+            if (subsystem < 0 || megabytes <= 0.0)
+            {
+                std::cerr << "ERROR: --budget expects SUBSYSTEM=MEGABYTES, where SUBSYSTEM is one of:";
+                for (int j = 0; j < Learus_Resources::SUB_COUNT; j++)
+                    std::cerr << (j ? ", " : " ") << Learus_Resources::subsystem_names[j];
+                std::cerr << std::endl;
+                return false;
+            }
+
+            options.budgets.push_back(std::make_pair(subsystem, (size_t)(megabytes * 1048576.0)));
+        }
+        else if (arg == "--renderer" && hasValue)
+        {
+            options.renderer = argv[++i];
+            if (options.renderer != "gl" && options.renderer != "software" && options.renderer != "pathtracer")
+            {
+                std::cerr << "ERROR: --renderer expects gl, software or pathtracer" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--threads" && hasValue)
+        {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        }
+        else if (arg == "--samples" && hasValue)
+        {
+            options.samples = std::strtoul(argv[++i], NULL, 10);
+        }
+        else if (arg == "--export" && hasValue)
+        {
+            options.exportPath = argv[++i];
+        }
+        else if (arg == "--sim-rate" && hasValue)
+        {
+            options.simRate = std::atof(argv[++i]);
+            if (options.simRate <= 0.0f)
+            {
+                std::cerr << "ERROR: --sim-rate expects steps per second, e.g. 120" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--fps" && hasValue)
+        {
+            options.fps = std::atof(argv[++i]);
+            if (options.fps < 0.0f)
+            {
+                std::cerr << "ERROR: --fps expects frames per second, or 0 to follow vsync" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--record-threads" && hasValue)
+        {
+            options.recordThreads = std::strtoul(argv[++i], NULL, 10);
+        }
+        else if (arg == "--gl-calls")
+        {
+            options.glCalls = true;
+        }
+        else if (arg == "--gl-trace" && hasValue)
+        {
+            options.glTrace = argv[++i];
+        }
+        else if (arg == "--gl-replay" && hasValue)
+        {
+            options.glReplay = argv[++i];
+        }
+        else if (arg == "--null-driver")
+        {
+            options.nullDriver = true;
+        }
+        else if (arg == "--call-budget" && hasValue)
+        {
+            // name=calls, e.g. draws=100 or glUniformMatrix4fv=200
+            std::string budget = argv[++i];
+            size_t equals = budget.find('=');
+            std::string name = budget.substr(0, equals);
+
+            if (equals == std::string::npos || !Learus_GLTrace::isBudgetName(name))
+            {
+                std::cerr << "ERROR: --call-budget expects NAME=CALLS, where NAME is a GL entry point (glDrawArrays), draws or total" << std::endl;
+                return false;
+            }
+
+            options.callBudgets.push_back(std::make_pair(name, std::strtoul(budget.c_str() + equals + 1, NULL, 10)));
+        }
+        else if (arg == "--dynamic-res" && hasValue)
+        {
+            options.dynamicRes = std::atof(argv[++i]);
+            if (options.dynamicRes <= 0.0f)
+            {
+                std::cerr << "ERROR: --dynamic-res expects the scene's GPU time target in milliseconds, e.g. 8" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--res-scale" && hasValue)
+        {
+            if (std::sscanf(argv[++i], "%f:%f", &options.minScale, &options.maxScale) != 2 || options.minScale <= 0.0f || options.minScale > options.maxScale || options.maxScale > 1.0f)
+            {
+                std::cerr << "ERROR: --res-scale expects MIN:MAX with 0 < MIN <= MAX <= 1, e.g. 0.5:1" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--upscale" && hasValue)
+        {
+            std::string filter = argv[++i];
+            if (filter == "bilinear")
+                options.upscale = Learus_DynamicRes::FILTER_BILINEAR;
+            else if (filter == "sharpen")
+                options.upscale = Learus_DynamicRes::FILTER_SHARPEN;
+            else
+            {
+                std::cerr << "ERROR: --upscale expects bilinear or sharpen" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--quality" && hasValue)
+        {
+            std::string level = argv[++i];
+            options.adaptiveQuality = level == "auto";
+            options.quality = options.adaptiveQuality ? -1 : Learus_Quality::levelFromName(level.c_str());
+            if (!options.adaptiveQuality && options.quality < 0)
+            {
+                std::cerr << "ERROR: --quality expects low, medium, high, ultra or auto" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--quality-target" && hasValue)
+        {
+            options.qualityTarget = std::atof(argv[++i]);
+            if (options.qualityTarget <= 0.0f)
+            {
+                std::cerr << "ERROR: --quality-target expects a frame time in milliseconds, e.g. 16.7" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--hud")
+        {
+            options.hud = true;
+        }
+        else if (arg == "--metrics-port" && hasValue)
+        {
+            unsigned long port = std::strtoul(argv[++i], NULL, 10);
+            if (port == 0 || port > 65535)
+            {
+                std::cerr << "ERROR: --metrics-port expects a TCP port, e.g. 9100" << std::endl;
+                return false;
+            }
+            options.metricsPort = (unsigned short)port;
+        }
+        else if (arg == "--control" && hasValue)
+        {
+            options.controlPath = argv[++i];
+        }
+        else if (arg == "--trace" && hasValue)
+        {
+            options.trace = argv[++i];
+#ifndef SOLAR_PROFILE
+            std::cerr << "ERROR: --trace needs a profiling build (make PROFILE=1)" << std::endl;
+            return false;
+#endif
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--size WIDTHxHEIGHT] [--output path] [--benchmark camera.path] [--results results.json] [--trace trace.json] [--budget subsystem=MB] [--renderer gl|software|pathtracer] [--threads N] [--samples N] [--export video.y4m|frame_%05d.png] [--sim-rate HZ] [--fps N] [--record-threads N] [--gl-calls] [--gl-trace file] [--gl-replay file] [--null-driver] [--call-budget NAME=N] [--dynamic-res MS] [--res-scale MIN:MAX] [--upscale bilinear|sharpen] [--quality low|medium|high|ultra|auto] [--quality-target MS] [--hud] [--metrics-port PORT] [--control socket] [--assert-no-alloc]" << std::endl;
+            return false;
+        }
+    }
+
+    if (options.frames == 0)
+        options.frames = 1;
+
+    if (!options.exportPath.empty() && !options.headless)
+    {
+        std::cerr << "ERROR: --export needs --headless" << std::endl;
+        return false;
+    }
+
+    if ((options.nullDriver || !options.glReplay.empty()) && !options.headless)
+    {
+        std::cerr << "ERROR: --null-driver and --gl-replay need --headless" << std::endl;
+        return false;
+    }
+
+    if (options.nullDriver && !options.exportPath.empty())
+    {
+        std::cerr << "ERROR: --null-driver draws nothing to export" << std::endl;
+        return false;
+    }
+
+    if (!options.controlPath.empty() && (options.headless || !options.benchmark.empty()))
+    {
+        std::cerr << "ERROR: --control drives the interactive window, not --headless or --benchmark runs" << std::endl;
+        return false;
+    }
+
+    if (options.dynamicRes > 0.0f && options.renderer != "gl")
+    {
+        std::cerr << "ERROR: --dynamic-res only scales the GL renderer" << std::endl;
+        return false;
+    }
+
+    if ((options.quality >= 0 || options.adaptiveQuality) && options.renderer != "gl")
+    {
+        std::cerr << "ERROR: --quality only applies to the GL renderer" << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
@@ -198,46 +1295,60 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
+    windowDamaged = true;
 }
 
-// Handles user keyboard input. Supposed to be used every frame, so deltaTime can be calculated appropriately.
-void keyboardInput(GLFWwindow * window, float deltaTime)
+// The window system lost what was on screen
+void windowRefreshCallback(GLFWwindow * window)
+{
+    windowDamaged = true;
+}
+
+// Handles user keyboard input. Polled every frame, changes are sent to the simulation thread.
+void keyboardInput(GLFWwindow * window)
 {
     // Exit
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    // Upwards Rotation
+    // Rotations around the orbit center, for as long as the keys are held
+    unsigned int keys = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.Orbit(UP, cameraOrbitRadius, rotateAngle);
-
-    // Downwards Rotation
+        keys |= Learus_Simulation::ORBIT_UP;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.Orbit(DOWN, cameraOrbitRadius, rotateAngle);
-
-    // Rightwards Rotation
+        keys |= Learus_Simulation::ORBIT_DOWN;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.Orbit(RIGHT, cameraOrbitRadius, rotateAngle);
-
-    // Leftwards Rotation
+        keys |= Learus_Simulation::ORBIT_RIGHT;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.Orbit(LEFT, cameraOrbitRadius, rotateAngle);
+        keys |= Learus_Simulation::ORBIT_LEFT;
 
+    if (keys != heldKeys)
+    {
+        simulation->send(Learus_Simulation::INPUT_KEYS, keys);
+        heldKeys = keys;
+    }
+
+    // Pause / Start, once per press
+    bool enter = glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS;
+    if (enter && !enterHeld)
+        simulation->send(Learus_Simulation::INPUT_TOGGLE_ANIMATION);
+    enterHeld = enter;
 
-    // Pause / Start
-    if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS)
+    // Performance overlay on / off, once per press
+    bool hudKey = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (hudKey && !hudKeyHeld && hud)
     {
-        if (timeSinceLastToggle > 0.2)
-        {
-            animation = !animation;
-            timeSinceLastToggle = 0.0f;
-        }
+        hud->toggle();
+        windowDamaged = true;
     }
-        
+    hudKeyHeld = hudKey;
 }
 
 // Handles mouse scroll wheel. Supposed to be used as the glfw scroll callback.
 void scrollInput(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.Zoom(yoffset);
+    if (simulation)
+        simulation->send(Learus_Simulation::INPUT_ZOOM, 0, yoffset);
 }
\ No newline at end of file
@@ -1,48 +1,39 @@
 #version 330 core
 out vec4 FragColor;
 
+// Only the maps the material actually has are declared, see shader_variants.h
 struct Material {
+#ifdef HAS_DIFFUSE_MAP
     sampler2D diffuse;
+#endif
+#ifdef HAS_SPECULAR_MAP
     sampler2D specular;
+#endif
+#ifdef HAS_EMISSION_MAP
     sampler2D emission;
+#endif
     float shininess;
 };
 
-struct PointLight
-{
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
+#include "light.glsl"
+#include "camera.glsl"
 
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
 
-uniform PointLight light;
 uniform Material material;
-uniform vec3 viewPos;
-
-uniform sampler2D texture_diffuse1;
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {    
-    vec3 result = CalcPointLight(light, normalize(Normal), FragPos, normalize(viewPos - FragPos));
+    vec3 result = CalcPointLight(normalize(Normal), FragPos, normalize(viewPos - FragPos));
 
     FragColor = vec4(result, 1.0);
-
-    // FragColor = texture(texture_diffuse1, TexCoords);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
 
@@ -53,21 +44,38 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
-    // emission shading
-    vec3 emission = vec3(texture(material.emission, TexCoords));
+#ifdef HAS_DIFFUSE_MAP
+    vec3 albedo = vec3(texture(material.diffuse, TexCoords, mipBias));
+#else
+    vec3 albedo = vec3(1.0);
+#endif
+
+    // Without a specular map the surface reflects its own color
+#ifdef HAS_SPECULAR_MAP
+    vec3 specularColor = vec3(texture(material.specular, TexCoords, mipBias));
+#else
+    vec3 specularColor = albedo;
+#endif
 
     // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // float distance = length(light.position - fragPos);
+    // float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
 
 
     // ambient *= attenuation;
     // diffuse *= attenuation;
     // specular *= attenuation;
 
-    return (ambient + diffuse + specular);
-}
\ No newline at end of file
+    vec3 result = ambient + diffuse + specular;
+
+    // emission shading
+#ifdef HAS_EMISSION_MAP
+    result += vec3(texture(material.emission, TexCoords, mipBias));
+#endif
+
+    return result;
+}
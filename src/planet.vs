@@ -7,15 +7,16 @@ out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 
+#include "camera.glsl"
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;   // transpose(inverse(model)), computed once per draw on the CPU
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
@@ -3,9 +3,19 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D texture_diffuse1;
+#include "camera.glsl"
+
+struct Material {
+    sampler2D diffuse;
+};
+
+uniform Material material;
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
-}
\ No newline at end of file
+#ifdef HAS_DIFFUSE_MAP
+    FragColor = texture(material.diffuse, TexCoords, mipBias);
+#else
+    FragColor = vec4(1.0);
+#endif
+}